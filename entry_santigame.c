@@ -31,7 +31,7 @@ Draw_Quad ndc_quad_to_screen_quad(Draw_Quad ndc_quad){
 	Matrix4 view = draw_frame.camera_xform;
 
 	Matrix4 ndc_to_screen_space = m4_identity;
-	ndc_to_screen_space = m4_mul(ndc_to_screen_space, m4_inverse(proj));
+	ndc_to_screen_space = m4_mul(ndc_to_screen_space, m4_is_affine(proj) ? m4_inverse_affine(proj) : m4_inverse(proj));
 	ndc_to_screen_space = m4_mul(ndc_to_screen_space, view);
 
 	ndc_quad.bottom_left = m4_transform(ndc_to_screen_space, v4(v2_expand(ndc_quad.bottom_left), 0, 1)).xy;
@@ -276,7 +276,7 @@ typedef enum UXState {
 } UXState;
 
 typedef struct World {
-	Entity entities[MAX_ENTITY_COUNT];
+	Pool entity_pool; // Entity, grows MAX_ENTITY_COUNT at a time
 	InventoryItemData inventory_items[ITEM_MAX];
 	UXState ux_state;
 	float inventory_alpha;
@@ -321,21 +321,15 @@ string get_archetype_pretty_name (EntityArchetype arch) {
 }
 
 Entity* entity_create() {
-	Entity* entity_found = 0;
-	for (int i= 0; i < MAX_ENTITY_COUNT; i++) {
-		Entity* existing_entity = &world->entities[i];
-		if (!existing_entity->is_valid){
-			entity_found = existing_entity;
-			break;
-		}	
-	}
-	assert(entity_found, "No more free entities!");
+	Entity* entity_found = pool_alloc(&world->entity_pool);
+	memset(entity_found, 0, sizeof(Entity));
 	entity_found->is_valid = true;
 	return entity_found;
 }
 
 void entity_destroy(Entity* entity) {
 	memset(entity, 0, sizeof(Entity));
+	pool_free(&world->entity_pool, entity);
 }
 
 // :setup things
@@ -420,8 +414,6 @@ Vector2 get_mouse_pos_in_ndc() {
 Vector2 get_mouse_pos_in_world_space() {
 	float mouseX = input_frame.mouse_x;
 	float mouseY = input_frame.mouse_y;
-	Matrix4 projection = draw_frame.projection;
-	Matrix4 view = draw_frame.camera_xform;
 	float windowWidth = window.width;
 	float windowHeight = window.height;
 
@@ -431,8 +423,7 @@ Vector2 get_mouse_pos_in_world_space() {
 
 	//Transform to world coordinates
 	Vector4 worldPos = v4(ndcX, ndcY, 0, 1);
-	worldPos = m4_transform(m4_inverse(projection), worldPos);
-	worldPos = m4_transform(view, worldPos);
+	worldPos = m4_transform(draw_frame_get_clip_to_world(), worldPos);
 	//log("%f, %f", worldPos.x, worldPos.y);
 	
 	//Return as 2D vector
@@ -911,6 +902,7 @@ int entry(int argc, char **argv) {
 
 	world = alloc(get_heap_allocator(), sizeof(World));
 	memset(world, 0, sizeof(World));
+	world->entity_pool = make_pool(sizeof(Entity), MAX_ENTITY_COUNT, true, get_heap_allocator());
 
 		sprites[0] = (Sprite){.image = load_image_from_disk(STR("res/sprites/missingTexture.jpeg"), get_heap_allocator())};
    		sprites[SPRITE_player] = (Sprite){.image = load_image_from_disk(STR("res/sprites/player.jpeg"), get_heap_allocator())};
@@ -1054,8 +1046,9 @@ int entry(int argc, char **argv) {
 
 			float smallest_dist = 0.000000001;
 			// :selected entity system		
-			for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-				Entity* en = &world->entities[i];
+			u64 entity_cursor = 0;
+			Entity* en = 0;
+			while (pool_iterate(&world->entity_pool, &entity_cursor, (void**)&en)) {
 				
 				if(en->is_valid && (en->detroyable_world_item || en->workbench_thing)) {
 					Sprite* sprite = get_sprite(en->sprite_id);
@@ -1098,8 +1091,9 @@ int entry(int argc, char **argv) {
 
 		// :update entities
 		
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
+		u64 entity_cursor = 0;
+		Entity* en = 0;
+		while (pool_iterate(&world->entity_pool, &entity_cursor, (void**)&en)) {
 			if(en->is_valid) {
 				if (en->workbench_thing) {
 					if (en->current_crafting_item) {
@@ -1193,8 +1187,8 @@ int entry(int argc, char **argv) {
 	}
 
 		// :render entities
-		for (int i = 0; i < MAX_ENTITY_COUNT; i++) {
-			Entity* en = &world->entities[i];
+		entity_cursor = 0;
+		while (pool_iterate(&world->entity_pool, &entity_cursor, (void**)&en)) {
 			if(en->is_valid) {
 				switch (en->arch) {
 					
@@ -902,7 +902,14 @@ void
 mix_frames(void *dst, void *src, u64 frame_count, Audio_Format format) {
     u64 comp_size = get_audio_bit_width_byte_size(format.bit_width);
     u64 frame_size = comp_size * format.channels;
-    u64 output_size = frame_count * frame_size;
+    
+    if (format.bit_width == AUDIO_BITS_32) {
+    	// Frames are interleaved so it's all one contiguous span of samples
+    	simd_add_f32((f32*)dst, (f32*)dst, (f32*)src, frame_count*format.channels);
+    	return;
+    }
+    
+    assert(format.bit_width == AUDIO_BITS_16, "Unhandled bit width");
     
     for (u64 frame = 0; frame < frame_count; frame++) {
         
@@ -911,17 +918,9 @@ mix_frames(void *dst, void *src, u64 frame_count, Audio_Format format) {
             void *src_sample = (u8*)src + frame*frame_size + c*comp_size;
             void *dst_sample = (u8*)dst + frame*frame_size + c*comp_size;
 
-            switch (format.bit_width) {
-                case AUDIO_BITS_32: {
-                	*((f32*)dst_sample) += *((f32*)src_sample);
-            	}
-                case AUDIO_BITS_16: {
-                    s16 dst_int = *((s16*)dst_sample);
-                    s16 src_int = *((s16*)src_sample);
-                    *((s16*)dst_sample) = (s16)clamp((s64)(dst_int + src_int), S16_MIN, S16_MAX);
-                    break;
-                }
-            }
+            s16 dst_int = *((s16*)dst_sample);
+            s16 src_int = *((s16*)src_sample);
+            *((s16*)dst_sample) = (s16)clamp((s64)(dst_int + src_int), S16_MIN, S16_MAX);
         }
     }
 }
@@ -1180,57 +1179,47 @@ typedef struct Audio_Player {
 	
 } Audio_Player;
 #define AUDIO_PLAYERS_PER_BLOCK 128
-typedef struct Audio_Player_Block {
-	Audio_Player players[AUDIO_PLAYERS_PER_BLOCK]; // Players need to be persistent in memory
-	
-	struct Audio_Player_Block *next;
-} Audio_Player_Block;
 
 // #Global
-ogb_instance Audio_Player_Block audio_player_block;
+// Players need to be persistent in memory, which the pool gives us.
+// The audio thread frees players, so alloc/free must hold audio_player_pool_lock.
+ogb_instance Pool audio_player_pool;
+ogb_instance Spinlock audio_player_pool_lock;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
-Audio_Player_Block audio_player_block = {0};
+Pool audio_player_pool = {0};
+Spinlock audio_player_pool_lock = {0};
 #endif
 
 Audio_Player *
 audio_player_get_one() {
 
-	Audio_Player_Block *block = &audio_player_block;
-	Audio_Player_Block *last = 0;
-	
-	while (block) {
-		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			if (!block->players[i].allocated) {
-			
-				memset(&block->players[i], 0, sizeof(block->players[i]));
-				block->players[i].allocated = true;
-				block->players[i].config.volume = 1.0;
-				block->players[i].config.playback_speed = 1.0;
-				
-				return &block->players[i];
-			}
-		}
-		
-		last = block;
-		block = block->next;
+	spinlock_acquire_or_wait(&audio_player_pool_lock);
+	if (!audio_player_pool.objects_per_chunk) {
+		audio_player_pool = make_pool(sizeof(Audio_Player), AUDIO_PLAYERS_PER_BLOCK, true, get_heap_allocator());
+		spinlock_set_name(&audio_player_pool_lock, STR("audio_player_pool_lock"));
 	}
-	
-	// No free player found, make another block
-	// #Volatile can't assign to last->next before this is zero initialized
-	Audio_Player_Block *new_block = alloc(get_heap_allocator(), sizeof(Audio_Player_Block));
-	
-#if !DO_ZERO_INITIALIATION
-	memset(new_block, 0, sizeof(*new_block));
-#endif
-
-	last->next = new_block;
+	Audio_Player *p = pool_alloc(&audio_player_pool);
+	spinlock_release(&audio_player_pool_lock);
+	
+	// #Volatile the audio thread skips players that aren't allocated, so set that last
+	memset(p, 0, sizeof(*p));
+	p->config.volume = 1.0;
+	p->config.playback_speed = 1.0;
+	// All players' sample locks add up into one lock stats entry
+	spinlock_set_name(&p->sample_lock, STR("audio sample_lock"));
+	p->allocated = true;
+	
+	return p;
+}
 
-	new_block->players[0].allocated = true;
-	new_block->players[0].config.volume = 1.0;
-	block->players[0].config.playback_speed = 1.0;
-	return &new_block->players[0];
+// Audio thread only
+void
+audio_player_free(Audio_Player *p) {
+	p->allocated = false;
+	spinlock_acquire_or_wait(&audio_player_pool_lock);
+	pool_free(&audio_player_pool, p);
+	spinlock_release(&audio_player_pool_lock);
 }
 
 void 
@@ -1362,12 +1351,54 @@ audio_player_set_looping(Audio_Player *p, bool looping) {
 // #Global
 ogb_instance Hash_Table just_audio_clips;
 ogb_instance bool just_audio_clips_initted;
+// Clips are played from any thread & almost always already loaded, so lookups only take
+// the read side and don't block each other.
+ogb_instance Rw_Lock just_audio_clips_lock;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Hash_Table just_audio_clips;
 bool just_audio_clips_initted = false;
+Rw_Lock just_audio_clips_lock = {0};
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+bool
+just_audio_clips_find_or_open(string path, Audio_Source *result) {
+	rw_lock_read_acquire_or_wait(&just_audio_clips_lock);
+	Audio_Source *src_ptr = just_audio_clips_initted ? hash_table_find(&just_audio_clips, path) : 0;
+	// Copy out while we hold the lock, an add can move the table's storage
+	if (src_ptr) *result = *src_ptr;
+	rw_lock_read_release(&just_audio_clips_lock);
+	if (src_ptr) return true;
+	
+	// Open outside of the lock so other clips keep playing while we hit the disk
+	Audio_Source new_src;
+	bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
+	if (!ok) {
+		log_error("Could not load audio to play from %s", path);
+		return false;
+	}
+	
+	rw_lock_write_acquire_or_wait(&just_audio_clips_lock);
+	if (!just_audio_clips_initted) {
+		just_audio_clips_initted = true;
+		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
+	}
+	// Someone else might have opened it while we weren't holding the lock
+	src_ptr = hash_table_find(&just_audio_clips, path);
+	if (src_ptr) {
+		*result = *src_ptr;
+	} else {
+		// The table only stores the string view, so it needs its own copy of the path
+		string key = string_copy(path, get_heap_allocator());
+		hash_table_add(&just_audio_clips, key, new_src);
+		*result = new_src;
+	}
+	rw_lock_write_release(&just_audio_clips_lock);
+	
+	if (src_ptr) audio_source_destroy(&new_src);
+	return true;
+}
+
 void
 DEPRECATED(play_one_audio_clip_source_at_position(Audio_Source source, Vector3 pos), "Use play_one_audio_clip_source_with_config() instead") {
 	Audio_Player *p = audio_player_get_one();
@@ -1396,45 +1427,16 @@ play_one_audio_clip_source(Audio_Source source) {
 }
 void
 DEPRECATED(play_one_audio_clip_at_position(string path, Vector3 pos), "Use play_one_audio_clip_with_config() instead") {
-	if (!just_audio_clips_initted) {
-		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
-	}
-	
-	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
-	if (src_ptr) {
-		play_one_audio_clip_source_at_position(*src_ptr, pos);
-	} else {
-		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
-		if (!ok) {
-			log_error("Could not load audio to play from %s", path);
-			return;
-		}
-		hash_table_add(&just_audio_clips, path, new_src);
-		play_one_audio_clip_source_at_position(new_src, pos);
+	Audio_Source source;
+	if (just_audio_clips_find_or_open(path, &source)) {
+		play_one_audio_clip_source_at_position(source, pos);
 	}
-	
 }
 void
 play_one_audio_clip_with_config(string path, Audio_Playback_Config config) {
-	if (!just_audio_clips_initted) {
-		just_audio_clips_initted = true;
-		just_audio_clips = make_hash_table(string, Audio_Source, get_heap_allocator());
-	}
-	
-	Audio_Source *src_ptr = hash_table_find(&just_audio_clips, path);
-	if (src_ptr) {
-		play_one_audio_clip_source_with_config(*src_ptr, config);
-	} else {
-		Audio_Source new_src;
-		bool ok = audio_open_source_stream(&new_src, path, get_heap_allocator());
-		if (!ok) {
-			log_error("Could not load audio to play from %s", path);
-			return;
-		}
-		hash_table_add(&just_audio_clips, path, new_src);
-		play_one_audio_clip_source_with_config(new_src, config);
+	Audio_Source source;
+	if (just_audio_clips_find_or_open(path, &source)) {
+		play_one_audio_clip_source_with_config(source, config);
 	}
 }
 void inline
@@ -1631,6 +1633,12 @@ void apply_audio_volume(void* frames, Audio_Format format, u64 number_of_frames,
     u64 frame_size = comp_size * format.channels;
 	if (vol <= 0.0) {
 		memset(frames, 0, frame_size*number_of_frames);
+		return;
+	}
+	
+	if (format.bit_width == AUDIO_BITS_32) {
+		simd_scale_f32((f32*)frames, (f32*)frames, vol, number_of_frames*format.channels);
+		return;
 	}
 	
 	for (u64 i = 0; i < number_of_frames; ++i) {
@@ -1668,8 +1676,6 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
     
 	memset(output, 0, output_size);
 	
-	Audio_Player_Block *block = &audio_player_block;
-	
 	// #Cleanup #Memory refactor intermediate buffers
 	local_persist thread_local void *mix_buffer = 0;
 	local_persist thread_local u64 mix_buffer_size;
@@ -1681,209 +1687,214 @@ do_program_audio_sample(u64 number_of_output_frames, Audio_Format out_format,
 	u64 *started_this_frame;
 	growing_array_init((void**)&started_this_frame, sizeof(u64), get_temporary_allocator());
 	
-	while (block) {
+	u64 player_cursor = 0;
+	Audio_Player *p = 0;
+	while (true) {
+		// Main thread adds chunks & hands out slots under this lock, so hold it while we
+		// walk them. Not for the whole loop body, audio_player_free takes it too.
+		spinlock_acquire_or_wait(&audio_player_pool_lock);
+		bool has_player = pool_iterate(&audio_player_pool, &player_cursor, (void**)&p);
+		spinlock_release(&audio_player_pool_lock);
+		if (!has_player) break;
 		
-		for (u64 i = 0; i < AUDIO_PLAYERS_PER_BLOCK; i++) {
-			Audio_Player *p = &block->players[i];
-			if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
-										  || !p->has_source)) {
-				p->allocated = false;
-			}
-			if (!p->allocated) {
-				continue;
-			}
-			
-			if (p->marked_for_release) {
-				p->marked_for_release = false;
-				p->allocated = false;
-				continue;
-			}
-			
-			if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
-				if (p->fade_frames == 0) continue;
-			}
-			
-			// #Incomplete Reverse playback ?
-			if (p->config.playback_speed <= 0.0) continue;
-			
-			if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
-			
-			spinlock_acquire_or_wait(&p->sample_lock);
-			
-			Audio_Source src = p->source;
-			
-			mutex_acquire_or_wait(&src.mutex_for_destroy);
+		// Could be live in the pool but still getting set up in audio_player_get_one
+		if (!p->allocated) {
+			continue;
+		}
+		if (p->release_when_done && (p->frame_index >= p->source.number_of_frames
+									  || !p->has_source)) {
+			audio_player_free(p);
+			continue;
+		}
+		
+		if (p->marked_for_release) {
+			p->marked_for_release = false;
+			audio_player_free(p);
+			continue;
+		}
+		
+		if (p->state != AUDIO_PLAYER_STATE_PLAYING) {
+			if (p->fade_frames == 0) continue;
+		}
+		
+		// #Incomplete Reverse playback ?
+		if (p->config.playback_speed <= 0.0) continue;
+		
+		if (p->frame_index >= p->source.number_of_frames && !p->looping) continue;
+		
+		spinlock_acquire_or_wait(&p->sample_lock);
+		
+		Audio_Source src = p->source;
+		
+		mutex_acquire_or_wait(&src.mutex_for_destroy);
 
-			Audio_Format sample_format = src.format;
-			sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
-			
-			bool need_convert = !bytes_match(
-				&out_format, 
-				&sample_format, 
-				sizeof(Audio_Format)
-			);
-			
-			u64 in_comp_size 
-				= get_audio_bit_width_byte_size(sample_format.bit_width);
-			
-			u64 in_frame_size = in_comp_size * sample_format.channels;
-			u64 input_size = number_of_output_frames * in_frame_size;
+		Audio_Format sample_format = src.format;
+		sample_format.sample_rate = sample_format.sample_rate*p->config.playback_speed;
+		
+		bool need_convert = !bytes_match(
+			&out_format, 
+			&sample_format, 
+			sizeof(Audio_Format)
+		);
+		
+		u64 in_comp_size 
+			= get_audio_bit_width_byte_size(sample_format.bit_width);
+		
+		u64 in_frame_size = in_comp_size * sample_format.channels;
+		u64 input_size = number_of_output_frames * in_frame_size;
+		
+		// #Copypaste #Cleanup
+		u64 biggest_size = max(input_size, output_size);
+		if (!mix_buffer || mix_buffer_size < biggest_size) {
+			u64 new_size = get_next_power_of_two(biggest_size);
+			if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
+			mix_buffer = alloc(get_heap_allocator(), new_size);
+			mix_buffer_size = new_size;
+			memset(mix_buffer, 0, new_size);
+		}
+		
+		void *target_buffer = mix_buffer;
+		u64 number_of_sample_frames = number_of_output_frames;
+		
+		if (need_convert) {
+			if (sample_format.sample_rate != out_format.sample_rate) {
+				f64 src_ratio 
+					= (f64)sample_format.sample_rate 
+					  / (f64)out_format.sample_rate;
+					
+				number_of_sample_frames = round(number_of_output_frames * src_ratio);
+				input_size = number_of_sample_frames * in_frame_size;
+
+				// #Copypaste #Cleanup  we need to potentially grow the mix buffer again after we change input_size
+				u64 biggest_size = max(input_size, output_size);
+				if (!mix_buffer || mix_buffer_size < biggest_size) {
+					u64 new_size = get_next_power_of_two(biggest_size);
+					if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
+					mix_buffer = alloc(get_heap_allocator(), new_size);
+					mix_buffer_size = new_size;
+					memset(mix_buffer, 0, new_size);
+				}
+			}
 			
-			// #Copypaste #Cleanup
 			u64 biggest_size = max(input_size, output_size);
-			if (!mix_buffer || mix_buffer_size < biggest_size) {
+			if (!convert_buffer || convert_buffer_size < biggest_size) {
 				u64 new_size = get_next_power_of_two(biggest_size);
-				if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-				mix_buffer = alloc(get_heap_allocator(), new_size);
-				mix_buffer_size = new_size;
-				memset(mix_buffer, 0, new_size);
+				if (convert_buffer) dealloc(get_heap_allocator(), convert_buffer);
+				convert_buffer = alloc(get_heap_allocator(), new_size);
+				convert_buffer_size = new_size;
+				memset(convert_buffer, 0, new_size);
 			}
+			target_buffer = convert_buffer;
 			
-			void *target_buffer = mix_buffer;
-			u64 number_of_sample_frames = number_of_output_frames;
+		}
+
+		// :PhaseCancellation
+		if (p->frame_index == 0) { // The players' source just started playing
+		
+			s64 existing_index = growing_array_find_index_from_left_by_value((void**)&started_this_frame, &src.uid);
 			
-			if (need_convert) {
-				if (sample_format.sample_rate != out_format.sample_rate) {
-					f64 src_ratio 
-						= (f64)sample_format.sample_rate 
-						  / (f64)out_format.sample_rate;
-						
-					number_of_sample_frames = round(number_of_output_frames * src_ratio);
-					input_size = number_of_sample_frames * in_frame_size;
-
-					// #Copypaste #Cleanup  we need to potentially grow the mix buffer again after we change input_size
-					u64 biggest_size = max(input_size, output_size);
-					if (!mix_buffer || mix_buffer_size < biggest_size) {
-						u64 new_size = get_next_power_of_two(biggest_size);
-						if (mix_buffer) dealloc(get_heap_allocator(), mix_buffer);
-						mix_buffer = alloc(get_heap_allocator(), new_size);
-						mix_buffer_size = new_size;
-						memset(mix_buffer, 0, new_size);
-					}
-				}
-				
-				u64 biggest_size = max(input_size, output_size);
-				if (!convert_buffer || convert_buffer_size < biggest_size) {
-					u64 new_size = get_next_power_of_two(biggest_size);
-					if (convert_buffer) dealloc(get_heap_allocator(), convert_buffer);
-					convert_buffer = alloc(get_heap_allocator(), new_size);
-					convert_buffer_size = new_size;
-					memset(convert_buffer, 0, new_size);
-				}
-				target_buffer = convert_buffer;
-				
+			if (existing_index != -1) {
+				// If this source already started playing this round from another player, then we pretend that
+				// we're already done playing by skipping to the last frame.
+				// For non-looping players, this means we don't play this instance at all.
+				// For looping players, this means we have a slight offset between the players that start
+				// playing at the exact same time. I'm not sure how else to deal with phase cancellation
+				// in looping players.
+				// #Incomplete player->is_muted_for_phase_cancellation ? 
+				p->frame_index = src.number_of_frames;
+				continue;
 			}
-	
-			// :PhaseCancellation
-			if (p->frame_index == 0) { // The players' source just started playing
+			growing_array_add((void**)&started_this_frame, &src.uid);
+		}
+
+		u64 last_frame_index = p->frame_index;
+		p->frame_index = audio_source_sample_next_frames(
+			&src,
+			p->frame_index, 
+			number_of_sample_frames,
+			target_buffer,
+			p->looping
+		);
+		if (p->frame_index > last_frame_index && (p->looping || p->frame_index != src.number_of_frames)) {
+			assert(p->frame_index - last_frame_index == number_of_sample_frames);
+		}
+		
+		if (p->fade_frames > 0) {
+			u64 frames_to_fade = min(p->fade_frames, number_of_sample_frames);
 			
-				s64 existing_index = growing_array_find_index_from_left_by_value((void**)&started_this_frame, &src.uid);
-				
-				if (existing_index != -1) {
-					// If this source already started playing this round from another player, then we pretend that
-					// we're already done playing by skipping to the last frame.
-					// For non-looping players, this means we don't play this instance at all.
-					// For looping players, this means we have a slight offset between the players that start
-					// playing at the exact same time. I'm not sure how else to deal with phase cancellation
-					// in looping players.
-					// #Incomplete player->is_muted_for_phase_cancellation ? 
-					p->frame_index = src.number_of_frames;
-					continue;
-				}
-				growing_array_add((void**)&started_this_frame, &src.uid);
-			}
-	
-			u64 last_frame_index = p->frame_index;
-			p->frame_index = audio_source_sample_next_frames(
-				&src,
-				p->frame_index, 
-				number_of_sample_frames,
-				target_buffer,
-				p->looping
-			);
-			if (p->frame_index > last_frame_index && (p->looping || p->frame_index != src.number_of_frames)) {
-				assert(p->frame_index - last_frame_index == number_of_sample_frames);
-			}
+			u64 frames_faded_so_far = (p->fade_frames_total-p->fade_frames);
 			
-			if (p->fade_frames > 0) {
-				u64 frames_to_fade = min(p->fade_frames, number_of_sample_frames);
-				
-				u64 frames_faded_so_far = (p->fade_frames_total-p->fade_frames);
-				
-				switch (p->state) {
-					case AUDIO_PLAYER_STATE_PLAYING: {
-						// We need to fade in
-						float64 fade_from 
-							= (f64)frames_faded_so_far / (f64)p->fade_frames_total;
-							
-						float64 fade_to 
-							= (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
-						audio_apply_fade_in(
-							target_buffer, 
-							frames_to_fade, 
-							p->source.format, 
-							fade_from,
-							fade_to
-						);
-						break;
-					}
-					case AUDIO_PLAYER_STATE_PAUSED: {
-						// We need to fade out
-						// #Bug #Incomplete
-						// I can't get this to fade out without noise.
-						// I tried dithering but that didn't help.
-						float64 fade_from 
-							= 1.0 - (f64)frames_faded_so_far / (f64)p->fade_frames_total;
-							
-						float64 fade_to 
-							= 1.0 - (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
-						audio_apply_fade_out(
-							target_buffer, 
-							frames_to_fade, 
-							p->source.format, 
-							fade_from,
-							fade_to
-						);
-						break;
-					}
+			switch (p->state) {
+				case AUDIO_PLAYER_STATE_PLAYING: {
+					// We need to fade in
+					float64 fade_from 
+						= (f64)frames_faded_so_far / (f64)p->fade_frames_total;
+						
+					float64 fade_to 
+						= (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
+					audio_apply_fade_in(
+						target_buffer, 
+						frames_to_fade, 
+						p->source.format, 
+						fade_from,
+						fade_to
+					);
+					break;
 				}
-				
-				p->fade_frames -= frames_to_fade;
-				
-				if (frames_to_fade < number_of_sample_frames) {
-					memset(
-						(u8*)target_buffer+frames_to_fade, 
-						0, 
-						number_of_sample_frames-frames_to_fade
+				case AUDIO_PLAYER_STATE_PAUSED: {
+					// We need to fade out
+					// #Bug #Incomplete
+					// I can't get this to fade out without noise.
+					// I tried dithering but that didn't help.
+					float64 fade_from 
+						= 1.0 - (f64)frames_faded_so_far / (f64)p->fade_frames_total;
+						
+					float64 fade_to 
+						= 1.0 - (f64)(frames_faded_so_far + frames_to_fade) / (f64)p->fade_frames_total;
+					audio_apply_fade_out(
+						target_buffer, 
+						frames_to_fade, 
+						p->source.format, 
+						fade_from,
+						fade_to
 					);
+					break;
 				}
 			}
 			
-			spinlock_release(&p->sample_lock);
-						
-			if (need_convert) {
-				int converted = convert_frames(
-					mix_buffer, 
-					out_format, 
-					convert_buffer, 
-					sample_format,
-					number_of_output_frames
+			p->fade_frames -= frames_to_fade;
+			
+			if (frames_to_fade < number_of_sample_frames) {
+				memset(
+					(u8*)target_buffer+frames_to_fade, 
+					0, 
+					number_of_sample_frames-frames_to_fade
 				);
-				assert(converted == number_of_output_frames);
 			}
+		}
+		
+		spinlock_release(&p->sample_lock);
+					
+		if (need_convert) {
+			int converted = convert_frames(
+				mix_buffer, 
+				out_format, 
+				convert_buffer, 
+				sample_format,
+				number_of_output_frames
+			);
+			assert(converted == number_of_output_frames);
+		}
 
-			if (p->config.enable_spacialization) {
-				apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, p->config.position_ndc);
-			}
-			if (p->config.volume != 0.0) {
-				apply_audio_volume(mix_buffer, out_format, number_of_output_frames, p->config.volume);
-			}
-			
-			mix_frames(output, mix_buffer, number_of_output_frames, out_format);
-			
-			mutex_release(&src.mutex_for_destroy);
+		if (p->config.enable_spacialization) {
+			apply_audio_spacialization(mix_buffer, out_format, number_of_output_frames, p->config.position_ndc);
 		}
+		if (p->config.volume != 0.0) {
+			apply_audio_volume(mix_buffer, out_format, number_of_output_frames, p->config.volume);
+		}
+		
+		mix_frames(output, mix_buffer, number_of_output_frames, out_format);
 		
-		block = block->next;
+		mutex_release(&src.mutex_for_destroy);
 	}
 }
@@ -10,12 +10,80 @@ inline bool compare_and_swap_32(volatile uint32_t *a, uint32_t b, uint32_t old);
 inline bool compare_and_swap_64(volatile uint64_t *a, uint64_t b, uint64_t old);
 inline bool compare_and_swap_bool(volatile bool *a, bool b, bool old);
 
+// For loads, stores, exchange and fetch_add with explicit memory orders, see the typed
+// atomics in cpu.c (atomic_load_32, atomic_fetch_add_64, ...)
+
+///
+// Lock stats (#define ENABLE_LOCK_STATS 1)
+// Spinlocks & Mutexes given a name with spinlock_set_name/mutex_set_name record how often
+// they were acquired, how often someone had to wait, how many spin iterations and cycles
+// that took, and the worst waits. Locks with the same name share one entry, so e.g. every
+// audio player's sample_lock adds up into one line.
+// Dumped with lock_stats_print_report() and, with ENABLE_PROFILING, as counter tracks in
+// google_trace.json.
+// The counters are shared between all threads using the lock, so this is not free; it's
+// off by default and the set_name procs do nothing then.
+#ifndef LOCK_STATS_MAX_COUNT
+	#define LOCK_STATS_MAX_COUNT 64
+#endif
+#define LOCK_STATS_WORST_WAIT_COUNT 4
+typedef struct Lock_Wait {
+	u64 cycles;
+	u64 start_cycle; // rdtsc when the wait started
+	u64 thread_id;
+} Lock_Wait;
+typedef struct Lock_Stats {
+	string name;
+	volatile u64 acquire_count;
+	volatile u64 contended_count; // Acquires where the lock was taken already
+	volatile u64 spin_count;
+	volatile u64 wait_cycles;
+	
+	volatile bool worst_waits_locked;
+	Lock_Wait worst_waits[LOCK_STATS_WORST_WAIT_COUNT]; // Longest first
+	
+	// What was reported to the profiler last, so counter tracks show per-frame numbers
+	u64 reported_acquire_count;
+	u64 reported_contended_count;
+	u64 reported_wait_cycles;
+} Lock_Stats;
+
+void ogb_instance
+spinlock_set_name(Spinlock *l, string name);
+
+void ogb_instance
+mutex_set_name(Mutex *m, string name);
+
+#if ENABLE_LOCK_STATS
+// Finds or makes the entry for name. Name is not copied.
+Lock_Stats* ogb_instance
+lock_stats_get(string name);
+
+void ogb_instance
+lock_stats_record(Lock_Stats *stats, u64 spin_count, u64 wait_start_cycle);
+
+u64 ogb_instance
+lock_stats_get_count();
+
+Lock_Stats* ogb_instance
+lock_stats_get_all();
+
+void ogb_instance
+lock_stats_reset();
+
+void ogb_instance
+lock_stats_print_report();
+#endif
+
 ///
 // Spinlock "primitive"
 // Like a mutex but it eats up the entire core while waiting.
 // Beneficial if contention is low or sync speed is important
 typedef struct Spinlock {
 	volatile bool locked;
+#if ENABLE_LOCK_STATS
+	Lock_Stats *stats;
+#endif
 } Spinlock;
 
 void ogb_instance
@@ -33,16 +101,22 @@ spinlock_release(Spinlock* l);
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
-// Just spins for a few (configurable) microseconds with a spinlock,
-// and if acquiring fails it falls back to a OS mutex.
+// High-level mutex primitive (short spin, then sleep until woken)
+// Uncontended acquire & release are a single compare_and_swap each.
+// When contended it spins for a few (configurable) microseconds since the lock is
+// usually released quickly, and after that the thread sleeps with os_wait_on_address
+// until the owner wakes it, so waiting threads don't eat up cores.
 #define MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS 100
 typedef struct Mutex {
-	Spinlock spinlock;
+	// 0: unlocked, 1: locked, 2: locked and there might be threads sleeping on it
+	volatile u32 state;
 	f64 spin_time_microseconds;
-	Mutex_Handle os_handle;
+	// True if the owner got the lock without having to sleep
 	volatile bool spinlock_acquired;
 	volatile u64 acquiring_thread;
+#if ENABLE_LOCK_STATS
+	Lock_Stats *stats;
+#endif
 } Mutex;
 
 void ogb_instance
@@ -61,8 +135,7 @@ mutex_release(Mutex *m);
 ///
 // Binary semaphore
 typedef struct Binary_Semaphore {
-    volatile bool signaled;
-    Mutex mutex;
+    volatile u32 signaled;
 } Binary_Semaphore;
 
 void ogb_instance
@@ -78,19 +151,341 @@ void ogb_instance
 binary_semaphore_signal(Binary_Semaphore *sem);
 
 
+///
+// Counting semaphore
+// Wait takes one from count and sleeps while count is 0, signal adds to it.
+typedef struct Semaphore {
+	volatile u32 count;
+	volatile u32 waiter_count;
+} Semaphore;
+
+void ogb_instance
+semaphore_init(Semaphore *sem, u32 initial_count);
+
+void ogb_instance
+semaphore_destroy(Semaphore *sem);
+
+void ogb_instance
+semaphore_wait(Semaphore *sem);
+
+// Returns false if count was 0
+bool ogb_instance
+semaphore_try_wait(Semaphore *sem);
+
+void ogb_instance
+semaphore_signal(Semaphore *sem, u32 count);
+
+
+///
+// Condition variable
+// Always wait in a loop which checks your condition, wake ups can be spurious:
+//
+//     mutex_acquire_or_wait(&m);
+//     while (!ready) condition_variable_wait(&cv, &m);
+//     mutex_release(&m);
+typedef struct Condition_Variable {
+	volatile u32 sequence;
+	volatile u32 waiter_count;
+} Condition_Variable;
+
+void ogb_instance
+condition_variable_init(Condition_Variable *cv);
+
+void ogb_instance
+condition_variable_destroy(Condition_Variable *cv);
+
+// Releases the mutex while sleeping and has it acquired again when returning
+void ogb_instance
+condition_variable_wait(Condition_Variable *cv, Mutex *m);
+
+void ogb_instance
+condition_variable_signal(Condition_Variable *cv);
+
+void ogb_instance
+condition_variable_broadcast(Condition_Variable *cv);
+
+
+///
+// Event
+// Threads sleep in event_wait until the event is set.
+// An auto reset event lets one waiter through per event_set & resets itself, a manual
+// reset event lets everyone through until event_reset.
+typedef struct Event {
+	volatile u32 signaled;
+	bool auto_reset;
+} Event;
+
+void ogb_instance
+event_init(Event *e, bool auto_reset, bool initial_state);
+
+void ogb_instance
+event_destroy(Event *e);
+
+void ogb_instance
+event_set(Event *e);
+
+void ogb_instance
+event_reset(Event *e);
+
+void ogb_instance
+event_wait(Event *e);
+
+// Returns false if timeout was reached before the event was set
+bool ogb_instance
+event_wait_timeout(Event *e, f64 timeout_seconds);
+
+///
+// Reader-writer lock
+// Any number of readers or one writer. Writer preferring: once a writer is waiting, new
+// readers wait too, so a steady stream of readers can't starve writers. That also means
+// taking the read lock recursively can deadlock if a writer comes in between.
+// Readers only touch one cache line with one compare_and_swap, so read heavy data (caches,
+// asset tables) scales with the number of reading threads where a Mutex would serialize.
+#define RW_LOCK_WRITER_BIT (1u << 31)
+#define RW_LOCK_SPIN_COUNT 64
+typedef struct Rw_Lock {
+	// Reader count, | RW_LOCK_WRITER_BIT when a writer has it
+	volatile u32 state;
+	volatile u32 writers_waiting;
+	// Bumped to wake sleeping readers/writers with os_wait_on_address
+	volatile u32 reader_wake;
+	volatile u32 writer_wake;
+} Rw_Lock;
+
+void ogb_instance
+rw_lock_init(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_destroy(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_read_acquire_or_wait(Rw_Lock *l);
+
+// Returns false if a writer has it or is waiting for it
+bool ogb_instance
+rw_lock_read_try_acquire(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_read_release(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_write_acquire_or_wait(Rw_Lock *l);
+
+// Returns false if anyone has it
+bool ogb_instance
+rw_lock_write_try_acquire(Rw_Lock *l);
+
+void ogb_instance
+rw_lock_write_release(Rw_Lock *l);
+
+///
+// Bounded lock-free queues
+// Ring buffers of a fixed number (rounded up to a power of two) of element_size sized
+// elements, copied in & out. Push fails when full & pop fails when empty, nothing blocks.
+// The *_many procs move as many elements as they can in one go and return the count.
+//
+// Spsc_Queue: exactly one thread pushes and exactly one thread pops.
+// Mpmc_Queue: any number of threads on either end. Dmitry Vyukov's bounded queue; each
+//             slot has a sequence number saying whether it's ready to be written or read.
+// Both are FIFO per producer.
+typedef struct Spsc_Queue {
+	// Written by the producer
+	volatile u64 tail;
+	u64 cached_head;
+	u8 _pad0[64-sizeof(u64)*2];
+	// Written by the consumer
+	volatile u64 head;
+	u64 cached_tail;
+	u8 _pad1[64-sizeof(u64)*2];
+
+	u8 *data;
+	u64 capacity;
+	u64 element_size;
+	Allocator allocator;
+} Spsc_Queue;
+
+typedef struct Mpmc_Queue {
+	volatile u64 enqueue_position;
+	u8 _pad0[64-sizeof(u64)];
+	volatile u64 dequeue_position;
+	u8 _pad1[64-sizeof(u64)];
+
+	// Each cell is a volatile u64 sequence followed by the element
+	u8 *cells;
+	u64 cell_size;
+	u64 capacity;
+	u64 element_size;
+	Allocator allocator;
+} Mpmc_Queue;
+
+void ogb_instance
+spsc_queue_init(Spsc_Queue *q, u64 capacity, u64 element_size, Allocator allocator);
+
+void ogb_instance
+spsc_queue_destroy(Spsc_Queue *q);
+
+bool ogb_instance
+spsc_queue_push(Spsc_Queue *q, void *element);
+
+bool ogb_instance
+spsc_queue_pop(Spsc_Queue *q, void *element);
+
+u64 ogb_instance
+spsc_queue_push_many(Spsc_Queue *q, void *elements, u64 count);
+
+u64 ogb_instance
+spsc_queue_pop_many(Spsc_Queue *q, void *elements, u64 max_count);
+
+void ogb_instance
+mpmc_queue_init(Mpmc_Queue *q, u64 capacity, u64 element_size, Allocator allocator);
+
+void ogb_instance
+mpmc_queue_destroy(Mpmc_Queue *q);
+
+bool ogb_instance
+mpmc_queue_push(Mpmc_Queue *q, void *element);
+
+bool ogb_instance
+mpmc_queue_pop(Mpmc_Queue *q, void *element);
+
+u64 ogb_instance
+mpmc_queue_push_many(Mpmc_Queue *q, void *elements, u64 count);
+
+u64 ogb_instance
+mpmc_queue_pop_many(Mpmc_Queue *q, void *elements, u64 max_count);
+
+
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
+///
+// Lock stats
+
+#if ENABLE_LOCK_STATS
+Lock_Stats lock_stats[LOCK_STATS_MAX_COUNT];
+volatile u32 lock_stats_count = 0;
+volatile bool lock_stats_registry_locked = false;
+
+Lock_Stats *lock_stats_get(string name) {
+	// Can't use a Spinlock here, that would record into itself
+	while (!compare_and_swap_bool(&lock_stats_registry_locked, true, false)) _mm_pause();
+	
+	Lock_Stats *stats = 0;
+	for (u32 i = 0; i < lock_stats_count; i += 1) {
+		if (strings_match(lock_stats[i].name, name)) {
+			stats = &lock_stats[i];
+			break;
+		}
+	}
+	if (!stats) {
+		assert(lock_stats_count < LOCK_STATS_MAX_COUNT, "Out of lock stats slots, #define LOCK_STATS_MAX_COUNT to something bigger than %d", LOCK_STATS_MAX_COUNT);
+		stats = &lock_stats[lock_stats_count];
+		memset(stats, 0, sizeof(*stats));
+		stats->name = name;
+		atomic_store_32(&lock_stats_count, lock_stats_count+1, MEMORY_ORDER_RELEASE);
+	}
+	
+	compare_and_swap_bool(&lock_stats_registry_locked, false, true);
+	return stats;
+}
+
+// wait_start_cycle is 0 if the lock was free on the first try
+void lock_stats_record(Lock_Stats *stats, u64 spin_count, u64 wait_start_cycle) {
+	atomic_fetch_add_64(&stats->acquire_count, 1, MEMORY_ORDER_RELAXED);
+	if (!wait_start_cycle) return;
+	
+	u64 wait_cycles = rdtsc() - wait_start_cycle;
+	atomic_fetch_add_64(&stats->contended_count, 1, MEMORY_ORDER_RELAXED);
+	atomic_fetch_add_64(&stats->spin_count, spin_count, MEMORY_ORDER_RELAXED);
+	atomic_fetch_add_64(&stats->wait_cycles, wait_cycles, MEMORY_ORDER_RELAXED);
+	
+	// Racy peek so the common case doesn't touch the worst wait lock
+	if (wait_cycles <= stats->worst_waits[LOCK_STATS_WORST_WAIT_COUNT-1].cycles) return;
+	
+	while (!compare_and_swap_bool(&stats->worst_waits_locked, true, false)) _mm_pause();
+	s64 i = LOCK_STATS_WORST_WAIT_COUNT-1;
+	if (wait_cycles > stats->worst_waits[i].cycles) {
+		while (i > 0 && stats->worst_waits[i-1].cycles < wait_cycles) {
+			stats->worst_waits[i] = stats->worst_waits[i-1];
+			i -= 1;
+		}
+		stats->worst_waits[i].cycles = wait_cycles;
+		stats->worst_waits[i].start_cycle = wait_start_cycle;
+		stats->worst_waits[i].thread_id = context.thread_id;
+	}
+	compare_and_swap_bool(&stats->worst_waits_locked, false, true);
+}
+
+u64 lock_stats_get_count() {
+	return atomic_load_32(&lock_stats_count, MEMORY_ORDER_ACQUIRE);
+}
+Lock_Stats *lock_stats_get_all() {
+	return lock_stats;
+}
+void lock_stats_reset() {
+	u64 count = lock_stats_get_count();
+	for (u64 i = 0; i < count; i += 1) {
+		Lock_Stats *stats = &lock_stats[i];
+		string name = stats->name;
+		memset(stats, 0, sizeof(*stats));
+		stats->name = name;
+	}
+}
+
+void lock_stats_print_report() {
+	u64 count = lock_stats_get_count();
+	print("Lock stats (%llu locks):\n", count);
+	for (u64 i = 0; i < count; i += 1) {
+		Lock_Stats *stats = &lock_stats[i];
+		u64 acquires  = stats->acquire_count;
+		u64 contended = stats->contended_count;
+		f64 contended_percent = acquires ? (f64)contended/(f64)acquires*100.0 : 0;
+		u64 average_wait = contended ? stats->wait_cycles/contended : 0;
+		print("\t%s: %llu acquires, %llu contended (%.2f%%), %llu spins, %llu kcycles waiting (%llu cycles avg)\n", stats->name, acquires, contended, contended_percent, stats->spin_count, stats->wait_cycles/1000, average_wait);
+		for (u64 j = 0; j < LOCK_STATS_WORST_WAIT_COUNT; j += 1) {
+			Lock_Wait w = stats->worst_waits[j];
+			if (!w.cycles) break;
+			print("\t\tWorst wait %llu: %llu cycles on thread %llu at cycle %llu\n", j, w.cycles, w.thread_id, w.start_cycle);
+		}
+	}
+}
+#endif // ENABLE_LOCK_STATS
+
+void spinlock_set_name(Spinlock *l, string name) {
+#if ENABLE_LOCK_STATS
+	l->stats = lock_stats_get(name);
+#endif
+}
+void mutex_set_name(Mutex *m, string name) {
+#if ENABLE_LOCK_STATS
+	m->stats = lock_stats_get(name);
+#endif
+}
+
 void spinlock_init(Spinlock *l) {
 	memset(l, 0, sizeof(*l));
 }
 void spinlock_acquire_or_wait(Spinlock* l) {
+#if ENABLE_LOCK_STATS
+	u64 spin_count = 0;
+	u64 wait_start_cycle = 0;
+#endif
 	while (true) {
         bool expected = false;
         if (compare_and_swap_bool(&l->locked, true, expected)) {
+#if ENABLE_LOCK_STATS
+            if (l->stats) lock_stats_record(l->stats, spin_count, wait_start_cycle);
+#endif
             return;
         }
+#if ENABLE_LOCK_STATS
+        if (!wait_start_cycle) wait_start_cycle = rdtsc();
+#endif
         while (l->locked) {
             // spinny boi
+            _mm_pause();
+#if ENABLE_LOCK_STATS
+            spin_count += 1;
+#endif
         }
     }
 }
@@ -104,6 +499,7 @@ bool spinlock_acquire_or_wait_timeout(Spinlock* l, f64 timeout_seconds) {
         }
         while (l->locked) {
             // spinny boi
+            _mm_pause();
             if ((os_get_elapsed_seconds()-start) >= timeout_seconds) return false;
         }
     }
@@ -117,66 +513,454 @@ void spinlock_release(Spinlock* l) {
 
 
 ///
-// High-level mutex primitive (short spinlock then OS mutex lock)
+// High-level mutex primitive (short spin, then sleep until woken)
 
 void mutex_init(Mutex *m) {
-	spinlock_init(&m->spinlock);
+	m->state = 0;
 	m->spin_time_microseconds = MUTEX_DEFAULT_SPIN_TIME_MICROSECONDS;
-	m->os_handle = os_make_mutex();
 	m->spinlock_acquired = false;
 	m->acquiring_thread = 0;
+#if ENABLE_LOCK_STATS
+	m->stats = 0;
+#endif
 }
 void mutex_destroy(Mutex *m) {
-	os_destroy_mutex(m->os_handle);
+	assert(m->state == 0, "Destroying a mutex which is still acquired");
 }
 void mutex_acquire_or_wait(Mutex *m) {
-	if (spinlock_acquire_or_wait_timeout(&m->spinlock, m->spin_time_microseconds / 1000000.0)) {
-        assert(!m->spinlock_acquired, "Internal sync error in Mutex");
-    	m->spinlock_acquired = true;
-    }
-    os_lock_mutex(m->os_handle);
-    
-    assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
-    m->acquiring_thread = context.thread_id;
+	bool spun = compare_and_swap_32(&m->state, 1, 0);
+	
+#if ENABLE_LOCK_STATS
+	u64 spin_count = 0;
+	u64 wait_start_cycle = spun ? 0 : rdtsc();
+#endif
+	
+	if (!spun && m->spin_time_microseconds > 0) {
+		f64 end = os_get_elapsed_seconds() + m->spin_time_microseconds / 1000000.0;
+		while (!spun) {
+			if (m->state == 0) spun = compare_and_swap_32(&m->state, 1, 0);
+			else if (os_get_elapsed_seconds() >= end) break;
+			else _mm_pause();
+#if ENABLE_LOCK_STATS
+			spin_count += 1;
+#endif
+		}
+	}
+	
+	if (!spun) {
+		// Mark the mutex as having sleepers so whoever releases it wakes one of us.
+		// If it was unlocked when we swapped, we got it (in the 2 state, which just
+		// means one extra wake when we release).
+		while (atomic_exchange_32(&m->state, 2, MEMORY_ORDER_ACQUIRE) != 0) {
+			os_wait_on_address(&m->state, 2, -1);
+		}
+	}
+	
+	assert(!m->acquiring_thread, "Internal sync error in Mutex: Multiple threads acquired");
+	m->spinlock_acquired = spun;
+	m->acquiring_thread = context.thread_id;
+	
+#if ENABLE_LOCK_STATS
+	if (m->stats) lock_stats_record(m->stats, spin_count, wait_start_cycle);
+#endif
 }
 void mutex_release(Mutex *m) {
 	assert(m->acquiring_thread != 0, "Tried to release a mutex which is not acquired");
 	assert(m->acquiring_thread == context.thread_id, "Non-owning thread tried to release mutex");
 	m->acquiring_thread = 0;
-	bool was_spinlock_acquired = m->spinlock_acquired;
 	m->spinlock_acquired = false;
-	os_unlock_mutex(m->os_handle);
-	if (was_spinlock_acquired) {
-		spinlock_release(&m->spinlock);
+	
+	if (atomic_exchange_32(&m->state, 0, MEMORY_ORDER_RELEASE) == 2) {
+		os_wake_one_on_address(&m->state);
 	}
 }
 
 
 
 void binary_semaphore_init(Binary_Semaphore *sem, bool initial_state) {
-    sem->signaled = initial_state;
-    mutex_init(&sem->mutex);
+    sem->signaled = initial_state ? 1 : 0;
 }
 
 void binary_semaphore_destroy(Binary_Semaphore *sem) {
-    mutex_destroy(&sem->mutex);
 }
 
 void binary_semaphore_wait(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    while (!sem->signaled) {
-        mutex_release(&sem->mutex);
-        os_yield_thread();
-        mutex_acquire_or_wait(&sem->mutex);
+    while (!compare_and_swap_32(&sem->signaled, 0, 1)) {
+        os_wait_on_address(&sem->signaled, 0, -1);
     }
-    sem->signaled = false;
-    mutex_release(&sem->mutex);
 }
 
 void binary_semaphore_signal(Binary_Semaphore *sem) {
-    mutex_acquire_or_wait(&sem->mutex);
-    sem->signaled = true;
-    mutex_release(&sem->mutex);
+    if (atomic_exchange_32(&sem->signaled, 1, MEMORY_ORDER_ACQ_REL) == 0) {
+        os_wake_one_on_address(&sem->signaled);
+    }
+}
+
+
+///
+// Counting semaphore
+
+void semaphore_init(Semaphore *sem, u32 initial_count) {
+	sem->count = initial_count;
+	sem->waiter_count = 0;
+}
+void semaphore_destroy(Semaphore *sem) {
+	assert(sem->waiter_count == 0, "Destroying a semaphore which has threads waiting on it");
+}
+bool semaphore_try_wait(Semaphore *sem) {
+	while (true) {
+		u32 count = sem->count;
+		if (count == 0) return false;
+		if (compare_and_swap_32(&sem->count, count-1, count)) return true;
+	}
+}
+void semaphore_wait(Semaphore *sem) {
+	if (semaphore_try_wait(sem)) return;
+	
+	atomic_fetch_add_32(&sem->waiter_count, 1, MEMORY_ORDER_SEQ_CST);
+	while (!semaphore_try_wait(sem)) {
+		os_wait_on_address(&sem->count, 0, -1);
+	}
+	atomic_fetch_add_32(&sem->waiter_count, -1, MEMORY_ORDER_SEQ_CST);
+}
+void semaphore_signal(Semaphore *sem, u32 count) {
+	if (count == 0) return;
+	atomic_fetch_add_32(&sem->count, (s32)count, MEMORY_ORDER_SEQ_CST);
+	
+	// Nobody sleeping, no need to go to the OS
+	if (sem->waiter_count == 0) return;
+	
+	if (count == 1) os_wake_one_on_address(&sem->count);
+	else            os_wake_all_on_address(&sem->count);
+}
+
+
+///
+// Condition variable
+
+void condition_variable_init(Condition_Variable *cv) {
+	cv->sequence = 0;
+	cv->waiter_count = 0;
+}
+void condition_variable_destroy(Condition_Variable *cv) {
+	assert(cv->waiter_count == 0, "Destroying a condition variable which has threads waiting on it");
+}
+void condition_variable_wait(Condition_Variable *cv, Mutex *m) {
+	// If someone signals after we release the mutex but before we sleep, sequence will
+	// have changed and os_wait_on_address returns right away.
+	u32 sequence = cv->sequence;
+	atomic_fetch_add_32(&cv->waiter_count, 1, MEMORY_ORDER_SEQ_CST);
+	
+	mutex_release(m);
+	os_wait_on_address(&cv->sequence, sequence, -1);
+	atomic_fetch_add_32(&cv->waiter_count, -1, MEMORY_ORDER_SEQ_CST);
+	mutex_acquire_or_wait(m);
+}
+void condition_variable_signal(Condition_Variable *cv) {
+	atomic_fetch_add_32(&cv->sequence, 1, MEMORY_ORDER_SEQ_CST);
+	if (cv->waiter_count) os_wake_one_on_address(&cv->sequence);
+}
+void condition_variable_broadcast(Condition_Variable *cv) {
+	atomic_fetch_add_32(&cv->sequence, 1, MEMORY_ORDER_SEQ_CST);
+	if (cv->waiter_count) os_wake_all_on_address(&cv->sequence);
+}
+
+
+///
+// Event
+
+void event_init(Event *e, bool auto_reset, bool initial_state) {
+	e->signaled = initial_state ? 1 : 0;
+	e->auto_reset = auto_reset;
+}
+void event_destroy(Event *e) {
+}
+void event_set(Event *e) {
+	if (atomic_exchange_32(&e->signaled, 1, MEMORY_ORDER_ACQ_REL) == 1) return;
+	
+	if (e->auto_reset) os_wake_one_on_address(&e->signaled);
+	else               os_wake_all_on_address(&e->signaled);
+}
+void event_reset(Event *e) {
+	e->signaled = 0;
+}
+bool event_wait_timeout(Event *e, f64 timeout_seconds) {
+	f64 end = timeout_seconds >= 0 ? os_get_elapsed_seconds() + timeout_seconds : 0;
+	while (true) {
+		if (e->auto_reset) {
+			if (compare_and_swap_32(&e->signaled, 0, 1)) return true;
+		} else {
+			if (e->signaled) return true;
+		}
+		
+		f64 remaining = -1;
+		if (timeout_seconds >= 0) {
+			remaining = end - os_get_elapsed_seconds();
+			if (remaining <= 0) return false;
+		}
+		os_wait_on_address(&e->signaled, 0, remaining);
+	}
+}
+void event_wait(Event *e) {
+	event_wait_timeout(e, -1);
+}
+
+///
+// Rw_Lock
+
+void rw_lock_init(Rw_Lock *l) {
+	memset(l, 0, sizeof(*l));
+}
+void rw_lock_destroy(Rw_Lock *l) {
+	assert(l->state == 0, "Destroying a Rw_Lock which is still acquired");
+}
+bool rw_lock_read_try_acquire(Rw_Lock *l) {
+	u32 state = atomic_load_32(&l->state, MEMORY_ORDER_RELAXED);
+	while (!(state & RW_LOCK_WRITER_BIT) && atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) == 0) {
+		assert(state + 1 < RW_LOCK_WRITER_BIT, "Too many readers in Rw_Lock");
+		if (atomic_compare_exchange_32(&l->state, &state, state+1, MEMORY_ORDER_SEQ_CST)) return true;
+	}
+	return false;
+}
+void rw_lock_read_acquire_or_wait(Rw_Lock *l) {
+	u32 spin = 0;
+	while (!rw_lock_read_try_acquire(l)) {
+		if (spin < RW_LOCK_SPIN_COUNT) {
+			spin += 1;
+			_mm_pause();
+			continue;
+		}
+		// Take the sequence before checking again so a release in between changes it
+		// and the wait returns right away instead of missing the wake.
+		u32 sequence = atomic_load_32(&l->reader_wake, MEMORY_ORDER_SEQ_CST);
+		u32 state = atomic_load_32(&l->state, MEMORY_ORDER_SEQ_CST);
+		if (!(state & RW_LOCK_WRITER_BIT) && atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) == 0) {
+			continue;
+		}
+		os_wait_on_address(&l->reader_wake, sequence, -1);
+	}
+}
+void rw_lock_read_release(Rw_Lock *l) {
+	u32 previous = atomic_fetch_add_32(&l->state, -1, MEMORY_ORDER_SEQ_CST);
+	assert((previous & ~RW_LOCK_WRITER_BIT) > 0, "Tried to release a Rw_Lock read lock which is not acquired");
+	
+	// Last reader out lets a waiting writer in
+	if (previous == 1 && atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) > 0) {
+		atomic_fetch_add_32(&l->writer_wake, 1, MEMORY_ORDER_SEQ_CST);
+		os_wake_one_on_address(&l->writer_wake);
+	}
+}
+bool rw_lock_write_try_acquire(Rw_Lock *l) {
+	u32 expected = 0;
+	return atomic_compare_exchange_32(&l->state, &expected, RW_LOCK_WRITER_BIT, MEMORY_ORDER_SEQ_CST);
+}
+void rw_lock_write_acquire_or_wait(Rw_Lock *l) {
+	if (rw_lock_write_try_acquire(l)) return;
+	
+	// Counting ourselves as waiting blocks new readers
+	atomic_fetch_add_32(&l->writers_waiting, 1, MEMORY_ORDER_SEQ_CST);
+	u32 spin = 0;
+	while (!rw_lock_write_try_acquire(l)) {
+		if (spin < RW_LOCK_SPIN_COUNT) {
+			spin += 1;
+			_mm_pause();
+			continue;
+		}
+		u32 sequence = atomic_load_32(&l->writer_wake, MEMORY_ORDER_SEQ_CST);
+		if (atomic_load_32(&l->state, MEMORY_ORDER_SEQ_CST) == 0) continue;
+		os_wait_on_address(&l->writer_wake, sequence, -1);
+	}
+	atomic_fetch_add_32(&l->writers_waiting, -1, MEMORY_ORDER_SEQ_CST);
+}
+void rw_lock_write_release(Rw_Lock *l) {
+	assert(atomic_load_32(&l->state, MEMORY_ORDER_RELAXED) == RW_LOCK_WRITER_BIT, "Tried to release a Rw_Lock write lock which is not acquired");
+	atomic_store_32(&l->state, 0, MEMORY_ORDER_SEQ_CST);
+	
+	// Writers first, readers are blocked anyway while writers are waiting
+	if (atomic_load_32(&l->writers_waiting, MEMORY_ORDER_SEQ_CST) > 0) {
+		atomic_fetch_add_32(&l->writer_wake, 1, MEMORY_ORDER_SEQ_CST);
+		os_wake_one_on_address(&l->writer_wake);
+	} else {
+		atomic_fetch_add_32(&l->reader_wake, 1, MEMORY_ORDER_SEQ_CST);
+		os_wake_all_on_address(&l->reader_wake);
+	}
+}
+
+///
+// Spsc_Queue
+
+void spsc_queue_init(Spsc_Queue *q, u64 capacity, u64 element_size, Allocator allocator) {
+	assert(capacity > 0 && element_size > 0, "Bad parameters passed to spsc_queue_init");
+	memset(q, 0, sizeof(*q));
+	q->capacity = get_next_power_of_two(capacity);
+	q->element_size = element_size;
+	q->allocator = allocator;
+	q->data = alloc(allocator, q->capacity*element_size);
+}
+void spsc_queue_destroy(Spsc_Queue *q) {
+	dealloc(q->allocator, q->data);
+	memset(q, 0, sizeof(*q));
+}
+
+// Copy count elements into/out of the ring starting at index, wrapping around
+void spsc_queue_copy_in(Spsc_Queue *q, u64 index, void *elements, u64 count) {
+	u64 first = index & (q->capacity-1);
+	u64 first_count = min(count, q->capacity - first);
+	memcpy(q->data + first*q->element_size, elements, first_count*q->element_size);
+	if (count > first_count) {
+		memcpy(q->data, (u8*)elements + first_count*q->element_size, (count-first_count)*q->element_size);
+	}
+}
+void spsc_queue_copy_out(Spsc_Queue *q, u64 index, void *elements, u64 count) {
+	u64 first = index & (q->capacity-1);
+	u64 first_count = min(count, q->capacity - first);
+	memcpy(elements, q->data + first*q->element_size, first_count*q->element_size);
+	if (count > first_count) {
+		memcpy((u8*)elements + first_count*q->element_size, q->data, (count-first_count)*q->element_size);
+	}
+}
+
+u64 spsc_queue_push_many(Spsc_Queue *q, void *elements, u64 count) {
+	u64 tail = q->tail;
+	
+	// Only look at the consumer's cache line when our cached head says we're full
+	u64 free_count = q->capacity - (tail - q->cached_head);
+	if (free_count < count) {
+		q->cached_head = q->head;
+		free_count = q->capacity - (tail - q->cached_head);
+	}
+	count = min(count, free_count);
+	if (count == 0) return 0;
+	
+	spsc_queue_copy_in(q, tail, elements, count);
+	
+	// Elements must be written before the consumer can see the new tail
+	COMPILER_BARRIER;
+	q->tail = tail + count;
+	
+	return count;
+}
+u64 spsc_queue_pop_many(Spsc_Queue *q, void *elements, u64 max_count) {
+	u64 head = q->head;
+	
+	u64 available_count = q->cached_tail - head;
+	if (available_count < max_count) {
+		q->cached_tail = q->tail;
+		available_count = q->cached_tail - head;
+	}
+	u64 count = min(max_count, available_count);
+	if (count == 0) return 0;
+	
+	// Don't read elements before we've read the tail that says they're there
+	COMPILER_BARRIER;
+	spsc_queue_copy_out(q, head, elements, count);
+	
+	// And be done reading them before the producer may overwrite them
+	COMPILER_BARRIER;
+	q->head = head + count;
+	
+	return count;
+}
+bool spsc_queue_push(Spsc_Queue *q, void *element) {
+	return spsc_queue_push_many(q, element, 1) == 1;
+}
+bool spsc_queue_pop(Spsc_Queue *q, void *element) {
+	return spsc_queue_pop_many(q, element, 1) == 1;
+}
+
+///
+// Mpmc_Queue
+
+void mpmc_queue_init(Mpmc_Queue *q, u64 capacity, u64 element_size, Allocator allocator) {
+	assert(capacity > 0 && element_size > 0, "Bad parameters passed to mpmc_queue_init");
+	memset(q, 0, sizeof(*q));
+	q->capacity = get_next_power_of_two(max(capacity, 2));
+	q->element_size = element_size;
+	q->cell_size = align_next(sizeof(u64) + element_size, sizeof(u64));
+	q->allocator = allocator;
+	q->cells = alloc(allocator, q->capacity*q->cell_size);
+	
+	for (u64 i = 0; i < q->capacity; i += 1) {
+		*(volatile u64*)(q->cells + i*q->cell_size) = i;
+	}
+}
+void mpmc_queue_destroy(Mpmc_Queue *q) {
+	dealloc(q->allocator, q->cells);
+	memset(q, 0, sizeof(*q));
+}
+
+inline volatile u64 *mpmc_queue_get_sequence(Mpmc_Queue *q, u64 position) {
+	return (volatile u64*)(q->cells + (position & (q->capacity-1))*q->cell_size);
+}
+
+u64 mpmc_queue_push_many(Mpmc_Queue *q, void *elements, u64 count) {
+	if (count == 0) return 0;
+	
+	u64 position = q->enqueue_position;
+	u64 claimed = 0;
+	while (true) {
+		s64 diff = (s64)(*mpmc_queue_get_sequence(q, position) - position);
+		if (diff < 0) return 0; // Full
+		
+		if (diff == 0) {
+			// Claim as many of the following cells as are ready to be written.
+			// A cell can't stop being ready unless someone moves enqueue_position,
+			// which would make our compare_and_swap fail.
+			claimed = 1;
+			while (claimed < count && claimed < q->capacity 
+			    && *mpmc_queue_get_sequence(q, position+claimed) == position+claimed) {
+				claimed += 1;
+			}
+			if (compare_and_swap_64(&q->enqueue_position, position+claimed, position)) break;
+		}
+		position = q->enqueue_position;
+	}
+	
+	for (u64 i = 0; i < claimed; i += 1) {
+		volatile u64 *sequence = mpmc_queue_get_sequence(q, position+i);
+		memcpy((u8*)sequence + sizeof(u64), (u8*)elements + i*q->element_size, q->element_size);
+		COMPILER_BARRIER;
+		*sequence = position+i+1;
+	}
+	
+	return claimed;
+}
+u64 mpmc_queue_pop_many(Mpmc_Queue *q, void *elements, u64 max_count) {
+	if (max_count == 0) return 0;
+	
+	u64 position = q->dequeue_position;
+	u64 claimed = 0;
+	while (true) {
+		s64 diff = (s64)(*mpmc_queue_get_sequence(q, position) - (position+1));
+		if (diff < 0) return 0; // Empty
+		
+		if (diff == 0) {
+			claimed = 1;
+			while (claimed < max_count && claimed < q->capacity 
+			    && *mpmc_queue_get_sequence(q, position+claimed) == position+claimed+1) {
+				claimed += 1;
+			}
+			if (compare_and_swap_64(&q->dequeue_position, position+claimed, position)) break;
+		}
+		position = q->dequeue_position;
+	}
+	
+	for (u64 i = 0; i < claimed; i += 1) {
+		volatile u64 *sequence = mpmc_queue_get_sequence(q, position+i);
+		COMPILER_BARRIER;
+		memcpy((u8*)elements + i*q->element_size, (u8*)sequence + sizeof(u64), q->element_size);
+		COMPILER_BARRIER;
+		// Ready to be written again, one lap later
+		*sequence = position+i+q->capacity;
+	}
+	
+	return claimed;
+}
+bool mpmc_queue_push(Mpmc_Queue *q, void *element) {
+	return mpmc_queue_push_many(q, element, 1) == 1;
+}
+bool mpmc_queue_pop(Mpmc_Queue *q, void *element) {
+	return mpmc_queue_pop_many(q, element, 1) == 1;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -23,6 +23,22 @@ typedef struct Cpu_Capabilities {
 // I think this is the standard? (sse1)
 #define COMPILER_CAN_DO_SSE 1
 
+///
+// Memory orders for the typed atomics (atomic_load_32 etc.)
+// Same values as C11/gcc so they can be passed straight to the compiler builtins.
+//   RELAXED: Only the operation itself is atomic, no ordering with other memory
+//   ACQUIRE: Loads & stores after it can't be moved before it (use when taking a lock/reading a flag)
+//   RELEASE: Loads & stores before it can't be moved after it (use when releasing a lock/publishing)
+//   ACQ_REL: Both, for read-modify-write
+//   SEQ_CST: Acq_rel plus one total order of all seq_cst operations. When in doubt, this.
+typedef enum Memory_Order {
+	MEMORY_ORDER_RELAXED = 0,
+	MEMORY_ORDER_ACQUIRE = 2,
+	MEMORY_ORDER_RELEASE = 3,
+	MEMORY_ORDER_ACQ_REL = 4,
+	MEMORY_ORDER_SEQ_CST = 5,
+} Memory_Order;
+
 ///
 // Compiler specific stuff
 #if COMPILER_MVSC
@@ -44,11 +60,31 @@ typedef struct Cpu_Capabilities {
     rdtsc() {
         return __rdtsc();
     }
+    // Undefined for x == 0
+    inline u32 
+    count_trailing_zeros_32(u32 x) {
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return (u32)index;
+    }
+    // Undefined for x == 0
+    inline u32 
+    count_leading_zeros_64(u64 x) {
+        unsigned long index;
+        _BitScanReverse64(&index, x);
+        return 63 - (u32)index;
+    }
     inline Cpu_Info_X86 cpuid(u32 function_id) {
     	Cpu_Info_X86 i;
-    	__cpuid((int*)&i, function_id);
+    	__cpuidex((int*)&i, function_id, 0);
     	return i;
     }
+    inline u64
+    xgetbv(u32 index) {
+    	return _xgetbv(index);
+    }
+    // MSVC lets you use any intrinsic regardless of /arch so there's nothing to do here
+    #define SIMD_TARGET(features)
     
     #if _M_IX86_FP >= 2
 		#define COMPILER_CAN_DO_SSE2 1
@@ -106,6 +142,89 @@ typedef struct Cpu_Capabilities {
 	}
 	
 	#define MEMORY_BARRIER _ReadWriteBarrier()
+	#define COMPILER_BARRIER _ReadWriteBarrier()
+	
+	///
+	// Typed atomics
+	// x86 only reorders stores with later loads, so everything but a seq_cst store is
+	// a plain access + a compiler barrier.
+	inline uint32_t 
+	atomic_load_32(volatile uint32_t *a, Memory_Order order) {
+		uint32_t v = *a;
+		_ReadWriteBarrier();
+		return v;
+	}
+	inline uint64_t 
+	atomic_load_64(volatile uint64_t *a, Memory_Order order) {
+		uint64_t v = *a;
+		_ReadWriteBarrier();
+		return v;
+	}
+	inline void* 
+	atomic_load_pointer(void *volatile *a, Memory_Order order) {
+		void *v = *a;
+		_ReadWriteBarrier();
+		return v;
+	}
+	inline void 
+	atomic_store_32(volatile uint32_t *a, uint32_t v, Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) { _InterlockedExchange((volatile long*)a, (long)v); return; }
+		_ReadWriteBarrier();
+		*a = v;
+	}
+	inline void 
+	atomic_store_64(volatile uint64_t *a, uint64_t v, Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) { _InterlockedExchange64((volatile long long*)a, (long long)v); return; }
+		_ReadWriteBarrier();
+		*a = v;
+	}
+	inline void 
+	atomic_store_pointer(void *volatile *a, void *v, Memory_Order order) {
+		if (order == MEMORY_ORDER_SEQ_CST) { _InterlockedExchangePointer(a, v); return; }
+		_ReadWriteBarrier();
+		*a = v;
+	}
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t v, Memory_Order order) {
+		return (uint32_t)_InterlockedExchange((volatile long*)a, (long)v);
+	}
+	inline uint64_t 
+	atomic_exchange_64(volatile uint64_t *a, uint64_t v, Memory_Order order) {
+		return (uint64_t)_InterlockedExchange64((volatile long long*)a, (long long)v);
+	}
+	inline void* 
+	atomic_exchange_pointer(void *volatile *a, void *v, Memory_Order order) {
+		return _InterlockedExchangePointer(a, v);
+	}
+	inline bool 
+	atomic_compare_exchange_32(volatile uint32_t *a, uint32_t *expected, uint32_t desired, Memory_Order order) {
+		uint32_t old = (uint32_t)_InterlockedCompareExchange((volatile long*)a, (long)desired, (long)*expected);
+		if (old == *expected) return true;
+		*expected = old;
+		return false;
+	}
+	inline bool 
+	atomic_compare_exchange_64(volatile uint64_t *a, uint64_t *expected, uint64_t desired, Memory_Order order) {
+		uint64_t old = (uint64_t)_InterlockedCompareExchange64((volatile long long*)a, (long long)desired, (long long)*expected);
+		if (old == *expected) return true;
+		*expected = old;
+		return false;
+	}
+	inline bool 
+	atomic_compare_exchange_pointer(void *volatile *a, void **expected, void *desired, Memory_Order order) {
+		void *old = _InterlockedCompareExchangePointer(a, desired, *expected);
+		if (old == *expected) return true;
+		*expected = old;
+		return false;
+	}
+	inline uint32_t 
+	atomic_fetch_add_32(volatile uint32_t *a, int32_t delta, Memory_Order order) {
+		return (uint32_t)_InterlockedExchangeAdd((volatile long*)a, (long)delta);
+	}
+	inline uint64_t 
+	atomic_fetch_add_64(volatile uint64_t *a, int64_t delta, Memory_Order order) {
+		return (uint64_t)_InterlockedExchangeAdd64((volatile long long*)a, (long long)delta);
+	}
 	
 	#define thread_local __declspec(thread)
 	
@@ -133,6 +252,16 @@ typedef struct Cpu_Capabilities {
         __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
         return ((u64)hi << 32) | lo;
     }
+    // Undefined for x == 0
+    inline u32 
+    count_trailing_zeros_32(u32 x) {
+        return (u32)__builtin_ctz(x);
+    }
+    // Undefined for x == 0
+    inline u32 
+    count_leading_zeros_64(u64 x) {
+        return (u32)__builtin_clzll(x);
+    }
     
     inline 
     Cpu_Info_X86 cpuid(u32 function_id) {
@@ -143,6 +272,15 @@ typedef struct Cpu_Capabilities {
 	        : "a"(function_id), "c"(0));
 	    return info;
 	}
+	inline u64
+	xgetbv(u32 index) {
+		u32 lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(index));
+		return ((u64)hi << 32) | lo;
+	}
+	// Lets a single function use instructions the rest of the program wasn't compiled for,
+	// i.e. SIMD_TARGET("avx2"). Only call those through a pointer picked after checking query_cpu_capabilities().
+	#define SIMD_TARGET(features) __attribute__((target(features)))
 	
 	#ifdef __SSE2__
 		#define COMPILER_CAN_DO_SSE2 1
@@ -226,6 +364,72 @@ typedef struct Cpu_Capabilities {
 	}
 	
 	#define MEMORY_BARRIER {__asm__ __volatile__("" ::: "memory");__sync_synchronize();}
+	// Only stops the compiler from moving loads & stores across it. x86 doesn't reorder
+	// stores with stores or loads with loads, so this is enough for publishing data.
+	#define COMPILER_BARRIER __asm__ __volatile__("" ::: "memory")
+	
+	///
+	// Typed atomics
+	// order is a compile time constant once these are inlined, which the builtins need to
+	// pick the right instructions.
+	inline uint32_t 
+	atomic_load_32(volatile uint32_t *a, Memory_Order order) {
+		return __atomic_load_n(a, order);
+	}
+	inline uint64_t 
+	atomic_load_64(volatile uint64_t *a, Memory_Order order) {
+		return __atomic_load_n(a, order);
+	}
+	inline void* 
+	atomic_load_pointer(void *volatile *a, Memory_Order order) {
+		return __atomic_load_n(a, order);
+	}
+	inline void 
+	atomic_store_32(volatile uint32_t *a, uint32_t v, Memory_Order order) {
+		__atomic_store_n(a, v, order);
+	}
+	inline void 
+	atomic_store_64(volatile uint64_t *a, uint64_t v, Memory_Order order) {
+		__atomic_store_n(a, v, order);
+	}
+	inline void 
+	atomic_store_pointer(void *volatile *a, void *v, Memory_Order order) {
+		__atomic_store_n(a, v, order);
+	}
+	inline uint32_t 
+	atomic_exchange_32(volatile uint32_t *a, uint32_t v, Memory_Order order) {
+		return __atomic_exchange_n(a, v, order);
+	}
+	inline uint64_t 
+	atomic_exchange_64(volatile uint64_t *a, uint64_t v, Memory_Order order) {
+		return __atomic_exchange_n(a, v, order);
+	}
+	inline void* 
+	atomic_exchange_pointer(void *volatile *a, void *v, Memory_Order order) {
+		return __atomic_exchange_n(a, v, order);
+	}
+	// On failure, expected is set to the current value
+	inline bool 
+	atomic_compare_exchange_32(volatile uint32_t *a, uint32_t *expected, uint32_t desired, Memory_Order order) {
+		return __atomic_compare_exchange_n(a, expected, desired, false, order, order == MEMORY_ORDER_ACQ_REL ? MEMORY_ORDER_ACQUIRE : (order == MEMORY_ORDER_RELEASE ? MEMORY_ORDER_RELAXED : order));
+	}
+	inline bool 
+	atomic_compare_exchange_64(volatile uint64_t *a, uint64_t *expected, uint64_t desired, Memory_Order order) {
+		return __atomic_compare_exchange_n(a, expected, desired, false, order, order == MEMORY_ORDER_ACQ_REL ? MEMORY_ORDER_ACQUIRE : (order == MEMORY_ORDER_RELEASE ? MEMORY_ORDER_RELAXED : order));
+	}
+	inline bool 
+	atomic_compare_exchange_pointer(void *volatile *a, void **expected, void *desired, Memory_Order order) {
+		return __atomic_compare_exchange_n(a, expected, desired, false, order, order == MEMORY_ORDER_ACQ_REL ? MEMORY_ORDER_ACQUIRE : (order == MEMORY_ORDER_RELEASE ? MEMORY_ORDER_RELAXED : order));
+	}
+	// Returns the value from before the add
+	inline uint32_t 
+	atomic_fetch_add_32(volatile uint32_t *a, int32_t delta, Memory_Order order) {
+		return __atomic_fetch_add(a, (uint32_t)delta, order);
+	}
+	inline uint64_t 
+	atomic_fetch_add_64(volatile uint64_t *a, int64_t delta, Memory_Order order) {
+		return __atomic_fetch_add(a, (uint64_t)delta, order);
+	}
 	
 	#define thread_local __thread
 	
@@ -243,7 +447,21 @@ typedef struct Cpu_Capabilities {
     
     inline u64 
     rdtsc() { return 0; }
+    inline u32 
+    count_trailing_zeros_32(u32 x) {
+        u32 n = 0;
+        while (n < 32 && !(x & (1u << n))) n += 1;
+        return n;
+    }
+    inline u32 
+    count_leading_zeros_64(u64 x) {
+        u32 n = 0;
+        while (n < 64 && !(x & (1ull << (63-n)))) n += 1;
+        return n;
+    }
     inline Cpu_Info_X86 cpuid(u32 function_id) {return (Cpu_Info_X86){0};}
+    inline u64 xgetbv(u32 index) {return 0;}
+    #define SIMD_TARGET(features)
     #define COMPILER_CAN_DO_SSE2 0
     #define COMPILER_CAN_DO_AVX 0
     #define COMPILER_CAN_DO_AVX2 0
@@ -252,6 +470,7 @@ typedef struct Cpu_Capabilities {
     #define DEPRECATED(proc, msg) 
     
     #define MEMORY_BARRIER
+    #define COMPILER_BARRIER
     
     #warning "Compiler is not explicitly supported, some things will probably not work as expected"
 #endif
@@ -272,12 +491,24 @@ query_cpu_capabilities() {
     result.sse42 = (info.ecx & (1 << 20)) != 0;
     result.any_sse = result.sse1 || result.sse2 || result.sse3 || result.ssse3 || result.sse41 || result.sse42;
     
-    result.avx = (info.ecx & (1 << 28)) != 0;
-
-    Cpu_Info_X86 ext_info = cpuid(7);
-    result.avx2 = (ext_info.ebx & (1 << 5)) != 0;
+    // The cpu having avx isn't enough, the os also needs to save the ymm/zmm registers
+    // on context switches. XCR0 bits 1,2 are xmm/ymm and 5,6,7 are the avx512 state.
+    bool os_saves_ymm = false;
+    bool os_saves_zmm = false;
+    if (info.ecx & (1 << 27)) { // osxsave
+    	u64 xcr0 = xgetbv(0);
+    	os_saves_ymm = (xcr0 & 0x6)  == 0x6;
+    	os_saves_zmm = (xcr0 & 0xe6) == 0xe6;
+    }
     
-    result.avx512 = (ext_info.ebx & (1 << 16)) != 0;
+    result.avx = (info.ecx & (1 << 28)) != 0 && os_saves_ymm;
+
+	if (cpuid(0).eax >= 7) {
+	    Cpu_Info_X86 ext_info = cpuid(7);
+	    result.avx2 = (ext_info.ebx & (1 << 5)) != 0 && os_saves_ymm;
+	    
+	    result.avx512 = (ext_info.ebx & (1 << 16)) != 0 && os_saves_zmm;
+	}
 
     return result;
 }
@@ -0,0 +1,222 @@
+
+// The quad to vertex stage of the 2D renderer.
+// It only sees quads through Draw_Vertex_Stream.get_quad and knows nothing about images
+// or the draw frame, so it's part of headless builds too. drawing.c has the get_quad for
+// Draw_Quads, which is what the renderer uses.
+
+#ifndef VERTEX_2D_USER_DATA_COUNT
+	#define VERTEX_2D_USER_DATA_COUNT 1
+#endif
+
+// What the renderer feeds the 2D shader, 6 per quad (two triangles).
+// #Volatile vertex layout in the renderer & shader
+// #Volatile uv & self_uv must share 16 bytes, write_draw_vertices() writes them as one
+typedef struct alignat(16) Draw_Vertex {
+	
+	Vector4 color;
+	Vector4 position;
+	Vector2 uv;
+	Vector2 self_uv;
+	s8 texture_index;
+	u8 type;
+	u8 sampler;
+	u8 has_scissor;
+	
+	Vector4 userdata[VERTEX_2D_USER_DATA_COUNT];
+	
+	Vector4 scissor;
+
+} Draw_Vertex;
+
+// Everything write_draw_vertices needs to know about a quad
+typedef struct Draw_Vertex_Quad {
+	Vector2 bottom_left, top_left, top_right, bottom_right; // ndc, in this order
+	Vector4 color;
+	Vector4 uv; // x1, y1, x2, y2
+	Vector4 *userdata; // VERTEX_2D_USER_DATA_COUNT of them
+	u32 scissor_index; // 0 for no scissor
+	u32 image_width, image_height; // 0 without an image
+	u8 type;
+	u8 sampler;
+} Draw_Vertex_Quad;
+
+// Fills out the quad at index (not in draw order) in quads
+typedef void(*Draw_Vertex_Get_Quad_Proc)(void *quads, u64 index, Draw_Vertex_Quad *out);
+
+typedef struct Draw_Vertex_Stream {
+	void *quads;
+	Draw_Vertex_Get_Quad_Proc get_quad;
+	u32 *order; // 0 for submission order
+	s8 *texture_indices; // From draw_frame_make_batches()
+	Vector4 *scissors; // Indexed by scissor_index, already in the space the backend wants
+	Draw_Vertex *vertices; // 6 per quad in draw order, 16 byte aligned
+	
+	// Positions are snapped to this pixel grid, 0 to not snap.
+	// This is meant to fix the annoying artifacts that shows up when sampling from a large atlas
+	// presumably for floating point precision issues or something.
+	// #Incomplete
+	// If we want to animate text with small movements then it will look wonky.
+	u32 viewport_width, viewport_height;
+} Draw_Vertex_Stream;
+
+// Smallest number of quads worth handing to another thread
+#define DRAW_VERTEX_BATCH_SIZE 1024
+
+#if ENABLE_SIMD
+// round() on 4 floats with sse1 only, so halves round away from zero like the scalar path.
+// Anything at or above 2^22 is far off screen and left alone.
+inline __m128 draw_vertex_round_ps(__m128 x) {
+	__m128 zero  = _mm_setzero_ps();
+	__m128 half  = _mm_set1_ps(0.5f);
+	// Adding and subtracting 1.5*2^23 rounds to the nearest integer, halves to even
+	__m128 magic = _mm_set1_ps(12582912.0f);
+	__m128 limit = _mm_set1_ps(4194304.0f);
+	
+	__m128 r = _mm_sub_ps(_mm_add_ps(x, magic), magic);
+	
+	// x - r is exact in range, so it's a tie when that's exactly a half. If x - r has
+	// the same sign as x it went toward zero and needs to go one further.
+	__m128 diff = _mm_sub_ps(x, r);
+	__m128 abs_diff = _mm_max_ps(diff, _mm_sub_ps(zero, diff));
+	__m128 toward_zero = _mm_and_ps(_mm_cmpeq_ps(abs_diff, half), _mm_cmpgt_ps(_mm_mul_ps(diff, x), zero));
+	r = _mm_add_ps(r, _mm_and_ps(toward_zero, _mm_add_ps(diff, diff)));
+	
+	__m128 in_range = _mm_cmplt_ps(_mm_max_ps(x, _mm_sub_ps(zero, x)), limit);
+	return _mm_or_ps(_mm_and_ps(in_range, r), _mm_andnot_ps(in_range, x));
+}
+#endif
+
+// Writes the vertices for quads first to end (in draw order) of a Draw_Vertex_Stream.
+// Doesn't touch the gpu or the quads so backends can run it with parallel_for.
+void write_draw_vertices(u64 first, u64 end, void *userdata) {
+	Draw_Vertex_Stream *stream = (Draw_Vertex_Stream*)userdata;
+	
+	assert((u64)stream->vertices % 16 == 0, "Draw_Vertex_Stream.vertices must be 16 byte aligned");
+	assert(stream->get_quad, "Draw_Vertex_Stream.get_quad is not set");
+	
+	bool snap = stream->viewport_width != 0 && stream->viewport_height != 0;
+	float32 pixel_width  = snap ? 2.0f/(float32)stream->viewport_width  : 0;
+	float32 pixel_height = snap ? 2.0f/(float32)stream->viewport_height : 0;
+	
+	// #Hack #Bug #Cleanup
+	// When a window dimension is uneven it slightly under/oversamples on an axis by a
+	// seemingly arbitrary amount. The 0.25 is a magic value I got from trial and error.
+	// (It undersamples by a fourth of the atlas texture?)
+	// Anything > 0.25 < will slightly over/undersample on my machine.
+	// I have no idea about #Portability here.
+	// - Charlie M 26th July 2024
+	bool odd_width  = stream->viewport_width  % 2 != 0;
+	bool odd_height = stream->viewport_height % 2 != 0;
+
+#if ENABLE_SIMD
+	// Corners are stored x, y, x, y so one divide snaps two corners. Divide, not multiply
+	// by the inverse, so it snaps exactly like the scalar path.
+	__m128 pixel_size  = _mm_setr_ps(pixel_width, pixel_height, pixel_width, pixel_height);
+	__m128 zero_one    = _mm_setr_ps(0, 1, 0, 1);
+	__m128 self_uv_tl_br = _mm_setr_ps(0, 1, 1, 0);
+	__m128 ones        = _mm_set1_ps(1.0f);
+	__m128 zero        = _mm_setzero_ps();
+	
+	const u64 chunk_count    = sizeof(Draw_Vertex)/sizeof(__m128);
+	const u64 position_chunk = offsetof(Draw_Vertex, position)/sizeof(__m128);
+	const u64 uv_chunk       = offsetof(Draw_Vertex, uv)/sizeof(__m128);
+#endif
+
+	for (u64 i = first; i < end; i++) {
+		Draw_Vertex_Quad q;
+		stream->get_quad(stream->quads, stream->order ? stream->order[i] : i, &q);
+		Draw_Vertex *v = stream->vertices + i*6;
+		
+		// Everything but position & uv is the same for all corners
+		Draw_Vertex corner = ZERO(Draw_Vertex);
+		corner.color = q.color;
+		corner.texture_index = stream->texture_indices[i];
+		corner.type = q.type;
+		corner.sampler = q.sampler;
+		corner.has_scissor = q.scissor_index != 0;
+		corner.scissor = q.scissor_index ? stream->scissors[q.scissor_index] : v4(0, 0, 0, 0);
+		memcpy(corner.userdata, q.userdata, sizeof(corner.userdata));
+		
+		Vector4 uv = q.uv;
+		if (odd_width && q.image_width) {
+			uv.x1 += (2.0/(float)q.image_width)*0.25;
+			uv.x2 += (2.0/(float)q.image_width)*0.25;
+		}
+		if (odd_height && q.image_height) {
+			uv.y1 -= (2.0/(float)q.image_height)*0.25;
+			uv.y2 -= (2.0/(float)q.image_height)*0.25;
+		}
+
+#if ENABLE_SIMD
+		__m128 bl_tl = _mm_loadu_ps(&q.bottom_left.x);
+		__m128 tr_br = _mm_loadu_ps(&q.top_right.x);
+		
+		if (snap) {
+			bl_tl = _mm_mul_ps(draw_vertex_round_ps(_mm_div_ps(bl_tl, pixel_size)), pixel_size);
+			tr_br = _mm_mul_ps(draw_vertex_round_ps(_mm_div_ps(tr_br, pixel_size)), pixel_size);
+		}
+		
+		// x, y, 0, 1
+		__m128 positions[4];
+		positions[0] = _mm_movelh_ps(bl_tl, zero_one);
+		positions[1] = _mm_movehl_ps(zero_one, bl_tl);
+		positions[2] = _mm_movelh_ps(tr_br, zero_one);
+		positions[3] = _mm_movehl_ps(zero_one, tr_br);
+		
+		// u, v, self_u, self_v
+		__m128 uvs = _mm_loadu_ps(&uv.x1);
+		__m128 uv_blocks[4];
+		uv_blocks[0] = _mm_movelh_ps(uvs, zero);                                       // x1 y1 0 0
+		uv_blocks[1] = _mm_shuffle_ps(uvs, self_uv_tl_br, _MM_SHUFFLE(1, 0, 3, 0));    // x1 y2 0 1
+		uv_blocks[2] = _mm_movehl_ps(ones, uvs);                                       // x2 y2 1 1
+		uv_blocks[3] = _mm_shuffle_ps(uvs, self_uv_tl_br, _MM_SHUFFLE(3, 2, 1, 2));    // x2 y1 1 0
+		
+		// BL, TL, TR, BL, TR, BR
+		const u8 corner_of_vertex[6] = { 0, 1, 2, 0, 2, 3 };
+		__m128 *src = (__m128*)&corner;
+		for (u64 j = 0; j < 6; j++) {
+			__m128 *dst = (__m128*)&v[j];
+			for (u64 k = 0; k < chunk_count; k++) {
+				if      (k == position_chunk) _mm_store_ps((float*)&dst[k], positions[corner_of_vertex[j]]);
+				else if (k == uv_chunk)       _mm_store_ps((float*)&dst[k], uv_blocks[corner_of_vertex[j]]);
+				else                          _mm_store_ps((float*)&dst[k], src[k]);
+			}
+		}
+#else
+		Vector2 corners[4] = { q.bottom_left, q.top_left, q.top_right, q.bottom_right };
+		if (snap) {
+			for (u64 j = 0; j < 4; j++) {
+				corners[j].x = round(corners[j].x / pixel_width)  * pixel_width;
+				corners[j].y = round(corners[j].y / pixel_height) * pixel_height;
+			}
+		}
+		
+		Draw_Vertex *BL  = v + 0;
+		Draw_Vertex *TL  = v + 1;
+		Draw_Vertex *TR  = v + 2;
+		Draw_Vertex *BL2 = v + 3;
+		Draw_Vertex *TR2 = v + 4;
+		Draw_Vertex *BR  = v + 5;
+		
+		*BL = *TL = *TR = *BR = corner;
+		
+		BL->position = v4(corners[0].x, corners[0].y, 0, 1);
+		TL->position = v4(corners[1].x, corners[1].y, 0, 1);
+		TR->position = v4(corners[2].x, corners[2].y, 0, 1);
+		BR->position = v4(corners[3].x, corners[3].y, 0, 1);
+		
+		BL->uv = v2(uv.x1, uv.y1);
+		TL->uv = v2(uv.x1, uv.y2);
+		TR->uv = v2(uv.x2, uv.y2);
+		BR->uv = v2(uv.x2, uv.y1);
+		
+		BL->self_uv = v2(0, 0);
+		TL->self_uv = v2(0, 1);
+		TR->self_uv = v2(1, 1);
+		BR->self_uv = v2(1, 0);
+		
+		*BL2 = *BL;
+		*TR2 = *TR;
+#endif
+	}
+}
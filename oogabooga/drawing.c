@@ -5,6 +5,15 @@
 	void push_window_scissor(Vector2 min, Vector2 max);
 	void pop_window_scissor();
 	
+	// projection * inverse(camera_xform) is cached and only recomputed when
+	// projection or camera_xform change. Assigning draw_frame.projection or
+	// draw_frame.camera_xform directly still works, the setters just skip the
+	// change check.
+	void draw_frame_set_projection(Matrix4 projection);
+	void draw_frame_set_camera_xform(Matrix4 camera_xform);
+	Matrix4 draw_frame_get_world_to_clip();
+	Matrix4 draw_frame_get_clip_to_world(); // For picking
+	
 	Draw_Quad *draw_rect(Vector2 position, Vector2 size, Vector4 color);
 	Draw_Quad *draw_rect_xform(Matrix4 xform, Vector2 size, Vector4 color);
 	Draw_Quad *draw_circle(Vector2 position, Vector2 size, Vector4 color);
@@ -14,6 +23,14 @@
 	Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip);
 	Draw_Quad *draw_quad(Draw_Quad quad);
 	Draw_Quad *draw_quad_xform(Draw_Quad quad, Matrix4 xform);
+	
+	// Batched versions of the above. All quads share one matrix, corners are
+	// transformed and culled 4 at a time. Returns the number of quads that were
+	// not culled, those are appended to the frame in submission order.
+	u64 draw_quads_projected(Draw_Quad *quads, u64 count, Matrix4 world_to_clip);
+	u64 draw_quads(Draw_Quad *quads, u64 count);
+	u64 draw_quads_xform(Draw_Quad *quads, u64 count, Matrix4 xform);
+	
 	void draw_text_xform(Gfx_Font *font, string text, u32 raster_height, Matrix4 xform, Vector2 scale, Vector4 color);
 	void draw_text(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);
 	Gfx_Text_Metrics draw_text_and_measure(Gfx_Font *font, string text, u32 raster_height, Vector2 position, Vector2 scale, Vector4 color);
@@ -26,25 +43,43 @@
 #define Z_STACK_MAX 4096
 #define SCISSOR_STACK_MAX 4096
 
+// This is copied for every quad drawn and read again when the frame is rendered, so
+// keep it small. Things that are the same for lots of quads (like the scissor rect)
+// go in side tables in Draw_Frame and the quad only stores an index.
 typedef struct Draw_Quad {
 	// BEWARE !! These are in ndc
 	Vector2 bottom_left, top_left, top_right, bottom_right;
 	// r, g, b, a
 	Vector4 color;
+	// x1, y1, x2, y2
+	Vector4 uv;
 	Gfx_Image *image;
-	Gfx_Filter_Mode image_min_filter;
-	Gfx_Filter_Mode image_mag_filter;
 	s32 z;
+	// Index in draw_frame.scissor_buffer, 0 is no scissor
+	u32 scissor_index;
+	u8 image_min_filter; // Gfx_Filter_Mode
+	u8 image_mag_filter; // Gfx_Filter_Mode
 	u8 type;
-	bool has_scissor;
-	// x1, y1, x2, y2
-	Vector4 uv;
-	Vector4 scissor;
 	
 	Vector4 userdata[VERTEX_2D_USER_DATA_COUNT]; // #Volatile do NOT change this to a pointer
 	
 } Draw_Quad;
 
+// Packed 64 bit sort key for a Draw_Quad, see make_draw_quad_sort_key().
+// From most to least significant bits:
+//     z layer | texture id | sampler | scissor index
+// Sorting on just the z bits gives the draw order, the rest groups quads that can share
+// render state within a z layer. Texture id and scissor index are truncated, which can
+// only make grouping worse, never the draw order wrong.
+#define DRAW_KEY_SCISSOR_BITS 17
+#define DRAW_KEY_SAMPLER_BITS 2
+#define DRAW_KEY_TEXTURE_BITS 24
+#define DRAW_KEY_Z_BITS MAX_Z_BITS
+#define DRAW_KEY_SCISSOR_SHIFT 0
+#define DRAW_KEY_SAMPLER_SHIFT (DRAW_KEY_SCISSOR_SHIFT+DRAW_KEY_SCISSOR_BITS)
+#define DRAW_KEY_TEXTURE_SHIFT (DRAW_KEY_SAMPLER_SHIFT+DRAW_KEY_SAMPLER_BITS)
+#define DRAW_KEY_Z_SHIFT       (DRAW_KEY_TEXTURE_SHIFT+DRAW_KEY_TEXTURE_BITS)
+
 
 
 typedef struct Draw_Frame {
@@ -57,13 +92,27 @@ typedef struct Draw_Frame {
 	void *cbuffer;
 	
 	u64 scissor_count;
-	Vector4 scissor_stack[SCISSOR_STACK_MAX];
+	u32 scissor_stack[SCISSOR_STACK_MAX]; // Indices in scissor_buffer
 	
 	Draw_Quad *quad_buffer;
+	// Every scissor rect pushed this frame, Draw_Quad.scissor_index points in here.
+	// 0 is a dummy for quads without a scissor.
+	Vector4 *scissor_buffer;
 	
 	u64 z_count;
 	s32 z_stack[Z_STACK_MAX];
 	bool enable_z_sorting;
+	// Also sorts quads by image & filter modes within each z layer so fewer draw calls are
+	// needed. Implies z sorting. Quads that overlap a quad with a different image or filter
+	// mode are never moved past it, so blending looks the same as without state sorting.
+	bool enable_state_sorting;
+	
+	// Don't touch these, use draw_frame_get_world_to_clip() & draw_frame_get_clip_to_world()
+	Matrix4 world_to_clip;
+	Matrix4 clip_to_world;
+	Matrix4 cached_projection;
+	Matrix4 cached_camera_xform;
+	bool world_to_clip_dirty;
 	
 } Draw_Frame;
 
@@ -85,15 +134,57 @@ void reset_draw_frame(Draw_Frame *frame) {
 
 	Draw_Quad *quad_buffer = frame->quad_buffer;
 	if (quad_buffer) growing_array_clear((void**)&quad_buffer);
+	Vector4 *scissor_buffer = frame->scissor_buffer;
+	if (scissor_buffer) growing_array_clear((void**)&scissor_buffer);
 
 	*frame = (Draw_Frame){0};
 	
 	frame->quad_buffer = quad_buffer;
+	frame->scissor_buffer = scissor_buffer;
 	
 	float32 aspect = (float32)window.width/(float32)window.height;
 	
 	frame->projection = m4_make_orthographic_projection(-aspect, aspect, -1, 1, -1, 10);
 	frame->camera_xform = m4_scalar(1.0);
+	frame->world_to_clip_dirty = true;
+}
+
+void draw_frame_set_projection(Matrix4 projection) {
+	draw_frame.projection = projection;
+	draw_frame.world_to_clip_dirty = true;
+}
+void draw_frame_set_camera_xform(Matrix4 camera_xform) {
+	draw_frame.camera_xform = camera_xform;
+	draw_frame.world_to_clip_dirty = true;
+}
+
+void update_world_to_clip(Draw_Frame *frame) {
+	// projection & camera_xform are public fields that programs assign directly,
+	// so comparing against the last used ones is what actually catches changes.
+	// That's 128 bytes compared per quad instead of a general 4x4 inverse.
+	if (!frame->world_to_clip_dirty
+	 && bytes_match(&frame->projection, &frame->cached_projection, sizeof(Matrix4))
+	 && bytes_match(&frame->camera_xform, &frame->cached_camera_xform, sizeof(Matrix4))) {
+		return;
+	}
+	
+	frame->cached_projection   = frame->projection;
+	frame->cached_camera_xform = frame->camera_xform;
+	// Camera transforms and orthographic projections are affine, which has a much cheaper
+	// inverse. Anything else (like a perspective projection) gets the general one.
+	Matrix4 inverse_camera_xform = m4_is_affine(frame->camera_xform) ? m4_inverse_affine(frame->camera_xform) : m4_inverse(frame->camera_xform);
+	Matrix4 inverse_projection   = m4_is_affine(frame->projection)   ? m4_inverse_affine(frame->projection)   : m4_inverse(frame->projection);
+	frame->world_to_clip = m4_mul(frame->projection, inverse_camera_xform);
+	frame->clip_to_world = m4_mul(frame->camera_xform, inverse_projection);
+	frame->world_to_clip_dirty = false;
+}
+Matrix4 draw_frame_get_world_to_clip() {
+	update_world_to_clip(&draw_frame);
+	return draw_frame.world_to_clip;
+}
+Matrix4 draw_frame_get_clip_to_world() {
+	update_world_to_clip(&draw_frame);
+	return draw_frame.clip_to_world;
 }
 
 void push_z_layer(s32 z) {
@@ -110,7 +201,18 @@ void pop_z_layer() {
 void push_window_scissor(Vector2 min, Vector2 max) {
 	assert(draw_frame.scissor_count < SCISSOR_STACK_MAX, "Too many scissors pushed. You can pop with pop_window_scissor() when you are done drawing to it.");
 	
-	draw_frame.scissor_stack[draw_frame.scissor_count] = v4(min.x, min.y, max.x, max.y);
+	if (!draw_frame.scissor_buffer) {
+		growing_array_init((void**)&draw_frame.scissor_buffer, sizeof(Vector4), get_heap_allocator());
+	}
+	if (growing_array_get_valid_count(draw_frame.scissor_buffer) == 0) {
+		Vector4 no_scissor = v4(0, 0, 0, 0);
+		growing_array_add((void**)&draw_frame.scissor_buffer, &no_scissor);
+	}
+	
+	Vector4 scissor = v4(min.x, min.y, max.x, max.y);
+	growing_array_add((void**)&draw_frame.scissor_buffer, &scissor);
+	
+	draw_frame.scissor_stack[draw_frame.scissor_count] = growing_array_get_valid_count(draw_frame.scissor_buffer)-1;
 	draw_frame.scissor_count += 1;
 }
 void pop_window_scissor() {
@@ -142,11 +244,8 @@ Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip) {
 	quad.z = 0;
 	if (draw_frame.z_count > 0)  quad.z = draw_frame.z_stack[draw_frame.z_count-1];
 	
-	quad.has_scissor = false;
-	if (draw_frame.scissor_count > 0) {
-		quad.scissor = draw_frame.scissor_stack[draw_frame.scissor_count-1];
-		quad.has_scissor = true;
-	}
+	quad.scissor_index = 0;
+	if (draw_frame.scissor_count > 0) quad.scissor_index = draw_frame.scissor_stack[draw_frame.scissor_count-1];
 	
 	memset(quad.userdata, 0, sizeof(quad.userdata));
 	
@@ -163,17 +262,120 @@ Draw_Quad *draw_quad_projected(Draw_Quad quad, Matrix4 world_to_clip) {
 	return &(*target_buffer)[growing_array_get_valid_count(*target_buffer)-1];
 }
 Draw_Quad *draw_quad(Draw_Quad quad) {
-	return draw_quad_projected(quad, m4_mul(draw_frame.projection, m4_inverse(draw_frame.camera_xform)));
+	return draw_quad_projected(quad, draw_frame_get_world_to_clip());
 }
 
 Draw_Quad *draw_quad_xform(Draw_Quad quad, Matrix4 xform) {
-	Matrix4 world_to_clip = m4_scalar(1.0);
-	world_to_clip         = m4_mul(world_to_clip, draw_frame.projection);
-	world_to_clip         = m4_mul(world_to_clip, m4_inverse(draw_frame.camera_xform));
-	world_to_clip         = m4_mul(world_to_clip, xform);
+	Matrix4 world_to_clip = m4_mul(draw_frame_get_world_to_clip(), xform);
 	return draw_quad_projected(quad, world_to_clip);
 }
 
+u64 draw_quads_projected(Draw_Quad *quads, u64 count, Matrix4 world_to_clip) {
+	if (count == 0) return 0;
+	
+	if (!draw_frame.quad_buffer) {
+		// #Memory
+		// Use an arena
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), get_heap_allocator());
+	}
+	
+	u64 first = growing_array_get_valid_count(draw_frame.quad_buffer);
+	
+	// Reserve once for the whole batch, culled quads just leave slack at the end
+	growing_array_reserve((void**)&draw_frame.quad_buffer, first+count);
+	Draw_Quad *dst = draw_frame.quad_buffer + first;
+	
+	// This is the same for every quad in the batch
+	s32 z = 0;
+	if (draw_frame.z_count > 0)  z = draw_frame.z_stack[draw_frame.z_count-1];
+	u32 scissor_index = 0;
+	if (draw_frame.scissor_count > 0) scissor_index = draw_frame.scissor_stack[draw_frame.scissor_count-1];
+	
+	// Corners are 2D with z=0 and w=1, so only the x, y and translation
+	// columns of the two top rows of the matrix matter.
+#if ENABLE_SIMD
+	__m128 m00 = _mm_set1_ps(world_to_clip.m[0][0]);
+	__m128 m01 = _mm_set1_ps(world_to_clip.m[0][1]);
+	__m128 m03 = _mm_set1_ps(world_to_clip.m[0][3]);
+	__m128 m10 = _mm_set1_ps(world_to_clip.m[1][0]);
+	__m128 m11 = _mm_set1_ps(world_to_clip.m[1][1]);
+	__m128 m13 = _mm_set1_ps(world_to_clip.m[1][3]);
+	__m128 neg_one = _mm_set1_ps(-1.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+#endif
+	
+	u64 drawn = 0;
+	for (u64 i = 0; i < count; i++) {
+		Draw_Quad *src = &quads[i];
+		Draw_Quad *q = &dst[drawn];
+		
+#if ENABLE_SIMD
+		// bl.x bl.y tl.x tl.y | tr.x tr.y br.x br.y
+		__m128 a = _mm_loadu_ps(&src->bottom_left.x);
+		__m128 b = _mm_loadu_ps(&src->top_right.x);
+		__m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		
+		__m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), m03);
+		__m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), m13);
+		
+		// Cull if all 4 corners are outside of the same edge
+		bool should_cull = 
+		    _mm_movemask_ps(_mm_cmplt_ps(px, neg_one)) == 0xF ||
+		    _mm_movemask_ps(_mm_cmpgt_ps(px, one))     == 0xF ||
+		    _mm_movemask_ps(_mm_cmplt_ps(py, neg_one)) == 0xF ||
+		    _mm_movemask_ps(_mm_cmpgt_ps(py, one))     == 0xF;
+		
+		if (should_cull) continue;
+		
+		if (q != src) memcpy(q, src, offsetof(Draw_Quad, userdata));
+		
+		_mm_storeu_ps(&q->bottom_left.x, _mm_unpacklo_ps(px, py));
+		_mm_storeu_ps(&q->top_right.x,   _mm_unpackhi_ps(px, py));
+#else
+		const Matrix4 *m = &world_to_clip;
+		float32 px[4], py[4];
+		Vector2 *corners = &src->bottom_left;
+		for (int c = 0; c < 4; c++) {
+			px[c] = m->m[0][0]*corners[c].x + m->m[0][1]*corners[c].y + m->m[0][3];
+			py[c] = m->m[1][0]*corners[c].x + m->m[1][1]*corners[c].y + m->m[1][3];
+		}
+		
+		bool should_cull = 
+		    (px[0] < -1 && px[1] < -1 && px[2] < -1 && px[3] < -1) ||
+		    (px[0] >  1 && px[1] >  1 && px[2] >  1 && px[3] >  1) ||
+		    (py[0] < -1 && py[1] < -1 && py[2] < -1 && py[3] < -1) ||
+		    (py[0] >  1 && py[1] >  1 && py[2] >  1 && py[3] >  1);
+		
+		if (should_cull) continue;
+		
+		if (q != src) memcpy(q, src, offsetof(Draw_Quad, userdata));
+		
+		Vector2 *out = &q->bottom_left;
+		for (int c = 0; c < 4; c++) out[c] = v2(px[c], py[c]);
+#endif
+		
+		q->image_min_filter = GFX_FILTER_MODE_NEAREST;
+		q->image_mag_filter = GFX_FILTER_MODE_NEAREST;
+		q->z = z;
+		q->scissor_index = scissor_index;
+		memset(q->userdata, 0, sizeof(q->userdata));
+		
+		drawn += 1;
+	}
+	
+	growing_array_resize((void**)&draw_frame.quad_buffer, first+drawn);
+	
+	return drawn;
+}
+u64 draw_quads(Draw_Quad *quads, u64 count) {
+	return draw_quads_projected(quads, count, draw_frame_get_world_to_clip());
+}
+u64 draw_quads_xform(Draw_Quad *quads, u64 count, Matrix4 xform) {
+	Matrix4 world_to_clip = m4_mul(draw_frame_get_world_to_clip(), xform);
+	return draw_quads_projected(quads, count, world_to_clip);
+}
+
 Draw_Quad *draw_rect(Vector2 position, Vector2 size, Vector4 color) {
 	// #Copypaste #Volatile	
 	const float32 left   = position.x;
@@ -318,6 +520,249 @@ void draw_line(Vector2 p0, Vector2 p1, float line_width, Vector4 color) {
 	draw_rect_xform(line_xform, v2(length, line_width), color);
 }
 
+// #Volatile order of samplers in the renderer
+u8 get_draw_quad_sampler(Draw_Quad *q) {
+	if (q->image_min_filter == GFX_FILTER_MODE_NEAREST && q->image_mag_filter == GFX_FILTER_MODE_NEAREST) return 0;
+	if (q->image_min_filter == GFX_FILTER_MODE_LINEAR  && q->image_mag_filter == GFX_FILTER_MODE_LINEAR)  return 1;
+	if (q->image_min_filter == GFX_FILTER_MODE_LINEAR  && q->image_mag_filter == GFX_FILTER_MODE_NEAREST) return 2;
+	return 3;
+}
+
+u64 make_draw_quad_sort_key(Draw_Quad *q) {
+	// Biased so the lowest z is 0, MAX_Z_BITS fits -MAX_Z+1 to MAX_Z
+	u64 z = (u64)(q->z + MAX_Z - 1);
+	
+	// Only used to group quads with the same image, so the address works as an id
+	u64 texture_id = 0;
+	u64 sampler = 0;
+	if (q->image) {
+		texture_id = ((u64)q->image >> 4) | 1;
+		sampler = get_draw_quad_sampler(q);
+	}
+	
+	return ((z          & ((1ULL << DRAW_KEY_Z_BITS)-1))       << DRAW_KEY_Z_SHIFT)
+	     | ((texture_id & ((1ULL << DRAW_KEY_TEXTURE_BITS)-1)) << DRAW_KEY_TEXTURE_SHIFT)
+	     | ((sampler    & ((1ULL << DRAW_KEY_SAMPLER_BITS)-1)) << DRAW_KEY_SAMPLER_SHIFT)
+	     | (((u64)q->scissor_index & ((1ULL << DRAW_KEY_SCISSOR_BITS)-1)) << DRAW_KEY_SCISSOR_SHIFT);
+}
+
+// Coarse grid over ndc for finding overlapping quads while state sorting, see
+// draw_frame_sort_quads. Each cell remembers which state (image & sampler) drew in it in
+// the current run. Cells from earlier runs count as empty so new runs don't need a clear.
+#define DRAW_SORT_GRID_SIZE 64
+#define DRAW_SORT_GRID_MIXED 0xFFFFFFFF
+typedef struct Draw_Sort_Cell {
+	u32 run; // Runs start at 1, so a zeroed grid is empty
+	u32 state; // DRAW_SORT_GRID_MIXED if quads with different states drew here
+} Draw_Sort_Cell;
+
+// Makes a sort key for every quad in the frame and sorts the keys by z. order then has
+// the quad indices in the order they should be drawn, quads in the same z layer keep the
+// order they were drawn in. The quads themselves are not moved.
+// With frame->enable_state_sorting, quads in a z layer are also grouped by image &
+// sampler, but only within runs of quads where no quad overlaps an earlier quad with a
+// different image or sampler. Those could blend differently if swapped, so they stay in
+// submission order. keys are only scratch space then and don't hold the quad keys anymore.
+// keys & key_buffer need space for a u64 per quad, order & order_buffer a u32 per quad.
+void draw_frame_sort_quads(Draw_Frame *frame, u64 *keys, u64 *key_buffer, u32 *order, u32 *order_buffer) {
+	if (!frame->quad_buffer) return;
+	u64 quad_count = growing_array_get_valid_count(frame->quad_buffer);
+	if (quad_count == 0) return;
+	
+	for (u64 i = 0; i < quad_count; i++) {
+		keys[i] = make_draw_quad_sort_key(&frame->quad_buffer[i]);
+		order[i] = (u32)i;
+	}
+	
+	// #Incomplete parallel_radix_sort_keys is a drop in for both sorts here, but it stays
+	// out of the renderer until it's been shown to scale on real multi core machines.
+	radix_sort_keys(keys, order, key_buffer, order_buffer, quad_count, DRAW_KEY_Z_SHIFT, DRAW_KEY_Z_BITS);
+	
+	if (!frame->enable_state_sorting) return;
+	
+	// Split every z layer in runs where quads with different states don't overlap, then
+	// replace the z bits with the run index so one more stable sort groups by state
+	// within each run. Overlap is checked on the grid cells the quad bounds touch, which
+	// can only end runs too early, never let overlapping quads swap.
+	const u64 STATE_SHIFT = DRAW_KEY_SAMPLER_SHIFT;
+	const u64 STATE_BITS = DRAW_KEY_Z_SHIFT-DRAW_KEY_SAMPLER_SHIFT;
+	const u64 STATE_MASK = (1ULL << STATE_BITS)-1;
+	const float32 CELLS_PER_NDC = DRAW_SORT_GRID_SIZE*0.5f;
+	
+	Draw_Sort_Cell grid[DRAW_SORT_GRID_SIZE*DRAW_SORT_GRID_SIZE];
+	memset(grid, 0, sizeof(grid));
+	
+	u32 run = 1;
+	u64 last_z = keys[0] >> DRAW_KEY_Z_SHIFT;
+	
+	for (u64 i = 0; i < quad_count; i++) {
+		Draw_Quad *q = &frame->quad_buffer[order[i]];
+		u64 z = keys[i] >> DRAW_KEY_Z_SHIFT;
+		u32 state = (u32)((keys[i] >> STATE_SHIFT) & STATE_MASK);
+		
+		float32 min_x = min(min(q->bottom_left.x, q->top_left.x), min(q->top_right.x, q->bottom_right.x));
+		float32 min_y = min(min(q->bottom_left.y, q->top_left.y), min(q->top_right.y, q->bottom_right.y));
+		float32 max_x = max(max(q->bottom_left.x, q->top_left.x), max(q->top_right.x, q->bottom_right.x));
+		float32 max_y = max(max(q->bottom_left.y, q->top_left.y), max(q->top_right.y, q->bottom_right.y));
+		
+		// Anything off screen lands in the border cells
+		s64 x0 = min((s64)((clamp(min_x, -1.0f, 1.0f)+1.0f)*CELLS_PER_NDC), DRAW_SORT_GRID_SIZE-1);
+		s64 y0 = min((s64)((clamp(min_y, -1.0f, 1.0f)+1.0f)*CELLS_PER_NDC), DRAW_SORT_GRID_SIZE-1);
+		s64 x1 = min((s64)((clamp(max_x, -1.0f, 1.0f)+1.0f)*CELLS_PER_NDC), DRAW_SORT_GRID_SIZE-1);
+		s64 y1 = min((s64)((clamp(max_y, -1.0f, 1.0f)+1.0f)*CELLS_PER_NDC), DRAW_SORT_GRID_SIZE-1);
+		
+		bool new_run = z != last_z;
+		for (s64 y = y0; y <= y1 && !new_run; y++) {
+			for (s64 x = x0; x <= x1; x++) {
+				Draw_Sort_Cell *c = &grid[y*DRAW_SORT_GRID_SIZE + x];
+				if (c->run == run && c->state != state) {
+					new_run = true;
+					break;
+				}
+			}
+		}
+		if (new_run) {
+			run += 1;
+			last_z = z;
+		}
+		
+		for (s64 y = y0; y <= y1; y++) {
+			for (s64 x = x0; x <= x1; x++) {
+				Draw_Sort_Cell *c = &grid[y*DRAW_SORT_GRID_SIZE + x];
+				if (c->run != run) {
+					c->run = run;
+					c->state = state;
+				} else if (c->state != state) {
+					c->state = DRAW_SORT_GRID_MIXED;
+				}
+			}
+		}
+		
+		keys[i] = ((u64)run << STATE_BITS) | state;
+	}
+	
+	u64 run_bits = 0;
+	while ((1ULL << run_bits) <= run) run_bits += 1;
+	radix_sort_keys(keys, order, key_buffer, order_buffer, quad_count, 0, STATE_BITS+run_bits);
+}
+
+// #Volatile number of textures the 2D shader can sample from
+#define DRAW_BATCH_MAX_TEXTURES 32
+
+// Quads that can go in one draw call
+typedef struct Draw_Batch {
+	u64 first_quad; // In draw order
+	u64 quad_count;
+	Gfx_Handle textures[DRAW_BATCH_MAX_TEXTURES];
+	u64 texture_count;
+} Draw_Batch;
+
+// Which slot a texture has in the current batch. Entries from earlier batches count as
+// empty so starting a new batch doesn't need to clear the table.
+// 4 times the number of slots so probes stay short.
+#define DRAW_TEXTURE_SLOT_TABLE_SIZE (DRAW_BATCH_MAX_TEXTURES*4)
+typedef struct Draw_Texture_Slot {
+	Gfx_Handle texture;
+	u64 batch; // Batch index + 1
+	s8 slot;
+} Draw_Texture_Slot;
+
+// Splits the frame's quads in batches that each fit in one draw call, in the order given
+// (order from draw_frame_sort_quads or 0 for the order they were drawn in).
+// texture_indices gets the texture slot in its batch for each quad in draw order, -1 for
+// quads without an image.
+// Returns a growing array of batches allocated with allocator.
+Draw_Batch *draw_frame_make_batches(Draw_Frame *frame, u32 *order, s8 *texture_indices, Allocator allocator) {
+	Draw_Batch *batches = 0;
+	growing_array_init_reserve((void**)&batches, sizeof(Draw_Batch), 4, allocator);
+	
+	u64 quad_count = frame->quad_buffer ? growing_array_get_valid_count(frame->quad_buffer) : 0;
+	if (quad_count == 0) return batches;
+	
+	Draw_Batch *batch = growing_array_add_empty((void**)&batches);
+	*batch = ZERO(Draw_Batch);
+	u64 batch_id = 1;
+	
+	Draw_Texture_Slot slots[DRAW_TEXTURE_SLOT_TABLE_SIZE];
+	memset(slots, 0, sizeof(slots));
+	
+	Gfx_Handle last_texture = 0;
+	s8 last_texture_index = -1;
+	
+	for (u64 i = 0; i < quad_count; i++)  {
+		
+		Draw_Quad *q = &frame->quad_buffer[order ? order[i] : i];
+		
+		assert(q->z <= MAX_Z, "Z is too high. Z is %d, Max is %d.", q->z, MAX_Z);
+		assert(q->z >= (-MAX_Z+1), "Z is too low. Z is %d, Min is %d.", q->z, -MAX_Z+1);
+		
+		s8 texture_index = -1;
+		
+		if (q->image) {
+			Gfx_Handle texture = q->image->gfx_handle;
+			
+			if (texture == last_texture && last_texture_index >= 0) {
+				texture_index = last_texture_index;
+			} else {
+				u64 mask = DRAW_TEXTURE_SLOT_TABLE_SIZE-1;
+				u64 h = xx_hash((u64)texture) & mask;
+				while (slots[h].batch == batch_id && slots[h].texture != texture) h = (h+1) & mask;
+				
+				if (slots[h].batch == batch_id) {
+					texture_index = slots[h].slot;
+				} else {
+					if (batch->texture_count >= DRAW_BATCH_MAX_TEXTURES) {
+						// Out of texture slots, start a new batch which gets its own draw call
+						batch = growing_array_add_empty((void**)&batches);
+						*batch = ZERO(Draw_Batch);
+						batch->first_quad = i;
+						batch_id += 1;
+						
+						// Every slot is stale now
+						h = xx_hash((u64)texture) & mask;
+					}
+					texture_index = (s8)batch->texture_count;
+					batch->textures[texture_index] = texture;
+					batch->texture_count += 1;
+					
+					slots[h].texture = texture;
+					slots[h].batch = batch_id;
+					slots[h].slot = texture_index;
+				}
+			}
+			last_texture = texture;
+			last_texture_index = texture_index;
+		}
+		
+		texture_indices[i] = texture_index;
+		batch->quad_count += 1;
+	}
+	
+	return batches;
+}
+
+// Draw_Vertex_Get_Quad_Proc for an array of Draw_Quads, see draw_vertex.c
+void get_draw_quad_vertex_quad(void *quads, u64 index, Draw_Vertex_Quad *out) {
+	Draw_Quad *q = &((Draw_Quad*)quads)[index];
+	
+	memcpy(&out->bottom_left, &q->bottom_left, sizeof(Vector2)*4);
+	out->color = q->color;
+	out->userdata = q->userdata;
+	out->scissor_index = q->scissor_index;
+	out->type = q->type;
+	if (q->image) {
+		out->uv = q->uv;
+		out->image_width = q->image->width;
+		out->image_height = q->image->height;
+		out->sampler = get_draw_quad_sampler(q);
+	} else {
+		out->uv = v4(0, 0, 0, 0);
+		out->image_width = 0;
+		out->image_height = 0;
+		out->sampler = 0;
+	}
+}
+
 #define COLOR_RED   ((Vector4){1.0, 0.0, 0.0, 1.0})
 #define COLOR_GREEN ((Vector4){0.0, 1.0, 0.0, 1.0})
 #define COLOR_BLUE  ((Vector4){0.0, 0.0, 1.0, 1.0})
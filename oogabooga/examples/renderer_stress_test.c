@@ -93,12 +93,17 @@ int entry(int argc, char **argv) {
 		
 		Vector2 cam_move = v2_mulf(cam_move_axis, delta * cam_move_speed);
 		camera_xform = m4_translate(camera_xform, v3(v2_expand(cam_move), 0));
-		draw_frame.camera_xform = camera_xform;
+		draw_frame_set_camera_xform(camera_xform);
 		
 		local_persist bool do_enable_z_sorting = false;
 		draw_frame.enable_z_sorting = do_enable_z_sorting;
 		if (is_key_just_pressed('Z')) do_enable_z_sorting = !do_enable_z_sorting;
 		
+		// Press B to also sort by texture & sampler within each z layer
+		local_persist bool do_enable_state_sorting = false;
+		draw_frame.enable_state_sorting = do_enable_state_sorting;
+		if (is_key_just_pressed('B')) do_enable_state_sorting = !do_enable_state_sorting;
+		
 		if (do_enable_z_sorting) {
 			push_window_scissor(
 				v2(input_frame.mouse_x-256, input_frame.mouse_y-256), 
@@ -106,8 +111,18 @@ int entry(int argc, char **argv) {
 			);
 		}
 
+		// Press C to invalidate the cached world to clip matrix before each quad,
+		// which is what every draw_quad used to cost (a full m4_inverse per quad).
+		local_persist bool invalidate_world_to_clip_per_quad = false;
+		if (is_key_just_pressed('C')) invalidate_world_to_clip_per_quad = !invalidate_world_to_clip_per_quad;
+		
+		const u64 bush_count = 10000;
+		u64 bush_start_cycles = rdtsc();
+		
 		seed_for_random = 69;
-		for (u64 i = 0; i < 10000; i++) {
+		for (u64 i = 0; i < bush_count; i++) {
+			if (invalidate_world_to_clip_per_quad) draw_frame_set_camera_xform(camera_xform);
+			
 			float32 aspect = (float32)window.width/(float32)window.height;
 			float min_x = -aspect;
 			float max_x = aspect;
@@ -121,13 +136,14 @@ int entry(int argc, char **argv) {
 			draw_image(bush_image, v2(x, y), v2(0.1, 0.1), COLOR_WHITE);
 			pop_z_layer();
 		}
+		u64 bush_cycles = rdtsc()-bush_start_cycles;
 		seed_for_random = rdtsc();
 		
 		
 		draw_image(bush_image, v2(0.65, 0.65), v2(0.2*sin(now), 0.2*sin(now)), COLOR_WHITE);
 		
 		u32 atlas_index = 0;
-		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_find(&font->variations[32].atlases, atlas_index);
+		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)swiss_table_find(&font->variations[32].atlases, atlas_index);
 		
 		draw_text(font, STR("I am text"), 128, v2(sin(now), -0.61), v2(0.001, 0.001), COLOR_BLACK);
 		draw_text(font, STR("I am text"), 128, v2(sin(now)-0.01, -0.6), v2(0.001, 0.001), COLOR_WHITE);
@@ -161,6 +177,8 @@ int entry(int argc, char **argv) {
 		if (is_key_just_released('E')) {
 			log("FPS: %.2f", 1.0 / delta);
 			log("ms: %.2f", delta*1000.0);
+			log("%.1f cycles per bush quad, world to clip %cs", (float64)bush_cycles/(float64)bush_count, invalidate_world_to_clip_per_quad ? "recomputed per quad" : "cached");
+			log("%llu quads, %llu draw calls, %llu texture flushes, state sorting %cs", gfx_stats.quad_count, gfx_stats.draw_call_count, gfx_stats.texture_flush_count, do_enable_state_sorting ? "on" : "off");
 		}
 	}
 
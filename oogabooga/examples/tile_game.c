@@ -83,8 +83,6 @@ int entry(int argc, char **argv) {
 }
 
 Vector2 screen_to_world(Vector2 screen) {
-	Matrix4 proj = draw_frame.projection;
-	Matrix4 cam = draw_frame.camera_xform;
 	float window_w = window.width;
 	float window_h = window.height;
 
@@ -94,8 +92,7 @@ Vector2 screen_to_world(Vector2 screen) {
 
 	// Transform to world coordinates
 	Vector4 world_pos = v4(ndc_x, ndc_y, 0, 1);
-	world_pos = m4_transform(m4_inverse(proj), world_pos);
-	world_pos = m4_transform(cam, world_pos);
+	world_pos = m4_transform(draw_frame_get_clip_to_world(), world_pos);
 	
 	return world_pos.xy;
 }
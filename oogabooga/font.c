@@ -96,7 +96,7 @@ typedef struct Gfx_Font_Variation {
 	Gfx_Font_Metrics metrics;
 	float scale;
 	u32 codepoint_range_per_atlas;
-	Hash_Table atlases; // u32 atlas_index, Gfx_Font_Atlas
+	Swiss_Table atlases; // u32 atlas_index, Gfx_Font_Atlas
 	bool initted;
 } Gfx_Font_Variation;
 typedef struct Gfx_Font {
@@ -138,13 +138,14 @@ void destroy_font(Gfx_Font *font) {
 		Gfx_Font_Variation *variation = &font->variations[i];
 		if (!variation->initted) continue;
 		
-		for (u64 j = 0; j < variation->atlases.count; j++) {
-			Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_get_nth_value(&variation->atlases, j);
+		u64 cursor = 0;
+		Gfx_Font_Atlas *atlas;
+		while (swiss_table_iterate(&variation->atlases, &cursor, 0, (void**)&atlas)) {
 			delete_image(atlas->image);
 			dealloc(font->allocator, atlas->glyphs);
 		}
 		
-		hash_table_destroy(&variation->atlases);
+		swiss_table_destroy(&variation->atlases);
 		
 	}
 
@@ -164,7 +165,7 @@ void font_variation_init(Gfx_Font_Variation *variation, Gfx_Font *font, u32 font
 	
 	variation->codepoint_range_per_atlas = x_range*y_range;
 	
-	variation->atlases = make_hash_table(u32, Gfx_Font_Atlas, font->allocator);
+	variation->atlases = make_swiss_table(u32, Gfx_Font_Atlas, font->allocator);
 	
 	variation->scale = stbtt_ScaleForPixelHeight(&font->stbtt_handle, (float)font_height);
 	
@@ -270,10 +271,10 @@ void render_atlas_if_not_yet_rendered(Gfx_Font *font, u32 font_height, u32 codep
 	
 	u32 atlas_index = codepoint / variation->codepoint_range_per_atlas;
 	
-	if (!hash_table_contains(&variation->atlases, atlas_index)) {
+	if (!swiss_table_contains(&variation->atlases, atlas_index)) {
 		Gfx_Font_Atlas atlas = ZERO(Gfx_Font_Atlas);
 		font_atlas_init(&atlas, variation, atlas_index*variation->codepoint_range_per_atlas);
-		hash_table_add(&variation->atlases, atlas_index, atlas);
+		swiss_table_add(&variation->atlases, atlas_index, atlas);
 	}
 }
 
@@ -313,7 +314,7 @@ void walk_glyphs(Walk_Glyphs_Spec spec, Walk_Glyphs_Callback_Proc proc) {
 		
 		u32 atlas_index = c/variation->codepoint_range_per_atlas;
 		
-		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)hash_table_find(&variation->atlases, atlas_index);
+		Gfx_Font_Atlas *atlas = (Gfx_Font_Atlas*)swiss_table_find(&variation->atlases, atlas_index);
 		Gfx_Glyph glyph = atlas->glyphs[c-atlas->first_codepoint];
 		
 		float glyph_x = x+glyph.xoffset*spec.scale.x;
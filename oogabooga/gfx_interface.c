@@ -16,10 +16,6 @@
 #endif
 
 
-#ifndef VERTEX_2D_USER_DATA_COUNT
-	#define VERTEX_2D_USER_DATA_COUNT 1
-#endif
-
 ogb_instance const Gfx_Handle GFX_INVALID_HANDLE;
 // #Volatile reflected in 2D batch shader
 #define QUAD_TYPE_REGULAR 0
@@ -37,6 +33,20 @@ typedef struct Gfx_Image {
 	Allocator allocator;
 } Gfx_Image;
 
+typedef struct Gfx_Frame_Stats {
+	u64 quad_count;
+	u64 draw_call_count;
+	// Draw calls that had to be started because every texture slot was in use
+	u64 texture_flush_count;
+} Gfx_Frame_Stats;
+
+// Stats for the last frame rendered in gfx_update()
+ogb_instance Gfx_Frame_Stats gfx_stats;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Gfx_Frame_Stats gfx_stats;
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
 Gfx_Image *
 make_image(u32 width, u32 height, u32 channels, void *initial_data, Allocator allocator);
 Gfx_Image *
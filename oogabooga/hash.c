@@ -25,7 +25,14 @@ static inline u64 city_hash(string s) {
     u64 c = 9;
     u64 d = b;
 
-    if (s.count <= 16) {
+    if (s.count < 8) {
+        // Don't read past the end of short strings, that would make the hash
+        // depend on whatever memory comes after the string data.
+        u64 bytes = 0;
+        memcpy(&bytes, s.data, s.count);
+        a ^= bytes;
+        b ^= bytes;
+    } else if (s.count <= 16) {
         memcpy(&a, s.data, sizeof(u64));
         memcpy(&b, s.data + s.count - 8, sizeof(u64));
     } else {
@@ -1,6 +1,7 @@
 
-// Very naive implementation but it should be very cache efficient so it's alright
-// for non-excessive use for now.
+// Open addressing hash table with power-of-two capacity and triangular probing.
+// Entries are stored inline in one flat allocation so it stays cache friendly, and
+// find/set/remove are O(1) expected as long as we stay under the max load factor.
 
 /*
 
@@ -30,6 +31,24 @@
 		
 	}
 	
+	// Remove entry with key. Returns true if an entry was removed.
+	bool removed = hash_table_remove(&table, key);
+	
+	// Make sure there's room for 1000 entries without rehashing
+	hash_table_reserve(&table, 1000);
+	
+	// Iterate all entries. Empty and removed slots are skipped.
+	// It's OK to hash_table_remove() the current entry while iterating.
+	u64 cursor = 0;
+	string *it_key;
+	int *it_value;
+	while (hash_table_iterate(&table, &cursor, (void**)&it_key, (void**)&it_value)) {
+		
+	}
+	
+	// Shrink allocated entries down to what's needed for the current count
+	hash_table_shrink_to_fit(&table);
+	
 	// Reset all entries (but keep allocated memory)
 	hash_table_reset(&table);
 	
@@ -37,6 +56,13 @@
 	hash_table_destroy(&table);
 	
 	
+	Keys:
+		Keys are stored in the table and compared in full when the hash matches, so
+		colliding hashes can't alias each other. String keys are compared by content,
+		everything else by bytes.
+		For string keys we only store the string view (count & data pointer), NOT the
+		characters, so the string data needs to outlive the entry.
+	
 	Limitations:
 		- Key can only be a base type or pointer
 		- Key and value passed to the following function needs to be lvalues (we need to be able to take their addresses with '&'):
@@ -58,66 +84,127 @@
 
 typedef struct Hash_Table Hash_Table;
 
+typedef bool(*Hash_Table_Key_Compare_Proc)(void *a, void *b, u64 key_size);
+
+bool hash_table_keys_match_bytes(void *a, void *b, u64 key_size) {
+	return bytes_match(a, b, key_size);
+}
+bool hash_table_keys_match_string(void *a, void *b, u64 key_size) {
+	return strings_match(*(string*)a, *(string*)b);
+}
+
+#define get_hash_table_key_compare_proc(Key_Type) _Generic(((Key_Type){0}), \
+		    string: hash_table_keys_match_string, \
+		    default: hash_table_keys_match_bytes \
+		    )
+
 // API:
 #define make_hash_table_reserve(Key_Type, Value_Type, capacity_count, allocator) \
-	make_hash_table_reserve(sizeof(Key_Type), sizeof(Value_Type), capacity_count, allocator)
+	make_hash_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), capacity_count, get_hash_table_key_compare_proc(Key_Type), allocator)
 	
 #define make_hash_table(Key_Type, Value_Type, allocator) \
-	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), allocator)
+	make_hash_table_raw(sizeof(Key_Type), sizeof(Value_Type), get_hash_table_key_compare_proc(Key_Type), allocator)
 
 #define hash_table_add(table_ptr, key, value) \
 	hash_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
 
 #define hash_table_find(table_ptr, key) \
-	hash_table_find_raw((table_ptr), get_hash(key))
+	hash_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 	
 #define hash_table_contains(table_ptr, key) \
-	hash_table_contains_raw((table_ptr), get_hash(key))
+	hash_table_contains_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 	
 #define hash_table_set(table_ptr, key, value) \
 	hash_table_set_raw((table_ptr), get_hash(key), &key, &value, sizeof(key), sizeof(value))
+	
+#define hash_table_remove(table_ptr, key) \
+	hash_table_remove_raw((table_ptr), get_hash(key), &(key), sizeof(key))
 
 void hash_table_reserve(Hash_Table *t, u64 required_count);
 
+// We rehash to a bigger table when live entries + tombstones would exceed this
+// percentage of the capacity.
+#ifndef HASH_TABLE_MAX_LOAD_PERCENT
+	#define HASH_TABLE_MAX_LOAD_PERCENT 70
+#endif
+
+// The stored hash doubles as the slot state, so these two hashes are reserved.
+// Real hashes that collide with them are nudged up by HASH_TABLE_FIRST_VALID_HASH.
+#define HASH_TABLE_EMPTY_HASH       0
+#define HASH_TABLE_DELETED_HASH     1
+#define HASH_TABLE_FIRST_VALID_HASH 2
 
 typedef struct Hash_Table {
 	
 	// Each entry is hash-key-value
-	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes
+	// Hash is sizeof(u64) bytes, key is _key_size bytes and value is _value_size bytes.
+	// Key and value are each padded to 8 bytes.
 	void *entries; 
 	
 	u64 count; // Number of valid entries
-	u64 capacity_count; // Number of allocated entries
+	u64 capacity_count; // Number of allocated entries (always a power of two)
 	
 	u64 _key_size;
 	u64 _value_size;
 	
+	u64 _tombstone_count; // Number of removed entries still taking up a slot
+	
+	Hash_Table_Key_Compare_Proc _key_compare;
+	
 	Allocator allocator;
 } Hash_Table;
 
-Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Allocator allocator) {
+inline u64 hash_table_sanitize_hash(u64 hash) {
+	if (hash < HASH_TABLE_FIRST_VALID_HASH) hash += HASH_TABLE_FIRST_VALID_HASH;
+	return hash;
+}
+inline u64 hash_table_get_value_offset(Hash_Table *t) {
+	return sizeof(u64)+align_next(t->_key_size, 8);
+}
+inline u64 hash_table_get_entry_size(Hash_Table *t) {
+	return hash_table_get_value_offset(t)+align_next(t->_value_size, 8);
+}
+inline u64 *hash_table_get_slot_hash(Hash_Table *t, u64 slot) {
+	return (u64*)((u8*)t->entries+slot*hash_table_get_entry_size(t));
+}
+inline void *hash_table_get_slot_key(Hash_Table *t, u64 slot) {
+	return (u8*)t->entries+slot*hash_table_get_entry_size(t)+sizeof(u64);
+}
+inline void *hash_table_get_slot_value(Hash_Table *t, u64 slot) {
+	return (u8*)t->entries+slot*hash_table_get_entry_size(t)+hash_table_get_value_offset(t);
+}
+inline u64 hash_table_get_capacity_for_count(u64 count) {
+	u64 capacity = get_next_power_of_two((count*100+HASH_TABLE_MAX_LOAD_PERCENT-1)/HASH_TABLE_MAX_LOAD_PERCENT + 1);
+	return max(capacity, 8);
+}
 
-	capacity_count = min(capacity_count, 8);
+Hash_Table make_hash_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Hash_Table_Key_Compare_Proc key_compare, Allocator allocator) {
 
 	Hash_Table t = ZERO(Hash_Table);
 	
 	t._key_size = key_size;
 	t._value_size = value_size;
+	t._key_compare = key_compare ? key_compare : hash_table_keys_match_bytes;
 	t.allocator = allocator;
 	
-	u64 entry_size = value_size+sizeof(u64);
+	capacity_count = hash_table_get_capacity_for_count(capacity_count);
+	
+	u64 entry_size = hash_table_get_entry_size(&t);
 	t.entries = alloc(t.allocator, entry_size*capacity_count);
 	memset(t.entries, 0, entry_size*capacity_count);
 	t.capacity_count = capacity_count;
 	
 	return t;
 }
-inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Allocator allocator) {
-	return make_hash_table_reserve_raw(key_size, value_size, 128, allocator);
+inline Hash_Table make_hash_table_raw(u64 key_size, u64 value_size, Hash_Table_Key_Compare_Proc key_compare, Allocator allocator) {
+	return make_hash_table_reserve_raw(key_size, value_size, 64, key_compare, allocator);
 }
 
 void hash_table_reset(Hash_Table *t) {
+	// Slots are marked empty by a zero hash, so we need to clear them all
+	memset(t->entries, 0, t->capacity_count*hash_table_get_entry_size(t));
 	t->count = 0;
+	t->_tombstone_count = 0;
 }
 void hash_table_destroy(Hash_Table *t) {
 	dealloc(t->allocator, t->entries);
@@ -125,30 +212,106 @@ void hash_table_destroy(Hash_Table *t) {
 	t->entries = 0;
 	t->count = 0;
 	t->capacity_count = 0;
+	t->_tombstone_count = 0;
 }
 
-void hash_table_reserve(Hash_Table *t, u64 required_count) {
-	u64 entry_size = t->_value_size+sizeof(u64);
+// Returns the slot for the key, or the slot where it should be inserted if it does
+// not exist (the first tombstone on the probe sequence, otherwise the empty slot we
+// stopped at).
+// We probe with triangular numbers (1, 3, 6, 10, ...) which visits every slot
+// exactly once when the capacity is a power of two.
+u64 hash_table_probe(Hash_Table *t, u64 hash, void *k, bool *found) {
+	u64 mask = t->capacity_count-1;
+	u64 slot = hash & mask;
+	u64 first_tombstone = UINT64_MAX;
+	
+	for (u64 step = 1; step <= t->capacity_count; step += 1) {
+		u64 existing_hash = *hash_table_get_slot_hash(t, slot);
+		
+		if (existing_hash == hash && t->_key_compare(hash_table_get_slot_key(t, slot), k, t->_key_size)) {
+			*found = true;
+			return slot;
+		}
+		if (existing_hash == HASH_TABLE_EMPTY_HASH) {
+			*found = false;
+			return first_tombstone != UINT64_MAX ? first_tombstone : slot;
+		}
+		if (existing_hash == HASH_TABLE_DELETED_HASH && first_tombstone == UINT64_MAX) {
+			first_tombstone = slot;
+		}
+		
+		slot = (slot+step) & mask;
+	}
 	
-	u64 required_size = required_count*entry_size;
+	// Only reachable if every slot is a tombstone or taken, which the load factor
+	// should prevent.
+	assert(first_tombstone != UINT64_MAX, "Internal hash table error: table is full");
+	*found = false;
+	return first_tombstone;
+}
+
+void hash_table_rehash(Hash_Table *t, u64 new_capacity) {
+	assert(new_capacity && (new_capacity & (new_capacity-1)) == 0, "Hash table capacity must be a power of two");
 	
-	u64 current_size = t->capacity_count*entry_size;
+	u64 entry_size = hash_table_get_entry_size(t);
 	
-	if (current_size >= required_size) return;
+	void *old_entries = t->entries;
+	u64 old_capacity = t->capacity_count;
 	
-	u64 new_count = get_next_power_of_two(required_count);
-	u64 new_size = new_count*entry_size;
+	t->entries = alloc(t->allocator, new_capacity*entry_size);
+	memset(t->entries, 0, new_capacity*entry_size);
+	t->capacity_count = new_capacity;
+	t->_tombstone_count = 0;
 	
-	void *new_entries = alloc(t->allocator, new_size);
-	memcpy(new_entries, t->entries, current_size);
+	for (u64 i = 0; i < old_capacity; i += 1) {
+		u8 *entry = (u8*)old_entries+i*entry_size;
+		u64 hash = *(u64*)entry;
+		if (hash < HASH_TABLE_FIRST_VALID_HASH) continue;
+		
+		// No need to look for duplicates, just take the first free slot
+		u64 mask = new_capacity-1;
+		u64 slot = hash & mask;
+		for (u64 step = 1; *hash_table_get_slot_hash(t, slot) != HASH_TABLE_EMPTY_HASH; step += 1) {
+			slot = (slot+step) & mask;
+		}
+		memcpy((u8*)t->entries+slot*entry_size, entry, entry_size);
+	}
 	
-	dealloc(t->allocator, t->entries);
+	if (old_entries) dealloc(t->allocator, old_entries);
+}
+
+// Makes sure required_count entries fit without exceeding the max load factor.
+// Also cleans out tombstones if they are the reason we ran out of room.
+void hash_table_reserve(Hash_Table *t, u64 required_count) {
+	u64 used_count = required_count + t->_tombstone_count;
+	
+	if (used_count*100 <= t->capacity_count*HASH_TABLE_MAX_LOAD_PERCENT) return;
+	
+	u64 new_capacity = max(hash_table_get_capacity_for_count(required_count), t->capacity_count);
+	
+	hash_table_rehash(t, new_capacity);
+}
+
+// Rehashes into the smallest capacity that fits the current count.
+// Tables only grow by themselves, so call this after removing lots of entries
+// if you want the memory back.
+void hash_table_shrink_to_fit(Hash_Table *t) {
+	u64 new_capacity = hash_table_get_capacity_for_count(t->count);
+	if (new_capacity >= t->capacity_count && t->_tombstone_count == 0) return;
+	
+	hash_table_rehash(t, min(new_capacity, t->capacity_count));
+}
+
+inline void hash_table_write_slot(Hash_Table *t, u64 slot, u64 hash, void *k, void *v) {
+	u64 *slot_hash = hash_table_get_slot_hash(t, slot);
+	if (*slot_hash == HASH_TABLE_DELETED_HASH) t->_tombstone_count -= 1;
 	
-	t->entries = new_entries;
-	t->capacity_count = new_count;
+	*slot_hash = hash;
+	memcpy(hash_table_get_slot_key(t, slot), k, t->_key_size);
+	memcpy(hash_table_get_slot_value(t, slot), v, t->_value_size);
 }
 
-// This can add multiple entries of same hash, beware!
+// This can add multiple entries of same key, beware!
 void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
 
 	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
@@ -156,63 +319,110 @@ void hash_table_add_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size,
 
 	hash_table_reserve(t, t->count+1);
 	
-	u64 entry_size = t->_value_size+sizeof(u64);
+	hash = hash_table_sanitize_hash(hash);
 	
-	u64 index = entry_size*t->count;
-	t->count += 1;
-	
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	// Take the first free slot in the probe sequence, even if the key already exists
+	u64 mask = t->capacity_count-1;
+	u64 slot = hash & mask;
+	for (u64 step = 1; *hash_table_get_slot_hash(t, slot) >= HASH_TABLE_FIRST_VALID_HASH; step += 1) {
+		slot = (slot+step) & mask;
+	}
 	
-	memcpy((u8*)t->entries+index+hash_offset,  &hash, sizeof(u64));
-	memcpy((u8*)t->entries+index+value_offset, v,     value_size);
+	hash_table_write_slot(t, slot, hash, k, v);
+	t->count += 1;
 }
 
-void *hash_table_find_raw(Hash_Table *t, u64 hash) {
+void *hash_table_find_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
 
-	// #Speed #Incomplete
-	// Do quadratic probe 'triangular numbers'
+	if (t->count == 0) return 0;
 
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	bool found;
+	u64 slot = hash_table_probe(t, hash_table_sanitize_hash(hash), k, &found);
 	
-	for (u64 i = 0; i < t->count; i += 1) {
-		u64 existing_hash = *(u64*)((u8*)t->entries+i*entry_size+hash_offset);
-		if (existing_hash == hash) {
-			void *value = ((u8*)t->entries+i*entry_size+value_offset);
-			return value;
-		}
+	if (!found) return 0;
+	
+	return hash_table_get_slot_value(t, slot);
+}
+
+// Walks valid entries in slot order. Start with *cursor = 0 and keep calling until
+// it returns false. key_ptr and value_ptr may be null if you don't need them.
+// It's OK to remove the current entry while iterating, but adding entries may
+// rehash the table and invalidate the cursor.
+bool hash_table_iterate(Hash_Table *t, u64 *cursor, void **key_ptr, void **value_ptr) {
+	while (*cursor < t->capacity_count) {
+		u64 slot = *cursor;
+		*cursor += 1;
+		
+		if (*hash_table_get_slot_hash(t, slot) < HASH_TABLE_FIRST_VALID_HASH) continue;
+		
+		if (key_ptr)   *key_ptr   = hash_table_get_slot_key(t, slot);
+		if (value_ptr) *value_ptr = hash_table_get_slot_value(t, slot);
+		return true;
 	}
-	return 0;
+	return false;
 }
 
+// Slow, O(capacity). Prefer hash_table_iterate() to walk all entries.
 void *hash_table_get_nth_value(Hash_Table *t, u64 n) {
 	assert(n < t->count, "Hash table n is out of range");
 	
-	u64 entry_size = t->_value_size+sizeof(u64);
-	u64 hash_offset = 0;
-	u64 value_offset = hash_offset + sizeof(u64);
+	u64 cursor = 0;
+	void *value = 0;
+	while (hash_table_iterate(t, &cursor, 0, &value)) {
+		if (n == 0) return value;
+		n -= 1;
+	}
 	
-	return (u8*)t->entries+entry_size*n+value_offset;
+	assert(false, "Internal hash table error: count does not match occupied slots");
+	return 0;
 }
 
-bool hash_table_contains_raw(Hash_Table *t, u64 hash) {
-	return hash_table_find_raw(t, hash) != 0;
+bool hash_table_contains_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+	return hash_table_find_raw(t, hash, k, key_size) != 0;
 }
 
 // Returns true if key was newly added or false if it already existed
 bool hash_table_set_raw(Hash_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
-	bool newly_added = true;
+
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+	assert(t->_value_size == value_size, "Value type size does not match hash table initted value type size");
+	
+	// Reserve before probing so the slot we get stays valid
+	hash_table_reserve(t, t->count+1);
 	
-	if (hash_table_contains_raw(t, hash)) newly_added = false;
+	hash = hash_table_sanitize_hash(hash);
 	
-	if (newly_added) {
-		hash_table_add_raw(t, hash, k, v, key_size, value_size);
+	bool found;
+	u64 slot = hash_table_probe(t, hash, k, &found);
+	
+	if (found) {
+		memcpy(hash_table_get_slot_value(t, slot), v, value_size);
 	} else {
-		memcpy(hash_table_find_raw(t, hash), v, value_size);
+		hash_table_write_slot(t, slot, hash, k, v);
+		t->count += 1;
 	}
 	
-	return newly_added;
+	return !found;
 }
 
+// Returns true if an entry was removed
+bool hash_table_remove_raw(Hash_Table *t, u64 hash, void *k, u64 key_size) {
+
+	assert(t->_key_size == key_size, "Key type size does not match hash table initted key type size");
+
+	if (t->count == 0) return false;
+	
+	bool found;
+	u64 slot = hash_table_probe(t, hash_table_sanitize_hash(hash), k, &found);
+	
+	if (!found) return false;
+	
+	// Leave a tombstone so probe sequences passing through this slot are not cut short
+	*hash_table_get_slot_hash(t, slot) = HASH_TABLE_DELETED_HASH;
+	t->count -= 1;
+	t->_tombstone_count += 1;
+	
+	return true;
+}
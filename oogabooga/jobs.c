@@ -0,0 +1,724 @@
+
+///
+///
+// Job system
+///
+// One worker per logical core. The thread that calls job_system_init is worker 0 and
+// only runs jobs while it waits in job_counter_wait, the other workers are threads.
+//
+// Every worker has its own deque. A worker pushes & pops its own jobs at the bottom
+// (newest first, which keeps the cache warm) and when it runs dry it steals from the
+// top (oldest) of another worker's deque.
+// Jobs pushed from threads which are not workers (audio thread, your own threads) go
+// to worker 0's deque, so the other workers will steal them.
+//
+// Each worker thread has its own temporary storage, and every job runs between a
+// temp_begin/temp_end, so you can talloc in a job but it's gone when the job returns.
+//
+// Usage:
+//
+//     job_system_init(0); // 0 for one worker per logical core
+//
+//     Job_Counter counter = ZERO(Job_Counter);
+//     for (u64 i = 0; i < chunk_count; i += 1) {
+//         job_run(process_chunk, &chunks[i], &counter);
+//     }
+//     job_counter_wait(&counter); // Runs jobs on this thread until counter is 0
+//
+// job_counter_wait is fine to call from within a job, so jobs can spawn & wait for
+// jobs of their own.
+
+typedef void(*Job_Proc)(void *data);
+
+typedef struct Job_Counter {
+	volatile u64 count;
+} Job_Counter;
+
+typedef struct Job {
+	Job_Proc proc;
+	void *data;
+	Job_Counter *counter;
+} Job;
+
+// If a deque is full, job_run just runs the job right away
+#define JOB_QUEUE_CAPACITY 4096
+#define JOB_WORKER_TEMPORARY_STORAGE_SIZE MB(1)
+// How many times an idle worker looks for work before it starts yielding & then parks
+// on job_wake_semaphore until job_run wakes it up
+#define JOB_WORKER_SPIN_COUNT 128
+#define JOB_WORKER_YIELD_COUNT 512
+
+// A spinlock is plenty here. The owner is the only one who touches the bottom and
+// stealing is rare compared to push & pop, so the lock is almost never contended.
+typedef struct alignat(64) Job_Queue {
+	Spinlock lock;
+	u64 top;
+	u64 bottom;
+	Job jobs[JOB_QUEUE_CAPACITY];
+} Job_Queue;
+
+typedef struct alignat(64) Job_Worker {
+	Job_Queue queue;
+	Thread thread;
+	u64 index;
+	u64 steal_seed;
+
+	// Stats, only written by the worker itself
+	u64 executed_count;
+	u64 stolen_count;
+} Job_Worker;
+
+typedef struct Job_System_Stats {
+	u64 worker_count;
+	u64 executed_count;
+	u64 stolen_count;
+} Job_System_Stats;
+
+ogb_instance void
+job_system_init(u64 worker_count);
+
+ogb_instance void
+job_system_shutdown();
+
+ogb_instance u64
+job_system_get_worker_count();
+
+// Worker index of the calling thread, or -1 if it's not a worker
+ogb_instance s64
+job_get_worker_index();
+
+// counter may be 0 if nobody needs to wait for the job
+ogb_instance void
+job_run(Job_Proc proc, void *data, Job_Counter *counter);
+
+// Runs a job on the calling thread if there's one available.
+// Returns false if there was nothing to run.
+ogb_instance bool
+job_try_run_one();
+
+// Helps running jobs until counter reaches 0
+ogb_instance void
+job_counter_wait(Job_Counter *counter);
+
+ogb_instance Job_System_Stats
+job_system_get_stats();
+
+///
+// parallel_for & parallel_reduce
+//
+// Split [0, count) into batches and run them as jobs, the calling thread runs a batch
+// too and then helps out until all batches are done.
+// batch_size is the smallest batch worth making a job for (0 for the default). Batches
+// grow so there are about PARALLEL_BATCHES_PER_WORKER per worker, which keeps the job
+// overhead down for cheap work over large counts.
+// If everything fits in one batch, or there's only one worker, it just runs inline.
+//
+// Batch data goes in temporary storage and is rolled back before returning.
+
+typedef void(*Parallel_For_Proc)(u64 first, u64 end, void *userdata);
+
+// Each batch gets its own partial, which starts out as a copy of *result, so *result
+// should be the identity of the reduction when calling parallel_reduce (0 for a sum).
+typedef void(*Parallel_Reduce_Proc)(u64 first, u64 end, void *userdata, void *partial);
+// Combine a partial into result. Runs on the calling thread, in batch order, so the
+// result is the same no matter how many workers there are.
+typedef void(*Parallel_Reduce_Combine_Proc)(void *result, void *partial, void *userdata);
+
+#define PARALLEL_DEFAULT_BATCH_SIZE 256
+#define PARALLEL_BATCHES_PER_WORKER 4
+
+ogb_instance u64
+parallel_get_batch_size(u64 count, u64 batch_size);
+
+ogb_instance void
+parallel_for(u64 count, u64 batch_size, Parallel_For_Proc proc, void *userdata);
+
+ogb_instance void
+parallel_reduce(u64 count, u64 batch_size, Parallel_Reduce_Proc proc, Parallel_Reduce_Combine_Proc combine, void *userdata, void *result, u64 result_size);
+
+///
+// Parallel radix sort
+// Same contract & result as radix_sort_keys in utility.c: a stable sort of u64 keys with a
+// u32 payload each, on bits [first_bit, first_bit+number_of_bits) of the keys, with the
+// result in keys & payloads. key_buffer & payload_buffer should be the same size as keys
+// & payloads.
+// Each pass, the keys are split into one chunk per batch; every chunk counts its digits,
+// the calling thread turns the counts into per-chunk offsets (in chunk order, which keeps
+// it stable) and then the chunks scatter their keys at the same time.
+// Below PARALLEL_RADIX_SORT_MIN_ITEM_COUNT items or with one worker it's just
+// radix_sort_keys, so it's fine to call for any size.
+#define PARALLEL_RADIX_SORT_MIN_ITEM_COUNT 32768
+
+ogb_instance void
+parallel_radix_sort_keys(u64 *keys, u32 *payloads, u64 *key_buffer, u32 *payload_buffer, u64 item_count, u64 first_bit, u64 number_of_bits);
+
+// #Global
+ogb_instance Job_Worker *job_workers;
+ogb_instance void *job_workers_allocation;
+ogb_instance u64 job_worker_count;
+ogb_instance volatile bool job_system_running;
+// Jobs which are pushed but not yet picked up. Idle workers check this before they go
+// looking in the deques.
+ogb_instance volatile u64 job_queued_count;
+// Parked workers which nobody has signaled yet. job_run takes one off and signals the
+// semaphore so a parked worker wakes up for the new job.
+ogb_instance volatile u32 job_parked_count;
+ogb_instance Semaphore job_wake_semaphore;
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+Job_Worker *job_workers = 0;
+void *job_workers_allocation = 0;
+u64 job_worker_count = 0;
+volatile bool job_system_running = false;
+volatile u64 job_queued_count = 0;
+volatile u32 job_parked_count = 0;
+Semaphore job_wake_semaphore;
+#endif
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+thread_local s64 job_worker_index = -1;
+
+bool
+job_queue_push(Job_Queue *q, Job job) {
+	spinlock_acquire_or_wait(&q->lock);
+	if (q->bottom - q->top >= JOB_QUEUE_CAPACITY) {
+		spinlock_release(&q->lock);
+		return false;
+	}
+	q->jobs[q->bottom % JOB_QUEUE_CAPACITY] = job;
+	q->bottom += 1;
+	spinlock_release(&q->lock);
+	return true;
+}
+
+bool
+job_queue_pop(Job_Queue *q, Job *job) {
+	// Peek without the lock so an empty deque costs nothing.
+	// A stale read just means we try again in a bit.
+	if (q->bottom == q->top) return false;
+	spinlock_acquire_or_wait(&q->lock);
+	if (q->bottom == q->top) {
+		spinlock_release(&q->lock);
+		return false;
+	}
+	q->bottom -= 1;
+	*job = q->jobs[q->bottom % JOB_QUEUE_CAPACITY];
+	spinlock_release(&q->lock);
+	return true;
+}
+
+bool
+job_queue_steal(Job_Queue *q, Job *job) {
+	if (q->bottom == q->top) return false;
+	spinlock_acquire_or_wait(&q->lock);
+	if (q->bottom == q->top) {
+		spinlock_release(&q->lock);
+		return false;
+	}
+	*job = q->jobs[q->top % JOB_QUEUE_CAPACITY];
+	q->top += 1;
+	spinlock_release(&q->lock);
+	return true;
+}
+
+void
+job_execute(Job *job) {
+	Temp_Mark mark = temp_begin();
+	job->proc(job->data);
+	temp_end(mark);
+
+	if (job->counter) {
+		u64 previous = atomic_fetch_add_64(&job->counter->count, -1, MEMORY_ORDER_ACQ_REL);
+		assert(previous > 0, "Job counter went below 0");
+	}
+}
+
+bool
+job_try_run_one() {
+	if (!job_workers || job_queued_count == 0) return false;
+
+	Job job;
+	bool found = false;
+	bool stolen = false;
+
+	s64 self = job_worker_index;
+	if (self >= 0) {
+		found = job_queue_pop(&job_workers[self].queue, &job);
+	}
+
+	if (!found) {
+		// Start at a random victim so thieves don't all pile on the same deque
+		u64 seed = self >= 0 ? job_workers[self].steal_seed : (u64)&job;
+		seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+		if (self >= 0) job_workers[self].steal_seed = seed;
+
+		u64 start = (seed >> 33) % job_worker_count;
+		for (u64 i = 0; i < job_worker_count; i += 1) {
+			u64 victim = (start + i) % job_worker_count;
+			if ((s64)victim == self) continue;
+			if (job_queue_steal(&job_workers[victim].queue, &job)) {
+				found = true;
+				stolen = true;
+				break;
+			}
+		}
+	}
+
+	if (!found) return false;
+
+	atomic_fetch_add_64(&job_queued_count, -1, MEMORY_ORDER_RELAXED);
+
+	// Count before running so the stats are complete once the counter reaches 0
+	if (self >= 0) {
+		job_workers[self].executed_count += 1;
+		if (stolen) job_workers[self].stolen_count += 1;
+	}
+
+	job_execute(&job);
+
+	return true;
+}
+
+void
+job_wake_one_worker() {
+	u32 parked = atomic_load_32(&job_parked_count, MEMORY_ORDER_SEQ_CST);
+	while (parked) {
+		if (compare_and_swap_32(&job_parked_count, parked-1, parked)) {
+			semaphore_signal(&job_wake_semaphore, 1);
+			return;
+		}
+		parked = atomic_load_32(&job_parked_count, MEMORY_ORDER_SEQ_CST);
+	}
+}
+
+void
+job_worker_park() {
+	atomic_fetch_add_32(&job_parked_count, 1, MEMORY_ORDER_SEQ_CST);
+
+	// A job pushed before we counted ourselves as parked wouldn't wake us, so look again.
+	// If we can't take ourselves back off the count, someone already signaled for us and
+	// the wait below returns right away.
+	if (atomic_load_64(&job_queued_count, MEMORY_ORDER_SEQ_CST) != 0 || !job_system_running) {
+		u32 parked = atomic_load_32(&job_parked_count, MEMORY_ORDER_SEQ_CST);
+		while (parked) {
+			if (compare_and_swap_32(&job_parked_count, parked-1, parked)) return;
+			parked = atomic_load_32(&job_parked_count, MEMORY_ORDER_SEQ_CST);
+		}
+	}
+
+	semaphore_wait(&job_wake_semaphore);
+}
+
+void
+job_worker_proc(Thread *t) {
+	Job_Worker *worker = (Job_Worker*)t->data;
+	job_worker_index = (s64)worker->index;
+
+	u64 idle_count = 0;
+	while (job_system_running) {
+		if (job_try_run_one()) {
+			idle_count = 0;
+			continue;
+		}
+
+		// Back off gradually so a burst of jobs right after we go idle still gets
+		// picked up quickly, then park so an idle game doesn't wake up every core.
+		idle_count += 1;
+		if (idle_count < JOB_WORKER_SPIN_COUNT) {
+			_mm_pause();
+		} else if (idle_count < JOB_WORKER_SPIN_COUNT + JOB_WORKER_YIELD_COUNT) {
+			os_yield_thread();
+		} else {
+			job_worker_park();
+			idle_count = 0;
+		}
+	}
+}
+
+void
+job_system_init(u64 worker_count) {
+	assert(!job_workers, "job_system_init called twice without job_system_shutdown");
+
+	if (worker_count == 0) worker_count = os_get_number_of_logical_processors();
+	if (worker_count == 0) worker_count = 1;
+
+	// Workers are cache line aligned so they don't false share
+	u64 size = sizeof(Job_Worker)*worker_count + 64;
+	job_workers_allocation = alloc(get_heap_allocator(), size);
+	memset(job_workers_allocation, 0, size);
+	job_workers = (Job_Worker*)align_next((u64)job_workers_allocation, 64);
+	job_worker_count = worker_count;
+	job_queued_count = 0;
+	job_parked_count = 0;
+	semaphore_init(&job_wake_semaphore, 0);
+
+	for (u64 i = 0; i < worker_count; i += 1) {
+		Job_Worker *worker = &job_workers[i];
+		spinlock_init(&worker->queue.lock);
+		spinlock_set_name(&worker->queue.lock, STR("job queue lock"));
+		worker->index = i;
+		worker->steal_seed = (u64)(i+1)*0x9E3779B97F4A7C15ULL;
+	}
+
+	// The calling thread is worker 0
+	job_worker_index = 0;
+
+	MEMORY_BARRIER;
+	job_system_running = true;
+
+	for (u64 i = 1; i < worker_count; i += 1) {
+		Job_Worker *worker = &job_workers[i];
+		os_thread_init(&worker->thread, job_worker_proc);
+		worker->thread.data = worker;
+		worker->thread.temporary_storage_size = JOB_WORKER_TEMPORARY_STORAGE_SIZE;
+		os_thread_start(&worker->thread);
+	}
+}
+
+void
+job_system_shutdown() {
+	if (!job_workers) return;
+
+	// Don't leave anything behind, someone might be waiting for it
+	while (job_try_run_one());
+
+	job_system_running = false;
+	MEMORY_BARRIER;
+
+	// Enough for every worker, parked or not. Leftovers are thrown away with the semaphore.
+	semaphore_signal(&job_wake_semaphore, (u32)job_worker_count);
+
+	for (u64 i = 1; i < job_worker_count; i += 1) {
+		os_thread_destroy(&job_workers[i].thread);
+	}
+	semaphore_destroy(&job_wake_semaphore);
+
+	assert(job_queued_count == 0, "Jobs were queued while the job system was shutting down");
+
+	dealloc(get_heap_allocator(), job_workers_allocation);
+	job_workers_allocation = 0;
+	job_workers = 0;
+	job_worker_count = 0;
+	job_worker_index = -1;
+}
+
+u64
+job_system_get_worker_count() {
+	return job_worker_count;
+}
+
+s64
+job_get_worker_index() {
+	return job_worker_index;
+}
+
+void
+job_run(Job_Proc proc, void *data, Job_Counter *counter) {
+	assert(proc, "job_run called with a null proc");
+
+	Job job;
+	job.proc = proc;
+	job.data = data;
+	job.counter = counter;
+
+	if (counter) atomic_fetch_add_64(&counter->count, 1, MEMORY_ORDER_RELAXED);
+
+	if (!job_workers) {
+		// No job system, just do it here
+		job_execute(&job);
+		return;
+	}
+
+	s64 self = job_worker_index;
+	Job_Queue *q = &job_workers[self >= 0 ? self : 0].queue;
+
+	// Count it before it's visible so a thief never decrements below 0.
+	// Seq cst pairs with job_worker_park: either it sees the job or we see it parked.
+	atomic_fetch_add_64(&job_queued_count, 1, MEMORY_ORDER_SEQ_CST);
+	if (!job_queue_push(q, job)) {
+		atomic_fetch_add_64(&job_queued_count, -1, MEMORY_ORDER_RELAXED);
+		job_execute(&job);
+		return;
+	}
+
+	job_wake_one_worker();
+}
+
+void
+job_counter_wait(Job_Counter *counter) {
+	u64 idle_count = 0;
+	// Acquire pairs with the acq_rel decrement in job_execute so the jobs' writes are visible
+	while (atomic_load_64(&counter->count, MEMORY_ORDER_ACQUIRE) != 0) {
+		if (job_try_run_one()) {
+			idle_count = 0;
+			continue;
+		}
+		// The jobs we're waiting for are running on other workers
+		idle_count += 1;
+		if (idle_count < JOB_WORKER_SPIN_COUNT) {
+			_mm_pause();
+		} else {
+			os_yield_thread();
+		}
+	}
+}
+
+Job_System_Stats
+job_system_get_stats() {
+	Job_System_Stats stats = ZERO(Job_System_Stats);
+	stats.worker_count = job_worker_count;
+	for (u64 i = 0; i < job_worker_count; i += 1) {
+		stats.executed_count += job_workers[i].executed_count;
+		stats.stolen_count   += job_workers[i].stolen_count;
+	}
+	return stats;
+}
+
+typedef struct Parallel_Batch {
+	u64 first;
+	u64 end;
+	Parallel_For_Proc proc;
+	Parallel_Reduce_Proc reduce_proc;
+	void *userdata;
+	void *partial;
+} Parallel_Batch;
+
+void
+parallel_batch_job(void *data) {
+	Parallel_Batch *batch = (Parallel_Batch*)data;
+	if (batch->reduce_proc) batch->reduce_proc(batch->first, batch->end, batch->userdata, batch->partial);
+	else                    batch->proc(batch->first, batch->end, batch->userdata);
+}
+
+u64
+parallel_get_batch_size(u64 count, u64 batch_size) {
+	if (batch_size == 0) batch_size = PARALLEL_DEFAULT_BATCH_SIZE;
+	u64 target_batch_count = max(job_worker_count, 1)*PARALLEL_BATCHES_PER_WORKER;
+	return max(batch_size, (count + target_batch_count - 1)/target_batch_count);
+}
+
+void
+parallel_run_batches(u64 count, u64 batch_size, Parallel_For_Proc proc, Parallel_Reduce_Proc reduce_proc, Parallel_Reduce_Combine_Proc combine, void *userdata, void *result, u64 result_size) {
+	if (count == 0) return;
+
+	Temp_Mark mark = temp_begin();
+
+	u64 batch_count = 1;
+	if (job_worker_count > 1) {
+		batch_size = parallel_get_batch_size(count, batch_size);
+		batch_count = (count + batch_size - 1)/batch_size;
+	} else {
+		batch_size = count;
+	}
+
+	// Partials on their own cache lines so batches don't false share
+	u64 partial_stride = align_next(result_size, 64);
+	u8 *partials = 0;
+	if (reduce_proc) {
+		partials = (u8*)talloc(partial_stride*batch_count);
+		for (u64 i = 0; i < batch_count; i += 1) memcpy(partials + i*partial_stride, result, result_size);
+	}
+
+	Parallel_Batch *batches = (Parallel_Batch*)talloc(sizeof(Parallel_Batch)*batch_count);
+	for (u64 i = 0; i < batch_count; i += 1) {
+		Parallel_Batch *batch = &batches[i];
+		batch->first = i*batch_size;
+		batch->end = min(batch->first + batch_size, count);
+		batch->proc = proc;
+		batch->reduce_proc = reduce_proc;
+		batch->userdata = userdata;
+		batch->partial = partials ? partials + i*partial_stride : 0;
+	}
+
+	// Hand out all but the first batch, which we run ourselves right away
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 1; i < batch_count; i += 1) {
+		job_run(parallel_batch_job, &batches[i], &counter);
+	}
+	parallel_batch_job(&batches[0]);
+	job_counter_wait(&counter);
+
+	if (reduce_proc) {
+		for (u64 i = 0; i < batch_count; i += 1) combine(result, batches[i].partial, userdata);
+	}
+
+	temp_end(mark);
+}
+
+void
+parallel_for(u64 count, u64 batch_size, Parallel_For_Proc proc, void *userdata) {
+	assert(proc, "parallel_for called with a null proc");
+	parallel_run_batches(count, batch_size, proc, 0, 0, userdata, 0, 0);
+}
+
+void
+parallel_reduce(u64 count, u64 batch_size, Parallel_Reduce_Proc proc, Parallel_Reduce_Combine_Proc combine, void *userdata, void *result, u64 result_size) {
+	assert(proc && combine, "parallel_reduce called with a null proc");
+	assert(result && result_size, "parallel_reduce needs a result");
+	parallel_run_batches(count, batch_size, 0, proc, combine, userdata, result, result_size);
+}
+
+#define PARALLEL_RADIX_SORT_RADIX 256
+#define PARALLEL_RADIX_SORT_BITS_PER_PASS 8
+#define PARALLEL_RADIX_SORT_MAX_PASS_COUNT 8
+
+typedef struct Parallel_Radix_Sort {
+	u64 *keys;
+	u32 *payloads;
+	u64 *other_keys;
+	u32 *other_payloads;
+	u64 item_count;
+	u64 first_bit;
+	u64 value_mask;
+	u64 pass_count;
+	u32 shift;
+	
+	u64 chunk_count;
+	u64 chunk_size;
+	// [chunk][digit] for the current pass. Counts, then offsets to scatter to.
+	u64 *chunk_counts;
+	// [chunk][pass][digit], counted before anything moves
+	u64 *first_counts;
+} Parallel_Radix_Sort;
+
+inline u64
+parallel_radix_sort_digit(Parallel_Radix_Sort *sort, u64 key, u32 shift) {
+	return (((key >> sort->first_bit) & sort->value_mask) >> shift) & (PARALLEL_RADIX_SORT_RADIX-1);
+}
+
+void
+parallel_radix_sort_first_count(u64 first, u64 end, void *userdata) {
+	Parallel_Radix_Sort *sort = (Parallel_Radix_Sort*)userdata;
+	for (u64 chunk = first; chunk < end; chunk += 1) {
+		u64 *counts = sort->first_counts + chunk*PARALLEL_RADIX_SORT_MAX_PASS_COUNT*PARALLEL_RADIX_SORT_RADIX;
+		memset(counts, 0, sizeof(u64)*PARALLEL_RADIX_SORT_MAX_PASS_COUNT*PARALLEL_RADIX_SORT_RADIX);
+		
+		u64 chunk_end = min((chunk+1)*sort->chunk_size, sort->item_count);
+		for (u64 i = chunk*sort->chunk_size; i < chunk_end; i += 1) {
+			u64 key = sort->keys[i];
+			for (u64 pass = 0; pass < sort->pass_count; pass += 1) {
+				counts[pass*PARALLEL_RADIX_SORT_RADIX + parallel_radix_sort_digit(sort, key, pass*PARALLEL_RADIX_SORT_BITS_PER_PASS)] += 1;
+			}
+		}
+	}
+}
+void
+parallel_radix_sort_count(u64 first, u64 end, void *userdata) {
+	Parallel_Radix_Sort *sort = (Parallel_Radix_Sort*)userdata;
+	for (u64 chunk = first; chunk < end; chunk += 1) {
+		u64 *counts = sort->chunk_counts + chunk*PARALLEL_RADIX_SORT_RADIX;
+		memset(counts, 0, sizeof(u64)*PARALLEL_RADIX_SORT_RADIX);
+		
+		u64 chunk_end = min((chunk+1)*sort->chunk_size, sort->item_count);
+		for (u64 i = chunk*sort->chunk_size; i < chunk_end; i += 1) {
+			counts[parallel_radix_sort_digit(sort, sort->keys[i], sort->shift)] += 1;
+		}
+	}
+}
+void
+parallel_radix_sort_scatter(u64 first, u64 end, void *userdata) {
+	Parallel_Radix_Sort *sort = (Parallel_Radix_Sort*)userdata;
+	for (u64 chunk = first; chunk < end; chunk += 1) {
+		u64 *offsets = sort->chunk_counts + chunk*PARALLEL_RADIX_SORT_RADIX;
+		
+		u64 chunk_end = min((chunk+1)*sort->chunk_size, sort->item_count);
+		for (u64 i = chunk*sort->chunk_size; i < chunk_end; i += 1) {
+			u64 key = sort->keys[i];
+			u64 dst = offsets[parallel_radix_sort_digit(sort, key, sort->shift)]++;
+			sort->other_keys[dst] = key;
+			sort->other_payloads[dst] = sort->payloads[i];
+		}
+	}
+}
+void
+parallel_radix_sort_copy_back(u64 first, u64 end, void *userdata) {
+	Parallel_Radix_Sort *sort = (Parallel_Radix_Sort*)userdata;
+	// keys & payloads are the buffers at this point, other_keys & other_payloads the
+	// arrays we were given.
+	memcpy(sort->other_keys + first, sort->keys + first, (end-first)*sizeof(u64));
+	memcpy(sort->other_payloads + first, sort->payloads + first, (end-first)*sizeof(u32));
+}
+
+void
+parallel_radix_sort_keys(u64 *keys, u32 *payloads, u64 *key_buffer, u32 *payload_buffer, u64 item_count, u64 first_bit, u64 number_of_bits) {
+	if (item_count < PARALLEL_RADIX_SORT_MIN_ITEM_COUNT || job_worker_count <= 1) {
+		radix_sort_keys(keys, payloads, key_buffer, payload_buffer, item_count, first_bit, number_of_bits);
+		return;
+	}
+	assert(number_of_bits > 0 && first_bit+number_of_bits <= 64, "parallel_radix_sort_keys can only sort bits 0-63, got %llu bits from bit %llu", number_of_bits, first_bit);
+	
+	Parallel_Radix_Sort sort = ZERO(Parallel_Radix_Sort);
+	sort.keys = keys;
+	sort.payloads = payloads;
+	sort.other_keys = key_buffer;
+	sort.other_payloads = payload_buffer;
+	sort.item_count = item_count;
+	sort.first_bit = first_bit;
+	sort.pass_count = (number_of_bits + PARALLEL_RADIX_SORT_BITS_PER_PASS - 1)/PARALLEL_RADIX_SORT_BITS_PER_PASS;
+	// The last pass can reach past the bits we sort on, those must not affect the order
+	sort.value_mask = number_of_bits == 64 ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << number_of_bits) - 1);
+	
+	// One chunk per batch so parallel_for hands each one out as a job
+	sort.chunk_count = min(job_worker_count*PARALLEL_BATCHES_PER_WORKER, item_count);
+	sort.chunk_size = (item_count + sort.chunk_count - 1)/sort.chunk_count;
+	
+	// #Memory #Heapalloc
+	// Too big for temporary storage with many workers
+	u64 *counts = (u64*)alloc(get_heap_allocator(), sizeof(u64)*sort.chunk_count*PARALLEL_RADIX_SORT_RADIX*(1 + PARALLEL_RADIX_SORT_MAX_PASS_COUNT));
+	sort.chunk_counts = counts;
+	sort.first_counts = counts + sort.chunk_count*PARALLEL_RADIX_SORT_RADIX;
+	
+	parallel_for(sort.chunk_count, 1, parallel_radix_sort_first_count, &sort);
+	
+	bool moved = false;
+	for (u64 pass = 0; pass < sort.pass_count; pass += 1) {
+		sort.shift = pass*PARALLEL_RADIX_SORT_BITS_PER_PASS;
+		
+		// Every key has the same digit, this pass wouldn't change the order
+		u64 first_digit = parallel_radix_sort_digit(&sort, sort.keys[0], sort.shift);
+		u64 first_digit_count = 0;
+		for (u64 chunk = 0; chunk < sort.chunk_count; chunk += 1) {
+			first_digit_count += sort.first_counts[(chunk*PARALLEL_RADIX_SORT_MAX_PASS_COUNT + pass)*PARALLEL_RADIX_SORT_RADIX + first_digit];
+		}
+		if (first_digit_count == item_count) continue;
+		
+		// The first counts only match the chunks until the keys have moved
+		if (moved) {
+			parallel_for(sort.chunk_count, 1, parallel_radix_sort_count, &sort);
+		} else {
+			for (u64 chunk = 0; chunk < sort.chunk_count; chunk += 1) {
+				memcpy(sort.chunk_counts + chunk*PARALLEL_RADIX_SORT_RADIX, sort.first_counts + (chunk*PARALLEL_RADIX_SORT_MAX_PASS_COUNT + pass)*PARALLEL_RADIX_SORT_RADIX, sizeof(u64)*PARALLEL_RADIX_SORT_RADIX);
+			}
+		}
+		
+		// Digit major, chunk minor, so equal digits keep their chunk order
+		u64 offset = 0;
+		for (u64 digit = 0; digit < PARALLEL_RADIX_SORT_RADIX; digit += 1) {
+			for (u64 chunk = 0; chunk < sort.chunk_count; chunk += 1) {
+				u64 *count = &sort.chunk_counts[chunk*PARALLEL_RADIX_SORT_RADIX + digit];
+				u64 chunk_digit_count = *count;
+				*count = offset;
+				offset += chunk_digit_count;
+			}
+		}
+		
+		parallel_for(sort.chunk_count, 1, parallel_radix_sort_scatter, &sort);
+		
+		u64 *temp_keys = sort.keys;
+		sort.keys = sort.other_keys;
+		sort.other_keys = temp_keys;
+		u32 *temp_payloads = sort.payloads;
+		sort.payloads = sort.other_payloads;
+		sort.other_payloads = temp_payloads;
+		moved = true;
+	}
+	
+	if (sort.keys != keys) {
+		parallel_for(item_count, 0, parallel_radix_sort_copy_back, &sort);
+	}
+	
+	dealloc(get_heap_allocator(), counts);
+}
+
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
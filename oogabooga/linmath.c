@@ -95,19 +95,43 @@ inline Vector3 v3_divf(Vector3 a, float32 s) {
 }
 
 inline Vector4 v4_add(Vector4 a, Vector4 b) {
+#if ENABLE_SIMD
+	Vector4 r;
+	_mm_storeu_ps(r.data, _mm_add_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+	return r;
+#else
 	return v4(a.x+b.x, a.y+b.y, a.z+b.z, a.w+b.w);
+#endif
 }
 inline Vector4 v4_sub(Vector4 a, Vector4 b) {
+#if ENABLE_SIMD
+	Vector4 r;
+	_mm_storeu_ps(r.data, _mm_sub_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+	return r;
+#else
 	return v4(a.x-b.x, a.y-b.y, a.z-b.z, a.w-b.w);
+#endif
 }
 inline Vector4 v4_mul(Vector4 a, Vector4 b) {
+#if ENABLE_SIMD
+	Vector4 r;
+	_mm_storeu_ps(r.data, _mm_mul_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+	return r;
+#else
 	return v4(a.x*b.x, a.y*b.y, a.z*b.z, a.w*b.w);
+#endif
 }
 inline Vector4 v4_mulf(Vector4 a, float32 s) {
 	return v4_mul(a, v4(s, s, s, s));
 }
 inline Vector4 v4_div(Vector4 a, Vector4 b) {
+#if ENABLE_SIMD
+	Vector4 r;
+	_mm_storeu_ps(r.data, _mm_div_ps(_mm_loadu_ps(a.data), _mm_loadu_ps(b.data)));
+	return r;
+#else
 	return v4(a.x/b.x, a.y/b.y, a.z/b.z, a.w/b.w);
+#endif
 }
 inline Vector4 v4_divf(Vector4 a, float32 s) {
 	return v4_div(a, v4(s, s, s, s));
@@ -376,12 +400,14 @@ Matrix4 m4_make_scale(Vector3 scale) {
     return m;
 }
 
-Matrix4 m4_mul(Matrix4 a, Matrix4 b) {
+// The basic_m4_ procs are the plain scalar versions. With ENABLE_SIMD the m4_ ones use sse,
+// which is part of x64 so there's nothing to dispatch at runtime. Same results within float
+// rounding, mul & transform even add in the same order.
+
+Matrix4 basic_m4_mul(Matrix4 a, Matrix4 b) {
     Matrix4 result;
     for (int i = 0; i < 4; ++i) {
         for (int j = 0; j < 4; ++j) {
-
-        	
             result.m[i][j] = a.m[i][0] * b.m[0][j] +
                              a.m[i][1] * b.m[1][j] +
                              a.m[i][2] * b.m[2][j] +
@@ -391,6 +417,27 @@ Matrix4 m4_mul(Matrix4 a, Matrix4 b) {
     return result;
 }
 
+Matrix4 m4_mul(Matrix4 a, Matrix4 b) {
+#if ENABLE_SIMD
+	// Row i of the result is a.m[i][0]*b row 0 + ... + a.m[i][3]*b row 3
+    __m128 b0 = _mm_load_ps(b.m[0]);
+    __m128 b1 = _mm_load_ps(b.m[1]);
+    __m128 b2 = _mm_load_ps(b.m[2]);
+    __m128 b3 = _mm_load_ps(b.m[3]);
+    Matrix4 result;
+    for (int i = 0; i < 4; ++i) {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+        _mm_store_ps(result.m[i], r);
+    }
+    return result;
+#else
+	return basic_m4_mul(a, b);
+#endif
+}
+
 inline Matrix4 m4_translate(Matrix4 m, Vector3 translation) {
     Matrix4 translation_matrix = m4_make_translation(translation);
     return m4_mul(m, translation_matrix);
@@ -424,7 +471,31 @@ Matrix4 m4_make_orthographic_projection(float32 left, float32 right, float32 bot
     return m;
 }
 
-Vector4 m4_transform(Matrix4 m, Vector4 v) {
+Matrix4 m4_transpose(Matrix4 m) {
+#if ENABLE_SIMD
+    __m128 r0 = _mm_load_ps(m.m[0]);
+    __m128 r1 = _mm_load_ps(m.m[1]);
+    __m128 r2 = _mm_load_ps(m.m[2]);
+    __m128 r3 = _mm_load_ps(m.m[3]);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    Matrix4 result;
+    _mm_store_ps(result.m[0], r0);
+    _mm_store_ps(result.m[1], r1);
+    _mm_store_ps(result.m[2], r2);
+    _mm_store_ps(result.m[3], r3);
+    return result;
+#else
+    Matrix4 result;
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            result.m[i][j] = m.m[j][i];
+        }
+    }
+    return result;
+#endif
+}
+
+Vector4 basic_m4_transform(Matrix4 m, Vector4 v) {
     Vector4 result;
     result.x = m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3] * v.w;
     result.y = m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3] * v.w;
@@ -432,7 +503,26 @@ Vector4 m4_transform(Matrix4 m, Vector4 v) {
     result.w = m.m[3][0] * v.x + m.m[3][1] * v.y + m.m[3][2] * v.z + m.m[3][3] * v.w;
     return result;
 }
-Matrix4 m4_inverse(Matrix4 m) {
+Vector4 m4_transform(Matrix4 m, Vector4 v) {
+#if ENABLE_SIMD
+	// Columns scaled by the components of v
+    __m128 c0 = _mm_load_ps(m.m[0]);
+    __m128 c1 = _mm_load_ps(m.m[1]);
+    __m128 c2 = _mm_load_ps(m.m[2]);
+    __m128 c3 = _mm_load_ps(m.m[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 r = _mm_mul_ps(c0, _mm_set1_ps(v.x));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(v.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(v.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(v.w)));
+    Vector4 result;
+    _mm_storeu_ps(result.data, r);
+    return result;
+#else
+	return basic_m4_transform(m, v);
+#endif
+}
+Matrix4 basic_m4_inverse(Matrix4 m) {
     Matrix4 inv;
     float32 det;
 
@@ -564,6 +654,164 @@ Matrix4 m4_inverse(Matrix4 m) {
     return inv;
 }
 
+
+#if ENABLE_SIMD
+// Helpers for the sse inverse. The 4x4 is split into 2x2 blocks stored as (m00, m01, m10, m11)
+#define _m4_swizzle(v, x, y, z, w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(w, z, y, x))
+#define _m4_shuffle(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE(w, z, y, x))
+// A*B
+inline __m128 _m4_mat2_mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, _m4_swizzle(b, 0,3,0,3)), _mm_mul_ps(_m4_swizzle(a, 1,0,3,2), _m4_swizzle(b, 2,1,2,1)));
+}
+// adjugate(A)*B
+inline __m128 _m4_mat2_adj_mul(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(_m4_swizzle(a, 3,3,0,0), b), _mm_mul_ps(_m4_swizzle(a, 1,1,2,2), _m4_swizzle(b, 2,3,0,1)));
+}
+// A*adjugate(B)
+inline __m128 _m4_mat2_mul_adj(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(a, _m4_swizzle(b, 3,0,3,0)), _mm_mul_ps(_m4_swizzle(a, 1,0,3,2), _m4_swizzle(b, 2,1,2,1)));
+}
+inline __m128 _m4_cross(__m128 a, __m128 b) {
+	return _mm_sub_ps(_mm_mul_ps(_m4_swizzle(a, 1,2,0,3), _m4_swizzle(b, 2,0,1,3)), 
+	                  _mm_mul_ps(_m4_swizzle(a, 2,0,1,3), _m4_swizzle(b, 1,2,0,3)));
+}
+#endif
+
+Matrix4 m4_inverse(Matrix4 m) {
+#if ENABLE_SIMD
+	// Block wise inverse: M = |A B|, inverse = 1/|M| * |X Y|
+	//                         |C D|                    |Z W|
+	// with the adjugates X# = |D|A - B(D#C), Y# = |B|C - D(A#B)#, Z# = |C|B - A(D#C)#,
+	// W# = |A|D - C(A#B) and |M| = |A||D| + |B||C| - tr((A#B)(D#C)).
+    __m128 r0 = _mm_load_ps(m.m[0]);
+    __m128 r1 = _mm_load_ps(m.m[1]);
+    __m128 r2 = _mm_load_ps(m.m[2]);
+    __m128 r3 = _mm_load_ps(m.m[3]);
+    
+    __m128 A = _mm_movelh_ps(r0, r1);
+    __m128 B = _mm_movehl_ps(r1, r0);
+    __m128 C = _mm_movelh_ps(r2, r3);
+    __m128 D = _mm_movehl_ps(r3, r2);
+    
+    // (|A|, |B|, |C|, |D|)
+    __m128 det_sub = _mm_sub_ps(
+    	_mm_mul_ps(_m4_shuffle(r0, r2, 0,2,0,2), _m4_shuffle(r1, r3, 1,3,1,3)),
+    	_mm_mul_ps(_m4_shuffle(r0, r2, 1,3,1,3), _m4_shuffle(r1, r3, 0,2,0,2))
+	);
+    __m128 det_a = _m4_swizzle(det_sub, 0,0,0,0);
+    __m128 det_b = _m4_swizzle(det_sub, 1,1,1,1);
+    __m128 det_c = _m4_swizzle(det_sub, 2,2,2,2);
+    __m128 det_d = _m4_swizzle(det_sub, 3,3,3,3);
+    
+    __m128 d_c = _m4_mat2_adj_mul(D, C);
+    __m128 a_b = _m4_mat2_adj_mul(A, B);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, A), _m4_mat2_mul(B, d_c));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, D), _m4_mat2_mul(C, a_b));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, C), _m4_mat2_mul_adj(D, a_b));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, B), _m4_mat2_mul_adj(A, d_c));
+    
+    __m128 tr = _mm_mul_ps(a_b, _m4_swizzle(d_c, 0,2,1,3));
+    tr = _mm_add_ps(tr, _m4_swizzle(tr, 2,3,0,1));
+    tr = _mm_add_ps(tr, _m4_swizzle(tr, 1,0,3,2));
+    
+    __m128 det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+    det = _mm_sub_ps(det, tr);
+    
+    if (_mm_cvtss_f32(det) == 0)
+        return m4_scalar(0);
+    
+    // The sign flips turn the adjugates back into the blocks
+    __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    x = _mm_mul_ps(x, inv_det);
+    y = _mm_mul_ps(y, inv_det);
+    z = _mm_mul_ps(z, inv_det);
+    w = _mm_mul_ps(w, inv_det);
+    
+    Matrix4 inv;
+    _mm_store_ps(inv.m[0], _m4_shuffle(x, y, 3,1,3,1));
+    _mm_store_ps(inv.m[1], _m4_shuffle(x, y, 2,0,2,0));
+    _mm_store_ps(inv.m[2], _m4_shuffle(z, w, 3,1,3,1));
+    _mm_store_ps(inv.m[3], _m4_shuffle(z, w, 2,0,2,0));
+    return inv;
+#else
+	return basic_m4_inverse(m);
+#endif
+}
+
+// Last row is (0, 0, 0, 1), so m4_inverse_affine() can be used
+inline bool m4_is_affine(Matrix4 m) {
+	return m.m[3][0] == 0 && m.m[3][1] == 0 && m.m[3][2] == 0 && m.m[3][3] == 1;
+}
+
+// Inverse of a matrix whose last row is (0, 0, 0, 1), i.e. anything made from translation,
+// rotation & scale, and orthographic projections. Much cheaper than m4_inverse. Gives
+// garbage for perspective projections.
+Matrix4 basic_m4_inverse_affine(Matrix4 m) {
+	// The inverse of the 3x3 part has the cross products of its rows as columns, over the
+	// determinant. The translation becomes -(inverse 3x3 * translation).
+	Vector3 r0 = v3(m.m[0][0], m.m[0][1], m.m[0][2]);
+	Vector3 r1 = v3(m.m[1][0], m.m[1][1], m.m[1][2]);
+	Vector3 r2 = v3(m.m[2][0], m.m[2][1], m.m[2][2]);
+	Vector3 c0 = v3_cross(r1, r2);
+	Vector3 c1 = v3_cross(r2, r0);
+	Vector3 c2 = v3_cross(r0, r1);
+	
+	float32 det = r0.x*c0.x + r0.y*c0.y + r0.z*c0.z;
+	if (det == 0)
+		return m4_scalar(0);
+	
+	float32 inv_det = 1.0f / det;
+	c0 = v3_mulf(c0, inv_det);
+	c1 = v3_mulf(c1, inv_det);
+	c2 = v3_mulf(c2, inv_det);
+	
+	Matrix4 inv = m4_scalar(1.0f);
+	inv.m[0][0] = c0.x; inv.m[0][1] = c1.x; inv.m[0][2] = c2.x;
+	inv.m[1][0] = c0.y; inv.m[1][1] = c1.y; inv.m[1][2] = c2.y;
+	inv.m[2][0] = c0.z; inv.m[2][1] = c1.z; inv.m[2][2] = c2.z;
+	for (int i = 0; i < 3; ++i) {
+		inv.m[i][3] = -(inv.m[i][0]*m.m[0][3] + inv.m[i][1]*m.m[1][3] + inv.m[i][2]*m.m[2][3]);
+	}
+	return inv;
+}
+Matrix4 m4_inverse_affine(Matrix4 m) {
+#if ENABLE_SIMD
+	__m128 r0 = _mm_setr_ps(m.m[0][0], m.m[0][1], m.m[0][2], 0);
+	__m128 r1 = _mm_setr_ps(m.m[1][0], m.m[1][1], m.m[1][2], 0);
+	__m128 r2 = _mm_setr_ps(m.m[2][0], m.m[2][1], m.m[2][2], 0);
+	__m128 c0 = _m4_cross(r1, r2);
+	__m128 c1 = _m4_cross(r2, r0);
+	__m128 c2 = _m4_cross(r0, r1);
+	
+	float32 d[4];
+	_mm_storeu_ps(d, _mm_mul_ps(r0, c0));
+	float32 det = d[0] + d[1] + d[2];
+	if (det == 0)
+		return m4_scalar(0);
+	
+	__m128 inv_det = _mm_set1_ps(1.0f / det);
+	c0 = _mm_mul_ps(c0, inv_det);
+	c1 = _mm_mul_ps(c1, inv_det);
+	c2 = _mm_mul_ps(c2, inv_det);
+	
+	__m128 t = _mm_mul_ps(c0, _mm_set1_ps(m.m[0][3]));
+	t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(m.m[1][3])));
+	t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(m.m[2][3])));
+	// Lane 3 of every column is 0 so this gives the (0, 0, 0, 1) row after the transpose
+	t = _mm_sub_ps(_mm_setr_ps(0, 0, 0, 1), t);
+	
+	_MM_TRANSPOSE4_PS(c0, c1, c2, t);
+	Matrix4 inv;
+	_mm_store_ps(inv.m[0], c0);
+	_mm_store_ps(inv.m[1], c1);
+	_mm_store_ps(inv.m[2], c2);
+	_mm_store_ps(inv.m[3], t);
+	return inv;
+#else
+	return basic_m4_inverse_affine(m);
+#endif
+}
+
 // This isn't really linmath but just putting it here for now
 #define clamp(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
 
@@ -43,12 +43,20 @@ Allocator get_initialization_allocator() {
 
 ///
 ///
-// Basic general heap allocator, free list
+// Basic general heap allocator
 ///
+// Small and medium allocations (up to HEAP_SIZE_CLASS_MAX_SIZE including metadata) are
+// rounded up to a size class and served from slabs with an intrusive free list per class,
+// so alloc & dealloc are O(1) and small allocations can't fragment the rest of the heap.
+// Slabs are carved out of the free list part of the heap and are never given back.
+//
+// Each thread keeps a small cache of free slots per size class, so most size class
+// allocations don't touch heap_lock at all. Caches are filled from and returned to the
+// shared size classes in batches. Threads flush their cache when they exit.
+//
+// Larger allocations go to the free list, which is a best-fit search over all free nodes.
 // Technically thread safe but synchronization is horrible.
-// Fragmentation is catastrophic.
-// We could fix it by merging free nodes every now and then
-// BUT: We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
+// We aren't really supposed to allocate/deallocate directly on the heap too much anyways...
 
 #define MAX_HEAP_BLOCK_SIZE align_next(MB(500), os.page_size)
 #define DEFAULT_HEAP_BLOCK_SIZE (min(MAX_HEAP_BLOCK_SIZE, program_memory_capacity))
@@ -83,16 +91,81 @@ typedef alignat(16) struct Heap_Allocation_Metadata {
 #endif
 } Heap_Allocation_Metadata;
 
+// Size classes are the full slot size, including Heap_Allocation_Metadata.
+// 32 to 256 in steps of 16, then 4 classes per power of two up to HEAP_SIZE_CLASS_MAX_SIZE,
+// so we never waste more than 25% of a slot on rounding.
+#define HEAP_SIZE_CLASS_MAX_SIZE KB(32)
+#define HEAP_SMALL_SIZE_CLASS_COUNT 15
+#define HEAP_SIZE_CLASS_COUNT (HEAP_SMALL_SIZE_CLASS_COUNT + 7*4)
+#define HEAP_SLAB_SIZE KB(64)
+// How much a thread cache moves to/from the shared size class in one go.
+// A bin holds at most two batches.
+#define HEAP_THREAD_CACHE_BATCH_BYTES KB(16)
+#define HEAP_THREAD_CACHE_MAX_BATCH_COUNT 64
+
+typedef struct Heap_Free_Slot Heap_Free_Slot;
+typedef struct Heap_Free_Slot {
+	Heap_Free_Slot *next;
+} Heap_Free_Slot;
+
+typedef struct Heap_Size_Class {
+	u64 slot_size;
+	Heap_Free_Slot *free_head;
+	u64 slab_count;
+	u64 slab_bytes;
+	u64 slot_count;
+	u64 free_count; // Excluding slots sitting in thread caches
+	u64 batch_count;
+} Heap_Size_Class;
+
+typedef struct Heap_Thread_Cache_Bin {
+	Heap_Free_Slot *head;
+	u64 count;
+} Heap_Thread_Cache_Bin;
+
+typedef struct Heap_Stats {
+	u64 block_count;
+	u64 block_bytes; // Excluding Heap_Block metadata
+	u64 free_bytes; // Free bytes in the free list part of the heap
+	u64 free_node_count;
+	u64 largest_free_node;
+	u64 slab_bytes; // Bytes taken from the free list for size class slabs
+	u64 slot_bytes_in_use; // Including slots sitting in thread caches
+	u64 slot_bytes_free;
+} Heap_Stats;
+
 // #Global
 ogb_instance Heap_Block *heap_head;
 ogb_instance bool heap_initted;
 ogb_instance Spinlock heap_lock;
+ogb_instance Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+// Turn this off to make every size class alloc/dealloc go through heap_lock.
+// Thread caches are thread_local so they can't be shared with an external instance,
+// which always takes the locked path.
+ogb_instance bool heap_use_thread_caches;
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 Heap_Block *heap_head;
 bool heap_initted = false;
 Spinlock heap_lock;
+Heap_Size_Class heap_size_classes[HEAP_SIZE_CLASS_COUNT];
+bool heap_use_thread_caches = true;
+thread_local Heap_Thread_Cache_Bin heap_thread_cache[HEAP_SIZE_CLASS_COUNT];
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+u64 get_heap_size_class_slot_size(u64 size_class) {
+	if (size_class < HEAP_SMALL_SIZE_CLASS_COUNT) return (size_class+2)*16;
+	u64 k = size_class - HEAP_SMALL_SIZE_CLASS_COUNT;
+	u64 p = 8 + k/4;
+	return (1ULL << p) + (k%4+1)*(1ULL << (p-2));
+}
+// slot_size must include the metadata and be <= HEAP_SIZE_CLASS_MAX_SIZE
+u64 get_heap_size_class(u64 slot_size) {
+	if (slot_size <= 32) return 0;
+	if (slot_size <= 256) return (slot_size+15)/16 - 2;
+	u64 p = 63 - count_leading_zeros_64(slot_size-1);
+	return HEAP_SMALL_SIZE_CLASS_COUNT + (p-8)*4 + (((slot_size-1) >> (p-2)) & 3);
+}
 	
 
 u64 get_heap_block_size_excluding_metadata(Heap_Block *block) {
@@ -155,6 +228,11 @@ inline void check_meta(Heap_Allocation_Metadata *meta) {
 #if CONFIGURATION == DEBUG
 	assert(meta->signature == HEAP_META_SIGNATURE, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
 #endif
+	// Size class slots don't belong to a block directly
+	if (!meta->block) {
+		assert(meta->size <= HEAP_SIZE_CLASS_MAX_SIZE && heap_size_classes[get_heap_size_class(meta->size)].slot_size == meta->size, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");
+		return;
+	}
 // If > 256GB then prolly not legit lol
 	assert(meta->size < 1024ULL*1024ULL*1024ULL*256ULL, "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap.");	
 	assert(is_pointer_in_program_memory(meta->block), "Heap error. Either 1) You passed a bad pointer to dealloc or 2) You corrupted the heap."); 
@@ -247,19 +325,18 @@ void heap_init() {
 	heap_initted = true;
 	heap_head = make_heap_block(0, DEFAULT_HEAP_BLOCK_SIZE);
 	spinlock_init(&heap_lock);
+	spinlock_set_name(&heap_lock, STR("heap_lock"));
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i += 1) {
+		heap_size_classes[i] = (Heap_Size_Class){0};
+		heap_size_classes[i].slot_size = get_heap_size_class_slot_size(i);
+		heap_size_classes[i].batch_count = clamp(HEAP_THREAD_CACHE_BATCH_BYTES/heap_size_classes[i].slot_size, 2, HEAP_THREAD_CACHE_MAX_BATCH_COUNT);
+	}
+	assert(heap_size_classes[HEAP_SIZE_CLASS_COUNT-1].slot_size == HEAP_SIZE_CLASS_MAX_SIZE);
 }
 
-void *heap_alloc(u64 size) {
-
-	if (!heap_initted) heap_init();
-
-	// #Sync #Speed oof
-	spinlock_acquire_or_wait(&heap_lock);
-	
-
-
+// Free list path. Caller must hold heap_lock.
+void *heap_alloc_large_locked(u64 size) {
 
-	
 	size += sizeof(Heap_Allocation_Metadata);
 	
 	size = (size+HEAP_ALIGNMENT) & ~(HEAP_ALIGNMENT-1);
@@ -388,25 +465,13 @@ void *heap_alloc(u64 size) {
 	sanity_check_block(meta->block);
 #endif
 	
-	// #Sync #Speed oof
-	spinlock_release(&heap_lock);
-	
-	
 	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
 	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
 	return p;
 }
-void heap_dealloc(void *p) {
-	// #Sync #Speed oof
-	
-	if (!heap_initted) heap_init();
-
-	spinlock_acquire_or_wait(&heap_lock);
-	
-	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
-	p = (u8*)p-sizeof(Heap_Allocation_Metadata);
-	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(p);
-	check_meta(meta);
+// Free list path. Caller must hold heap_lock and have checked the metadata.
+void heap_dealloc_large_locked(Heap_Allocation_Metadata *meta) {
+	void *p = meta;
 	
 	// Yoink meta data before we start overwriting it
 	Heap_Block *block = meta->block;
@@ -527,10 +592,236 @@ void heap_dealloc(void *p) {
 #if VERY_DEBUG
 	sanity_check_block(block);
 #endif
+}
+
+// Caller must hold heap_lock
+void heap_size_class_refill_locked(Heap_Size_Class *c) {
+	u64 slab_size = max(HEAP_SLAB_SIZE, c->slot_size*4);
+	u8 *slab = (u8*)heap_alloc_large_locked(slab_size);
+	u64 slot_count = slab_size / c->slot_size;
+	
+	// Thread back to front so we hand out slots in address order
+	for (s64 i = (s64)slot_count-1; i >= 0; i -= 1) {
+		Heap_Free_Slot *slot = (Heap_Free_Slot*)(slab + (u64)i*c->slot_size);
+		slot->next = c->free_head;
+		c->free_head = slot;
+	}
+	
+	c->slab_count += 1;
+	c->slab_bytes += slab_size;
+	c->slot_count += slot_count;
+	c->free_count += slot_count;
+}
+
+inline void *heap_size_class_init_slot(Heap_Size_Class *c, Heap_Free_Slot *slot) {
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)slot;
+	meta->size = c->slot_size;
+	meta->block = 0;
+#if CONFIGURATION == DEBUG
+	meta->signature = HEAP_META_SIGNATURE;
+#endif
+	
+	void *p = ((u8*)meta)+sizeof(Heap_Allocation_Metadata);
+	assert((u64)p % HEAP_ALIGNMENT == 0, "Internal heap error. Result pointer is not aligned to HEAP_ALIGNMENT");
+	return p;
+}
+
+// Caller must hold heap_lock
+void *heap_size_class_alloc_locked(Heap_Size_Class *c) {
+	if (!c->free_head) heap_size_class_refill_locked(c);
+	
+	Heap_Free_Slot *slot = c->free_head;
+	c->free_head = slot->next;
+	c->free_count -= 1;
+	
+	return heap_size_class_init_slot(c, slot);
+}
+
+// Caller must hold heap_lock and have checked the metadata
+void heap_size_class_dealloc_locked(Heap_Allocation_Metadata *meta) {
+	Heap_Size_Class *c = &heap_size_classes[get_heap_size_class(meta->size)];
+	
+#if CONFIGURATION == DEBUG
+	memset(meta, 0x69696969, c->slot_size);
+#endif
+	
+	Heap_Free_Slot *slot = (Heap_Free_Slot*)meta;
+	slot->next = c->free_head;
+	c->free_head = slot;
+	c->free_count += 1;
+}
+
+// Caller must hold heap_lock
+void heap_thread_cache_fill_locked(Heap_Size_Class *c, Heap_Thread_Cache_Bin *bin) {
+	for (u64 i = 0; i < c->batch_count; i += 1) {
+		if (!c->free_head) heap_size_class_refill_locked(c);
+		
+		Heap_Free_Slot *slot = c->free_head;
+		c->free_head = slot->next;
+		c->free_count -= 1;
+		
+		slot->next = bin->head;
+		bin->head = slot;
+		bin->count += 1;
+	}
+}
+// Caller must hold heap_lock
+void heap_thread_cache_release_locked(Heap_Size_Class *c, Heap_Thread_Cache_Bin *bin, u64 count) {
+	for (u64 i = 0; i < count; i += 1) {
+		Heap_Free_Slot *slot = bin->head;
+		bin->head = slot->next;
+		bin->count -= 1;
+		
+		slot->next = c->free_head;
+		c->free_head = slot;
+		c->free_count += 1;
+	}
+}
+
+// Gives all slots cached by the calling thread back to the shared size classes.
+// Threads started with os_thread_start do this when they exit.
+void heap_thread_cache_flush() {
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+	if (!heap_initted) return;
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i += 1) {
+		Heap_Thread_Cache_Bin *bin = &heap_thread_cache[i];
+		if (bin->count) heap_thread_cache_release_locked(&heap_size_classes[i], bin, bin->count);
+	}
+	spinlock_release(&heap_lock);
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+}
+
+void *heap_alloc(u64 size) {
+
+	if (!heap_initted) heap_init();
+	
+	u64 slot_size = size + sizeof(Heap_Allocation_Metadata);
+	
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+	if (slot_size <= HEAP_SIZE_CLASS_MAX_SIZE && heap_use_thread_caches) {
+		u64 size_class = get_heap_size_class(slot_size);
+		Heap_Size_Class *c = &heap_size_classes[size_class];
+		Heap_Thread_Cache_Bin *bin = &heap_thread_cache[size_class];
+		
+		if (!bin->head) {
+			spinlock_acquire_or_wait(&heap_lock);
+			heap_thread_cache_fill_locked(c, bin);
+			spinlock_release(&heap_lock);
+		}
+		
+		Heap_Free_Slot *slot = bin->head;
+		bin->head = slot->next;
+		bin->count -= 1;
+		
+		return heap_size_class_init_slot(c, slot);
+	}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+	
+	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	void *p;
+	if (slot_size <= HEAP_SIZE_CLASS_MAX_SIZE) {
+		p = heap_size_class_alloc_locked(&heap_size_classes[get_heap_size_class(slot_size)]);
+	} else {
+		p = heap_alloc_large_locked(size);
+	}
+	
+	spinlock_release(&heap_lock);
+	
+	return p;
+}
+// Always goes through the free list, regardless of size.
+// Only really useful for comparing against the size classes.
+void *heap_alloc_large(u64 size) {
+	if (!heap_initted) heap_init();
+	spinlock_acquire_or_wait(&heap_lock);
+	void *p = heap_alloc_large_locked(size);
+	spinlock_release(&heap_lock);
+	return p;
+}
+void heap_dealloc(void *p) {
+	
+	if (!heap_initted) heap_init();
+	
+	assert(is_pointer_in_program_memory(p), "A bad pointer was passed tp heap_dealloc: it is out of program memory bounds!"); 
+	Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)((u8*)p-sizeof(Heap_Allocation_Metadata));
+	
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+	if (!meta->block && heap_use_thread_caches) {
+		check_meta(meta);
+		
+		// Slots are interchangeable within a size class, so it doesn't matter
+		// which thread allocated this one.
+		u64 size_class = get_heap_size_class(meta->size);
+		Heap_Size_Class *c = &heap_size_classes[size_class];
+		Heap_Thread_Cache_Bin *bin = &heap_thread_cache[size_class];
+		
+#if CONFIGURATION == DEBUG
+		memset(meta, 0x69696969, c->slot_size);
+#endif
+		
+		Heap_Free_Slot *slot = (Heap_Free_Slot*)meta;
+		slot->next = bin->head;
+		bin->head = slot;
+		bin->count += 1;
+		
+		if (bin->count > c->batch_count*2) {
+			spinlock_acquire_or_wait(&heap_lock);
+			heap_thread_cache_release_locked(c, bin, c->batch_count);
+			spinlock_release(&heap_lock);
+		}
+		return;
+	}
+#endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
+	
 	// #Sync #Speed oof
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	check_meta(meta);
+	
+	if (meta->block) heap_dealloc_large_locked(meta);
+	else             heap_size_class_dealloc_locked(meta);
+	
 	spinlock_release(&heap_lock);
 }
 
+Heap_Stats heap_get_stats() {
+	if (!heap_initted) heap_init();
+	
+	Heap_Stats stats = ZERO(Heap_Stats);
+	
+	spinlock_acquire_or_wait(&heap_lock);
+	
+	Heap_Block *block = heap_head;
+	while (block) {
+		stats.block_count += 1;
+		stats.block_bytes += get_heap_block_size_excluding_metadata(block);
+		
+		Heap_Free_Node *node = block->free_head;
+		while (node) {
+			stats.free_node_count += 1;
+			stats.free_bytes += node->size;
+			stats.largest_free_node = max(stats.largest_free_node, node->size);
+			node = node->next;
+		}
+		block = block->next;
+	}
+	
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i += 1) {
+		Heap_Size_Class *c = &heap_size_classes[i];
+		stats.slab_bytes       += c->slab_bytes;
+		stats.slot_bytes_free  += c->free_count*c->slot_size;
+		stats.slot_bytes_in_use += (c->slot_count-c->free_count)*c->slot_size;
+	}
+	
+	spinlock_release(&heap_lock);
+	
+	return stats;
+}
+
 void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
 	switch (message) {
 		case ALLOCATOR_ALLOCATE: {
@@ -549,7 +840,7 @@ void* heap_allocator_proc(u64 size, void *p, Allocator_Message message, void* da
 			Heap_Allocation_Metadata *meta = (Heap_Allocation_Metadata*)(((u64)p)-sizeof(Heap_Allocation_Metadata));
 			check_meta(meta);
 			void *new = heap_alloc(size);
-			memcpy(new, p, min(size, meta->size));
+			memcpy(new, p, min(size, meta->size-sizeof(Heap_Allocation_Metadata)));
 			heap_dealloc(p);
 			return new;
 		}
@@ -575,6 +866,34 @@ Allocator get_heap_allocator() {
 	#define TEMPORARY_STORAGE_SIZE (1024ULL*1024ULL*2ULL) // 2mb
 #endif
 
+// Each thread has a block of temporary storage. If a frame needs more than that, we chain
+// extra blocks from the heap instead of wrapping around over memory that's still in use.
+// The extra blocks are freed in reset_temporary_storage().
+// Look at get_temporary_storage_stats() to see how big the block actually needs to be.
+
+typedef struct Temporary_Storage_Block Temporary_Storage_Block;
+typedef struct Temporary_Storage_Block {
+	Temporary_Storage_Block *previous;
+	void *end;
+} Temporary_Storage_Block;
+
+// Returned by temp_begin(), pass it to temp_end() to free everything talloc'd in between
+typedef struct Temp_Mark {
+	Temporary_Storage_Block *block;
+	void *pointer;
+	u64 used;
+} Temp_Mark;
+
+typedef struct Temporary_Storage_Stats {
+	u64 size; // Size of the thread's main block
+	u64 used; // Right now
+	u64 high_water; // Most used at once since the last reset_temporary_storage()
+	u64 last_frame_high_water; // high_water at the last reset_temporary_storage()
+	u64 peak_high_water; // Most used at once since temporary_storage_init()
+	u64 overflow_block_count; // Blocks chained since the last reset_temporary_storage()
+	u64 total_overflow_block_count;
+} Temporary_Storage_Stats;
+
 ogb_instance void* talloc(u64);
 ogb_instance void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void*);
 
@@ -585,6 +904,9 @@ get_temporary_allocator();
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 thread_local void * temporary_storage = 0;
 thread_local void * temporary_storage_pointer = 0;
+thread_local void * temporary_storage_end = 0;
+thread_local Temporary_Storage_Block *temporary_storage_overflow_head = 0;
+thread_local Temporary_Storage_Stats temporary_storage_stats;
 thread_local bool   has_warned_temporary_storage_overflow = false;
 thread_local Allocator temp_allocator;
 
@@ -601,12 +923,25 @@ temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data);
 ogb_instance void 
 temporary_storage_init(u64 arena_size);
 
+// Frees the calling thread's temporary storage, including any overflow blocks
+ogb_instance void 
+temporary_storage_deinit();
+
 ogb_instance void* 
 talloc(u64 size);
 
 ogb_instance void 
 reset_temporary_storage();
 
+ogb_instance Temp_Mark 
+temp_begin();
+
+ogb_instance void 
+temp_end(Temp_Mark mark);
+
+ogb_instance Temporary_Storage_Stats 
+get_temporary_storage_stats();
+
 
 #if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
 void* temp_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
@@ -631,55 +966,188 @@ void temporary_storage_init(u64 arena_size) {
 	temporary_storage = heap_alloc(arena_size);
 	assert(temporary_storage, "Failed allocating temporary storage");
 	temporary_storage_pointer = temporary_storage;
+	temporary_storage_end = (u8*)temporary_storage + arena_size;
+	temporary_storage_overflow_head = 0;
+	
+	temporary_storage_stats = ZERO(Temporary_Storage_Stats);
+	temporary_storage_stats.size = arena_size;
 
 	temp_allocator.proc = temp_allocator_proc;
 	temp_allocator.data = 0;
+}
+
+// Frees overflow blocks until block is the newest one (0 means the main block)
+void temporary_storage_pop_blocks(Temporary_Storage_Block *block) {
+	while (temporary_storage_overflow_head != block) {
+		assert(temporary_storage_overflow_head, "Temp mark block is not in the chain. Did you temp_end() the same mark twice or after reset_temporary_storage()?");
+		Temporary_Storage_Block *previous = temporary_storage_overflow_head->previous;
+		heap_dealloc(temporary_storage_overflow_head);
+		temporary_storage_overflow_head = previous;
+	}
 	
-	temp_allocator.proc = temp_allocator_proc;
+	if (block) temporary_storage_end = block->end;
+	else       temporary_storage_end = (u8*)temporary_storage + temporary_storage_stats.size;
+}
+
+void temporary_storage_deinit() {
+	temporary_storage_pop_blocks(0);
+	heap_dealloc(temporary_storage);
+	temporary_storage = 0;
+	temporary_storage_pointer = 0;
+	temporary_storage_end = 0;
 }
 
 void* talloc(u64 size) {
 	
-	assert(size < TEMPORARY_STORAGE_SIZE, "Bruddah this is too large for temp allocator");
+	if ((u8*)temporary_storage_pointer + size > (u8*)temporary_storage_end) {
+		if (!has_warned_temporary_storage_overflow) {
+			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, chaining more memory from the heap until the next reset_temporary_storage().\n"));
+			has_warned_temporary_storage_overflow = true;
+		}
+		
+		u64 block_size = sizeof(Temporary_Storage_Block) + max(size, temporary_storage_stats.size);
+		Temporary_Storage_Block *block = (Temporary_Storage_Block*)heap_alloc(block_size);
+		block->previous = temporary_storage_overflow_head;
+		block->end = (u8*)block + block_size;
+		temporary_storage_overflow_head = block;
+		
+		temporary_storage_pointer = (u8*)block + sizeof(Temporary_Storage_Block);
+		temporary_storage_end = block->end;
+		
+		temporary_storage_stats.overflow_block_count += 1;
+		temporary_storage_stats.total_overflow_block_count += 1;
+	}
 	
 	void* p = temporary_storage_pointer;
 	
 	temporary_storage_pointer = (u8*)temporary_storage_pointer + size;
 	
-	if ((u8*)temporary_storage_pointer >= (u8*)temporary_storage+TEMPORARY_STORAGE_SIZE) {
-		if (!has_warned_temporary_storage_overflow) {
-			os_write_string_to_stdout(STR("WARNING: temporary storage was overflown, we wrap around at the start.\n"));
-			has_warned_temporary_storage_overflow = true;
-		}
-		temporary_storage_pointer = temporary_storage;
-		return talloc(size);;
-	}
+	temporary_storage_stats.used += size;
+	temporary_storage_stats.high_water = max(temporary_storage_stats.high_water, temporary_storage_stats.used);
 	
 	return p;
 }
 
 void reset_temporary_storage() {
-	temporary_storage_pointer = temporary_storage;	
+	temporary_storage_pop_blocks(0);
+	temporary_storage_pointer = temporary_storage;
+	
+	temporary_storage_stats.peak_high_water = max(temporary_storage_stats.peak_high_water, temporary_storage_stats.high_water);
+	temporary_storage_stats.last_frame_high_water = temporary_storage_stats.high_water;
+	temporary_storage_stats.high_water = 0;
+	temporary_storage_stats.used = 0;
+	temporary_storage_stats.overflow_block_count = 0;
+	
+	// Warn again the next frame that overflows
 	has_warned_temporary_storage_overflow = false;
 }
 
+Temp_Mark temp_begin() {
+	Temp_Mark mark;
+	mark.block = temporary_storage_overflow_head;
+	mark.pointer = temporary_storage_pointer;
+	mark.used = temporary_storage_stats.used;
+	return mark;
+}
+void temp_end(Temp_Mark mark) {
+	temporary_storage_pop_blocks(mark.block);
+	temporary_storage_pointer = mark.pointer;
+	temporary_storage_stats.used = mark.used;
+}
+
+Temporary_Storage_Stats get_temporary_storage_stats() {
+	Temporary_Storage_Stats stats = temporary_storage_stats;
+	stats.peak_high_water = max(stats.peak_high_water, stats.high_water);
+	return stats;
+}
+
 #endif // NOT OOGABOOGA_LINK_EXTERNAL_INSTANCE
 
 
+///
+///
+// Arena
+///
+// Bump allocator. Either a fixed block of memory (make_arena, make_arena_allocator,
+// make_arena_allocator_with_memory) or a virtual arena (make_virtual_arena).
+// Virtual arenas reserve max_size of address space up front and commit pages as they
+// grow, so you don't need to guess a worst case in physical memory and pointers into
+// the arena never move.
+
+#define ARENA_ALIGNMENT 8
+#define ARENA_COMMIT_SIZE KB(64)
+
 typedef struct Arena {
 	void *start;
 	void *next;
-	u64 size;
+	u64 size; // For virtual arenas, this is the reserved size
+	u64 committed; // Virtual arenas only
+	u64 high_water; // Most bytes used since creation or the last arena_decommit_to_high_water_mark
+	bool is_virtual;
 } Arena;
 
+// Bytes used at the time the mark was taken
+typedef u64 Arena_Mark;
+
+u64 arena_get_used(Arena *arena) {
+	return (u64)arena->next - (u64)arena->start;
+}
+
+void *arena_push(Arena *arena, u64 size) {
+	size = align_next(size, ARENA_ALIGNMENT);
+	
+	u64 used = arena_get_used(arena);
+	assert(size <= arena->size - used, "Arena is out of memory. %llu/%llu bytes used, tried to allocate %llu bytes.", used, arena->size, size);
+	u64 new_used = used + size;
+	
+	if (arena->is_virtual && new_used > arena->committed) {
+		u64 new_committed = min(align_next(new_used, ARENA_COMMIT_SIZE), arena->size);
+		bool ok = os_commit_virtual_memory((u8*)arena->start+arena->committed, new_committed-arena->committed);
+		assert(ok, "Failed committing arena memory. Out of memory?");
+		arena->committed = new_committed;
+	}
+	
+	void *p = arena->next;
+	arena->next = (u8*)arena->start + new_used;
+	arena->high_water = max(arena->high_water, new_used);
+	return p;
+}
+
+void arena_reset(Arena *arena) {
+	arena->next = arena->start;
+}
+
+Arena_Mark arena_get_mark(Arena *arena) {
+	return arena_get_used(arena);
+}
+// Frees everything allocated after the mark was taken
+void arena_pop_to_mark(Arena *arena, Arena_Mark mark) {
+	assert(mark <= arena_get_used(arena), "Arena mark is past the end of the arena. Did you pop to a mark taken after an earlier pop or reset?");
+	arena->next = (u8*)arena->start + mark;
+}
+
+// Gives back committed pages above the most memory used since the last call (or since
+// creation), then starts tracking the high water mark again from what's used right now.
+// Call this where usage is known to have dropped for good, like after unloading a level,
+// so resident memory follows what the program actually needs instead of its worst moment.
+// Does nothing on arenas that aren't virtual.
+void arena_decommit_to_high_water_mark(Arena *arena) {
+	if (!arena->is_virtual) return;
+	
+	u64 used = arena_get_used(arena);
+	u64 keep = min(align_next(max(arena->high_water, used), ARENA_COMMIT_SIZE), arena->size);
+	if (keep < arena->committed) {
+		os_decommit_virtual_memory((u8*)arena->start+keep, arena->committed-keep);
+		arena->committed = keep;
+	}
+	arena->high_water = used;
+}
+
 void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
-	if (size > 8) size = align_next(size, 8);
 	Arena *arena = (Arena*)data;
 	switch (message) {
 		case ALLOCATOR_ALLOCATE: {
-			void *p = arena->next;
-			
-			arena->next = (u8*)arena->next + size;
+			return arena_push(arena, size);
 			break;
 		}
 		case ALLOCATOR_DEALLOCATE: {
@@ -693,10 +1161,17 @@ void* arena_allocator_proc(u64 size, void *p, Allocator_Message message, void* d
 	return 0;
 }
 
+Allocator get_arena_allocator(Arena *arena) {
+	Allocator allocator;
+	allocator.data = arena;
+	allocator.proc = arena_allocator_proc;
+	return allocator;
+}
+
 // Allocates arena from heap
 Arena make_arena(u64 size) {
-	size = align_next(size, 8);
-	Arena arena;
+	size = align_next(size, ARENA_ALIGNMENT);
+	Arena arena = ZERO(Arena);
 	
 	arena.start = alloc(get_heap_allocator(), size);
 	arena.next = arena.start;
@@ -705,34 +1180,282 @@ Arena make_arena(u64 size) {
 	return arena;
 }
 
+// Reserves max_size of address space, but only commits memory as the arena grows.
+// max_size can be very generous, like GB(16).
+Arena make_virtual_arena(u64 max_size) {
+	max_size = align_next(max_size, os.granularity);
+	Arena arena = ZERO(Arena);
+	
+	arena.start = os_reserve_virtual_memory(max_size);
+	assert(arena.start, "Failed reserving %llu bytes of address space for arena", max_size);
+	arena.next = arena.start;
+	arena.size = max_size;
+	arena.is_virtual = true;
+	
+	return arena;
+}
+
+// Only for arenas from make_arena or make_virtual_arena
+void arena_destroy(Arena *arena) {
+	if (arena->is_virtual) os_release_virtual_memory(arena->start);
+	else                   dealloc(get_heap_allocator(), arena->start);
+	*arena = ZERO(Arena);
+}
+
 // Allocates arena from heap
 Allocator make_arena_allocator(u64 size) {
+	size = align_next(size, ARENA_ALIGNMENT);
 	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
 	
 	Arena *arena = (Arena*)mem;
+	*arena = ZERO(Arena);
 	
 	arena->start = (u8*)mem + sizeof(Arena);
 	arena->next = arena->start;
 	arena->size = size;
 	
-	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
-	
-	return allocator;
+	return get_arena_allocator(arena);
 }
 Allocator make_arena_allocator_with_memory(u64 size, void *p) {
-	void *mem = alloc(get_heap_allocator(), size + sizeof(Arena));
 	
 	Arena *arena = (Arena*)alloc(get_heap_allocator(), sizeof(Arena));
+	*arena = ZERO(Arena);
 	
 	arena->start = p;
 	arena->next = arena->start;
 	arena->size = size;
 	
+	return get_arena_allocator(arena);
+}
+
+///
+///
+// Pool
+///
+// Fixed size objects handed out from chunks through an intrusive free list, so alloc and
+// free are O(1) no matter how many objects are live. Objects never move, chunks are only
+// given back in pool_destroy().
+//
+// With use_generations, each slot also has a generation counter which is bumped on alloc
+// and free (odd means live). That lets us:
+//  - catch double frees,
+//  - keep a Pool_Handle and check if it still refers to the same object (pool_resolve),
+//  - iterate live objects (pool_iterate).
+// It also keeps the free list link out of the object, so a freed object's memory is left
+// exactly as you left it.
+
+#define POOL_ALIGNMENT 16
+
+typedef struct Pool_Chunk Pool_Chunk;
+typedef struct Pool_Chunk {
+	Pool_Chunk *next;
+	u64 padding;
+	// Slots follow
+} Pool_Chunk;
+
+typedef struct Pool_Slot_Header {
+	u64 generation;
+	void *next_free;
+} Pool_Slot_Header;
+
+typedef struct Pool {
+	u64 object_size;
+	u64 slot_size;
+	u64 objects_per_chunk;
+	Pool_Chunk *first_chunk;
+	Pool_Chunk *last_chunk;
+	u64 chunk_count;
+	void *free_head; // Slot, not object
+	u64 count; // Live objects
+	bool use_generations;
 	Allocator allocator;
-	allocator.data = arena;
-	allocator.proc = arena_allocator_proc;
+} Pool;
+
+typedef struct Pool_Handle {
+	void *object;
+	u64 generation;
+} Pool_Handle;
+
+Pool make_pool(u64 object_size, u64 objects_per_chunk, bool use_generations, Allocator allocator) {
+	assert(object_size > 0 && objects_per_chunk > 0, "Pool needs a non-zero object size and chunk size");
+	assert(sizeof(Pool_Chunk) % POOL_ALIGNMENT == 0 && sizeof(Pool_Slot_Header) % POOL_ALIGNMENT == 0);
+	
+	Pool pool = ZERO(Pool);
+	pool.object_size = object_size;
+	pool.slot_size = align_next(max(object_size, sizeof(void*)), POOL_ALIGNMENT);
+	if (use_generations) pool.slot_size += sizeof(Pool_Slot_Header);
+	pool.objects_per_chunk = objects_per_chunk;
+	pool.use_generations = use_generations;
+	pool.allocator = allocator;
+	return pool;
+}
+
+inline void *pool_slot_to_object(Pool *pool, void *slot) {
+	return pool->use_generations ? (u8*)slot + sizeof(Pool_Slot_Header) : slot;
+}
+inline void *pool_object_to_slot(Pool *pool, void *object) {
+	return pool->use_generations ? (u8*)object - sizeof(Pool_Slot_Header) : object;
+}
+inline void *pool_get_next_free(Pool *pool, void *slot) {
+	return pool->use_generations ? ((Pool_Slot_Header*)slot)->next_free : *(void**)slot;
+}
+inline void pool_set_next_free(Pool *pool, void *slot, void *next) {
+	if (pool->use_generations) ((Pool_Slot_Header*)slot)->next_free = next;
+	else                       *(void**)slot = next;
+}
+
+void pool_add_chunk(Pool *pool) {
+	u64 chunk_size = sizeof(Pool_Chunk) + pool->slot_size*pool->objects_per_chunk;
+	Pool_Chunk *chunk = (Pool_Chunk*)alloc(pool->allocator, chunk_size);
+	assert(chunk, "Failed allocating pool chunk");
+	assert((u64)chunk % POOL_ALIGNMENT == 0, "Pool allocator returned memory that isn't aligned to POOL_ALIGNMENT");
+	
+	// Zeroed so slots that were never handed out read as zero, and generations start at 0
+	memset(chunk, 0, chunk_size);
+	
+	u8 *slots = (u8*)chunk + sizeof(Pool_Chunk);
+	for (s64 i = (s64)pool->objects_per_chunk-1; i >= 0; i -= 1) {
+		void *slot = slots + (u64)i*pool->slot_size;
+		pool_set_next_free(pool, slot, pool->free_head);
+		pool->free_head = slot;
+	}
+	
+	// Link it last, after it's initialized, so anyone walking the chunks
+	// (pool_iterate) never sees a half initialized chunk.
+	if (pool->last_chunk) pool->last_chunk->next = chunk;
+	else                  pool->first_chunk = chunk;
+	pool->last_chunk = chunk;
+	pool->chunk_count += 1;
+}
+
+// Not zero initialized unless it's a fresh slot. Use alloc(get_pool_allocator(&pool), size)
+// if you want it zeroed like other allocators.
+void *pool_alloc(Pool *pool) {
+	if (!pool->free_head) pool_add_chunk(pool);
+	
+	void *slot = pool->free_head;
+	pool->free_head = pool_get_next_free(pool, slot);
+	pool->count += 1;
+	
+	if (pool->use_generations) {
+		Pool_Slot_Header *header = (Pool_Slot_Header*)slot;
+		assert(header->generation % 2 == 0, "Pool is corrupt, a slot on the free list is live");
+		header->generation += 1;
+		header->next_free = 0;
+	}
+	
+	return pool_slot_to_object(pool, slot);
+}
+
+bool pool_owns(Pool *pool, void *object) {
+	Pool_Chunk *chunk = pool->first_chunk;
+	while (chunk) {
+		u8 *slots = (u8*)chunk + sizeof(Pool_Chunk);
+		u8 *slot = (u8*)pool_object_to_slot(pool, object);
+		if (slot >= slots && slot < slots + pool->slot_size*pool->objects_per_chunk) {
+			return (u64)(slot-slots) % pool->slot_size == 0;
+		}
+		chunk = chunk->next;
+	}
+	return false;
+}
+
+void pool_free(Pool *pool, void *object) {
+#if VERY_DEBUG
+	assert(pool_owns(pool, object), "Pointer passed to pool_free was not allocated from this pool");
+#endif
+	void *slot = pool_object_to_slot(pool, object);
 	
+	if (pool->use_generations) {
+		Pool_Slot_Header *header = (Pool_Slot_Header*)slot;
+		assert(header->generation % 2 == 1, "Pool object was freed twice");
+		header->generation += 1;
+	}
+	
+	pool_set_next_free(pool, slot, pool->free_head);
+	pool->free_head = slot;
+	pool->count -= 1;
+}
+
+// Requires use_generations
+Pool_Handle pool_get_handle(Pool *pool, void *object) {
+	assert(pool->use_generations, "Pool handles need a pool with generations");
+	Pool_Slot_Header *header = (Pool_Slot_Header*)pool_object_to_slot(pool, object);
+	assert(header->generation % 2 == 1, "Tried to get a handle to a pool object that isn't live");
+	return (Pool_Handle){ object, header->generation };
+}
+// Returns 0 if the object was freed since the handle was made (even if the slot was reused)
+void *pool_resolve(Pool *pool, Pool_Handle handle) {
+	assert(pool->use_generations, "Pool handles need a pool with generations");
+	if (!handle.object) return 0;
+	Pool_Slot_Header *header = (Pool_Slot_Header*)pool_object_to_slot(pool, handle.object);
+	return header->generation == handle.generation ? handle.object : 0;
+}
+
+// Requires use_generations. Goes through live objects in address order per chunk.
+// It's fine to pool_free the object you just got.
+// Start with *cursor = 0.
+bool pool_iterate(Pool *pool, u64 *cursor, void **object) {
+	if (!pool->first_chunk) return false;
+	assert(pool->use_generations, "pool_iterate needs a pool with generations to know which objects are live");
+	
+	u64 chunk_index = *cursor / pool->objects_per_chunk;
+	Pool_Chunk *chunk = pool->first_chunk;
+	for (u64 i = 0; i < chunk_index && chunk; i += 1) chunk = chunk->next;
+	
+	while (chunk) {
+		u8 *slots = (u8*)chunk + sizeof(Pool_Chunk);
+		for (u64 i = *cursor % pool->objects_per_chunk; i < pool->objects_per_chunk; i += 1) {
+			*cursor += 1;
+			Pool_Slot_Header *header = (Pool_Slot_Header*)(slots + i*pool->slot_size);
+			if (header->generation % 2 == 1) {
+				if (object) *object = pool_slot_to_object(pool, header);
+				return true;
+			}
+		}
+		chunk = chunk->next;
+	}
+	return false;
+}
+
+void pool_destroy(Pool *pool) {
+	Pool_Chunk *chunk = pool->first_chunk;
+	while (chunk) {
+		Pool_Chunk *next = chunk->next;
+		dealloc(pool->allocator, chunk);
+		chunk = next;
+	}
+	pool->first_chunk = 0;
+	pool->last_chunk = 0;
+	pool->chunk_count = 0;
+	pool->free_head = 0;
+	pool->count = 0;
+}
+
+void* pool_allocator_proc(u64 size, void *p, Allocator_Message message, void* data) {
+	Pool *pool = (Pool*)data;
+	switch (message) {
+		case ALLOCATOR_ALLOCATE: {
+			assert(size <= pool->object_size, "Tried to allocate %llu bytes from a pool of %llu byte objects", size, pool->object_size);
+			return pool_alloc(pool);
+			break;
+		}
+		case ALLOCATOR_DEALLOCATE: {
+			pool_free(pool, p);
+			return 0;
+		}
+		case ALLOCATOR_REALLOCATE: {
+			if (!p) return pool_alloc(pool);
+			assert(size <= pool->object_size, "Pool objects can't grow past the pool object size");
+			return p;
+		}
+	}
+	return 0;
+}
+
+Allocator get_pool_allocator(Pool *pool) {
+	Allocator allocator;
+	allocator.data = pool;
+	allocator.proc = pool_allocator_proc;
 	return allocator;
 }
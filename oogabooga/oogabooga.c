@@ -61,6 +61,8 @@
 				These may require you to pass the respective instruction set flag to your 
 				compiler.
 				For compatilibility reasons, all simd extensions are disabled by default.
+				Disabled extensions are still used at runtime for the 256 & 512 bit kernels
+				if the cpu supports them, see simd_dispatch in simd.c.
 				
 		- INITIAL_PROGRAM_MEMORY_SIZE
 			Defines this as the size in number of bytes you want the initial allocation for 
@@ -86,6 +88,17 @@
 			
 				#define RUN_TESTS 1
 				
+		- RUN_TEST_BENCHMARKS
+			Also run the speed tests with RUN_TESTS. They print timings and take a while,
+			so the default test run only checks correctness.
+			
+			0: Disable (default)
+			1: Enable
+			
+			Example:
+			
+				#define RUN_TEST_BENCHMARKS 1
+				
 		- ENABLE_PROFILING
 			Enable time profiling which will be dumped to google_trace.json.
 		
@@ -102,6 +115,30 @@
 					tm_scope_var
 					tm_scope_accum
 					
+		- ENABLE_LOCK_STATS
+			Record contention stats for named Spinlocks & Mutexes (see spinlock_set_name).
+			Printed at exit and, with ENABLE_PROFILING, written as counter tracks to google_trace.json.
+			
+			0: Disable (default)
+			1: Enable
+			
+			Example:
+			
+				#define ENABLE_LOCK_STATS 1
+				
+		- JOB_WORKER_COUNT
+			Number of workers the job system is started with in oogabooga_init, see jobs.c.
+			parallel_for, parallel_radix_sort_keys and the renderer's vertex writing go wide on these.
+			Idle workers park on a semaphore until there's a job, so they cost nothing when
+			the game isn't using them.
+			
+			0: One worker per logical core (default)
+			1: No worker threads, everything runs on the thread that calls it
+			
+			Example:
+			
+				#define JOB_WORKER_COUNT 4
+				
 		- OOGABOOGA_HEADLESS
             Run oogabooga in headless mode, i.e. no window, no graphics, no audio.
             Useful if you only need the oogabooga standard library for something like a game server.
@@ -197,6 +234,18 @@ typedef u8 bool;
 	#define ENABLE_SIMD 1
 #endif
 
+#ifndef ENABLE_LOCK_STATS
+	#define ENABLE_LOCK_STATS 0
+#endif
+
+#ifndef RUN_TEST_BENCHMARKS
+	#define RUN_TEST_BENCHMARKS 0
+#endif
+
+#ifndef JOB_WORKER_COUNT
+	#define JOB_WORKER_COUNT 0
+#endif
+
 #ifndef INITIAL_PROGRAM_MEMORY_SIZE
     #define INITIAL_PROGRAM_MEMORY_SIZE MB(5)
 #endif
@@ -289,6 +338,7 @@ typedef u8 bool;
 #include "utility.c"
 
 #include "hash_table.c"
+#include "swiss_table.c"
 #include "growing_array.c"
 
 #include "os_interface.c"
@@ -310,7 +360,9 @@ typedef u8 bool;
 #include "random.c"
 #include "color.c"
 #include "memory.c"
+#include "jobs.c"
 #include "input.c"
+#include "draw_vertex.c"
 
 #ifndef OOGABOOGA_HEADLESS
 
@@ -361,6 +413,7 @@ void default_logger(Log_Level level, string s) {
 
 	if (!_default_logger_mutex_initted) {
 		mutex_init(&_default_logger_mutex);
+		mutex_set_name(&_default_logger_mutex, STR("_default_logger_mutex"));
 		_default_logger_mutex_initted = true;
 	}
 	
@@ -382,9 +435,11 @@ void oogabooga_init(u64 program_memory_size) {
 	context.logger = default_logger;
 	temp_allocator = get_initialization_allocator();
 	Cpu_Capabilities features = query_cpu_capabilities();
+	simd_init_dispatch(features);
 	os_init(program_memory_size);
 	heap_init();
 	temporary_storage_init(TEMPORARY_STORAGE_SIZE);
+	job_system_init(JOB_WORKER_COUNT);
 	log_info("Ooga booga version is %d.%02d.%03d", OGB_VERSION_MAJOR, OGB_VERSION_MINOR, OGB_VERSION_PATCH);
 #ifndef OOGABOOGA_HEADLESS
 	gfx_init();
@@ -400,6 +455,8 @@ void oogabooga_init(u64 program_memory_size) {
 	log_verbose("CPU has avx:    %cs", features.avx    ? "true" : "false");
 	log_verbose("CPU has avx2:   %cs", features.avx2   ? "true" : "false");
 	log_verbose("CPU has avx512: %cs", features.avx512 ? "true" : "false");
+	log_verbose("Simd dispatch level: %cs", simd_level_name(simd_dispatch.level));
+	log_verbose("Job workers: %llu", job_system_get_worker_count());
 	
 	Os_Monitor *m = os.primary_monitor;
 	log_verbose("Primary Monitor:\n\t%s\n\t%dhz\n\t%dx%d\n\tdpi: %d", m->name, m->refresh_rate, m->resolution_x, m->resolution_y, m->dpi);
@@ -432,10 +489,19 @@ int main(int argc, char **argv) {
 	
 	int code = ENTRY_PROC(argc, argv);
 	
+	job_system_shutdown();
+	
 #if ENABLE_PROFILING
 	
+#if ENABLE_LOCK_STATS
+	_profiler_report_lock_stats();
+#endif
 	dump_profile_result();
 	
+#endif
+
+#if ENABLE_LOCK_STATS
+	lock_stats_print_report();
 #endif
 	
 	printf("Ooga booga program exit with code %i\n", code);
@@ -13,6 +13,8 @@
 
 void* heap_alloc(u64);
 void heap_dealloc(void*);
+void heap_thread_cache_flush();
+void temporary_storage_deinit();
 
 u16 *win32_fixed_utf8_to_null_terminated_wide(string utf8, Allocator allocator) {
 
@@ -592,7 +594,8 @@ DWORD WINAPI win32_thread_invoker(LPVOID param) {
 	
 	t->proc(t);
 	
-	heap_dealloc(temporary_storage);
+	temporary_storage_deinit();
+	heap_thread_cache_flush();
 	
 	return 0;
 }
@@ -706,6 +709,21 @@ void os_yield_thread() {
     SwitchToThread();
 }
 
+bool os_wait_on_address(volatile u32 *address, u32 expected, f64 timeout_seconds) {
+	DWORD ms = timeout_seconds < 0 ? INFINITE : (DWORD)(timeout_seconds*1000.0);
+	if (WaitOnAddress(address, &expected, sizeof(u32), ms)) return true;
+	
+	DWORD error = GetLastError();
+	assert(error == ERROR_TIMEOUT, "WaitOnAddress failed with error %d", error);
+	return false;
+}
+void os_wake_one_on_address(volatile u32 *address) {
+	WakeByAddressSingle((PVOID)address);
+}
+void os_wake_all_on_address(volatile u32 *address) {
+	WakeByAddressAll((PVOID)address);
+}
+
 void os_high_precision_sleep(f64 ms) {
 	
 	const f64 s = ms/1000.0;
@@ -751,6 +769,18 @@ os_get_elapsed_seconds() {
 	return (float64)(counter.QuadPart-win32_counter_at_start.QuadPart) / (float64)freq.QuadPart;
 }
 
+float64
+os_get_process_cpu_seconds() {
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+		return -1.0;
+	}
+	// FILETIMEs are in 100 nanosecond units
+	u64 kernel = ((u64)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+	u64 user   = ((u64)user_time.dwHighDateTime << 32)   | user_time.dwLowDateTime;
+	return (float64)(kernel + user) / 10000000.0;
+}
+
 
 ///
 ///
@@ -1409,6 +1439,30 @@ os_lock_program_memory_pages(void *start, u64 size) {
 #endif
 }
 
+void*
+os_reserve_virtual_memory(u64 size) {
+	assert(size % os.granularity == 0, "size was not aligned to granularity in os_reserve_virtual_memory");
+	return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+bool
+os_commit_virtual_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When committing memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When committing memory pages, the size must be aligned to page_size");
+	return VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+}
+void
+os_decommit_virtual_memory(void *start, u64 size) {
+	assert((u64)start % os.page_size == 0, "When decommitting memory pages, the start address must be the start of a page");
+	assert(size       % os.page_size == 0, "When decommitting memory pages, the size must be aligned to page_size");
+	BOOL ok = VirtualFree(start, size, MEM_DECOMMIT);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+void
+os_release_virtual_memory(void *start) {
+	BOOL ok = VirtualFree(start, 0, MEM_RELEASE);
+	assert(ok, "VirtualFree Failed with error %d", GetLastError());
+}
+
 ///
 ///
 // Mouse pointer
@@ -1885,6 +1939,11 @@ void os_update() {
 
 	has_os_update_been_called_at_all = true;
 
+#if ENABLE_LOCK_STATS && ENABLE_PROFILING
+	// One sample per frame so lock counter tracks line up with frames in the trace
+	_profiler_report_lock_stats();
+#endif
+
 	win32_do_handle_raw_input = true;
 #ifndef OOGABOOGA_HEADLESS
 	UINT dpi = GetDpiForWindow(window._os_handle);
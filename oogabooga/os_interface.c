@@ -175,6 +175,20 @@ os_yield_thread();
 void ogb_instance
 os_high_precision_sleep(f64 ms);
 
+///
+// Address based waiting (WaitOnAddress on windows, futex on linux)
+// Puts the thread to sleep as long as *address == expected, until someone wakes it.
+// It may also wake up for no reason, so always check the value again in a loop.
+// timeout_seconds < 0 waits forever. Returns false if the timeout was reached.
+bool ogb_instance
+os_wait_on_address(volatile u32 *address, u32 expected, f64 timeout_seconds);
+
+void ogb_instance
+os_wake_one_on_address(volatile u32 *address);
+
+void ogb_instance
+os_wake_all_on_address(volatile u32 *address);
+
 
 ///
 ///
@@ -187,6 +201,10 @@ DEPRECATED(os_get_current_time_in_seconds(), "Use os_get_elapsed_seconds() inste
 float64 ogb_instance
 os_get_elapsed_seconds();
 
+// User + kernel CPU time of all threads in the process so far
+float64 ogb_instance
+os_get_process_cpu_seconds();
+
 
 ///
 ///
@@ -463,6 +481,21 @@ os_unlock_program_memory_pages(void *start, u64 size);
 void ogb_instance
 os_lock_program_memory_pages(void *start, u64 size);
 
+// Raw virtual memory, separate from program memory.
+// Reserving only claims address space, nothing is backed by physical memory until it's committed.
+// Everything must be aligned to os.page_size, and os_reserve_virtual_memory sizes to os.granularity.
+// Committed memory is zero initialized.
+// Returns 0 on fail
+ogb_instance void*
+os_reserve_virtual_memory(u64 size);
+bool ogb_instance
+os_commit_virtual_memory(void *start, u64 size);
+void ogb_instance
+os_decommit_virtual_memory(void *start, u64 size);
+// Releases the whole reservation, start must be what os_reserve_virtual_memory returned
+void ogb_instance
+os_release_virtual_memory(void *start);
+
 ///
 ///
 // Mouse pointer
@@ -22,14 +22,18 @@ void dump_profile_result() {
 	
 	log_verbose("Wrote profiling result to google_trace.json");
 }
-void _profiler_report_time_cycles(string name, u64 count, u64 start) {
+void _profiler_init_if_needed() {
 	if (!profiler_initted) {
 		spinlock_init(&_profiler_lock);
+		spinlock_set_name(&_profiler_lock, STR("_profiler_lock"));
 		profiler_initted = true;
 		
 		string_builder_init_reserve(&_profile_output, 1024*1000, get_heap_allocator());	
 		
 	}
+}
+void _profiler_report_time_cycles(string name, u64 count, u64 start) {
+	_profiler_init_if_needed();
 	
 	spinlock_acquire_or_wait(&_profiler_lock);
 	
@@ -38,6 +42,34 @@ void _profiler_report_time_cycles(string name, u64 count, u64 start) {
 	
 	spinlock_release(&_profiler_lock);
 }
+#if ENABLE_LOCK_STATS
+// Adds a counter track per named lock with what happened since the last call.
+// Called once per frame from os_update when profiling.
+void _profiler_report_lock_stats() {
+	_profiler_init_if_needed();
+	
+	u64 now = rdtsc();
+	u64 count = lock_stats_get_count();
+	Lock_Stats *all = lock_stats_get_all();
+	
+	spinlock_acquire_or_wait(&_profiler_lock);
+	
+	string fmt = STR("{\"cat\":\"lock\",\"name\":\"lock %s\",\"ph\":\"C\",\"pid\":0,\"ts\":%lld,\"args\":{\"acquires\":%llu,\"contended\":%llu,\"wait_kcycles\":%.3f}},");
+	for (u64 i = 0; i < count; i += 1) {
+		Lock_Stats *stats = &all[i];
+		u64 acquires    = stats->acquire_count;
+		u64 contended   = stats->contended_count;
+		u64 wait_cycles = stats->wait_cycles;
+		string_builder_print(&_profile_output, fmt, stats->name, now*1000, acquires-stats->reported_acquire_count, contended-stats->reported_contended_count, (float64)(wait_cycles-stats->reported_wait_cycles)/1000.0);
+		stats->reported_acquire_count   = acquires;
+		stats->reported_contended_count = contended;
+		stats->reported_wait_cycles     = wait_cycles;
+	}
+	
+	spinlock_release(&_profiler_lock);
+}
+#endif
+
 #if ENABLE_PROFILING
 #define tm_scope(name) \
     for (u64 start_time = rdtsc(), end_time = start_time, elapsed_time = 0; \
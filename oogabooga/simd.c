@@ -41,7 +41,134 @@ inline void basic_rsqrt_float32_128(float *a, float *result);
 inline void basic_rsqrt_float32_256(float *a, float *result);
 inline void basic_rsqrt_float32_512(float *a, float *result);
 
+///
+// Runtime dispatch
+// The extensions which aren't enabled at compile time (SIMD_ENABLE_xxx) are still used if
+// the cpu has them: the 256 & 512 bit kernels (and the sse4.1 int mul) call through
+// simd_dispatch, which simd_init_dispatch() points at the best implementation the cpu
+// supports. oogabooga_init() does this for you, until then it's the basic_ versions.
+// Extensions enabled at compile time are inlined directly and skip the table.
+// The 64/96 bit kernels & dot products are too small to be worth an indirect call.
 
+typedef enum Simd_Level {
+	SIMD_LEVEL_BASELINE, // basic_ procs on top of the compile time 128 bit kernels
+	SIMD_LEVEL_SSE41,
+	SIMD_LEVEL_AVX,
+	SIMD_LEVEL_AVX2,
+	SIMD_LEVEL_AVX512,
+	
+	SIMD_LEVEL_COUNT,
+} Simd_Level;
+
+typedef void (*Simd_Float32_Binary_Proc)(float32 *a, float32 *b, float32 *result);
+typedef void (*Simd_Float32_Unary_Proc) (float32 *a, float32 *result);
+typedef void (*Simd_Int32_Binary_Proc)  (s32 *a, s32 *b, s32 *result);
+
+typedef struct Simd_Dispatch {
+	Simd_Level level;
+	
+	Simd_Int32_Binary_Proc mul_int32_128;
+	
+	Simd_Float32_Binary_Proc add_float32_256;
+	Simd_Float32_Binary_Proc sub_float32_256;
+	Simd_Float32_Binary_Proc mul_float32_256;
+	Simd_Float32_Binary_Proc div_float32_256;
+	Simd_Float32_Unary_Proc  sqrt_float32_256;
+	Simd_Float32_Unary_Proc  rsqrt_float32_256;
+	Simd_Int32_Binary_Proc   add_int32_256;
+	Simd_Int32_Binary_Proc   sub_int32_256;
+	Simd_Int32_Binary_Proc   mul_int32_256;
+	
+	Simd_Float32_Binary_Proc add_float32_512;
+	Simd_Float32_Binary_Proc sub_float32_512;
+	Simd_Float32_Binary_Proc mul_float32_512;
+	Simd_Float32_Binary_Proc div_float32_512;
+	Simd_Float32_Unary_Proc  sqrt_float32_512;
+	Simd_Float32_Unary_Proc  rsqrt_float32_512;
+	Simd_Int32_Binary_Proc   add_int32_512;
+	Simd_Int32_Binary_Proc   sub_int32_512;
+	Simd_Int32_Binary_Proc   mul_int32_512;
+	
+	// Span kernels, see simd_add_f32 & co below
+	void (*add_f32)      (float32 *dst, float32 *a, float32 *b, u64 count);
+	void (*sub_f32)      (float32 *dst, float32 *a, float32 *b, u64 count);
+	void (*mul_f32)      (float32 *dst, float32 *a, float32 *b, u64 count);
+	void (*min_f32)      (float32 *dst, float32 *a, float32 *b, u64 count);
+	void (*max_f32)      (float32 *dst, float32 *a, float32 *b, u64 count);
+	void (*mul_add_f32)  (float32 *dst, float32 *a, float32 *b, float32 *c, u64 count);
+	void (*scale_f32)    (float32 *dst, float32 *a, float32 scale, u64 count);
+	void (*scale_add_f32)(float32 *dst, float32 *a, float32 scale, float32 *b, u64 count);
+	void (*clamp_f32)    (float32 *dst, float32 *a, float32 min_value, float32 max_value, u64 count);
+	float32 (*sum_f32)   (float32 *a, u64 count);
+	float32 (*dot_f32)   (float32 *a, float32 *b, u64 count);
+	void (*f32_to_s32)   (s32 *dst, float32 *a, u64 count);
+	void (*s32_to_f32)   (float32 *dst, s32 *a, u64 count);
+} Simd_Dispatch;
+
+ogb_instance Simd_Dispatch simd_dispatch;
+
+///
+// Span kernels
+// Run over count elements and take the widest path the cpu supports. Pointers don't need
+// to be aligned & count doesn't need to be a multiple of anything, that's handled inside.
+// dst may be the same pointer as an input (in-place), but spans must not partially overlap.
+// The basic_ versions are the scalar reference.
+
+// dst[i] = a[i] + b[i]
+inline void simd_add_f32(float32 *dst, float32 *a, float32 *b, u64 count) { simd_dispatch.add_f32(dst, a, b, count); }
+// dst[i] = a[i] - b[i]
+inline void simd_sub_f32(float32 *dst, float32 *a, float32 *b, u64 count) { simd_dispatch.sub_f32(dst, a, b, count); }
+// dst[i] = a[i] * b[i]
+inline void simd_mul_f32(float32 *dst, float32 *a, float32 *b, u64 count) { simd_dispatch.mul_f32(dst, a, b, count); }
+// dst[i] = a[i] < b[i] ? a[i] : b[i]
+inline void simd_min_f32(float32 *dst, float32 *a, float32 *b, u64 count) { simd_dispatch.min_f32(dst, a, b, count); }
+// dst[i] = a[i] > b[i] ? a[i] : b[i]
+inline void simd_max_f32(float32 *dst, float32 *a, float32 *b, u64 count) { simd_dispatch.max_f32(dst, a, b, count); }
+// dst[i] = a[i] * b[i] + c[i]. May or may not be fused (one rounding) depending on the compiler.
+inline void simd_mul_add_f32(float32 *dst, float32 *a, float32 *b, float32 *c, u64 count) { simd_dispatch.mul_add_f32(dst, a, b, c, count); }
+// dst[i] = a[i] * scale
+inline void simd_scale_f32(float32 *dst, float32 *a, float32 scale, u64 count) { simd_dispatch.scale_f32(dst, a, scale, count); }
+// dst[i] = a[i] * scale + b[i]. With dst == b this accumulates, i.e. mixing in a sample at a volume.
+inline void simd_scale_add_f32(float32 *dst, float32 *a, float32 scale, float32 *b, u64 count) { simd_dispatch.scale_add_f32(dst, a, scale, b, count); }
+// dst[i] = clamp(a[i], min_value, max_value)
+inline void simd_clamp_f32(float32 *dst, float32 *a, float32 min_value, float32 max_value, u64 count) { simd_dispatch.clamp_f32(dst, a, min_value, max_value, count); }
+// Sum of a. Summation order differs per level so the result may differ in the last bits.
+inline float32 simd_sum_f32(float32 *a, u64 count) { return simd_dispatch.sum_f32(a, count); }
+// Sum of a[i]*b[i], same caveat as simd_sum_f32.
+inline float32 simd_dot_f32(float32 *a, float32 *b, u64 count) { return simd_dispatch.dot_f32(a, b, count); }
+// dst[i] = (s32)a[i], truncating. Values must fit in s32.
+inline void simd_f32_to_s32(s32 *dst, float32 *a, u64 count) { simd_dispatch.f32_to_s32(dst, a, count); }
+// dst[i] = (float32)a[i]
+inline void simd_s32_to_f32(float32 *dst, s32 *a, u64 count) { simd_dispatch.s32_to_f32(dst, a, count); }
+
+ogb_instance void basic_add_f32(float32 *dst, float32 *a, float32 *b, u64 count);
+ogb_instance void basic_sub_f32(float32 *dst, float32 *a, float32 *b, u64 count);
+ogb_instance void basic_mul_f32(float32 *dst, float32 *a, float32 *b, u64 count);
+ogb_instance void basic_min_f32(float32 *dst, float32 *a, float32 *b, u64 count);
+ogb_instance void basic_max_f32(float32 *dst, float32 *a, float32 *b, u64 count);
+ogb_instance void basic_mul_add_f32(float32 *dst, float32 *a, float32 *b, float32 *c, u64 count);
+ogb_instance void basic_scale_f32(float32 *dst, float32 *a, float32 scale, u64 count);
+ogb_instance void basic_scale_add_f32(float32 *dst, float32 *a, float32 scale, float32 *b, u64 count);
+ogb_instance void basic_clamp_f32(float32 *dst, float32 *a, float32 min_value, float32 max_value, u64 count);
+ogb_instance float32 basic_sum_f32(float32 *a, u64 count);
+ogb_instance float32 basic_dot_f32(float32 *a, float32 *b, u64 count);
+ogb_instance void basic_f32_to_s32(s32 *dst, float32 *a, u64 count);
+ogb_instance void basic_s32_to_f32(float32 *dst, s32 *a, u64 count);
+
+// Highest level both the cpu and the os support
+ogb_instance Simd_Level
+simd_get_max_level(Cpu_Capabilities features);
+
+// Table with the best implementation of each kernel up to and including level.
+// Doesn't check that the cpu can actually run it, see simd_get_max_level().
+ogb_instance Simd_Dispatch
+simd_make_dispatch(Simd_Level level);
+
+ogb_instance void
+simd_init_dispatch(Cpu_Capabilities features);
+
+ogb_instance const char*
+simd_level_name(Simd_Level level);
 
 #if ENABLE_SIMD
 
@@ -260,8 +387,8 @@ inline float simd_dot_product_float32_128_aligned(float *a, float *b) {
     return _mm_cvtss_f32(dot_product);
 }
 #else
-	#define simd_mul_int32_128 		basic_mul_int32_128
-	#define simd_mul_int32_128_aligned 		basic_mul_int32_128
+	#define simd_mul_int32_128 		simd_dispatch.mul_int32_128
+	#define simd_mul_int32_128_aligned 		simd_dispatch.mul_int32_128
 	#define simd_dot_product_float32_64 basic_dot_product_float32_64
 	#define simd_dot_product_float32_96 basic_dot_product_float32_96
 	#define simd_dot_product_float32_128 basic_dot_product_float32_128
@@ -344,18 +471,18 @@ inline void simd_rsqrt_float32_256_aligned(float *a, float *result) {
     _mm256_store_ps(result, vr);
 }
 #else
-	#define simd_add_float32_256 	basic_add_float32_256
-	#define simd_sub_float32_256 	basic_sub_float32_256
-	#define simd_mul_float32_256 	basic_mul_float32_256
-	#define simd_div_float32_256 	basic_div_float32_256
-	#define simd_sqrt_float32_256   		basic_sqrt_float32_256
-	#define simd_rsqrt_float32_256  		basic_rsqrt_float32_256
-	#define simd_add_float32_256_aligned 	basic_add_float32_256
-	#define simd_sub_float32_256_aligned 	basic_sub_float32_256
-	#define simd_mul_float32_256_aligned 	basic_mul_float32_256
-	#define simd_div_float32_256_aligned 	basic_div_float32_256
-	#define simd_sqrt_float32_256_aligned   basic_sqrt_float32_256
-	#define simd_rsqrt_float32_256_aligned  basic_rsqrt_float32_256
+	#define simd_add_float32_256 	simd_dispatch.add_float32_256
+	#define simd_sub_float32_256 	simd_dispatch.sub_float32_256
+	#define simd_mul_float32_256 	simd_dispatch.mul_float32_256
+	#define simd_div_float32_256 	simd_dispatch.div_float32_256
+	#define simd_sqrt_float32_256   		simd_dispatch.sqrt_float32_256
+	#define simd_rsqrt_float32_256  		simd_dispatch.rsqrt_float32_256
+	#define simd_add_float32_256_aligned 	simd_dispatch.add_float32_256
+	#define simd_sub_float32_256_aligned 	simd_dispatch.sub_float32_256
+	#define simd_mul_float32_256_aligned 	simd_dispatch.mul_float32_256
+	#define simd_div_float32_256_aligned 	simd_dispatch.div_float32_256
+	#define simd_sqrt_float32_256_aligned   simd_dispatch.sqrt_float32_256
+	#define simd_rsqrt_float32_256_aligned  simd_dispatch.rsqrt_float32_256
 #endif
 
 #if SIMD_ENABLE_AVX2
@@ -400,12 +527,12 @@ inline void simd_mul_int32_256_aligned(s32 *a, s32 *b, s32* result) {
     _mm256_store_si256((__m256i*)result, vr);
 }
 #else
-	#define simd_add_int32_256 		basic_add_int32_256
-	#define simd_sub_int32_256 		basic_sub_int32_256
-	#define simd_mul_int32_256 		basic_mul_int32_256
-	#define simd_add_int32_256_aligned 		basic_add_int32_256
-	#define simd_sub_int32_256_aligned 		basic_sub_int32_256
-	#define simd_mul_int32_256_aligned 		basic_mul_int32_256
+	#define simd_add_int32_256 		simd_dispatch.add_int32_256
+	#define simd_sub_int32_256 		simd_dispatch.sub_int32_256
+	#define simd_mul_int32_256 		simd_dispatch.mul_int32_256
+	#define simd_add_int32_256_aligned 		simd_dispatch.add_int32_256
+	#define simd_sub_int32_256_aligned 		simd_dispatch.sub_int32_256
+	#define simd_mul_int32_256_aligned 		simd_dispatch.mul_int32_256
 #endif
 
 #if SIMD_ENABLE_AVX512
@@ -525,24 +652,24 @@ inline void simd_rsqrt_float32_512_aligned(float *a, float *result) {
     _mm512_store_ps(result, vr);
 }
 #else 
-	#define simd_add_float32_512 	basic_add_float32_512
-	#define simd_sub_float32_512 	basic_sub_float32_512
-	#define simd_mul_float32_512 	basic_mul_float32_512
-	#define simd_div_float32_512 	basic_div_float32_512
-	#define simd_add_int32_512 		basic_add_int32_512
-	#define simd_sub_int32_512 		basic_sub_int32_512
-	#define simd_mul_int32_512 		basic_mul_int32_512
-	#define simd_sqrt_float32_512   basic_sqrt_float32_512
-	#define simd_rsqrt_float32_512  basic_rsqrt_float32_512
-	#define simd_add_float32_512_aligned 	basic_add_float32_512
-	#define simd_sub_float32_512_aligned 	basic_sub_float32_512
-	#define simd_mul_float32_512_aligned 	basic_mul_float32_512
-	#define simd_div_float32_512_aligned 	basic_div_float32_512
-	#define simd_add_int32_512_aligned 		basic_add_int32_512
-	#define simd_sub_int32_512_aligned 		basic_sub_int32_512
-	#define simd_mul_int32_512_aligned 		basic_mul_int32_512
-	#define simd_sqrt_float32_512_aligned   basic_sqrt_float32_512
-	#define simd_rsqrt_float32_512_aligned  basic_rsqrt_float32_512
+	#define simd_add_float32_512 	simd_dispatch.add_float32_512
+	#define simd_sub_float32_512 	simd_dispatch.sub_float32_512
+	#define simd_mul_float32_512 	simd_dispatch.mul_float32_512
+	#define simd_div_float32_512 	simd_dispatch.div_float32_512
+	#define simd_add_int32_512 		simd_dispatch.add_int32_512
+	#define simd_sub_int32_512 		simd_dispatch.sub_int32_512
+	#define simd_mul_int32_512 		simd_dispatch.mul_int32_512
+	#define simd_sqrt_float32_512   simd_dispatch.sqrt_float32_512
+	#define simd_rsqrt_float32_512  simd_dispatch.rsqrt_float32_512
+	#define simd_add_float32_512_aligned 	simd_dispatch.add_float32_512
+	#define simd_sub_float32_512_aligned 	simd_dispatch.sub_float32_512
+	#define simd_mul_float32_512_aligned 	simd_dispatch.mul_float32_512
+	#define simd_div_float32_512_aligned 	simd_dispatch.div_float32_512
+	#define simd_add_int32_512_aligned 		simd_dispatch.add_int32_512
+	#define simd_sub_int32_512_aligned 		simd_dispatch.sub_int32_512
+	#define simd_mul_int32_512_aligned 		simd_dispatch.mul_int32_512
+	#define simd_sqrt_float32_512_aligned   simd_dispatch.sqrt_float32_512
+	#define simd_rsqrt_float32_512_aligned  simd_dispatch.rsqrt_float32_512
 #endif // SIMD_ENABLE_AVX512
 
 #else
@@ -628,7 +755,6 @@ inline void simd_rsqrt_float32_512_aligned(float *a, float *result) {
 #endif
 
 double __cdecl sqrt(_In_ double _X);
-double __cdecl rsqrt(_In_ double _X);
 
 inline void basic_add_float32_64 (float32 *a, float32 *b, float32* result) {
 	result[0] = a[0] + b[0];
@@ -777,19 +903,19 @@ inline void basic_sqrt_float32_512(float *a, float *result) {
     basic_sqrt_float32_256(a+8, result+8);
 }
 inline void basic_rsqrt_float32_64(float *a, float *result) {
-    result[0] = rsqrt(a[0]);
-    result[1] = rsqrt(a[1]);
+    result[0] = 1.0 / sqrt(a[0]);
+    result[1] = 1.0 / sqrt(a[1]);
 }
 inline void basic_rsqrt_float32_96(float *a, float *result) {
-    result[0] = rsqrt(a[0]);
-    result[1] = rsqrt(a[1]);
-    result[2] = rsqrt(a[2]);
+    result[0] = 1.0 / sqrt(a[0]);
+    result[1] = 1.0 / sqrt(a[1]);
+    result[2] = 1.0 / sqrt(a[2]);
 }
 inline void basic_rsqrt_float32_128(float *a, float *result) {
-    result[0] = rsqrt(a[0]);
-    result[1] = rsqrt(a[1]);
-    result[2] = rsqrt(a[2]);
-    result[3] = rsqrt(a[3]);
+    result[0] = 1.0 / sqrt(a[0]);
+    result[1] = 1.0 / sqrt(a[1]);
+    result[2] = 1.0 / sqrt(a[2]);
+    result[3] = 1.0 / sqrt(a[3]);
 }
 inline void basic_rsqrt_float32_256(float *a, float *result) {
     basic_rsqrt_float32_128(a, result);
@@ -800,3 +926,478 @@ inline void basic_rsqrt_float32_512(float *a, float *result) {
     basic_rsqrt_float32_256(a+8, result+8);
 }
 
+
+#if !OOGABOOGA_LINK_EXTERNAL_INSTANCE
+
+// The basic_ procs are always inlined so they don't have an address we can put in the table
+#define _SIMD_BASELINE_BINARY(name, Type) \
+	void simd_baseline_##name(Type *a, Type *b, Type *result) { basic_##name(a, b, result); }
+#define _SIMD_BASELINE_UNARY(name, Type) \
+	void simd_baseline_##name(Type *a, Type *result) { basic_##name(a, result); }
+
+_SIMD_BASELINE_BINARY(mul_int32_128,   s32)
+_SIMD_BASELINE_BINARY(add_float32_256, float32)
+_SIMD_BASELINE_BINARY(sub_float32_256, float32)
+_SIMD_BASELINE_BINARY(mul_float32_256, float32)
+_SIMD_BASELINE_BINARY(div_float32_256, float32)
+_SIMD_BASELINE_UNARY (sqrt_float32_256,  float32)
+_SIMD_BASELINE_UNARY (rsqrt_float32_256, float32)
+_SIMD_BASELINE_BINARY(add_int32_256,   s32)
+_SIMD_BASELINE_BINARY(sub_int32_256,   s32)
+_SIMD_BASELINE_BINARY(mul_int32_256,   s32)
+_SIMD_BASELINE_BINARY(add_float32_512, float32)
+_SIMD_BASELINE_BINARY(sub_float32_512, float32)
+_SIMD_BASELINE_BINARY(mul_float32_512, float32)
+_SIMD_BASELINE_BINARY(div_float32_512, float32)
+_SIMD_BASELINE_UNARY (sqrt_float32_512,  float32)
+_SIMD_BASELINE_UNARY (rsqrt_float32_512, float32)
+_SIMD_BASELINE_BINARY(add_int32_512,   s32)
+_SIMD_BASELINE_BINARY(sub_int32_512,   s32)
+_SIMD_BASELINE_BINARY(mul_int32_512,   s32)
+
+#if ENABLE_SIMD
+
+// Each kernel is compiled for its instruction set with SIMD_TARGET so the rest of the
+// program doesn't need the compiler flags. Lane counts are constant so the loops unroll.
+#define _SIMD_FLOAT32_BINARY(name, features, Vector, lanes, load, store, op, count) \
+	SIMD_TARGET(features) void name(float32 *a, float32 *b, float32 *result) { \
+		for (u64 i = 0; i < (count); i += (lanes)) { \
+			Vector va = load(a+i); \
+			Vector vb = load(b+i); \
+			store(result+i, op(va, vb)); \
+		} \
+	}
+#define _SIMD_FLOAT32_UNARY(name, features, Vector, lanes, load, store, op, count) \
+	SIMD_TARGET(features) void name(float32 *a, float32 *result) { \
+		for (u64 i = 0; i < (count); i += (lanes)) { \
+			store(result+i, op(load(a+i))); \
+		} \
+	}
+#define _SIMD_INT32_BINARY(name, features, Vector, lanes, load, store, op, count) \
+	SIMD_TARGET(features) void name(s32 *a, s32 *b, s32 *result) { \
+		for (u64 i = 0; i < (count); i += (lanes)) { \
+			Vector va = load((Vector*)(a+i)); \
+			Vector vb = load((Vector*)(b+i)); \
+			store((Vector*)(result+i), op(va, vb)); \
+		} \
+	}
+
+// SSE4.1
+_SIMD_INT32_BINARY(simd_sse41_mul_int32_128, "sse4.1", __m128i, 4, _mm_loadu_si128, _mm_storeu_si128, _mm_mullo_epi32, 4)
+
+// AVX
+_SIMD_FLOAT32_BINARY(simd_avx_add_float32_256,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, 8)
+_SIMD_FLOAT32_BINARY(simd_avx_sub_float32_256,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps, 8)
+_SIMD_FLOAT32_BINARY(simd_avx_mul_float32_256,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_mul_ps, 8)
+_SIMD_FLOAT32_BINARY(simd_avx_div_float32_256,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_div_ps, 8)
+_SIMD_FLOAT32_UNARY (simd_avx_sqrt_float32_256, "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sqrt_ps, 8)
+_SIMD_FLOAT32_UNARY (simd_avx_rsqrt_float32_256,"avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_rsqrt_ps, 8)
+_SIMD_FLOAT32_BINARY(simd_avx_add_float32_512,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx_sub_float32_512,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sub_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx_mul_float32_512,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_mul_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx_div_float32_512,  "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_div_ps, 16)
+_SIMD_FLOAT32_UNARY (simd_avx_sqrt_float32_512, "avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_sqrt_ps, 16)
+_SIMD_FLOAT32_UNARY (simd_avx_rsqrt_float32_512,"avx", __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_rsqrt_ps, 16)
+
+// AVX2
+_SIMD_INT32_BINARY(simd_avx2_add_int32_256, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32, 8)
+_SIMD_INT32_BINARY(simd_avx2_sub_int32_256, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32, 8)
+_SIMD_INT32_BINARY(simd_avx2_mul_int32_256, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_mullo_epi32, 8)
+_SIMD_INT32_BINARY(simd_avx2_add_int32_512, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32, 16)
+_SIMD_INT32_BINARY(simd_avx2_sub_int32_512, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32, 16)
+_SIMD_INT32_BINARY(simd_avx2_mul_int32_512, "avx2", __m256i, 8, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_mullo_epi32, 16)
+
+// AVX-512
+_SIMD_FLOAT32_BINARY(simd_avx512_add_float32_512,  "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx512_sub_float32_512,  "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_sub_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx512_mul_float32_512,  "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_mul_ps, 16)
+_SIMD_FLOAT32_BINARY(simd_avx512_div_float32_512,  "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_div_ps, 16)
+_SIMD_FLOAT32_UNARY (simd_avx512_sqrt_float32_512, "avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_sqrt_ps, 16)
+_SIMD_FLOAT32_UNARY (simd_avx512_rsqrt_float32_512,"avx512f", __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_rsqrt14_ps, 16)
+_SIMD_INT32_BINARY  (simd_avx512_add_int32_512,    "avx512f", __m512i, 16, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_add_epi32, 16)
+_SIMD_INT32_BINARY  (simd_avx512_sub_int32_512,    "avx512f", __m512i, 16, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_sub_epi32, 16)
+_SIMD_INT32_BINARY  (simd_avx512_mul_int32_512,    "avx512f", __m512i, 16, _mm512_loadu_si512, _mm512_storeu_si512, _mm512_mullo_epi32, 16)
+
+#endif // ENABLE_SIMD
+
+void basic_add_f32(float32 *dst, float32 *a, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] + b[i];
+}
+void basic_sub_f32(float32 *dst, float32 *a, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] - b[i];
+}
+void basic_mul_f32(float32 *dst, float32 *a, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] * b[i];
+}
+void basic_min_f32(float32 *dst, float32 *a, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] < b[i] ? a[i] : b[i];
+}
+void basic_max_f32(float32 *dst, float32 *a, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] > b[i] ? a[i] : b[i];
+}
+void basic_mul_add_f32(float32 *dst, float32 *a, float32 *b, float32 *c, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] * b[i] + c[i];
+}
+void basic_scale_f32(float32 *dst, float32 *a, float32 scale, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] * scale;
+}
+void basic_scale_add_f32(float32 *dst, float32 *a, float32 scale, float32 *b, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = a[i] * scale + b[i];
+}
+void basic_clamp_f32(float32 *dst, float32 *a, float32 min_value, float32 max_value, u64 count) {
+	// Same order as the simd versions: min against max_value first, then max against min_value
+	for (u64 i = 0; i < count; i += 1) {
+		float32 x = a[i] < max_value ? a[i] : max_value;
+		dst[i] = x > min_value ? x : min_value;
+	}
+}
+float32 basic_sum_f32(float32 *a, u64 count) {
+	float32 sum = 0;
+	for (u64 i = 0; i < count; i += 1) sum += a[i];
+	return sum;
+}
+float32 basic_dot_f32(float32 *a, float32 *b, u64 count) {
+	float32 sum = 0;
+	for (u64 i = 0; i < count; i += 1) sum += a[i] * b[i];
+	return sum;
+}
+void basic_f32_to_s32(s32 *dst, float32 *a, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = (s32)a[i];
+}
+void basic_s32_to_f32(float32 *dst, s32 *a, u64 count) {
+	for (u64 i = 0; i < count; i += 1) dst[i] = (float32)a[i];
+}
+
+#if ENABLE_SIMD
+
+// Number of elements to do one by one before p is aligned to vector_size
+inline u64 
+_simd_span_head(void *p, u64 vector_size, u64 count) {
+	u64 misalignment = (u64)p & (vector_size-1);
+	if (misalignment == 0 || misalignment % sizeof(float32) != 0) return 0;
+	return min((vector_size - misalignment) / sizeof(float32), count);
+}
+
+// The span kernels are written once in _SIMD_DEFINE_SPAN_KERNELS in terms of these per
+// instruction set ops, L is the prefix (SSE, AVX, AVX512).
+#define _SIMD_SSE_V          __m128
+#define _SIMD_SSE_VI         __m128i
+#define _SIMD_SSE_LANES      4
+#define _SIMD_SSE_LOAD       _mm_loadu_ps
+#define _SIMD_SSE_STORE      _mm_storeu_ps
+#define _SIMD_SSE_LOADI(p)   _mm_loadu_si128((__m128i*)(p))
+#define _SIMD_SSE_STOREI(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define _SIMD_SSE_SET1       _mm_set1_ps
+#define _SIMD_SSE_ZERO       _mm_setzero_ps
+#define _SIMD_SSE_ADD        _mm_add_ps
+#define _SIMD_SSE_SUB        _mm_sub_ps
+#define _SIMD_SSE_MUL        _mm_mul_ps
+#define _SIMD_SSE_MIN        _mm_min_ps
+#define _SIMD_SSE_MAX        _mm_max_ps
+#define _SIMD_SSE_F2I        _mm_cvttps_epi32
+#define _SIMD_SSE_I2F        _mm_cvtepi32_ps
+
+#define _SIMD_AVX_V          __m256
+#define _SIMD_AVX_VI         __m256i
+#define _SIMD_AVX_LANES      8
+#define _SIMD_AVX_LOAD       _mm256_loadu_ps
+#define _SIMD_AVX_STORE      _mm256_storeu_ps
+#define _SIMD_AVX_LOADI(p)   _mm256_loadu_si256((__m256i*)(p))
+#define _SIMD_AVX_STOREI(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define _SIMD_AVX_SET1       _mm256_set1_ps
+#define _SIMD_AVX_ZERO       _mm256_setzero_ps
+#define _SIMD_AVX_ADD        _mm256_add_ps
+#define _SIMD_AVX_SUB        _mm256_sub_ps
+#define _SIMD_AVX_MUL        _mm256_mul_ps
+#define _SIMD_AVX_MIN        _mm256_min_ps
+#define _SIMD_AVX_MAX        _mm256_max_ps
+#define _SIMD_AVX_F2I        _mm256_cvttps_epi32
+#define _SIMD_AVX_I2F        _mm256_cvtepi32_ps
+
+#define _SIMD_AVX512_V       __m512
+#define _SIMD_AVX512_VI      __m512i
+#define _SIMD_AVX512_LANES   16
+#define _SIMD_AVX512_LOAD    _mm512_loadu_ps
+#define _SIMD_AVX512_STORE   _mm512_storeu_ps
+#define _SIMD_AVX512_LOADI(p)   _mm512_loadu_si512((p))
+#define _SIMD_AVX512_STOREI(p, v) _mm512_storeu_si512((p), v)
+#define _SIMD_AVX512_SET1    _mm512_set1_ps
+#define _SIMD_AVX512_ZERO    _mm512_setzero_ps
+#define _SIMD_AVX512_ADD     _mm512_add_ps
+#define _SIMD_AVX512_SUB     _mm512_sub_ps
+#define _SIMD_AVX512_MUL     _mm512_mul_ps
+#define _SIMD_AVX512_MIN     _mm512_min_ps
+#define _SIMD_AVX512_MAX     _mm512_max_ps
+#define _SIMD_AVX512_F2I     _mm512_cvttps_epi32
+#define _SIMD_AVX512_I2F     _mm512_cvtepi32_ps
+
+// Peel until dst is aligned, full vectors, then the basic_ version for the remainder.
+#define _SIMD_SPAN_BINARY(L, prefix, features, name, OP) \
+	SIMD_TARGET(features) void simd_##prefix##_##name(float32 *dst, float32 *a, float32 *b, u64 count) { \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_##name(dst, a, b, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_STORE(dst+i, OP(_SIMD_##L##_LOAD(a+i), _SIMD_##L##_LOAD(b+i))); \
+		} \
+		basic_##name(dst+i, a+i, b+i, count-i); \
+	}
+
+// Sums go through 4 accumulators since a single one would be bound by the add latency
+#define _SIMD_SPAN_REDUCE(L, prefix, features, name, ARGS, BASIC_ARGS, TERM) \
+	SIMD_TARGET(features) float32 simd_##prefix##_##name ARGS { \
+		const u64 lanes = _SIMD_##L##_LANES; \
+		u64 i = 0; \
+		_SIMD_##L##_V acc0 = _SIMD_##L##_ZERO(), acc1 = acc0, acc2 = acc0, acc3 = acc0; \
+		for (; i + lanes*4 <= count; i += lanes*4) { \
+			acc0 = _SIMD_##L##_ADD(acc0, TERM(i)); \
+			acc1 = _SIMD_##L##_ADD(acc1, TERM(i+lanes)); \
+			acc2 = _SIMD_##L##_ADD(acc2, TERM(i+lanes*2)); \
+			acc3 = _SIMD_##L##_ADD(acc3, TERM(i+lanes*3)); \
+		} \
+		for (; i + lanes <= count; i += lanes) { \
+			acc0 = _SIMD_##L##_ADD(acc0, TERM(i)); \
+		} \
+		acc0 = _SIMD_##L##_ADD(_SIMD_##L##_ADD(acc0, acc1), _SIMD_##L##_ADD(acc2, acc3)); \
+		float32 parts[_SIMD_##L##_LANES]; \
+		_SIMD_##L##_STORE(parts, acc0); \
+		float32 sum = basic_##name BASIC_ARGS; \
+		for (u64 j = 0; j < lanes; j += 1) sum += parts[j]; \
+		return sum; \
+	}
+
+#define _SIMD_DEFINE_SPAN_KERNELS(L, prefix, features) \
+	_SIMD_SPAN_BINARY(L, prefix, features, add_f32, _SIMD_##L##_ADD) \
+	_SIMD_SPAN_BINARY(L, prefix, features, sub_f32, _SIMD_##L##_SUB) \
+	_SIMD_SPAN_BINARY(L, prefix, features, mul_f32, _SIMD_##L##_MUL) \
+	_SIMD_SPAN_BINARY(L, prefix, features, min_f32, _SIMD_##L##_MIN) \
+	_SIMD_SPAN_BINARY(L, prefix, features, max_f32, _SIMD_##L##_MAX) \
+	\
+	SIMD_TARGET(features) void simd_##prefix##_mul_add_f32(float32 *dst, float32 *a, float32 *b, float32 *c, u64 count) { \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_mul_add_f32(dst, a, b, c, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_V product = _SIMD_##L##_MUL(_SIMD_##L##_LOAD(a+i), _SIMD_##L##_LOAD(b+i)); \
+			_SIMD_##L##_STORE(dst+i, _SIMD_##L##_ADD(product, _SIMD_##L##_LOAD(c+i))); \
+		} \
+		basic_mul_add_f32(dst+i, a+i, b+i, c+i, count-i); \
+	} \
+	SIMD_TARGET(features) void simd_##prefix##_scale_f32(float32 *dst, float32 *a, float32 scale, u64 count) { \
+		_SIMD_##L##_V vscale = _SIMD_##L##_SET1(scale); \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_scale_f32(dst, a, scale, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_STORE(dst+i, _SIMD_##L##_MUL(_SIMD_##L##_LOAD(a+i), vscale)); \
+		} \
+		basic_scale_f32(dst+i, a+i, scale, count-i); \
+	} \
+	SIMD_TARGET(features) void simd_##prefix##_scale_add_f32(float32 *dst, float32 *a, float32 scale, float32 *b, u64 count) { \
+		_SIMD_##L##_V vscale = _SIMD_##L##_SET1(scale); \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_scale_add_f32(dst, a, scale, b, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_V product = _SIMD_##L##_MUL(_SIMD_##L##_LOAD(a+i), vscale); \
+			_SIMD_##L##_STORE(dst+i, _SIMD_##L##_ADD(product, _SIMD_##L##_LOAD(b+i))); \
+		} \
+		basic_scale_add_f32(dst+i, a+i, scale, b+i, count-i); \
+	} \
+	SIMD_TARGET(features) void simd_##prefix##_clamp_f32(float32 *dst, float32 *a, float32 min_value, float32 max_value, u64 count) { \
+		_SIMD_##L##_V vmin = _SIMD_##L##_SET1(min_value); \
+		_SIMD_##L##_V vmax = _SIMD_##L##_SET1(max_value); \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_clamp_f32(dst, a, min_value, max_value, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_STORE(dst+i, _SIMD_##L##_MAX(_SIMD_##L##_MIN(_SIMD_##L##_LOAD(a+i), vmax), vmin)); \
+		} \
+		basic_clamp_f32(dst+i, a+i, min_value, max_value, count-i); \
+	} \
+	\
+	_SIMD_SPAN_REDUCE(L, prefix, features, sum_f32, (float32 *a, u64 count), (a+i, count-i), _SIMD_##L##_SUM_TERM) \
+	_SIMD_SPAN_REDUCE(L, prefix, features, dot_f32, (float32 *a, float32 *b, u64 count), (a+i, b+i, count-i), _SIMD_##L##_DOT_TERM) \
+	\
+	SIMD_TARGET(features) void simd_##prefix##_f32_to_s32(s32 *dst, float32 *a, u64 count) { \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_f32_to_s32(dst, a, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_STOREI(dst+i, _SIMD_##L##_F2I(_SIMD_##L##_LOAD(a+i))); \
+		} \
+		basic_f32_to_s32(dst+i, a+i, count-i); \
+	} \
+	SIMD_TARGET(features) void simd_##prefix##_s32_to_f32(float32 *dst, s32 *a, u64 count) { \
+		u64 i = _simd_span_head(dst, sizeof(_SIMD_##L##_V), count); \
+		basic_s32_to_f32(dst, a, i); \
+		for (; i + _SIMD_##L##_LANES <= count; i += _SIMD_##L##_LANES) { \
+			_SIMD_##L##_STORE(dst+i, _SIMD_##L##_I2F(_SIMD_##L##_LOADI(a+i))); \
+		} \
+		basic_s32_to_f32(dst+i, a+i, count-i); \
+	}
+
+#define _SIMD_SSE_SUM_TERM(j)    _SIMD_SSE_LOAD(a+(j))
+#define _SIMD_SSE_DOT_TERM(j)    _SIMD_SSE_MUL(_SIMD_SSE_LOAD(a+(j)), _SIMD_SSE_LOAD(b+(j)))
+#define _SIMD_AVX_SUM_TERM(j)    _SIMD_AVX_LOAD(a+(j))
+#define _SIMD_AVX_DOT_TERM(j)    _SIMD_AVX_MUL(_SIMD_AVX_LOAD(a+(j)), _SIMD_AVX_LOAD(b+(j)))
+#define _SIMD_AVX512_SUM_TERM(j) _SIMD_AVX512_LOAD(a+(j))
+#define _SIMD_AVX512_DOT_TERM(j) _SIMD_AVX512_MUL(_SIMD_AVX512_LOAD(a+(j)), _SIMD_AVX512_LOAD(b+(j)))
+
+// sse2 is part of x64 so this is the baseline, avx2 has nothing extra for these.
+_SIMD_DEFINE_SPAN_KERNELS(SSE,    sse,    "sse2")
+_SIMD_DEFINE_SPAN_KERNELS(AVX,    avx,    "avx")
+_SIMD_DEFINE_SPAN_KERNELS(AVX512, avx512, "avx512f")
+
+#define _SIMD_SPAN_BASELINE(name) simd_sse_##name
+
+#else
+
+#define _SIMD_SPAN_BASELINE(name) basic_##name
+
+#endif // ENABLE_SIMD
+
+#define _SIMD_BASELINE_DISPATCH { \
+	.level = SIMD_LEVEL_BASELINE, \
+	\
+	.mul_int32_128 = simd_baseline_mul_int32_128, \
+	\
+	.add_float32_256   = simd_baseline_add_float32_256, \
+	.sub_float32_256   = simd_baseline_sub_float32_256, \
+	.mul_float32_256   = simd_baseline_mul_float32_256, \
+	.div_float32_256   = simd_baseline_div_float32_256, \
+	.sqrt_float32_256  = simd_baseline_sqrt_float32_256, \
+	.rsqrt_float32_256 = simd_baseline_rsqrt_float32_256, \
+	.add_int32_256     = simd_baseline_add_int32_256, \
+	.sub_int32_256     = simd_baseline_sub_int32_256, \
+	.mul_int32_256     = simd_baseline_mul_int32_256, \
+	\
+	.add_float32_512   = simd_baseline_add_float32_512, \
+	.sub_float32_512   = simd_baseline_sub_float32_512, \
+	.mul_float32_512   = simd_baseline_mul_float32_512, \
+	.div_float32_512   = simd_baseline_div_float32_512, \
+	.sqrt_float32_512  = simd_baseline_sqrt_float32_512, \
+	.rsqrt_float32_512 = simd_baseline_rsqrt_float32_512, \
+	.add_int32_512     = simd_baseline_add_int32_512, \
+	.sub_int32_512     = simd_baseline_sub_int32_512, \
+	.mul_int32_512     = simd_baseline_mul_int32_512, \
+	\
+	.add_f32       = _SIMD_SPAN_BASELINE(add_f32), \
+	.sub_f32       = _SIMD_SPAN_BASELINE(sub_f32), \
+	.mul_f32       = _SIMD_SPAN_BASELINE(mul_f32), \
+	.min_f32       = _SIMD_SPAN_BASELINE(min_f32), \
+	.max_f32       = _SIMD_SPAN_BASELINE(max_f32), \
+	.mul_add_f32   = _SIMD_SPAN_BASELINE(mul_add_f32), \
+	.scale_f32     = _SIMD_SPAN_BASELINE(scale_f32), \
+	.scale_add_f32 = _SIMD_SPAN_BASELINE(scale_add_f32), \
+	.clamp_f32     = _SIMD_SPAN_BASELINE(clamp_f32), \
+	.sum_f32       = _SIMD_SPAN_BASELINE(sum_f32), \
+	.dot_f32       = _SIMD_SPAN_BASELINE(dot_f32), \
+	.f32_to_s32    = _SIMD_SPAN_BASELINE(f32_to_s32), \
+	.s32_to_f32    = _SIMD_SPAN_BASELINE(s32_to_f32), \
+}
+
+Simd_Dispatch simd_dispatch = _SIMD_BASELINE_DISPATCH;
+
+Simd_Level
+simd_get_max_level(Cpu_Capabilities features) {
+#if ENABLE_SIMD
+	if (features.avx512 && features.avx2) return SIMD_LEVEL_AVX512;
+	if (features.avx2   && features.avx)  return SIMD_LEVEL_AVX2;
+	if (features.avx)                     return SIMD_LEVEL_AVX;
+	if (features.sse41)                   return SIMD_LEVEL_SSE41;
+#endif
+	return SIMD_LEVEL_BASELINE;
+}
+
+Simd_Dispatch
+simd_make_dispatch(Simd_Level level) {
+	assert(level >= 0 && level < SIMD_LEVEL_COUNT, "Invalid simd level %d", level);
+	
+	// Start with the baseline and let each level overwrite what it does better
+	Simd_Dispatch d = _SIMD_BASELINE_DISPATCH;
+	d.level = level;
+
+#if ENABLE_SIMD
+	if (level >= SIMD_LEVEL_SSE41) {
+		d.mul_int32_128 = simd_sse41_mul_int32_128;
+	}
+	if (level >= SIMD_LEVEL_AVX) {
+		d.add_f32       = simd_avx_add_f32;
+		d.sub_f32       = simd_avx_sub_f32;
+		d.mul_f32       = simd_avx_mul_f32;
+		d.min_f32       = simd_avx_min_f32;
+		d.max_f32       = simd_avx_max_f32;
+		d.mul_add_f32   = simd_avx_mul_add_f32;
+		d.scale_f32     = simd_avx_scale_f32;
+		d.scale_add_f32 = simd_avx_scale_add_f32;
+		d.clamp_f32     = simd_avx_clamp_f32;
+		d.sum_f32       = simd_avx_sum_f32;
+		d.dot_f32       = simd_avx_dot_f32;
+		d.f32_to_s32    = simd_avx_f32_to_s32;
+		d.s32_to_f32    = simd_avx_s32_to_f32;
+		
+		d.add_float32_256   = simd_avx_add_float32_256;
+		d.sub_float32_256   = simd_avx_sub_float32_256;
+		d.mul_float32_256   = simd_avx_mul_float32_256;
+		d.div_float32_256   = simd_avx_div_float32_256;
+		d.sqrt_float32_256  = simd_avx_sqrt_float32_256;
+		d.rsqrt_float32_256 = simd_avx_rsqrt_float32_256;
+		d.add_float32_512   = simd_avx_add_float32_512;
+		d.sub_float32_512   = simd_avx_sub_float32_512;
+		d.mul_float32_512   = simd_avx_mul_float32_512;
+		d.div_float32_512   = simd_avx_div_float32_512;
+		d.sqrt_float32_512  = simd_avx_sqrt_float32_512;
+		d.rsqrt_float32_512 = simd_avx_rsqrt_float32_512;
+	}
+	if (level >= SIMD_LEVEL_AVX2) {
+		d.add_int32_256 = simd_avx2_add_int32_256;
+		d.sub_int32_256 = simd_avx2_sub_int32_256;
+		d.mul_int32_256 = simd_avx2_mul_int32_256;
+		d.add_int32_512 = simd_avx2_add_int32_512;
+		d.sub_int32_512 = simd_avx2_sub_int32_512;
+		d.mul_int32_512 = simd_avx2_mul_int32_512;
+	}
+	if (level >= SIMD_LEVEL_AVX512) {
+		d.add_f32       = simd_avx512_add_f32;
+		d.sub_f32       = simd_avx512_sub_f32;
+		d.mul_f32       = simd_avx512_mul_f32;
+		d.min_f32       = simd_avx512_min_f32;
+		d.max_f32       = simd_avx512_max_f32;
+		d.mul_add_f32   = simd_avx512_mul_add_f32;
+		d.scale_f32     = simd_avx512_scale_f32;
+		d.scale_add_f32 = simd_avx512_scale_add_f32;
+		d.clamp_f32     = simd_avx512_clamp_f32;
+		d.sum_f32       = simd_avx512_sum_f32;
+		d.dot_f32       = simd_avx512_dot_f32;
+		d.f32_to_s32    = simd_avx512_f32_to_s32;
+		d.s32_to_f32    = simd_avx512_s32_to_f32;
+		
+		d.add_float32_512   = simd_avx512_add_float32_512;
+		d.sub_float32_512   = simd_avx512_sub_float32_512;
+		d.mul_float32_512   = simd_avx512_mul_float32_512;
+		d.div_float32_512   = simd_avx512_div_float32_512;
+		d.sqrt_float32_512  = simd_avx512_sqrt_float32_512;
+		d.rsqrt_float32_512 = simd_avx512_rsqrt_float32_512;
+		d.add_int32_512     = simd_avx512_add_int32_512;
+		d.sub_int32_512     = simd_avx512_sub_int32_512;
+		d.mul_int32_512     = simd_avx512_mul_int32_512;
+	}
+#endif
+
+	return d;
+}
+
+void
+simd_init_dispatch(Cpu_Capabilities features) {
+	// Should happen before any threads are started, so no need to be atomic about it
+	simd_dispatch = simd_make_dispatch(simd_get_max_level(features));
+}
+
+const char*
+simd_level_name(Simd_Level level) {
+	switch (level) {
+		case SIMD_LEVEL_BASELINE: return "baseline";
+		case SIMD_LEVEL_SSE41:    return "sse4.1";
+		case SIMD_LEVEL_AVX:      return "avx";
+		case SIMD_LEVEL_AVX2:     return "avx2";
+		case SIMD_LEVEL_AVX512:   return "avx512";
+		default: return "invalid";
+	}
+}
+
+#endif // !OOGABOOGA_LINK_EXTERNAL_INSTANCE
@@ -0,0 +1,389 @@
+// Flat hash map in the style of a "swiss table".
+// Same idea as Hash_Table (open addressing, keys stored, compared in full on hash
+// match) but every slot also has a 1-byte control byte in a separate array. A control
+// byte holds 7 bits of the hash for full slots, or marks the slot as empty/deleted.
+// We probe 16 slots at a time by comparing 16 control bytes in one go with SSE2, so
+// we only ever touch the entries whose 7-bit hash matches. This keeps lookups fast at
+// much higher load factors than Hash_Table (we go up to 87.5%).
+
+/*
+
+	Example Usage:
+
+	Same as Hash_Table, just swap hash_table_ for swiss_table_.
+
+	// Make a table with key type 'u32' and value type 'Gfx_Font_Atlas', allocated on the heap
+	Swiss_Table table = make_swiss_table(u32, Gfx_Font_Atlas, get_heap_allocator());
+
+	u32 key = 5;
+	Gfx_Font_Atlas atlas = ...;
+	bool newly_added = swiss_table_set(&table, key, atlas);
+
+	Gfx_Font_Atlas *found = swiss_table_find(&table, key);
+
+	bool removed = swiss_table_remove(&table, key);
+
+	u64 cursor = 0;
+	u32 *it_key;
+	Gfx_Font_Atlas *it_value;
+	while (swiss_table_iterate(&table, &cursor, (void**)&it_key, (void**)&it_value)) {
+
+	}
+
+	swiss_table_reset(&table);
+	swiss_table_destroy(&table);
+
+	When to use which:
+		Hash_Table is fine for most things.
+		Swiss_Table pays off when the table is big, looked up a lot and you want it
+		densely packed, for example glyph or texture lookups every frame.
+
+	Limitations:
+		Same as Hash_Table.
+
+*/
+
+typedef struct Swiss_Table Swiss_Table;
+
+// API:
+#define make_swiss_table_reserve(Key_Type, Value_Type, capacity_count, allocator) \
+	make_swiss_table_reserve_raw(sizeof(Key_Type), sizeof(Value_Type), capacity_count, get_hash_table_key_compare_proc(Key_Type), allocator)
+
+#define make_swiss_table(Key_Type, Value_Type, allocator) \
+	make_swiss_table_raw(sizeof(Key_Type), sizeof(Value_Type), get_hash_table_key_compare_proc(Key_Type), allocator)
+
+#define swiss_table_add(table_ptr, key, value) \
+	swiss_table_add_raw((table_ptr), get_hash(key), &(key), &(value), sizeof(key), sizeof(value))
+
+#define swiss_table_find(table_ptr, key) \
+	swiss_table_find_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
+#define swiss_table_contains(table_ptr, key) \
+	swiss_table_contains_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
+#define swiss_table_set(table_ptr, key, value) \
+	swiss_table_set_raw((table_ptr), get_hash(key), &key, &value, sizeof(key), sizeof(value))
+
+#define swiss_table_remove(table_ptr, key) \
+	swiss_table_remove_raw((table_ptr), get_hash(key), &(key), sizeof(key))
+
+void swiss_table_reserve(Swiss_Table *t, u64 required_count);
+
+#define SWISS_TABLE_GROUP_SIZE 16
+
+// 7/8 max load
+#define SWISS_TABLE_MAX_LOAD_NUMERATOR   7
+#define SWISS_TABLE_MAX_LOAD_DENOMINATOR 8
+
+// Control bytes. Full slots store the low 7 bits of the hash (0..127), so the high
+// bit being set means the slot is free to insert into.
+#define SWISS_TABLE_CONTROL_EMPTY   ((u8)0x80)
+#define SWISS_TABLE_CONTROL_DELETED ((u8)0xFE)
+
+typedef struct Swiss_Table {
+
+	// capacity_count control bytes, one per slot.
+	// This is also the start of the allocation, entries come right after.
+	u8 *control;
+
+	// Each entry is hash-key-value, same layout as Hash_Table
+	void *entries;
+
+	u64 count; // Number of valid entries
+	u64 capacity_count; // Number of allocated entries (power of two, at least SWISS_TABLE_GROUP_SIZE)
+
+	u64 _key_size;
+	u64 _value_size;
+
+	u64 _tombstone_count;
+
+	Hash_Table_Key_Compare_Proc _key_compare;
+
+	Allocator allocator;
+} Swiss_Table;
+
+inline u64 swiss_table_get_value_offset(Swiss_Table *t) {
+	return sizeof(u64)+align_next(t->_key_size, 8);
+}
+inline u64 swiss_table_get_entry_size(Swiss_Table *t) {
+	return swiss_table_get_value_offset(t)+align_next(t->_value_size, 8);
+}
+inline u8 *swiss_table_get_slot_entry(Swiss_Table *t, u64 slot) {
+	return (u8*)t->entries+slot*swiss_table_get_entry_size(t);
+}
+inline u64 swiss_table_get_capacity_for_count(u64 count) {
+	u64 capacity = get_next_power_of_two((count*SWISS_TABLE_MAX_LOAD_DENOMINATOR)/SWISS_TABLE_MAX_LOAD_NUMERATOR + 1);
+	return max(capacity, SWISS_TABLE_GROUP_SIZE);
+}
+// High bits pick the group, low 7 bits go in the control byte
+inline u64 swiss_table_h1(u64 hash) { return hash >> 7; }
+inline u8  swiss_table_h2(u64 hash) { return (u8)(hash & 0x7F); }
+
+///
+// Group matching. Each returns a 16-bit mask with one bit per slot in the group.
+
+#if SIMD_ENABLE_SSE2
+inline u32 swiss_table_group_match(u8 *group, u8 h2) {
+	__m128i control = _mm_loadu_si128((__m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)h2)));
+}
+inline u32 swiss_table_group_match_empty(u8 *group) {
+	__m128i control = _mm_loadu_si128((__m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)SWISS_TABLE_CONTROL_EMPTY)));
+}
+inline u32 swiss_table_group_match_empty_or_deleted(u8 *group) {
+	// Both have the high bit set, which is exactly what movemask picks out
+	__m128i control = _mm_loadu_si128((__m128i*)group);
+	return (u32)_mm_movemask_epi8(control);
+}
+#else
+inline u32 swiss_table_group_match(u8 *group, u8 h2) {
+	u32 mask = 0;
+	for (u32 i = 0; i < SWISS_TABLE_GROUP_SIZE; i += 1) {
+		if (group[i] == h2) mask |= 1u << i;
+	}
+	return mask;
+}
+inline u32 swiss_table_group_match_empty(u8 *group) {
+	return swiss_table_group_match(group, SWISS_TABLE_CONTROL_EMPTY);
+}
+inline u32 swiss_table_group_match_empty_or_deleted(u8 *group) {
+	u32 mask = 0;
+	for (u32 i = 0; i < SWISS_TABLE_GROUP_SIZE; i += 1) {
+		if (group[i] & 0x80) mask |= 1u << i;
+	}
+	return mask;
+}
+#endif
+
+void swiss_table_alloc_storage(Swiss_Table *t, u64 capacity_count) {
+	// One allocation: control bytes first, then the entries
+	u64 control_size = align_next(capacity_count, 16);
+	u64 entries_size = capacity_count*swiss_table_get_entry_size(t);
+
+	t->control = alloc_uninitialized(t->allocator, control_size+entries_size);
+	t->entries = t->control+control_size;
+	t->capacity_count = capacity_count;
+
+	memset(t->control, SWISS_TABLE_CONTROL_EMPTY, capacity_count);
+}
+void swiss_table_free_storage(Swiss_Table *t) {
+	if (t->control) dealloc(t->allocator, t->control);
+	t->control = 0;
+	t->entries = 0;
+}
+
+Swiss_Table make_swiss_table_reserve_raw(u64 key_size, u64 value_size, u64 capacity_count, Hash_Table_Key_Compare_Proc key_compare, Allocator allocator) {
+	Swiss_Table t = ZERO(Swiss_Table);
+
+	t._key_size = key_size;
+	t._value_size = value_size;
+	t._key_compare = key_compare ? key_compare : hash_table_keys_match_bytes;
+	t.allocator = allocator;
+
+	swiss_table_alloc_storage(&t, swiss_table_get_capacity_for_count(capacity_count));
+
+	return t;
+}
+inline Swiss_Table make_swiss_table_raw(u64 key_size, u64 value_size, Hash_Table_Key_Compare_Proc key_compare, Allocator allocator) {
+	return make_swiss_table_reserve_raw(key_size, value_size, 64, key_compare, allocator);
+}
+
+void swiss_table_reset(Swiss_Table *t) {
+	memset(t->control, SWISS_TABLE_CONTROL_EMPTY, t->capacity_count);
+	t->count = 0;
+	t->_tombstone_count = 0;
+}
+void swiss_table_destroy(Swiss_Table *t) {
+	swiss_table_free_storage(t);
+
+	t->count = 0;
+	t->capacity_count = 0;
+	t->_tombstone_count = 0;
+}
+
+// Returns the slot of the key or UINT64_MAX if it's not in the table.
+// Groups are probed with triangular numbers, which visits every group once since the
+// group count is a power of two.
+u64 swiss_table_probe(Swiss_Table *t, u64 hash, void *k) {
+	u64 group_mask = t->capacity_count/SWISS_TABLE_GROUP_SIZE-1;
+	u64 group = swiss_table_h1(hash) & group_mask;
+	u8 h2 = swiss_table_h2(hash);
+
+	for (u64 step = 1; step <= group_mask+1; step += 1) {
+		u8 *group_control = t->control+group*SWISS_TABLE_GROUP_SIZE;
+
+		u32 match = swiss_table_group_match(group_control, h2);
+		while (match) {
+			u64 slot = group*SWISS_TABLE_GROUP_SIZE+count_trailing_zeros_32(match);
+			u8 *entry = swiss_table_get_slot_entry(t, slot);
+			if (*(u64*)entry == hash && t->_key_compare(entry+sizeof(u64), k, t->_key_size)) {
+				return slot;
+			}
+			match &= match-1;
+		}
+
+		// If there's an empty slot in this group, the key would have been put here
+		if (swiss_table_group_match_empty(group_control)) return UINT64_MAX;
+
+		group = (group+step) & group_mask;
+	}
+
+	return UINT64_MAX;
+}
+
+// First empty or deleted slot along the probe sequence of hash
+u64 swiss_table_find_insert_slot(Swiss_Table *t, u64 hash) {
+	u64 group_mask = t->capacity_count/SWISS_TABLE_GROUP_SIZE-1;
+	u64 group = swiss_table_h1(hash) & group_mask;
+
+	for (u64 step = 1; step <= group_mask+1; step += 1) {
+		u32 free_mask = swiss_table_group_match_empty_or_deleted(t->control+group*SWISS_TABLE_GROUP_SIZE);
+		if (free_mask) {
+			return group*SWISS_TABLE_GROUP_SIZE+count_trailing_zeros_32(free_mask);
+		}
+		group = (group+step) & group_mask;
+	}
+
+	assert(false, "Internal swiss table error: table is full");
+	return UINT64_MAX;
+}
+
+inline void swiss_table_write_slot(Swiss_Table *t, u64 slot, u64 hash, void *k, void *v) {
+	if (t->control[slot] == SWISS_TABLE_CONTROL_DELETED) t->_tombstone_count -= 1;
+	t->control[slot] = swiss_table_h2(hash);
+
+	u8 *entry = swiss_table_get_slot_entry(t, slot);
+	memcpy(entry, &hash, sizeof(u64));
+	memcpy(entry+sizeof(u64), k, t->_key_size);
+	memcpy(entry+swiss_table_get_value_offset(t), v, t->_value_size);
+}
+
+void swiss_table_rehash(Swiss_Table *t, u64 new_capacity) {
+	assert(new_capacity >= SWISS_TABLE_GROUP_SIZE && (new_capacity & (new_capacity-1)) == 0, "Swiss table capacity must be a power of two and at least one group");
+
+	u64 entry_size = swiss_table_get_entry_size(t);
+
+	Swiss_Table old = *t;
+
+	swiss_table_alloc_storage(t, new_capacity);
+	t->_tombstone_count = 0;
+
+	for (u64 i = 0; i < old.capacity_count; i += 1) {
+		if (old.control[i] & 0x80) continue;
+
+		u8 *entry = (u8*)old.entries+i*entry_size;
+		u64 hash = *(u64*)entry;
+		u64 slot = swiss_table_find_insert_slot(t, hash);
+		t->control[slot] = swiss_table_h2(hash);
+		memcpy(swiss_table_get_slot_entry(t, slot), entry, entry_size);
+	}
+
+	swiss_table_free_storage(&old);
+}
+
+void swiss_table_reserve(Swiss_Table *t, u64 required_count) {
+	u64 used_count = required_count + t->_tombstone_count;
+
+	if (used_count*SWISS_TABLE_MAX_LOAD_DENOMINATOR <= t->capacity_count*SWISS_TABLE_MAX_LOAD_NUMERATOR) return;
+
+	u64 new_capacity = max(swiss_table_get_capacity_for_count(required_count), t->capacity_count);
+
+	swiss_table_rehash(t, new_capacity);
+}
+
+void swiss_table_shrink_to_fit(Swiss_Table *t) {
+	u64 new_capacity = swiss_table_get_capacity_for_count(t->count);
+	if (new_capacity >= t->capacity_count && t->_tombstone_count == 0) return;
+
+	swiss_table_rehash(t, min(new_capacity, t->capacity_count));
+}
+
+// This can add multiple entries of same key, beware!
+void swiss_table_add_raw(Swiss_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
+	assert(t->_key_size == key_size, "Key type size does not match swiss table initted key type size");
+	assert(t->_value_size == value_size, "Value type size does not match swiss table initted value type size");
+
+	swiss_table_reserve(t, t->count+1);
+
+	u64 slot = swiss_table_find_insert_slot(t, hash);
+	swiss_table_write_slot(t, slot, hash, k, v);
+	t->count += 1;
+}
+
+void *swiss_table_find_raw(Swiss_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match swiss table initted key type size");
+
+	if (t->count == 0) return 0;
+
+	u64 slot = swiss_table_probe(t, hash, k);
+	if (slot == UINT64_MAX) return 0;
+
+	return swiss_table_get_slot_entry(t, slot)+swiss_table_get_value_offset(t);
+}
+
+bool swiss_table_contains_raw(Swiss_Table *t, u64 hash, void *k, u64 key_size) {
+	return swiss_table_find_raw(t, hash, k, key_size) != 0;
+}
+
+// Returns true if key was newly added or false if it already existed
+bool swiss_table_set_raw(Swiss_Table *t, u64 hash, void *k, void *v, u64 key_size, u64 value_size) {
+	assert(t->_key_size == key_size, "Key type size does not match swiss table initted key type size");
+	assert(t->_value_size == value_size, "Value type size does not match swiss table initted value type size");
+
+	if (t->count) {
+		u64 slot = swiss_table_probe(t, hash, k);
+		if (slot != UINT64_MAX) {
+			memcpy(swiss_table_get_slot_entry(t, slot)+swiss_table_get_value_offset(t), v, value_size);
+			return false;
+		}
+	}
+
+	swiss_table_reserve(t, t->count+1);
+
+	u64 slot = swiss_table_find_insert_slot(t, hash);
+	swiss_table_write_slot(t, slot, hash, k, v);
+	t->count += 1;
+
+	return true;
+}
+
+// Returns true if an entry was removed
+bool swiss_table_remove_raw(Swiss_Table *t, u64 hash, void *k, u64 key_size) {
+	assert(t->_key_size == key_size, "Key type size does not match swiss table initted key type size");
+
+	if (t->count == 0) return false;
+
+	u64 slot = swiss_table_probe(t, hash, k);
+	if (slot == UINT64_MAX) return false;
+
+	// Probes stop at the first group with an empty slot. If this group already has
+	// one, nothing can be probing past it, so we can mark the slot empty instead of
+	// leaving a tombstone.
+	u8 *group_control = t->control+(slot/SWISS_TABLE_GROUP_SIZE)*SWISS_TABLE_GROUP_SIZE;
+	if (swiss_table_group_match_empty(group_control)) {
+		t->control[slot] = SWISS_TABLE_CONTROL_EMPTY;
+	} else {
+		t->control[slot] = SWISS_TABLE_CONTROL_DELETED;
+		t->_tombstone_count += 1;
+	}
+	t->count -= 1;
+
+	return true;
+}
+
+// Same as hash_table_iterate()
+bool swiss_table_iterate(Swiss_Table *t, u64 *cursor, void **key_ptr, void **value_ptr) {
+	while (*cursor < t->capacity_count) {
+		u64 slot = *cursor;
+		*cursor += 1;
+
+		if (t->control[slot] & 0x80) continue;
+
+		u8 *entry = swiss_table_get_slot_entry(t, slot);
+		if (key_ptr)   *key_ptr   = entry+sizeof(u64);
+		if (value_ptr) *value_ptr = entry+swiss_table_get_value_offset(t);
+		return true;
+	}
+	return false;
+}
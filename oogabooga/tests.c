@@ -31,6 +31,12 @@ void log_heap() {
 		
 		block = block->next;
 	}
+	
+	for (u64 i = 0; i < HEAP_SIZE_CLASS_COUNT; i += 1) {
+		Heap_Size_Class *size_class = &heap_size_classes[i];
+		if (!size_class->slab_count) continue;
+		print("\tSIZE CLASS %llu bytes: %llu slabs, %llu/%llu slots free\n", size_class->slot_size, size_class->slab_count, size_class->free_count, size_class->slot_count);
+	}
 	spinlock_release(&heap_lock);
 }
 
@@ -197,6 +203,295 @@ void test_allocator(bool do_log_heap) {
     if (do_log_heap) log_heap();
 }
 
+// Skewed towards small sizes, like most programs
+u64 test_allocator_random_size() {
+	u64 r = get_random() % 100;
+	if (r < 70) return (u64)get_random_int_in_range(8, 256);
+	if (r < 95) return (u64)get_random_int_in_range(257, 4096);
+	return (u64)get_random_int_in_range(4097, 30000);
+}
+void test_allocator_speed(u64 live_count, u64 op_count) {
+	
+	Allocator heap = get_heap_allocator();
+	
+	void **live = (void**)alloc(heap, live_count*sizeof(void*));
+	u64 *live_sizes = (u64*)alloc(heap, live_count*sizeof(u64));
+	
+	u64 cycles[2];
+	float64 seconds[2];
+	u64 requested_bytes[2];
+	u64 held_bytes[2];
+	u64 new_slab_bytes[2];
+	u64 hole_count[2];
+	s64 new_hole_count[2];
+	u64 hole_bytes[2];
+	
+	u64 old_seed = seed_for_random;
+	
+	// 0: everything through the free list, 1: size classes
+	for (u64 pass = 0; pass < 2; pass += 1) {
+		// Same sizes and same order for both passes
+		seed_for_random = 1337;
+		
+		Heap_Stats before = heap_get_stats();
+		
+		float64 start_seconds = os_get_elapsed_seconds();
+		u64 start_cycles = rdtsc();
+		for (u64 i = 0; i < op_count; i += 1) {
+			u64 slot = get_random() % live_count;
+			u64 size = test_allocator_random_size();
+			if (live[slot]) heap_dealloc(live[slot]);
+			live[slot] = pass == 0 ? heap_alloc_large(size) : heap_alloc(size);
+			live_sizes[slot] = size;
+			
+			// Touch it so we don't measure an allocator that never hands out real memory
+			*(u8*)live[slot] = (u8)i;
+		}
+		cycles[pass] = rdtsc() - start_cycles;
+		seconds[pass] = os_get_elapsed_seconds() - start_seconds;
+		
+		Heap_Stats after = heap_get_stats();
+		
+		requested_bytes[pass] = 0;
+		for (u64 i = 0; i < live_count; i += 1) {
+			if (live[i]) requested_bytes[pass] += live_sizes[i];
+		}
+		// What the heap holds for the live set, including metadata and size class rounding
+		u64 large_in_use_before = before.block_bytes-before.free_bytes-before.slab_bytes;
+		u64 large_in_use_after  = after.block_bytes-after.free_bytes-after.slab_bytes;
+		held_bytes[pass] = (large_in_use_after-large_in_use_before) + (after.slot_bytes_in_use-before.slot_bytes_in_use);
+		new_slab_bytes[pass] = after.slab_bytes-before.slab_bytes;
+		
+		// Every free node except the largest one is a hole between allocations
+		hole_count[pass] = after.free_node_count - 1;
+		new_hole_count[pass] = (s64)after.free_node_count - (s64)before.free_node_count;
+		hole_bytes[pass] = after.free_bytes - after.largest_free_node;
+		
+		for (u64 i = 0; i < live_count; i += 1) {
+			if (live[i]) heap_dealloc(live[i]);
+			live[i] = 0;
+		}
+	}
+	
+	seed_for_random = old_seed;
+	
+	dealloc(heap, live);
+	dealloc(heap, live_sizes);
+	
+	const char *names[2] = { "Free list", "Size classes" };
+	print("Heap churn with %llu live allocations, %llu alloc/dealloc pairs:\n", live_count, op_count);
+	for (u64 pass = 0; pass < 2; pass += 1) {
+		print("\t%s:\n", names[pass]);
+		print("\t\t%.0f allocs/sec, %llu cycles/op\n", (float64)op_count/seconds[pass], cycles[pass]/op_count);
+		print("\t\t%llukb held for %llukb requested, %llukb new slab memory\n", held_bytes[pass]/1024, requested_bytes[pass]/1024, new_slab_bytes[pass]/1024);
+		print("\t\tfree list fragmentation: %llu holes (%+lld), %llukb in holes\n", hole_count[pass], new_hole_count[pass], hole_bytes[pass]/1024);
+	}
+}
+
+void test_temporary_storage() {
+	
+	reset_temporary_storage();
+	
+	Temporary_Storage_Stats stats = get_temporary_storage_stats();
+	assert(stats.used == 0 && stats.high_water == 0, "Failed: Temporary storage not empty after reset");
+	
+	u8 *first = (u8*)talloc(100);
+	memset(first, 0xAB, 100);
+	
+	// Nested marks roll back only their own scratch memory
+	Temp_Mark outer = temp_begin();
+	u8 *a = (u8*)talloc(200);
+	Temp_Mark inner = temp_begin();
+	talloc(300);
+	temp_end(inner);
+	u8 *b = (u8*)talloc(300);
+	assert(b == a+200, "Failed: temp_end did not roll back the inner scope");
+	temp_end(outer);
+	assert(talloc(1) == a, "Failed: temp_end did not roll back the outer scope");
+	
+	stats = get_temporary_storage_stats();
+	assert(stats.used == 101, "Failed: Temporary storage used count");
+	assert(stats.high_water == 600, "Failed: Temporary storage high water");
+	
+	// Overflowing chains a block instead of wrapping around over memory that's still in use
+	Temp_Mark before_overflow = temp_begin();
+	u64 big_size = stats.size/2+1;
+	u8 *big1 = (u8*)talloc(big_size);
+	u8 *big2 = (u8*)talloc(big_size);
+	memset(big1, 0x11, big_size);
+	memset(big2, 0x22, big_size);
+	u8 *huge = (u8*)talloc(stats.size*3);
+	memset(huge, 0x33, stats.size*3);
+	
+	stats = get_temporary_storage_stats();
+	assert(stats.overflow_block_count == 2, "Failed: Expected temporary storage to chain 2 blocks, got %llu", stats.overflow_block_count);
+	for (u64 i = 0; i < 100; i += 1) assert(first[i] == 0xAB, "Failed: Temporary storage overflow overwrote memory in use");
+	assert(big1[big_size-1] == 0x11 && big2[0] == 0x22, "Failed: Temporary storage overflow overwrote memory in use");
+	
+	// Ending a scope that chained blocks frees those blocks
+	temp_end(before_overflow);
+	assert(talloc(1) == first+101, "Failed: temp_end across chained blocks");
+	
+	u64 frame_high_water = get_temporary_storage_stats().high_water;
+	
+	reset_temporary_storage();
+	stats = get_temporary_storage_stats();
+	assert(stats.used == 0 && stats.high_water == 0 && stats.overflow_block_count == 0, "Failed: reset_temporary_storage stats");
+	assert(stats.last_frame_high_water == frame_high_water, "Failed: Last frame high water");
+	assert(stats.peak_high_water >= frame_high_water, "Failed: Peak high water");
+	assert(talloc(1) == first, "Failed: reset_temporary_storage did not go back to the main block");
+	
+	reset_temporary_storage();
+}
+
+void test_arena() {
+	
+	Arena arena = make_virtual_arena(GB(4));
+	assert(arena.committed == 0, "Failed: Virtual arena committed memory up front");
+	
+	Arena_Mark empty = arena_get_mark(&arena);
+	
+	u64 *a = (u64*)arena_push(&arena, sizeof(u64));
+	*a = 69;
+	assert(arena.committed == ARENA_COMMIT_SIZE, "Failed: Virtual arena did not commit exactly one chunk");
+	
+	Arena_Mark mark = arena_get_mark(&arena);
+	
+	// Grow well past the first commit
+	u8 *big = (u8*)arena_push(&arena, MB(10));
+	memset(big, 0xAB, MB(10));
+	assert(arena.committed >= MB(10), "Failed: Virtual arena did not commit when growing");
+	assert(arena.committed < MB(10)+2*ARENA_COMMIT_SIZE, "Failed: Virtual arena committed too much");
+	
+	Allocator allocator = get_arena_allocator(&arena);
+	u64 *b = (u64*)alloc(allocator, sizeof(u64));
+	*b = 420;
+	assert((u64)b % ARENA_ALIGNMENT == 0, "Failed: Arena allocation misaligned");
+	
+	arena_pop_to_mark(&arena, mark);
+	assert(arena_get_used(&arena) == mark, "Failed: Pop to mark");
+	assert(*a == 69, "Failed: Memory before the mark was corrupted");
+	
+	// Popping keeps the pages so the next push reuses them without committing again
+	u64 committed = arena.committed;
+	u64 *c = (u64*)arena_push(&arena, sizeof(u64));
+	assert((u8*)c == big, "Failed: Push after pop did not reuse memory");
+	assert(arena.committed == committed, "Failed: Committed memory changed without growing");
+	
+	// High water is still ~10mb, so nothing should be decommitted yet
+	arena_decommit_to_high_water_mark(&arena);
+	assert(arena.committed == committed, "Failed: Decommitted memory below the high water mark");
+	
+	// Now the high water mark is what we use right now, so the 10mb should go away
+	arena_decommit_to_high_water_mark(&arena);
+	assert(arena.committed == ARENA_COMMIT_SIZE, "Failed: Did not decommit down to the high water mark");
+	assert(*a == 69 && *c == 0xABABABABABABABABULL, "Failed: Decommit corrupted live memory");
+	
+	arena_pop_to_mark(&arena, empty);
+	arena_reset(&arena);
+	assert(arena_get_used(&arena) == 0, "Failed: Arena reset");
+	
+	arena_destroy(&arena);
+	
+	// Fixed size arenas still behave the same
+	Arena fixed = make_arena(1024);
+	void *first = arena_push(&fixed, 100);
+	arena_push(&fixed, 100);
+	arena_reset(&fixed);
+	assert(arena_push(&fixed, 100) == first, "Failed: Fixed arena reset");
+	arena_destroy(&fixed);
+	
+	Allocator fixed_allocator = make_arena_allocator(1024);
+	int *x = (int*)alloc(fixed_allocator, sizeof(int));
+	int *y = (int*)alloc(fixed_allocator, sizeof(int));
+	assert(x && y && x != y, "Failed: Arena allocator did not return memory");
+	dealloc(get_heap_allocator(), fixed_allocator.data);
+}
+
+typedef struct Test_Pool_Object {
+	u64 a;
+	float32 b;
+	u8 c[13];
+} Test_Pool_Object;
+void test_pool() {
+	
+	Allocator heap = get_heap_allocator();
+	
+	for (u64 generations = 0; generations < 2; generations += 1) {
+		Pool pool = make_pool(sizeof(Test_Pool_Object), 64, (bool)generations, heap);
+		
+		Test_Pool_Object *objects[1000];
+		for (u64 i = 0; i < 1000; i += 1) {
+			objects[i] = (Test_Pool_Object*)pool_alloc(&pool);
+			assert((u64)objects[i] % POOL_ALIGNMENT == 0, "Failed: Pool object misaligned");
+			objects[i]->a = i;
+		}
+		assert(pool.count == 1000, "Failed: Pool count");
+		assert(pool.chunk_count == (1000+63)/64, "Failed: Pool chunk count");
+		
+		// Free every other object, the memory for the rest must stay put
+		for (u64 i = 0; i < 1000; i += 2) pool_free(&pool, objects[i]);
+		for (u64 i = 1; i < 1000; i += 2) assert(objects[i]->a == i, "Failed: Pool object moved or was corrupted");
+		assert(pool.count == 500, "Failed: Pool count after free");
+		
+		// Freed slots are reused before we grow
+		u64 chunk_count = pool.chunk_count;
+		for (u64 i = 0; i < 1000; i += 2) objects[i] = (Test_Pool_Object*)pool_alloc(&pool);
+		assert(pool.chunk_count == chunk_count, "Failed: Pool grew even though it had free slots");
+		
+		Allocator allocator = get_pool_allocator(&pool);
+		Test_Pool_Object *zeroed = (Test_Pool_Object*)alloc(allocator, sizeof(Test_Pool_Object));
+		assert(zeroed->a == 0, "Failed: Pool allocator did not zero initialize");
+		dealloc(allocator, zeroed);
+		
+		if (generations) {
+			Pool_Handle handle = pool_get_handle(&pool, objects[1]);
+			assert(pool_resolve(&pool, handle) == objects[1], "Failed: Pool handle did not resolve");
+			pool_free(&pool, objects[1]);
+			assert(pool_resolve(&pool, handle) == 0, "Failed: Pool handle resolved after free");
+			
+			// Same slot again, handle must still be stale
+			void *again = pool_alloc(&pool);
+			assert(again == objects[1], "Failed: Expected pool to reuse the last freed slot");
+			assert(pool_resolve(&pool, handle) == 0, "Failed: Stale pool handle resolved to a reused slot");
+			
+			u64 live = 0;
+			u64 cursor = 0;
+			Test_Pool_Object *object = 0;
+			while (pool_iterate(&pool, &cursor, (void**)&object)) {
+				live += 1;
+				// Freeing while iterating is fine
+				if (live % 3 == 0) pool_free(&pool, object);
+			}
+			assert(live == 1000, "Failed: Pool iterate visited %llu objects, expected 1000", live);
+			assert(pool.count == 1000 - 1000/3, "Failed: Pool count after freeing while iterating");
+		}
+		
+		pool_destroy(&pool);
+		assert(pool.count == 0 && pool.first_chunk == 0, "Failed: pool_destroy");
+	}
+	
+	// O(1) regardless of how many are live
+	Pool pool = make_pool(sizeof(Test_Pool_Object), 1024, true, heap);
+	u64 count = 100000;
+	void **live = (void**)alloc(heap, count*sizeof(void*));
+	for (u64 i = 0; i < count; i += 1) live[i] = pool_alloc(&pool);
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	u64 start_cycles = rdtsc();
+	for (u64 i = 0; i < count; i += 1) {
+		pool_free(&pool, live[i]);
+		live[i] = pool_alloc(&pool);
+	}
+	u64 cycles = rdtsc() - start_cycles;
+	float64 seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	print("Pool free+alloc with %llu live objects: %llu cycles, %.2f ns\n", count, cycles/count, (seconds*1000000000.0)/(float64)count);
+	
+	dealloc(heap, live);
+	pool_destroy(&pool);
+}
+
 void test_thread_proc1(Thread* t) {
 	os_sleep(5);
 	print("Hello from thread %llu\n", t->id);
@@ -258,6 +553,540 @@ void test_allocator_threaded(Thread *t) {
     }
 }
 
+#define TEST_ALLOCATOR_THREADED_LIVE_COUNT 256
+void test_allocator_threaded_churn(Thread *t) {
+	u64 op_count = *(u64*)t->data;
+	
+	void *live[TEST_ALLOCATOR_THREADED_LIVE_COUNT] = {0};
+	
+	// Own rng, get_random() would make every thread fight over the seed
+	u64 rng = t->id*2654435761ULL + 1;
+	
+	for (u64 i = 0; i < op_count; i += 1) {
+		rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+		u64 slot = rng % TEST_ALLOCATOR_THREADED_LIVE_COUNT;
+		u64 size = 16 + (rng >> 32) % 2048;
+		
+		if (live[slot]) {
+			assert(*(u64*)live[slot] == (u64)live[slot], "Memory corrupted");
+			heap_dealloc(live[slot]);
+		}
+		live[slot] = heap_alloc(size);
+		*(u64*)live[slot] = (u64)live[slot];
+	}
+	
+	for (u64 i = 0; i < TEST_ALLOCATOR_THREADED_LIVE_COUNT; i += 1) {
+		if (live[i]) heap_dealloc(live[i]);
+	}
+}
+void test_allocator_threaded_speed(u64 op_count_per_thread) {
+	
+	Allocator heap = get_heap_allocator();
+	
+	u64 max_thread_count = min(os_get_number_of_logical_processors(), 16);
+	Thread *threads = alloc(heap, sizeof(Thread)*max_thread_count);
+	
+	// Mixed sizes on all threads at once, this also goes through the free list
+	for (u64 i = 0; i < max_thread_count; i += 1) {
+		os_thread_init(&threads[i], test_allocator_threaded);
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < max_thread_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	
+	bool old_use_thread_caches = heap_use_thread_caches;
+	
+	print("Heap churn, %llu alloc/dealloc pairs per thread:\n", op_count_per_thread);
+	for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+		float64 ops_per_second[2];
+		for (u64 use_caches = 0; use_caches < 2; use_caches += 1) {
+			heap_use_thread_caches = (bool)use_caches;
+			
+			float64 start_seconds = os_get_elapsed_seconds();
+			for (u64 i = 0; i < thread_count; i += 1) {
+				os_thread_init(&threads[i], test_allocator_threaded_churn);
+				threads[i].data = &op_count_per_thread;
+				os_thread_start(&threads[i]);
+			}
+			for (u64 i = 0; i < thread_count; i += 1) {
+				os_thread_join(&threads[i]);
+				os_thread_destroy(&threads[i]);
+			}
+			float64 seconds = os_get_elapsed_seconds() - start_seconds;
+			ops_per_second[use_caches] = (float64)(op_count_per_thread*thread_count)/seconds;
+		}
+		print("\t%llu threads: %.0f allocs/sec with heap_lock only, %.0f allocs/sec with thread caches\n", thread_count, ops_per_second[0], ops_per_second[1]);
+	}
+	
+	heap_use_thread_caches = old_use_thread_caches;
+	
+	dealloc(heap, threads);
+}
+
+typedef struct Test_Job {
+	volatile u64 *total;
+	u64 value;
+	u64 child_count;
+	u64 iteration_count;
+	u64 result;
+	u8 padding[24]; // Keep results on separate cache lines
+} Test_Job;
+
+void test_job_add(void *data) {
+	Test_Job *job = (Test_Job*)data;
+	
+	// Temporary storage is per worker and rolled back after each job
+	u64 *scratch = (u64*)talloc(sizeof(u64)*64);
+	for (u64 i = 0; i < 64; i += 1) scratch[i] = job->value;
+	assert(scratch[63] == job->value, "Temporary storage in job corrupted");
+	
+	atomic_fetch_add_64(job->total, (s64)job->value, MEMORY_ORDER_SEQ_CST);
+}
+void test_job_spawn_children(void *data) {
+	Test_Job *job = (Test_Job*)data;
+	
+	Test_Job *children = (Test_Job*)talloc(sizeof(Test_Job)*job->child_count);
+	Job_Counter counter = ZERO(Job_Counter);
+	for (u64 i = 0; i < job->child_count; i += 1) {
+		children[i] = ZERO(Test_Job);
+		children[i].total = job->total;
+		children[i].value = 1;
+		job_run(test_job_add, &children[i], &counter);
+	}
+	job_counter_wait(&counter);
+	assert(counter.count == 0, "Job counter not 0 after job_counter_wait");
+}
+void test_job_compute(void *data) {
+	Test_Job *job = (Test_Job*)data;
+	u64 x = job->value | 1;
+	for (u64 i = 0; i < job->iteration_count; i += 1) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	}
+	job->result = x;
+}
+
+// oogabooga_init starts the job system (see JOB_WORKER_COUNT). Tests that need some
+// other number of workers, or none at all, stop it and start it again when they're done.
+u64 test_job_system_stop() {
+	u64 old_worker_count = job_system_get_worker_count();
+	job_system_shutdown();
+	return old_worker_count;
+}
+void test_job_system_restore(u64 old_worker_count) {
+	job_system_shutdown();
+	if (old_worker_count) job_system_init(old_worker_count);
+}
+
+void test_job_system() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 old_worker_count = test_job_system_stop();
+	
+	// No job system: job_run just runs the job
+	{
+		volatile u64 total = 0;
+		Test_Job job = ZERO(Test_Job);
+		job.total = &total;
+		job.value = 7;
+		Job_Counter counter = ZERO(Job_Counter);
+		job_run(test_job_add, &job, &counter);
+		assert(total == 7, "job_run without a job system did not run the job");
+		assert(counter.count == 0, "Job counter wrong");
+	}
+	
+	job_system_init(0);
+	assert(job_system_get_worker_count() == os_get_number_of_logical_processors(), "Expected one worker per logical processor");
+	assert(job_get_worker_index() == 0, "Initializing thread should be worker 0");
+	
+	// Many independent jobs, more than fits in a deque
+	{
+		const u64 job_count = JOB_QUEUE_CAPACITY*2 + 123;
+		volatile u64 total = 0;
+		Test_Job *jobs = alloc(heap, sizeof(Test_Job)*job_count);
+		Job_Counter counter = ZERO(Job_Counter);
+		u64 expected = 0;
+		for (u64 i = 0; i < job_count; i += 1) {
+			jobs[i] = ZERO(Test_Job);
+			jobs[i].total = &total;
+			jobs[i].value = i;
+			expected += i;
+			job_run(test_job_add, &jobs[i], &counter);
+		}
+		job_counter_wait(&counter);
+		assert(total == expected, "Job results don't add up, %llu != %llu", total, expected);
+		dealloc(heap, jobs);
+	}
+	
+	// Jobs which spawn & wait for jobs
+	{
+		const u64 parent_count = 64;
+		volatile u64 total = 0;
+		Test_Job *parents = alloc(heap, sizeof(Test_Job)*parent_count);
+		Job_Counter counter = ZERO(Job_Counter);
+		for (u64 i = 0; i < parent_count; i += 1) {
+			parents[i] = ZERO(Test_Job);
+			parents[i].total = &total;
+			parents[i].child_count = 32;
+			job_run(test_job_spawn_children, &parents[i], &counter);
+		}
+		job_counter_wait(&counter);
+		assert(total == parent_count*32, "Nested jobs don't add up, %llu != %llu", total, parent_count*32);
+		dealloc(heap, parents);
+	}
+	
+	Job_System_Stats stats = job_system_get_stats();
+	assert(stats.executed_count > 0, "Job stats not counted");
+	
+	job_system_shutdown();
+	assert(job_get_worker_index() == -1, "Still a worker after shutdown");
+	
+	test_job_system_restore(old_worker_count);
+}
+
+void test_job_system_speed(u64 job_count, u64 iteration_count) {
+	Allocator heap = get_heap_allocator();
+	
+	Test_Job *jobs = alloc(heap, sizeof(Test_Job)*job_count);
+	
+	// Single threaded reference
+	u64 expected = 0;
+	float64 start_seconds = os_get_elapsed_seconds();
+	for (u64 i = 0; i < job_count; i += 1) {
+		jobs[i] = ZERO(Test_Job);
+		jobs[i].value = i;
+		jobs[i].iteration_count = iteration_count;
+		test_job_compute(&jobs[i]);
+		expected ^= jobs[i].result;
+	}
+	float64 serial_seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	print("%llu independent jobs, %.3fms without the job system:\n", job_count, serial_seconds*1000.0);
+	
+	u64 old_worker_count = test_job_system_stop();
+	
+	u64 max_worker_count = os_get_number_of_logical_processors();
+	for (u64 worker_count = 1; ; worker_count = min(worker_count*2, max_worker_count)) {
+		job_system_init(worker_count);
+		
+		start_seconds = os_get_elapsed_seconds();
+		Job_Counter counter = ZERO(Job_Counter);
+		for (u64 i = 0; i < job_count; i += 1) {
+			jobs[i].result = 0;
+			job_run(test_job_compute, &jobs[i], &counter);
+		}
+		job_counter_wait(&counter);
+		float64 seconds = os_get_elapsed_seconds() - start_seconds;
+		
+		Job_System_Stats stats = job_system_get_stats();
+		job_system_shutdown();
+		
+		u64 result = 0;
+		for (u64 i = 0; i < job_count; i += 1) result ^= jobs[i].result;
+		assert(result == expected, "Job results differ from the single threaded run");
+		
+		print("\t%llu workers: %.3fms, %.2fx speedup, %llu of %llu jobs stolen\n", worker_count, seconds*1000.0, serial_seconds/seconds, stats.stolen_count, stats.executed_count);
+
+		
+		if (worker_count == max_worker_count) break;
+	}
+	
+	test_job_system_restore(old_worker_count);
+	
+	dealloc(heap, jobs);
+}
+
+void test_parallel_fill(u64 first, u64 end, void *userdata) {
+	u64 *values = (u64*)userdata;
+	for (u64 i = first; i < end; i += 1) values[i] = i*3 + 1;
+}
+void test_parallel_sum(u64 first, u64 end, void *userdata, void *partial) {
+	u64 *values = (u64*)userdata;
+	u64 sum = 0;
+	for (u64 i = first; i < end; i += 1) sum += values[i];
+	*(u64*)partial += sum;
+}
+void test_parallel_sum_combine(void *result, void *partial, void *userdata) {
+	*(u64*)result += *(u64*)partial;
+}
+void test_parallel_scale(u64 first, u64 end, void *userdata) {
+	float32 *values = (float32*)userdata;
+	for (u64 i = first; i < end; i += 1) values[i] = values[i]*1.0001f + 0.5f;
+}
+
+void test_parallel_for() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 count = 100000;
+	u64 *values = alloc(heap, sizeof(u64)*count);
+	u64 expected = 0;
+	for (u64 i = 0; i < count; i += 1) expected += i*3 + 1;
+	
+	u64 old_worker_count = test_job_system_stop();
+	
+	// Without a job system everything runs inline, then with one
+	for (u64 run = 0; run < 2; run += 1) {
+		if (run == 1) job_system_init(0);
+		
+		u64 batch_sizes[] = {0, 1, 7, 1000, count, count*2};
+		for (u64 b = 0; b < sizeof(batch_sizes)/sizeof(u64); b += 1) {
+			memset(values, 0, sizeof(u64)*count);
+			parallel_for(count, batch_sizes[b], test_parallel_fill, values);
+			for (u64 i = 0; i < count; i += 1) assert(values[i] == i*3 + 1, "parallel_for missed index %llu", i);
+			
+			u64 sum = 0;
+			parallel_reduce(count, batch_sizes[b], test_parallel_sum, test_parallel_sum_combine, values, &sum, sizeof(sum));
+			assert(sum == expected, "parallel_reduce sum is %llu, expected %llu", sum, expected);
+		}
+		
+		// Nothing to do
+		parallel_for(0, 0, test_parallel_fill, values);
+		
+		if (run == 1) job_system_shutdown();
+	}
+	
+	test_job_system_restore(old_worker_count);
+	
+	dealloc(heap, values);
+}
+
+void test_parallel_for_speed() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 old_worker_count = test_job_system_stop();
+	job_system_init(0);
+	
+	const u64 max_count = 1 << 22;
+	float32 *values = alloc(heap, sizeof(float32)*max_count);
+	memset(values, 0, sizeof(float32)*max_count); // Fault in the pages before timing anything
+	
+	// Cheap work per item, so the job overhead shows. batch_size 1 so it always goes wide.
+	print("parallel_for crossover with %llu workers:\n", job_system_get_worker_count());
+	u64 crossover = 0;
+	for (u64 count = 256; count <= max_count; count *= 4) {
+		u64 repeat_count = max(1, (1 << 22)/count);
+		
+		float64 start_seconds = os_get_elapsed_seconds();
+		for (u64 r = 0; r < repeat_count; r += 1) test_parallel_scale(0, count, values);
+		float64 inline_seconds = (os_get_elapsed_seconds() - start_seconds)/(float64)repeat_count;
+		
+		start_seconds = os_get_elapsed_seconds();
+		for (u64 r = 0; r < repeat_count; r += 1) parallel_for(count, 1, test_parallel_scale, values);
+		float64 parallel_seconds = (os_get_elapsed_seconds() - start_seconds)/(float64)repeat_count;
+		
+		if (!crossover && parallel_seconds < inline_seconds) crossover = count;
+		
+		print("\t%llu items: %.2fus inline, %.2fus parallel, %.2fx\n", count, inline_seconds*1000000.0, parallel_seconds*1000000.0, inline_seconds/parallel_seconds);
+	}
+	if (crossover) print("\tGoing wide pays off from about %llu items\n", crossover);
+	else           print("\tGoing wide never paid off\n");
+	
+	dealloc(heap, values);
+	
+	job_system_shutdown();
+	test_job_system_restore(old_worker_count);
+}
+
+#define TEST_QUEUE_MAX_PRODUCERS 16
+#define TEST_QUEUE_BATCH_SIZE 32
+typedef struct Test_Queue_Context {
+	Spsc_Queue *spsc;
+	Mpmc_Queue *mpmc;
+	u64 message_count; // Per producer
+	u64 producer_index;
+	bool batched;
+	
+	// Filled in by consumers
+	u64 received_count[TEST_QUEUE_MAX_PRODUCERS];
+	u64 received_sum[TEST_QUEUE_MAX_PRODUCERS];
+	volatile u64 *total_received;
+	u64 total_to_receive;
+} Test_Queue_Context;
+
+// Messages are producer index in the top bits, sequence number in the bottom
+void test_queue_producer(Thread *t) {
+	Test_Queue_Context *c = (Test_Queue_Context*)t->data;
+	u64 batch[TEST_QUEUE_BATCH_SIZE];
+	u64 sent = 0;
+	while (sent < c->message_count) {
+		u64 count = c->batched ? min(TEST_QUEUE_BATCH_SIZE, c->message_count-sent) : 1;
+		for (u64 i = 0; i < count; i += 1) batch[i] = (c->producer_index << 48) | (sent+i);
+		
+		u64 pushed = c->spsc ? spsc_queue_push_many(c->spsc, batch, count) : mpmc_queue_push_many(c->mpmc, batch, count);
+		if (pushed == 0) os_yield_thread();
+		sent += pushed;
+	}
+}
+void test_queue_consumer(Thread *t) {
+	Test_Queue_Context *c = (Test_Queue_Context*)t->data;
+	u64 batch[TEST_QUEUE_BATCH_SIZE];
+	
+	// Messages from one producer must come out in the order they went in
+	s64 last_sequence[TEST_QUEUE_MAX_PRODUCERS];
+	for (u64 i = 0; i < TEST_QUEUE_MAX_PRODUCERS; i += 1) last_sequence[i] = -1;
+	
+	while (*c->total_received < c->total_to_receive) {
+		u64 max_count = c->batched ? TEST_QUEUE_BATCH_SIZE : 1;
+		u64 popped = c->spsc ? spsc_queue_pop_many(c->spsc, batch, max_count) : mpmc_queue_pop_many(c->mpmc, batch, max_count);
+		if (popped == 0) {
+			os_yield_thread();
+			continue;
+		}
+		for (u64 i = 0; i < popped; i += 1) {
+			u64 producer = batch[i] >> 48;
+			s64 sequence = (s64)(batch[i] & 0xFFFFFFFFFFFFULL);
+			assert(producer < TEST_QUEUE_MAX_PRODUCERS, "Garbage message from queue");
+			assert(sequence > last_sequence[producer], "Queue reordered messages from producer %llu: %lld after %lld", producer, sequence, last_sequence[producer]);
+			last_sequence[producer] = sequence;
+			c->received_count[producer] += 1;
+			c->received_sum[producer] += (u64)sequence;
+		}
+		atomic_fetch_add_64(c->total_received, (s64)popped, MEMORY_ORDER_SEQ_CST);
+	}
+}
+
+// Returns messages per second
+float64 test_queue_run(bool use_mpmc, u64 producer_count, u64 consumer_count, u64 message_count, bool batched) {
+	Allocator heap = get_heap_allocator();
+	assert(producer_count <= TEST_QUEUE_MAX_PRODUCERS, "Too many producers");
+	
+	Spsc_Queue spsc;
+	Mpmc_Queue mpmc;
+	if (use_mpmc) mpmc_queue_init(&mpmc, 1024, sizeof(u64), heap);
+	else      spsc_queue_init(&spsc, 1024, sizeof(u64), heap);
+	
+	volatile u64 total_received = 0;
+	u64 thread_count = producer_count + consumer_count;
+	Thread *threads = alloc(heap, sizeof(Thread)*thread_count);
+	Test_Queue_Context *contexts = alloc(heap, sizeof(Test_Queue_Context)*thread_count);
+	memset(contexts, 0, sizeof(Test_Queue_Context)*thread_count);
+	
+	for (u64 i = 0; i < thread_count; i += 1) {
+		Test_Queue_Context *c = &contexts[i];
+		c->spsc = use_mpmc ? 0 : &spsc;
+		c->mpmc = use_mpmc ? &mpmc : 0;
+		c->message_count = message_count;
+		c->producer_index = i;
+		c->batched = batched;
+		c->total_received = &total_received;
+		c->total_to_receive = message_count*producer_count;
+	}
+	
+	float64 start_seconds = os_get_elapsed_seconds();
+	for (u64 i = 0; i < thread_count; i += 1) {
+		os_thread_init(&threads[i], i < producer_count ? test_queue_producer : test_queue_consumer);
+		threads[i].data = &contexts[i];
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < thread_count; i += 1) {
+		os_thread_join(&threads[i]);
+		os_thread_destroy(&threads[i]);
+	}
+	float64 seconds = os_get_elapsed_seconds() - start_seconds;
+	
+	// Nothing lost, nothing duplicated
+	u64 expected_sum = message_count*(message_count-1)/2;
+	for (u64 p = 0; p < producer_count; p += 1) {
+		u64 count = 0;
+		u64 sum = 0;
+		for (u64 i = producer_count; i < thread_count; i += 1) {
+			count += contexts[i].received_count[p];
+			sum   += contexts[i].received_sum[p];
+		}
+		assert(count == message_count, "Producer %llu sent %llu messages but %llu were received", p, message_count, count);
+		assert(sum == expected_sum, "Messages from producer %llu were lost or duplicated", p);
+	}
+	
+	u64 leftover;
+	if (use_mpmc) {
+		assert(!mpmc_queue_pop(&mpmc, &leftover), "Queue should be empty");
+		mpmc_queue_destroy(&mpmc);
+	} else {
+		assert(!spsc_queue_pop(&spsc, &leftover), "Queue should be empty");
+		spsc_queue_destroy(&spsc);
+	}
+	
+	dealloc(heap, threads);
+	dealloc(heap, contexts);
+	
+	return (float64)(message_count*producer_count)/seconds;
+}
+
+void test_queues() {
+	Allocator heap = get_heap_allocator();
+	
+	// Single threaded basics, wrap around & full/empty
+	{
+		Spsc_Queue q;
+		spsc_queue_init(&q, 5, sizeof(u32), heap);
+		assert(q.capacity == 8, "Capacity should round up to a power of two");
+		
+		u32 in[20];
+		u32 out[20];
+		for (u32 i = 0; i < 20; i += 1) in[i] = i*7;
+		
+		for (u32 round = 0; round < 10; round += 1) {
+			assert(spsc_queue_push_many(&q, in, 5) == 5, "Push failed");
+			assert(spsc_queue_pop_many(&q, out, 3) == 3, "Pop failed");
+			assert(out[0] == 0 && out[1] == 7 && out[2] == 14, "Wrong order");
+			assert(spsc_queue_pop_many(&q, out, 20) == 2, "Pop failed");
+			assert(out[0] == 21 && out[1] == 28, "Wrong order");
+		}
+		assert(spsc_queue_push_many(&q, in, 20) == 8, "Should only fit capacity");
+		assert(!spsc_queue_push(&q, &in[0]), "Push on a full queue should fail");
+		assert(spsc_queue_pop_many(&q, out, 20) == 8, "Should pop everything");
+		for (u32 i = 0; i < 8; i += 1) assert(out[i] == in[i], "Wrong order");
+		assert(!spsc_queue_pop(&q, out), "Pop on an empty queue should fail");
+		
+		spsc_queue_destroy(&q);
+	}
+	{
+		Mpmc_Queue q;
+		mpmc_queue_init(&q, 5, sizeof(u32), heap);
+		assert(q.capacity == 8, "Capacity should round up to a power of two");
+		
+		u32 in[20];
+		u32 out[20];
+		for (u32 i = 0; i < 20; i += 1) in[i] = i*7;
+		
+		for (u32 round = 0; round < 10; round += 1) {
+			assert(mpmc_queue_push_many(&q, in, 5) == 5, "Push failed");
+			assert(mpmc_queue_pop_many(&q, out, 3) == 3, "Pop failed");
+			assert(out[0] == 0 && out[1] == 7 && out[2] == 14, "Wrong order");
+			assert(mpmc_queue_pop_many(&q, out, 20) == 2, "Pop failed");
+			assert(out[0] == 21 && out[1] == 28, "Wrong order");
+		}
+		assert(mpmc_queue_push_many(&q, in, 20) == 8, "Should only fit capacity");
+		assert(!mpmc_queue_push(&q, &in[0]), "Push on a full queue should fail");
+		assert(mpmc_queue_pop_many(&q, out, 20) == 8, "Should pop everything");
+		for (u32 i = 0; i < 8; i += 1) assert(out[i] == in[i], "Wrong order");
+		assert(!mpmc_queue_pop(&q, out), "Pop on an empty queue should fail");
+		
+		mpmc_queue_destroy(&q);
+	}
+	
+	// Stress, millions of messages across threads
+	test_queue_run(false, 1, 1, 2000000, false);
+	test_queue_run(false, 1, 1, 2000000, true);
+	test_queue_run(true, 4, 4, 500000, false);
+	test_queue_run(true, 4, 4, 500000, true);
+	test_queue_run(true, 1, 8, 1000000, true);
+	test_queue_run(true, 8, 1, 250000, false);
+}
+
+void test_queues_speed(u64 message_count) {
+	print("Queue throughput, %llu messages:\n", message_count);
+	print("\tspsc:           %.0f msgs/sec, %.0f msgs/sec batched\n", 
+		test_queue_run(false, 1, 1, message_count, false), test_queue_run(false, 1, 1, message_count, true));
+	
+	u64 max_thread_count = clamp(os_get_number_of_logical_processors()/2, 1, TEST_QUEUE_MAX_PRODUCERS);
+	for (u64 n = 1; n <= max_thread_count; n *= 2) {
+		print("\tmpmc %llup -> %llux: %.0f msgs/sec, %.0f msgs/sec batched\n", n, n,
+			test_queue_run(true, n, n, message_count/n, false), test_queue_run(true, n, n, message_count/n, true));
+	}
+}
+
 void test_strings() {
 	Allocator heap = get_heap_allocator();
 	{
@@ -838,18 +1667,235 @@ void test_simd() {
     print("NO SIMD float32 mul took %llu cycles\n", cycles);
 } 
 
-// Indirect testing of some simd stuff
-void test_linmath() {
-
-    // Test vector creation and access
-    Vector2 v2_test = v2(1.0f, 2.0f);
-    assert(v2_test.x == 1.0f && v2_test.y == 2.0f, "v2 creation incorrect");
-
-    Vector3 v3_test = v3(1.0f, 2.0f, 3.0f);
-    assert(v3_test.x == 1.0f && v3_test.y == 2.0f && v3_test.z == 3.0f, "v3 creation incorrect");
-
-    Vector4 v4_test = v4(1.0f, 2.0f, 3.0f, 4.0f);
-    assert(v4_test.x == 1.0f && v4_test.y == 2.0f && v4_test.z == 3.0f && v4_test.w == 4.0f, "v4 creation incorrect");
+// Checks every implementation the cpu can run against plain scalar math
+void test_simd_dispatch() {
+	Cpu_Capabilities features = query_cpu_capabilities();
+	Simd_Level max_level = simd_get_max_level(features);
+	
+	assert(simd_dispatch.level == max_level, "simd_dispatch was not initialized to the best level (%d, expected %d)", simd_dispatch.level, max_level);
+	
+	// +1 so the kernels see unaligned pointers
+	f32 a_f32[16+1], b_f32[16+1], result_f32[16+1];
+	s32 a_i32[16+1], b_i32[16+1], result_i32[16+1];
+	f32 *a = a_f32+1, *b = b_f32+1, *r = result_f32+1;
+	s32 *ai = a_i32+1, *bi = b_i32+1, *ri = result_i32+1;
+	
+	for (Simd_Level level = SIMD_LEVEL_BASELINE; level <= max_level; level += 1) {
+		Simd_Dispatch d = simd_make_dispatch(level);
+		assert(d.level == level);
+		
+		for (int round = 0; round < 64; round += 1) {
+			for (int i = 0; i < 16; i += 1) {
+				// Never 0 so div & rsqrt are fine
+				a[i] = get_random_float32_in_range(0.5f, 1000.0f);
+				b[i] = get_random_float32_in_range(0.5f, 1000.0f) * (get_random_int_in_range(0, 1) ? 1.0f : -1.0f);
+				// Small enough that the scalar mul doesn't overflow
+				ai[i] = (s32)get_random_int_in_range(-30000, 30000);
+				bi[i] = (s32)get_random_int_in_range(-30000, 30000);
+			}
+			
+			#define _CHECK_FLOAT32_BINARY(proc, lanes, op) \
+				d.proc(a, b, r); \
+				for (int i = 0; i < (lanes); i += 1) \
+					assert(r[i] == a[i] op b[i], #proc " at %cs level was wrong at lane %d", simd_level_name(level), i);
+			#define _CHECK_INT32_BINARY(proc, lanes, op) \
+				d.proc(ai, bi, ri); \
+				for (int i = 0; i < (lanes); i += 1) \
+					assert(ri[i] == ai[i] op bi[i], #proc " at %cs level was wrong at lane %d", simd_level_name(level), i);
+			
+			_CHECK_INT32_BINARY(mul_int32_128, 4, *);
+			
+			_CHECK_FLOAT32_BINARY(add_float32_256, 8, +);
+			_CHECK_FLOAT32_BINARY(sub_float32_256, 8, -);
+			_CHECK_FLOAT32_BINARY(mul_float32_256, 8, *);
+			_CHECK_FLOAT32_BINARY(div_float32_256, 8, /);
+			_CHECK_INT32_BINARY(add_int32_256, 8, +);
+			_CHECK_INT32_BINARY(sub_int32_256, 8, -);
+			_CHECK_INT32_BINARY(mul_int32_256, 8, *);
+			
+			_CHECK_FLOAT32_BINARY(add_float32_512, 16, +);
+			_CHECK_FLOAT32_BINARY(sub_float32_512, 16, -);
+			_CHECK_FLOAT32_BINARY(mul_float32_512, 16, *);
+			_CHECK_FLOAT32_BINARY(div_float32_512, 16, /);
+			_CHECK_INT32_BINARY(add_int32_512, 16, +);
+			_CHECK_INT32_BINARY(sub_int32_512, 16, -);
+			_CHECK_INT32_BINARY(mul_int32_512, 16, *);
+			
+			#undef _CHECK_FLOAT32_BINARY
+			#undef _CHECK_INT32_BINARY
+			
+			// sqrt is correctly rounded everywhere, rsqrt instructions are approximations
+			// (12 bits for sse/avx, 14 for avx512)
+			d.sqrt_float32_256(a, r);
+			for (int i = 0; i < 8; i += 1)  assert(r[i] == (f32)sqrt(a[i]), "sqrt_float32_256 at %cs level was wrong at lane %d", simd_level_name(level), i);
+			d.sqrt_float32_512(a, r);
+			for (int i = 0; i < 16; i += 1) assert(r[i] == (f32)sqrt(a[i]), "sqrt_float32_512 at %cs level was wrong at lane %d", simd_level_name(level), i);
+			d.rsqrt_float32_256(a, r);
+			for (int i = 0; i < 8; i += 1)  assert(fabs(r[i]*sqrt(a[i]) - 1.0) < 0.001, "rsqrt_float32_256 at %cs level was wrong at lane %d", simd_level_name(level), i);
+			d.rsqrt_float32_512(a, r);
+			for (int i = 0; i < 16; i += 1) assert(fabs(r[i]*sqrt(a[i]) - 1.0) < 0.001, "rsqrt_float32_512 at %cs level was wrong at lane %d", simd_level_name(level), i);
+		}
+	}
+}
+
+// Span kernels at every level against the basic_ versions, with every alignment and 
+// remainder. Everything except sum & dot has to match exactly.
+void test_simd_spans() {
+	Simd_Level max_level = simd_get_max_level(query_cpu_capabilities());
+	
+	const u64 max_count = 100;
+	const u64 padding = 16;
+	float32 *a = alloc(get_heap_allocator(), (max_count+padding)*sizeof(float32));
+	float32 *b = alloc(get_heap_allocator(), (max_count+padding)*sizeof(float32));
+	float32 *c = alloc(get_heap_allocator(), (max_count+padding)*sizeof(float32));
+	float32 *expected = alloc(get_heap_allocator(), (max_count+padding)*sizeof(float32));
+	float32 *result = alloc(get_heap_allocator(), (max_count+padding)*sizeof(float32));
+	s32 *ints = alloc(get_heap_allocator(), (max_count+padding)*sizeof(s32));
+	s32 *expected_ints = alloc(get_heap_allocator(), (max_count+padding)*sizeof(s32));
+	s32 *result_ints = alloc(get_heap_allocator(), (max_count+padding)*sizeof(s32));
+	
+	for (u64 i = 0; i < max_count+padding; i += 1) {
+		a[i] = get_random_float32_in_range(-1000.0f, 1000.0f);
+		b[i] = get_random_float32_in_range(-1000.0f, 1000.0f);
+		c[i] = get_random_float32_in_range(-1000.0f, 1000.0f);
+		ints[i] = (s32)get_random_int_in_range(-10000000, 10000000);
+	}
+	
+	for (Simd_Level level = SIMD_LEVEL_BASELINE; level <= max_level; level += 1) {
+		Simd_Dispatch d = simd_make_dispatch(level);
+		
+		for (u64 offset = 0; offset < padding; offset += 1) {
+			for (u64 count = 0; count <= max_count; count += 1) {
+				// dst gets a different offset from the inputs so they're misaligned differently
+				float32 *pa = a+offset, *pb = b+offset, *pc = c+offset;
+				float32 *pr = result+(padding-1-offset);
+				float32 *pe = expected+(padding-1-offset);
+				
+				// Marker past the end to catch writing too far
+				pr[count] = 12345.0f;
+				
+				#define _CHECK_SPAN(call_expected, call_result) \
+					call_expected; call_result; \
+					for (u64 i = 0; i < count; i += 1) assert(pr[i] == pe[i], #call_result " at %cs level was wrong at %llu (count %llu, offset %llu)", simd_level_name(level), i, count, offset); \
+					assert(pr[count] == 12345.0f, #call_result " at %cs level wrote past the end", simd_level_name(level));
+				
+				_CHECK_SPAN(basic_add_f32(pe, pa, pb, count),           d.add_f32(pr, pa, pb, count));
+				_CHECK_SPAN(basic_sub_f32(pe, pa, pb, count),           d.sub_f32(pr, pa, pb, count));
+				_CHECK_SPAN(basic_mul_f32(pe, pa, pb, count),           d.mul_f32(pr, pa, pb, count));
+				_CHECK_SPAN(basic_min_f32(pe, pa, pb, count),           d.min_f32(pr, pa, pb, count));
+				_CHECK_SPAN(basic_max_f32(pe, pa, pb, count),           d.max_f32(pr, pa, pb, count));
+				_CHECK_SPAN(basic_scale_f32(pe, pa, 0.37f, count),      d.scale_f32(pr, pa, 0.37f, count));
+				_CHECK_SPAN(basic_clamp_f32(pe, pa, -250.0f, 500.0f, count), d.clamp_f32(pr, pa, -250.0f, 500.0f, count));
+				_CHECK_SPAN(basic_s32_to_f32(pe, ints+offset, count),   d.s32_to_f32(pr, ints+offset, count));
+				
+				#undef _CHECK_SPAN
+				
+				// The compiler may fuse the scalar multiply-adds so these only need to be within a rounding
+				#define _CHECK_SPAN_ROUGHLY(call_expected, call_result) \
+					call_expected; call_result; \
+					for (u64 i = 0; i < count; i += 1) assert(fabs(pr[i] - pe[i]) <= fabs(pe[i])*1e-5 + 1e-3, #call_result " at %cs level was wrong at %llu (count %llu, offset %llu)", simd_level_name(level), i, count, offset); \
+					assert(pr[count] == 12345.0f, #call_result " at %cs level wrote past the end", simd_level_name(level));
+				
+				_CHECK_SPAN_ROUGHLY(basic_mul_add_f32(pe, pa, pb, pc, count), d.mul_add_f32(pr, pa, pb, pc, count));
+				_CHECK_SPAN_ROUGHLY(basic_scale_add_f32(pe, pa, 0.37f, pb, count), d.scale_add_f32(pr, pa, 0.37f, pb, count));
+				
+				// In place
+				memcpy(pr, pa, count*sizeof(float32));
+				_CHECK_SPAN_ROUGHLY(basic_scale_add_f32(pe, pa, 0.5f, pb, count), d.scale_add_f32(pr, pr, 0.5f, pb, count));
+				
+				#undef _CHECK_SPAN_ROUGHLY
+				
+				s32 *pri = result_ints+(padding-1-offset);
+				s32 *pei = expected_ints+(padding-1-offset);
+				basic_f32_to_s32(pei, pa, count);
+				d.f32_to_s32(pri, pa, count);
+				for (u64 i = 0; i < count; i += 1) assert(pri[i] == pei[i], "f32_to_s32 at %cs level was wrong at %llu", simd_level_name(level), i);
+				
+				// Summation order differs so allow for rounding relative to the magnitudes involved
+				float64 magnitude = 0;
+				for (u64 i = 0; i < count; i += 1) magnitude += fabs(pa[i]*pb[i]) + fabs(pa[i]);
+				float64 tolerance = magnitude*1e-5 + 1e-5;
+				assert(fabs(d.sum_f32(pa, count) - basic_sum_f32(pa, count)) <= tolerance, "sum_f32 at %cs level was wrong (count %llu)", simd_level_name(level), count);
+				assert(fabs(d.dot_f32(pa, pb, count) - basic_dot_f32(pa, pb, count)) <= tolerance, "dot_f32 at %cs level was wrong (count %llu)", simd_level_name(level), count);
+			}
+		}
+	}
+	
+	dealloc(get_heap_allocator(), a);
+	dealloc(get_heap_allocator(), b);
+	dealloc(get_heap_allocator(), c);
+	dealloc(get_heap_allocator(), expected);
+	dealloc(get_heap_allocator(), result);
+	dealloc(get_heap_allocator(), ints);
+	dealloc(get_heap_allocator(), expected_ints);
+	dealloc(get_heap_allocator(), result_ints);
+}
+
+// Throughput of the span kernels at every level vs the scalar loops, in cycles per element.
+// Sized to stay in L2 so it measures the kernels rather than memory bandwidth.
+void test_simd_span_speed(u64 count, u64 iterations) {
+	Simd_Level max_level = simd_get_max_level(query_cpu_capabilities());
+	
+	float32 *a   = alloc(get_heap_allocator(), count*sizeof(float32));
+	float32 *b   = alloc(get_heap_allocator(), count*sizeof(float32));
+	float32 *dst = alloc(get_heap_allocator(), count*sizeof(float32));
+	for (u64 i = 0; i < count; i += 1) {
+		a[i] = get_random_float32_in_range(-1.0f, 1.0f);
+		b[i] = get_random_float32_in_range(-1.0f, 1.0f);
+	}
+	
+	print("\n");
+	for (s64 level = -1; level <= (s64)max_level; level += 1) {
+		Simd_Dispatch d = level < 0 ? ZERO(Simd_Dispatch) : simd_make_dispatch((Simd_Level)level);
+		if (level < 0) {
+			d.add_f32       = basic_add_f32;
+			d.scale_add_f32 = basic_scale_add_f32;
+			d.clamp_f32     = basic_clamp_f32;
+			d.dot_f32       = basic_dot_f32;
+		}
+		
+		float64 add = 0, scale_add = 0, clamp = 0, dot = 0;
+		volatile float32 sink = 0;
+		d.add_f32(dst, a, b, count); // Warm up
+		for (u64 it = 0; it < iterations; it += 1) {
+			u64 start = rdtsc();
+			d.add_f32(dst, a, b, count);
+			add += (float64)(rdtsc()-start);
+			
+			start = rdtsc();
+			d.scale_add_f32(dst, a, 0.5f, dst, count);
+			scale_add += (float64)(rdtsc()-start);
+			
+			start = rdtsc();
+			d.clamp_f32(dst, dst, -0.5f, 0.5f, count);
+			clamp += (float64)(rdtsc()-start);
+			
+			start = rdtsc();
+			sink += d.dot_f32(a, b, count);
+			dot += (float64)(rdtsc()-start);
+		}
+		float64 n = (float64)(count*iterations);
+		print("    %cs: add %.3f, scale_add %.3f, clamp %.3f, dot %.3f cycles/element\n", 
+			level < 0 ? "scalar" : simd_level_name((Simd_Level)level), add/n, scale_add/n, clamp/n, dot/n);
+	}
+	
+	dealloc(get_heap_allocator(), a);
+	dealloc(get_heap_allocator(), b);
+	dealloc(get_heap_allocator(), dst);
+}
+
+// Indirect testing of some simd stuff
+void test_linmath() {
+
+    // Test vector creation and access
+    Vector2 v2_test = v2(1.0f, 2.0f);
+    assert(v2_test.x == 1.0f && v2_test.y == 2.0f, "v2 creation incorrect");
+
+    Vector3 v3_test = v3(1.0f, 2.0f, 3.0f);
+    assert(v3_test.x == 1.0f && v3_test.y == 2.0f && v3_test.z == 3.0f, "v3 creation incorrect");
+
+    Vector4 v4_test = v4(1.0f, 2.0f, 3.0f, 4.0f);
+    assert(v4_test.x == 1.0f && v4_test.y == 2.0f && v4_test.z == 3.0f && v4_test.w == 4.0f, "v4 creation incorrect");
 
     // Test vector operations
     Vector2 v2_a = v2(3.0f, 4.0f);
@@ -1029,6 +2075,128 @@ void test_linmath() {
 	assert(floats_roughly_match(v4_dot_product, 30), "Failed: v4_dot");
 }
 
+bool m4_roughly_match(Matrix4 a, Matrix4 b, float32 tolerance) {
+	for (int i = 0; i < 16; i += 1) {
+		if (fabs(a.data[i] - b.data[i]) > tolerance * (1.0 + fabs(b.data[i]))) return false;
+	}
+	return true;
+}
+Matrix4 make_random_affine_m4() {
+	Matrix4 m = m4_make_translation(v3(get_random_float32_in_range(-500, 500), get_random_float32_in_range(-500, 500), get_random_float32_in_range(-5, 5)));
+	m = m4_rotate(m, v3_normalize(v3(get_random_float32_in_range(-1, 1), get_random_float32_in_range(-1, 1), get_random_float32_in_range(0.1f, 1))), get_random_float32_in_range(-PI32, PI32));
+	m = m4_scale(m, v3(get_random_float32_in_range(0.1f, 10), get_random_float32_in_range(0.1f, 10), get_random_float32_in_range(0.1f, 10)));
+	return m;
+}
+
+// The sse matrix procs against the basic_ scalar versions
+void test_linmath_simd() {
+	for (int round = 0; round < 1000; round += 1) {
+		Matrix4 a, b;
+		for (int i = 0; i < 16; i += 1) {
+			a.data[i] = get_random_float32_in_range(-10, 10);
+			b.data[i] = get_random_float32_in_range(-10, 10);
+		}
+		// Keep the general matrix well conditioned
+		for (int i = 0; i < 4; i += 1) a.m[i][i] += 50.0f;
+		
+		assert(m4_roughly_match(m4_mul(a, b), basic_m4_mul(a, b), 1e-5), "m4_mul doesn't match basic_m4_mul");
+		
+		Vector4 v = v4(get_random_float32_in_range(-10, 10), get_random_float32_in_range(-10, 10), get_random_float32_in_range(-10, 10), 1);
+		Vector4 t = m4_transform(a, v);
+		Vector4 bt = basic_m4_transform(a, v);
+		for (int i = 0; i < 4; i += 1) {
+			assert(fabs(t.data[i] - bt.data[i]) <= 1e-5 * (1.0 + fabs(bt.data[i])), "m4_transform doesn't match basic_m4_transform");
+		}
+		
+		Matrix4 transposed = m4_transpose(a);
+		for (int i = 0; i < 4; i += 1) for (int j = 0; j < 4; j += 1) {
+			assert(transposed.m[i][j] == a.m[j][i], "m4_transpose incorrect");
+		}
+		
+		Matrix4 inv = m4_inverse(a);
+		assert(m4_roughly_match(inv, basic_m4_inverse(a), 1e-4), "m4_inverse doesn't match basic_m4_inverse");
+		assert(m4_roughly_match(m4_mul(a, inv), m4_identity(), 1e-4), "m4_inverse times the matrix isn't identity");
+		
+		Matrix4 affine = make_random_affine_m4();
+		Matrix4 affine_inv = m4_inverse_affine(affine);
+		assert(m4_roughly_match(affine_inv, basic_m4_inverse_affine(affine), 1e-4), "m4_inverse_affine doesn't match basic_m4_inverse_affine");
+		assert(m4_roughly_match(affine_inv, basic_m4_inverse(affine), 1e-3), "m4_inverse_affine doesn't match the general inverse");
+		assert(m4_roughly_match(m4_mul(affine, affine_inv), m4_identity(), 1e-3), "m4_inverse_affine times the matrix isn't identity");
+		assert(m4_is_affine(affine), "m4_is_affine false for an affine matrix");
+		
+		// Anything but (0, 0, 0, 1) in the last row is projective
+		for (int j = 0; j < 4; j += 1) {
+			Matrix4 projective = affine;
+			projective.m[3][j] = j == 3 ? 0.5f : 0.25f;
+			assert(!m4_is_affine(projective), "m4_is_affine true with %f at m[3][%d]", projective.m[3][j], j);
+		}
+	}
+	
+	Matrix4 ortho = m4_make_orthographic_projection(-16, 16, -9, 9, -1, 10);
+	assert(m4_is_affine(ortho), "Orthographic projections should be affine");
+	
+	// Perspective style w = -z
+	Matrix4 perspective = ortho;
+	perspective.m[3][2] = -1;
+	perspective.m[3][3] = 0;
+	assert(!m4_is_affine(perspective), "Perspective projections should not be affine");
+	assert(m4_roughly_match(m4_inverse_affine(ortho), m4_inverse(ortho), 1e-4), "m4_inverse_affine of an orthographic projection doesn't match m4_inverse");
+	
+	Matrix4 singular = m4_scalar(1.0f);
+	singular.m[2][2] = 0;
+	Matrix4 zero = m4_scalar(0);
+	assert(m4_roughly_match(m4_inverse(singular), zero, 0), "m4_inverse of a singular matrix should be 0");
+	assert(m4_roughly_match(m4_inverse_affine(singular), zero, 0), "m4_inverse_affine of a singular matrix should be 0");
+}
+
+// What draw_quad_xform & draw_quad_projected do per quad: two m4_mul, an m4_inverse of the
+// camera and four m4_transform. Scalar vs sse.
+void test_linmath_speed(u64 quad_count) {
+	Matrix4 projection = m4_make_orthographic_projection(-640, 640, -360, 360, -1, 10);
+	Matrix4 camera = make_random_affine_m4();
+	Matrix4 *xforms = alloc(get_heap_allocator(), quad_count*sizeof(Matrix4));
+	for (u64 i = 0; i < quad_count; i += 1) xforms[i] = make_random_affine_m4();
+	
+	volatile float32 sink = 0;
+	
+	u64 start = rdtsc();
+	for (u64 i = 0; i < quad_count; i += 1) {
+		Matrix4 m = basic_m4_mul(basic_m4_mul(projection, basic_m4_inverse(camera)), xforms[i]);
+		Vector4 bl = basic_m4_transform(m, v4(0, 0, 0, 1));
+		Vector4 tl = basic_m4_transform(m, v4(0, 1, 0, 1));
+		Vector4 tr = basic_m4_transform(m, v4(1, 1, 0, 1));
+		Vector4 br = basic_m4_transform(m, v4(1, 0, 0, 1));
+		sink += bl.x + tl.y + tr.x + br.y;
+	}
+	float64 scalar_cycles = (float64)(rdtsc()-start) / (float64)quad_count;
+	
+	start = rdtsc();
+	for (u64 i = 0; i < quad_count; i += 1) {
+		Matrix4 m = m4_mul(m4_mul(projection, m4_inverse(camera)), xforms[i]);
+		Vector4 bl = m4_transform(m, v4(0, 0, 0, 1));
+		Vector4 tl = m4_transform(m, v4(0, 1, 0, 1));
+		Vector4 tr = m4_transform(m, v4(1, 1, 0, 1));
+		Vector4 br = m4_transform(m, v4(1, 0, 0, 1));
+		sink += bl.x + tl.y + tr.x + br.y;
+	}
+	float64 simd_cycles = (float64)(rdtsc()-start) / (float64)quad_count;
+	
+	start = rdtsc();
+	for (u64 i = 0; i < quad_count; i += 1) {
+		Matrix4 m = m4_mul(m4_mul(projection, m4_inverse_affine(camera)), xforms[i]);
+		Vector4 bl = m4_transform(m, v4(0, 0, 0, 1));
+		Vector4 tl = m4_transform(m, v4(0, 1, 0, 1));
+		Vector4 tr = m4_transform(m, v4(1, 1, 0, 1));
+		Vector4 br = m4_transform(m, v4(1, 0, 0, 1));
+		sink += bl.x + tl.y + tr.x + br.y;
+	}
+	float64 affine_cycles = (float64)(rdtsc()-start) / (float64)quad_count;
+	
+	print("\n    per quad: scalar %.1f, sse %.1f, sse with affine inverse %.1f cycles\n", scalar_cycles, simd_cycles, affine_cycles);
+	
+	dealloc(get_heap_allocator(), xforms);
+}
+
 void test_intmath() {
     // Test vector creation and access
     Vector2i v2i_test = v2i(1, 2);
@@ -1138,6 +2306,319 @@ void test_hash_table() {
     assert(table.entries == NULL, "Failed: Hash table entries should be NULL after destroy");
     assert(table.count == 0, "Failed: Hash table count should be 0 after destroy");
     assert(table.capacity_count == 0, "Failed: Hash table capacity count should be 0 after destroy");
+    
+    // Growing, removing and re-adding many entries
+    Hash_Table numbers = make_hash_table(u64, u64, get_heap_allocator());
+    const u64 number_count = 50000;
+    for (u64 i = 0; i < number_count; i += 1) {
+        u64 value = i*3;
+        newly_added = hash_table_set(&numbers, i, value);
+        assert(newly_added, "Failed: Key %llu should be newly added", i);
+    }
+    assert(numbers.count == number_count, "Failed: Expected %llu entries, got %llu", number_count, numbers.count);
+    assert((numbers.capacity_count & (numbers.capacity_count-1)) == 0, "Failed: Hash table capacity should be a power of two");
+    
+    for (u64 i = 0; i < number_count; i += 2) {
+        bool removed = hash_table_remove(&numbers, i);
+        assert(removed, "Failed: Key %llu should have been removed", i);
+        removed = hash_table_remove(&numbers, i);
+        assert(!removed, "Failed: Key %llu should already be removed", i);
+    }
+    assert(numbers.count == number_count/2, "Failed: Expected %llu entries after remove, got %llu", number_count/2, numbers.count);
+    
+    for (u64 i = 0; i < number_count; i += 1) {
+        u64 *value = hash_table_find(&numbers, i);
+        if (i % 2 == 0) {
+            assert(!value, "Failed: Removed key %llu should not be found", i);
+        } else {
+            assert(value && *value == i*3, "Failed: Key %llu has wrong value", i);
+        }
+    }
+    
+    // Churn: removed slots should be reused instead of growing the table forever
+    u64 capacity_before_churn = numbers.capacity_count;
+    for (u64 round = 0; round < 10; round += 1) {
+        for (u64 i = 0; i < number_count; i += 2) {
+            u64 value = i+round;
+            hash_table_set(&numbers, i, value);
+        }
+        for (u64 i = 0; i < number_count; i += 2) {
+            hash_table_remove(&numbers, i);
+        }
+    }
+    assert(numbers.capacity_count <= capacity_before_churn*2, "Failed: Hash table grew from churn (%llu -> %llu)", capacity_before_churn, numbers.capacity_count);
+    
+    // Iteration should visit every valid entry exactly once
+    u64 cursor = 0;
+    u64 *it_key;
+    u64 *it_value;
+    u64 visited_count = 0;
+    while (hash_table_iterate(&numbers, &cursor, (void**)&it_key, (void**)&it_value)) {
+        assert(*it_key % 2 == 1, "Failed: Iterated a removed key %llu", *it_key);
+        assert(*it_value == *it_key*3, "Failed: Iterated key %llu has wrong value", *it_key);
+        visited_count += 1;
+    }
+    assert(visited_count == numbers.count, "Failed: Iterated %llu entries, expected %llu", visited_count, numbers.count);
+    
+    // Removing while iterating
+    cursor = 0;
+    while (hash_table_iterate(&numbers, &cursor, (void**)&it_key, 0)) {
+        if (*it_key % 4 == 1) {
+            u64 key = *it_key;
+            hash_table_remove(&numbers, key);
+        }
+    }
+    assert(numbers.count == number_count/4, "Failed: Expected %llu entries after removing while iterating, got %llu", number_count/4, numbers.count);
+    
+    u64 capacity_before_shrink = numbers.capacity_count;
+    hash_table_shrink_to_fit(&numbers);
+    assert(numbers.capacity_count < capacity_before_shrink, "Failed: Hash table did not shrink");
+    for (u64 i = 3; i < number_count; i += 4) {
+        u64 *value = hash_table_find(&numbers, i);
+        assert(value && *value == i*3, "Failed: Key %llu lost after shrink", i);
+    }
+    
+    hash_table_destroy(&numbers);
+    
+    // Different keys with the same hash must not alias each other
+    Hash_Table colliding = make_hash_table(u64, int, get_heap_allocator());
+    u64 colliding_key_a = 1;
+    u64 colliding_key_b = 2;
+    int colliding_value_a = 10;
+    int colliding_value_b = 20;
+    hash_table_set_raw(&colliding, 1337, &colliding_key_a, &colliding_value_a, sizeof(u64), sizeof(int));
+    newly_added = hash_table_set_raw(&colliding, 1337, &colliding_key_b, &colliding_value_b, sizeof(u64), sizeof(int));
+    assert(newly_added, "Failed: Colliding key should be newly added");
+    assert(colliding.count == 2, "Failed: Colliding keys should be separate entries");
+    assert(*(int*)hash_table_find_raw(&colliding, 1337, &colliding_key_a, sizeof(u64)) == 10, "Failed: Colliding key a has wrong value");
+    assert(*(int*)hash_table_find_raw(&colliding, 1337, &colliding_key_b, sizeof(u64)) == 20, "Failed: Colliding key b has wrong value");
+    hash_table_remove_raw(&colliding, 1337, &colliding_key_a, sizeof(u64));
+    assert(!hash_table_find_raw(&colliding, 1337, &colliding_key_a, sizeof(u64)), "Failed: Removed colliding key a was found");
+    assert(*(int*)hash_table_find_raw(&colliding, 1337, &colliding_key_b, sizeof(u64)) == 20, "Failed: Colliding key b was lost");
+    hash_table_destroy(&colliding);
+    
+    // String keys are compared by content, not by pointer
+    Hash_Table strings = make_hash_table(string, int, get_heap_allocator());
+    string short_key = STR("abc");
+    int short_value = 3;
+    hash_table_set(&strings, short_key, short_value);
+    char short_key_buffer[] = {'a', 'b', 'c', 'x'};
+    string other_short_key = (string){3, (u8*)short_key_buffer};
+    int *short_found = hash_table_find(&strings, other_short_key);
+    assert(short_found && *short_found == 3, "Failed: String key with same content in other memory was not found");
+    hash_table_destroy(&strings);
+}
+
+void test_swiss_table() {
+    Swiss_Table table = make_swiss_table(u64, u64, get_heap_allocator());
+    
+    const u64 number_count = 50000;
+    for (u64 i = 0; i < number_count; i += 1) {
+        u64 value = i*3;
+        bool newly_added = swiss_table_set(&table, i, value);
+        assert(newly_added, "Failed: Key %llu should be newly added", i);
+    }
+    assert(table.count == number_count, "Failed: Expected %llu entries, got %llu", number_count, table.count);
+    
+    u64 key = 7;
+    u64 value = 1234;
+    bool newly_added = swiss_table_set(&table, key, value);
+    assert(!newly_added, "Failed: Key should not be newly added");
+    assert(*(u64*)swiss_table_find(&table, key) == 1234, "Failed: Value should have been overwritten");
+    value = key*3;
+    swiss_table_set(&table, key, value);
+    
+    for (u64 i = 0; i < number_count; i += 2) {
+        bool removed = swiss_table_remove(&table, i);
+        assert(removed, "Failed: Key %llu should have been removed", i);
+        removed = swiss_table_remove(&table, i);
+        assert(!removed, "Failed: Key %llu should already be removed", i);
+    }
+    
+    for (u64 i = 0; i < number_count*2; i += 1) {
+        u64 *found = swiss_table_find(&table, i);
+        if (i % 2 == 0 || i >= number_count) {
+            assert(!found, "Failed: Key %llu should not be found", i);
+        } else {
+            assert(found && *found == i*3, "Failed: Key %llu has wrong value", i);
+        }
+    }
+    
+    // Churn should reuse deleted slots
+    u64 capacity_before_churn = table.capacity_count;
+    for (u64 round = 0; round < 10; round += 1) {
+        for (u64 i = 0; i < number_count; i += 2) {
+            u64 churn_value = i+round;
+            swiss_table_set(&table, i, churn_value);
+        }
+        for (u64 i = 0; i < number_count; i += 2) {
+            swiss_table_remove(&table, i);
+        }
+    }
+    assert(table.capacity_count <= capacity_before_churn*2, "Failed: Swiss table grew from churn (%llu -> %llu)", capacity_before_churn, table.capacity_count);
+    
+    u64 cursor = 0;
+    u64 *it_key;
+    u64 *it_value;
+    u64 visited_count = 0;
+    while (swiss_table_iterate(&table, &cursor, (void**)&it_key, (void**)&it_value)) {
+        assert(*it_key % 2 == 1 && *it_value == *it_key*3, "Failed: Iterated bad entry %llu", *it_key);
+        visited_count += 1;
+    }
+    assert(visited_count == table.count, "Failed: Iterated %llu entries, expected %llu", visited_count, table.count);
+    
+    swiss_table_shrink_to_fit(&table);
+    for (u64 i = 1; i < number_count; i += 2) {
+        u64 *found = swiss_table_find(&table, i);
+        assert(found && *found == i*3, "Failed: Key %llu lost after shrink", i);
+    }
+    
+    swiss_table_reset(&table);
+    assert(!swiss_table_find(&table, key), "Failed: Swiss table should be empty after reset");
+    
+    swiss_table_destroy(&table);
+    assert(table.control == NULL && table.entries == NULL, "Failed: Swiss table memory should be NULL after destroy");
+    assert(table.count == 0 && table.capacity_count == 0, "Failed: Swiss table should be empty after destroy");
+    
+    // String keys
+    Swiss_Table strings = make_swiss_table(string, int, get_heap_allocator());
+    string string_key = STR("Some string key");
+    int string_value = 69;
+    swiss_table_add(&strings, string_key, string_value);
+    char key_buffer[] = "Some string key";
+    string same_key = STR(key_buffer);
+    int *string_found = swiss_table_find(&strings, same_key);
+    assert(string_found && *string_found == 69, "Failed: String key with same content in other memory was not found");
+    swiss_table_destroy(&strings);
+}
+
+// Straight copy of how the hash table used to look up entries, for comparison:
+// entries are hash-value pairs packed from the start and we scan them in order.
+void *test_linear_hash_table_find(void *entries, u64 count, u64 value_size, u64 hash) {
+    u64 entry_size = value_size+sizeof(u64);
+    for (u64 i = 0; i < count; i += 1) {
+        u64 existing_hash = *(u64*)((u8*)entries+i*entry_size);
+        if (existing_hash == hash) return (u8*)entries+i*entry_size+sizeof(u64);
+    }
+    return 0;
+}
+void test_hash_table_speed(u64 entry_count) {
+    Allocator heap = get_heap_allocator();
+    
+    // Linear scan is O(n) per lookup, so only sample a bounded amount of lookups
+    u64 linear_lookup_count = min(entry_count, 1000);
+    
+    ///
+    // Open addressing
+    Hash_Table table = make_hash_table(u64, u64, heap);
+    
+    float64 start_seconds = os_get_elapsed_seconds();
+    u64 start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL;
+        hash_table_set(&table, key, i);
+    }
+    u64 insert_cycles = rdtsc() - start_cycles;
+    float64 insert_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    start_seconds = os_get_elapsed_seconds();
+    start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL;
+        u64 *value = hash_table_find(&table, key);
+        assert(value && *value == i, "Failed: Hash table lookup returned wrong value");
+    }
+    u64 find_cycles = rdtsc() - start_cycles;
+    float64 find_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    // Misses have to probe until they find an empty slot, that's the worst case
+    start_seconds = os_get_elapsed_seconds();
+    start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL+1;
+        u64 *value = hash_table_find(&table, key);
+        assert(!value, "Failed: Hash table found a key that was never added");
+    }
+    u64 miss_cycles = rdtsc() - start_cycles;
+    float64 miss_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    float64 load = (float64)table.count/(float64)table.capacity_count;
+    
+    hash_table_destroy(&table);
+    
+    ///
+    // Swiss table
+    Swiss_Table swiss = make_swiss_table(u64, u64, heap);
+    
+    start_seconds = os_get_elapsed_seconds();
+    start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL;
+        swiss_table_set(&swiss, key, i);
+    }
+    u64 swiss_insert_cycles = rdtsc() - start_cycles;
+    float64 swiss_insert_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    start_seconds = os_get_elapsed_seconds();
+    start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL;
+        u64 *value = swiss_table_find(&swiss, key);
+        assert(value && *value == i, "Failed: Swiss table lookup returned wrong value");
+    }
+    u64 swiss_find_cycles = rdtsc() - start_cycles;
+    float64 swiss_find_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    start_seconds = os_get_elapsed_seconds();
+    start_cycles = rdtsc();
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL+1;
+        u64 *value = swiss_table_find(&swiss, key);
+        assert(!value, "Failed: Swiss table found a key that was never added");
+    }
+    u64 swiss_miss_cycles = rdtsc() - start_cycles;
+    float64 swiss_miss_seconds = os_get_elapsed_seconds() - start_seconds;
+    
+    float64 swiss_load = (float64)swiss.count/(float64)swiss.capacity_count;
+    
+    swiss_table_destroy(&swiss);
+    
+    ///
+    // Linear scan
+    u64 entry_size = sizeof(u64)*2;
+    u8 *entries = alloc(heap, entry_count*entry_size);
+    for (u64 i = 0; i < entry_count; i += 1) {
+        u64 key = i*2654435761ULL;
+        u64 hash = get_hash(key);
+        memcpy(entries+i*entry_size, &hash, sizeof(u64));
+        memcpy(entries+i*entry_size+sizeof(u64), &i, sizeof(u64));
+    }
+    
+    float64 linear_start_seconds = os_get_elapsed_seconds();
+    u64 linear_start_cycles = rdtsc();
+    for (u64 n = 0; n < linear_lookup_count; n += 1) {
+        // Spread the samples over the whole table so the average scan length is fair
+        u64 i = (n*entry_count)/linear_lookup_count;
+        u64 key = i*2654435761ULL;
+        u64 *value = test_linear_hash_table_find(entries, entry_count, sizeof(u64), get_hash(key));
+        assert(value && *value == i, "Failed: Linear lookup returned wrong value");
+    }
+    u64 linear_find_cycles = rdtsc() - linear_start_cycles;
+    float64 linear_find_seconds = os_get_elapsed_seconds() - linear_start_seconds;
+    
+    dealloc(heap, entries);
+    
+    print("Hash table with %llu entries:\n", entry_count);
+    print("\tOpen addressing (load %.2f):\n", load);
+    print("\t\tinsert: %llu cycles/op, %.2f ns/op\n", insert_cycles/entry_count, (insert_seconds*1000000000.0)/(float64)entry_count);
+    print("\t\tfind:   %llu cycles/op, %.2f ns/op\n", find_cycles/entry_count, (find_seconds*1000000000.0)/(float64)entry_count);
+    print("\t\tmiss:   %llu cycles/op, %.2f ns/op\n", miss_cycles/entry_count, (miss_seconds*1000000000.0)/(float64)entry_count);
+    print("\tSwiss table (load %.2f):\n", swiss_load);
+    print("\t\tinsert: %llu cycles/op, %.2f ns/op\n", swiss_insert_cycles/entry_count, (swiss_insert_seconds*1000000000.0)/(float64)entry_count);
+    print("\t\tfind:   %llu cycles/op, %.2f ns/op\n", swiss_find_cycles/entry_count, (swiss_find_seconds*1000000000.0)/(float64)entry_count);
+    print("\t\tmiss:   %llu cycles/op, %.2f ns/op\n", swiss_miss_cycles/entry_count, (swiss_miss_seconds*1000000000.0)/(float64)entry_count);
+    print("\tLinear scan:\n");
+    print("\t\tfind:   %llu cycles/op, %.2f ns/op\n", linear_find_cycles/linear_lookup_count, (linear_find_seconds*1000000000.0)/(float64)linear_lookup_count);
 }
 
 #define NUM_BINS 100
@@ -1225,81 +2706,1699 @@ void test_mutex() {
     mutex_destroy(&data.mutex);
 }
 
-#ifndef OOGABOOGA_HEADLESS
-int compare_draw_quads(const void *a, const void *b) {
-    return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
+typedef struct Sync_Test_Shared_Data {
+	Mutex mutex;
+	Semaphore semaphore;
+	Condition_Variable cv;
+	Event event;
+	Binary_Semaphore ping;
+	Binary_Semaphore pong;
+	volatile u64 ready_count;
+	volatile u64 consumed_count;
+	volatile u64 passed_count;
+	u64 per_thread_count;
+} Sync_Test_Shared_Data;
+
+void sync_test_semaphore_consumer(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < data->per_thread_count; i += 1) {
+		semaphore_wait(&data->semaphore);
+		atomic_fetch_add_64(&data->consumed_count, 1, MEMORY_ORDER_SEQ_CST);
+	}
+}
+void sync_test_cv_consumer(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < data->per_thread_count; i += 1) {
+		mutex_acquire_or_wait(&data->mutex);
+		while (data->ready_count == 0) condition_variable_wait(&data->cv, &data->mutex);
+		data->ready_count -= 1;
+		data->consumed_count += 1;
+		mutex_release(&data->mutex);
+	}
+}
+void sync_test_event_waiter(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	event_wait(&data->event);
+	atomic_fetch_add_64(&data->passed_count, 1, MEMORY_ORDER_SEQ_CST);
+}
+void sync_test_pong(Thread *t) {
+	Sync_Test_Shared_Data *data = (Sync_Test_Shared_Data*)t->data;
+	for (u64 i = 0; i < data->per_thread_count; i += 1) {
+		binary_semaphore_wait(&data->ping);
+		data->consumed_count += 1;
+		binary_semaphore_signal(&data->pong);
+	}
 }
-void test_sort() {
-    
-    int num_samples = 500;
-    u64 id_bits = 21;
-    u64 item_count = 50000;
-    
-    f64 seconds = 0;
-    u64 cycles = 0;
-    
-    Draw_Quad *items = alloc(get_heap_allocator(), (item_count * 2) * sizeof(Draw_Quad));
-    Draw_Quad *buffer = items + item_count;
 
-    for (int a = 0; a < num_samples; a++) {
-        
-        for (u64 i = 0; i < item_count; i++) {
-            if (i % 2 == 0) items[i].z = get_random_int_in_range(0, pow(2, id_bits) / 2);
-            else items[i].z = i;
-        }
-    
-        u64 item_size = sizeof(Draw_Quad);
-        u64 sort_value_offset_in_item = offsetof(Draw_Quad, z);
-    
-        float64 start_seconds = os_get_elapsed_seconds();
-        u64 start_cycles = rdtsc();
-        radix_sort(items, buffer, item_count, item_size, sort_value_offset_in_item, id_bits);
-        u64 end_cycles = rdtsc();
-        float64 end_seconds = os_get_elapsed_seconds();
-    
-        for (u64 i = 1; i < item_count; i++) {
-            assert(items[i].z >= items[i-1].z, "Failed: not correctly sorted");
-        }
-        
-        seconds += end_seconds - start_seconds;
-        cycles += end_cycles - start_cycles;
-    }
-    
-    print("Radix sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
+void test_sync_primitives() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 thread_count = 8;
+	Thread *threads = alloc(heap, sizeof(Thread)*thread_count);
+	Sync_Test_Shared_Data *data = alloc(heap, sizeof(Sync_Test_Shared_Data));
+	memset(data, 0, sizeof(Sync_Test_Shared_Data));
+	mutex_init(&data->mutex);
+	
+	// Counting semaphore
+	{
+		semaphore_init(&data->semaphore, 0);
+		assert(!semaphore_try_wait(&data->semaphore), "Semaphore should start at 0");
+		
+		data->per_thread_count = 1000;
+		data->consumed_count = 0;
+		for (u64 i = 0; i < thread_count; i += 1) {
+			os_thread_init(&threads[i], sync_test_semaphore_consumer);
+			threads[i].data = data;
+			os_thread_start(&threads[i]);
+		}
+		// Mix single & bulk signals
+		for (u64 i = 0; i < thread_count*data->per_thread_count; ) {
+			u32 count = (i/7) % 2 == 0 ? 1 : 5;
+			count = (u32)min(count, thread_count*data->per_thread_count - i);
+			semaphore_signal(&data->semaphore, count);
+			i += count;
+		}
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+		
+		assert(data->consumed_count == thread_count*data->per_thread_count, "Semaphore lost a signal");
+		assert(!semaphore_try_wait(&data->semaphore), "Semaphore should be back at 0");
+		semaphore_destroy(&data->semaphore);
+	}
+	
+	// Condition variable
+	{
+		condition_variable_init(&data->cv);
+		data->per_thread_count = 1000;
+		data->consumed_count = 0;
+		data->ready_count = 0;
+		for (u64 i = 0; i < thread_count; i += 1) {
+			os_thread_init(&threads[i], sync_test_cv_consumer);
+			threads[i].data = data;
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count*data->per_thread_count; i += 1) {
+			mutex_acquire_or_wait(&data->mutex);
+			data->ready_count += 1;
+			if (i % 3 == 0) condition_variable_broadcast(&data->cv);
+			else            condition_variable_signal(&data->cv);
+			mutex_release(&data->mutex);
+		}
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+		
+		assert(data->consumed_count == thread_count*data->per_thread_count, "Condition variable consumers missed items");
+		assert(data->ready_count == 0, "Condition variable consumers missed items");
+		condition_variable_destroy(&data->cv);
+	}
+	
+	// Manual reset event lets everyone through
+	{
+		event_init(&data->event, false, false);
+		assert(!event_wait_timeout(&data->event, 0.001), "Event should not be set");
+		
+		data->passed_count = 0;
+		for (u64 i = 0; i < thread_count; i += 1) {
+			os_thread_init(&threads[i], sync_test_event_waiter);
+			threads[i].data = data;
+			os_thread_start(&threads[i]);
+		}
+		os_sleep(5);
+		assert(data->passed_count == 0, "Threads got through an event which isn't set");
+		event_set(&data->event);
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+		assert(data->passed_count == thread_count, "Not every thread got through the event");
+		
+		assert(event_wait_timeout(&data->event, 0), "Manual reset event should stay set");
+		event_reset(&data->event);
+		assert(!event_wait_timeout(&data->event, 0), "Event should be reset");
+		event_destroy(&data->event);
+	}
+	
+	// Auto reset event lets one through per set
+	{
+		event_init(&data->event, true, true);
+		assert(event_wait_timeout(&data->event, 0), "Event should start set");
+		assert(!event_wait_timeout(&data->event, 0.001), "Auto reset event should have reset");
+		event_destroy(&data->event);
+	}
+	
+	// Binary semaphore ping pong
+	{
+		binary_semaphore_init(&data->ping, false);
+		binary_semaphore_init(&data->pong, false);
+		data->per_thread_count = 10000;
+		data->consumed_count = 0;
+		
+		os_thread_init(&threads[0], sync_test_pong);
+		threads[0].data = data;
+		os_thread_start(&threads[0]);
+		for (u64 i = 0; i < data->per_thread_count; i += 1) {
+			binary_semaphore_signal(&data->ping);
+			binary_semaphore_wait(&data->pong);
+			assert(data->consumed_count == i+1, "Binary semaphore ping pong out of step");
+		}
+		os_thread_destroy(&threads[0]);
+		
+		binary_semaphore_destroy(&data->ping);
+		binary_semaphore_destroy(&data->pong);
+	}
+	
+	mutex_destroy(&data->mutex);
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
 
-	seconds = 0;
-    cycles = 0;
-	for (int a = 0; a < num_samples; a++) {
-        
-        for (u64 i = 0; i < item_count; i++) {
-            if (i % 2 == 0) items[i].z = get_random_int_in_range(0, pow(2, id_bits) / 2);
-            else items[i].z = i;
-        }
-    
-        u64 item_size = sizeof(Draw_Quad);
-        u64 sort_value_offset_in_item = offsetof(Draw_Quad, z);
-    
-        float64 start_seconds = os_get_elapsed_seconds();
-        u64 start_cycles = rdtsc();
-        merge_sort(items, buffer, item_count, item_size, compare_draw_quads);
-        u64 end_cycles = rdtsc();
-        float64 end_seconds = os_get_elapsed_seconds();
-    
-        for (u64 i = 1; i < item_count; i++) {
-            assert(items[i].z >= items[i-1].z, "Failed: not correctly sorted");
-        }
-        
-        seconds += end_seconds - start_seconds;
-        cycles += end_cycles - start_cycles;
-    }
-    
-    print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
+typedef enum Lock_Test_Kind {
+	LOCK_TEST_SPINLOCK,
+	LOCK_TEST_OS_MUTEX,
+	LOCK_TEST_MUTEX,
+	LOCK_TEST_KIND_COUNT,
+} Lock_Test_Kind;
+typedef struct Lock_Test_Shared_Data {
+	Lock_Test_Kind kind;
+	Spinlock spinlock;
+	Mutex_Handle os_mutex;
+	Mutex mutex;
+	u64 iteration_count;
+	u32 hold_ms; // 0 for a short critical section
+	u64 counter;
+} Lock_Test_Shared_Data;
+void lock_test_thread(Thread *t) {
+	Lock_Test_Shared_Data *data = (Lock_Test_Shared_Data*)t->data;
+	u64 rng = t->id;
+	for (u64 i = 0; i < data->iteration_count; i += 1) {
+		switch (data->kind) {
+			case LOCK_TEST_SPINLOCK: spinlock_acquire_or_wait(&data->spinlock); break;
+			case LOCK_TEST_OS_MUTEX: os_lock_mutex(data->os_mutex);             break;
+			case LOCK_TEST_MUTEX:    mutex_acquire_or_wait(&data->mutex);       break;
+			default: break;
+		}
+		
+		if (data->hold_ms) os_sleep(data->hold_ms);
+		data->counter += 1;
+		
+		switch (data->kind) {
+			case LOCK_TEST_SPINLOCK: spinlock_release(&data->spinlock);  break;
+			case LOCK_TEST_OS_MUTEX: os_unlock_mutex(data->os_mutex);    break;
+			case LOCK_TEST_MUTEX:    mutex_release(&data->mutex);        break;
+			default: break;
+		}
+		
+		// Some work outside of the lock
+		for (u64 j = 0; j < 200; j += 1) { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; }
+	}
+	volatile u64 sink = rng; // Keep the work from being optimized out
+	(void)sink;
 }
-#endif /* OOGABOOGA_HEADLESS */
 
-typedef struct Test_Thing {
-    int foo;
-    float bar;
+void test_lock_contention_speed() {
+	Allocator heap = get_heap_allocator();
+	
+	const char *names[LOCK_TEST_KIND_COUNT] = { "Spinlock", "OS mutex", "Mutex" };
+	u64 thread_count = clamp(os_get_number_of_logical_processors()*2, 4, 32);
+	Thread *threads = alloc(heap, sizeof(Thread)*thread_count);
+	Lock_Test_Shared_Data *data = alloc(heap, sizeof(Lock_Test_Shared_Data));
+	
+	for (u64 hold = 0; hold < 2; hold += 1) {
+		if (hold) print("%llu threads, lock held for 1ms (mostly waiting):\n", thread_count);
+		else      print("%llu threads, short critical sections:\n", thread_count);
+		
+		for (Lock_Test_Kind kind = 0; kind < LOCK_TEST_KIND_COUNT; kind += 1) {
+			memset(data, 0, sizeof(Lock_Test_Shared_Data));
+			data->kind = kind;
+			spinlock_init(&data->spinlock);
+			data->os_mutex = os_make_mutex();
+			mutex_init(&data->mutex);
+			data->hold_ms = hold ? 1 : 0;
+			data->iteration_count = hold ? 10 : 20000;
+			
+			f64 start_seconds = os_get_elapsed_seconds();
+			f64 start_cpu_seconds = os_get_process_cpu_seconds();
+			for (u64 i = 0; i < thread_count; i += 1) {
+				os_thread_init(&threads[i], lock_test_thread);
+				threads[i].data = data;
+				os_thread_start(&threads[i]);
+			}
+			for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+			f64 seconds = os_get_elapsed_seconds() - start_seconds;
+			f64 cpu_seconds = os_get_process_cpu_seconds() - start_cpu_seconds;
+			
+			assert(data->counter == thread_count*data->iteration_count, "Lock let more than one thread in");
+			
+			print("\t%-8s: %.2fms wall, %.2fms cpu\n", names[kind], seconds*1000.0, cpu_seconds*1000.0);
+			
+			os_destroy_mutex(data->os_mutex);
+			mutex_destroy(&data->mutex);
+		}
+	}
+	
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
+
+#if ENABLE_LOCK_STATS
+void test_lock_stats() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 thread_count = 8;
+	Thread *threads = alloc(heap, sizeof(Thread)*thread_count);
+	Lock_Test_Shared_Data *data = alloc(heap, sizeof(Lock_Test_Shared_Data));
+	
+	for (Lock_Test_Kind kind = 0; kind < LOCK_TEST_KIND_COUNT; kind += 1) {
+		if (kind == LOCK_TEST_OS_MUTEX) continue;
+		
+		memset(data, 0, sizeof(Lock_Test_Shared_Data));
+		data->kind = kind;
+		spinlock_init(&data->spinlock);
+		mutex_init(&data->mutex);
+		spinlock_set_name(&data->spinlock, STR("test spinlock"));
+		mutex_set_name(&data->mutex, STR("test mutex"));
+		data->iteration_count = 5000;
+		
+		Lock_Stats *stats = kind == LOCK_TEST_SPINLOCK ? data->spinlock.stats : data->mutex.stats;
+		assert(stats && strings_match(stats->name, kind == LOCK_TEST_SPINLOCK ? STR("test spinlock") : STR("test mutex")), "Lock didn't get its stats entry");
+		assert(stats == lock_stats_get(stats->name), "Same name should give the same stats entry");
+		u64 acquires_before = stats->acquire_count;
+		
+		for (u64 i = 0; i < thread_count; i += 1) {
+			os_thread_init(&threads[i], lock_test_thread);
+			threads[i].data = data;
+			os_thread_start(&threads[i]);
+		}
+		for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+		
+		assert(stats->acquire_count - acquires_before == thread_count*data->iteration_count, "Lock stats missed acquires");
+		assert(stats->contended_count <= stats->acquire_count, "More contended acquires than acquires");
+		for (u64 i = 1; i < LOCK_STATS_WORST_WAIT_COUNT; i += 1) {
+			assert(stats->worst_waits[i].cycles <= stats->worst_waits[i-1].cycles, "Worst waits are not sorted");
+		}
+		if (stats->contended_count) assert(stats->worst_waits[0].cycles > 0, "Contended lock has no worst wait");
+		
+		mutex_destroy(&data->mutex);
+	}
+	
+	lock_stats_print_report();
+	
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
+#endif
+
+void test_atomics() {
+	volatile u32 a32 = 5;
+	volatile u64 a64 = 5;
+	int x = 0, y = 0;
+	void *volatile ptr = &x;
+	
+	assert(atomic_load_32(&a32, MEMORY_ORDER_ACQUIRE) == 5, "atomic_load_32 failed");
+	atomic_store_32(&a32, 7, MEMORY_ORDER_RELEASE);
+	assert(a32 == 7, "atomic_store_32 failed");
+	assert(atomic_exchange_32(&a32, 9, MEMORY_ORDER_ACQ_REL) == 7, "atomic_exchange_32 should return the old value");
+	assert(atomic_fetch_add_32(&a32, -10, MEMORY_ORDER_SEQ_CST) == 9, "atomic_fetch_add_32 should return the old value");
+	assert(a32 == 0xffffffff, "atomic_fetch_add_32 should wrap");
+	
+	u32 expected32 = 3;
+	assert(!atomic_compare_exchange_32(&a32, &expected32, 4, MEMORY_ORDER_SEQ_CST), "atomic_compare_exchange_32 should fail on mismatch");
+	assert(expected32 == 0xffffffff, "atomic_compare_exchange_32 should give back the current value on failure");
+	assert(atomic_compare_exchange_32(&a32, &expected32, 4, MEMORY_ORDER_SEQ_CST), "atomic_compare_exchange_32 should succeed on match");
+	assert(a32 == 4, "atomic_compare_exchange_32 failed");
+	
+	assert(atomic_fetch_add_64(&a64, 1ull << 40, MEMORY_ORDER_RELAXED) == 5, "atomic_fetch_add_64 should return the old value");
+	assert(atomic_load_64(&a64, MEMORY_ORDER_SEQ_CST) == (1ull << 40) + 5, "atomic_fetch_add_64 failed");
+	u64 expected64 = (1ull << 40) + 5;
+	assert(atomic_compare_exchange_64(&a64, &expected64, 1, MEMORY_ORDER_ACQ_REL), "atomic_compare_exchange_64 should succeed on match");
+	assert(atomic_exchange_64(&a64, 2, MEMORY_ORDER_SEQ_CST) == 1, "atomic_exchange_64 failed");
+	atomic_store_64(&a64, 3, MEMORY_ORDER_SEQ_CST);
+	assert(a64 == 3, "atomic_store_64 failed");
+	
+	assert(atomic_load_pointer(&ptr, MEMORY_ORDER_ACQUIRE) == &x, "atomic_load_pointer failed");
+	void *expected_ptr = &y;
+	assert(!atomic_compare_exchange_pointer(&ptr, &expected_ptr, 0, MEMORY_ORDER_SEQ_CST), "atomic_compare_exchange_pointer should fail on mismatch");
+	assert(expected_ptr == &x, "atomic_compare_exchange_pointer should give back the current value on failure");
+	assert(atomic_exchange_pointer(&ptr, &y, MEMORY_ORDER_SEQ_CST) == &x, "atomic_exchange_pointer failed");
+	atomic_store_pointer(&ptr, 0, MEMORY_ORDER_RELEASE);
+	assert(ptr == 0, "atomic_store_pointer failed");
+}
+
+#define RW_LOCK_TEST_VALUE_COUNT 16
+typedef struct Rw_Lock_Test_Shared_Data {
+	Rw_Lock lock;
+	Mutex mutex;
+	bool use_mutex;
+	// Writers set all values to the same thing, readers check that they are the same
+	u64 values[RW_LOCK_TEST_VALUE_COUNT];
+	volatile u32 active_readers;
+	volatile u32 active_writers;
+	volatile u32 max_active_readers;
+	u64 iteration_count;
+	u32 write_every; // 0 for read only
+	volatile u64 write_count;
+	volatile u64 checksum;
+} Rw_Lock_Test_Shared_Data;
+
+void rw_lock_test_thread(Thread *t) {
+	Rw_Lock_Test_Shared_Data *data = (Rw_Lock_Test_Shared_Data*)t->data;
+	u64 sum = 0;
+	for (u64 i = 0; i < data->iteration_count; i += 1) {
+		bool write = data->write_every && ((i + t->id) % data->write_every) == 0;
+		
+		if (data->use_mutex) mutex_acquire_or_wait(&data->mutex);
+		else if (write)      rw_lock_write_acquire_or_wait(&data->lock);
+		else                 rw_lock_read_acquire_or_wait(&data->lock);
+		
+		if (write) {
+			assert(atomic_fetch_add_32(&data->active_writers, 1, MEMORY_ORDER_SEQ_CST) == 0, "Rw_Lock let two writers in");
+			assert(atomic_load_32(&data->active_readers, MEMORY_ORDER_SEQ_CST) == 0, "Rw_Lock let a writer in with readers");
+			u64 value = data->values[0] + 1;
+			for (u64 j = 0; j < RW_LOCK_TEST_VALUE_COUNT; j += 1) data->values[j] = value;
+			atomic_fetch_add_64(&data->write_count, 1, MEMORY_ORDER_RELAXED);
+			atomic_fetch_add_32(&data->active_writers, -1, MEMORY_ORDER_SEQ_CST);
+		} else {
+			u32 readers = atomic_fetch_add_32(&data->active_readers, 1, MEMORY_ORDER_SEQ_CST) + 1;
+			u32 max_readers = atomic_load_32(&data->max_active_readers, MEMORY_ORDER_RELAXED);
+			while (readers > max_readers && !atomic_compare_exchange_32(&data->max_active_readers, &max_readers, readers, MEMORY_ORDER_RELAXED));
+			assert(atomic_load_32(&data->active_writers, MEMORY_ORDER_SEQ_CST) == 0, "Rw_Lock let a reader in with a writer");
+			
+			u64 first = data->values[0];
+			for (u64 j = 0; j < RW_LOCK_TEST_VALUE_COUNT; j += 1) {
+				assert(data->values[j] == first, "Reader saw a half written value");
+				sum += data->values[j];
+			}
+			atomic_fetch_add_32(&data->active_readers, -1, MEMORY_ORDER_SEQ_CST);
+		}
+		
+		if (data->use_mutex) mutex_release(&data->mutex);
+		else if (write)      rw_lock_write_release(&data->lock);
+		else                 rw_lock_read_release(&data->lock);
+	}
+	atomic_fetch_add_64(&data->checksum, sum, MEMORY_ORDER_RELAXED);
+}
+
+void test_rw_lock() {
+	Allocator heap = get_heap_allocator();
+	
+	Rw_Lock_Test_Shared_Data *data = alloc(heap, sizeof(Rw_Lock_Test_Shared_Data));
+	memset(data, 0, sizeof(Rw_Lock_Test_Shared_Data));
+	rw_lock_init(&data->lock);
+	
+	// Single threaded rules
+	rw_lock_read_acquire_or_wait(&data->lock);
+	assert(rw_lock_read_try_acquire(&data->lock), "Readers should be able to share the lock");
+	assert(!rw_lock_write_try_acquire(&data->lock), "Writer got in with readers");
+	rw_lock_read_release(&data->lock);
+	rw_lock_read_release(&data->lock);
+	assert(rw_lock_write_try_acquire(&data->lock), "Writer should get a free lock");
+	assert(!rw_lock_read_try_acquire(&data->lock), "Reader got in with a writer");
+	assert(!rw_lock_write_try_acquire(&data->lock), "Two writers got in");
+	rw_lock_write_release(&data->lock);
+	
+	const u64 thread_count = 8;
+	Thread *threads = alloc(heap, sizeof(Thread)*thread_count);
+	
+	data->iteration_count = 20000;
+	data->write_every = 50;
+	for (u64 i = 0; i < thread_count; i += 1) {
+		os_thread_init(&threads[i], rw_lock_test_thread);
+		threads[i].data = data;
+		os_thread_start(&threads[i]);
+	}
+	for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+	
+	assert(data->write_count > 0, "Rw_Lock test didn't write");
+	assert(data->values[0] == data->write_count, "Rw_Lock lost a write");
+	assert(data->lock.state == 0 && data->lock.writers_waiting == 0, "Rw_Lock was left acquired");
+	
+	rw_lock_destroy(&data->lock);
+	dealloc(heap, threads);
+	dealloc(heap, data);
+}
+
+void test_rw_lock_reader_scaling() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 max_thread_count = clamp(os_get_number_of_logical_processors(), 1, 32);
+	Thread *threads = alloc(heap, sizeof(Thread)*max_thread_count);
+	Rw_Lock_Test_Shared_Data *data = alloc(heap, sizeof(Rw_Lock_Test_Shared_Data));
+	
+	print("\nRead throughput (Mreads/s), 1 write per 1000 ops:\n");
+	print("\tThreads  Rw_Lock  Mutex\n");
+	for (u64 thread_count = 1; thread_count <= max_thread_count; thread_count *= 2) {
+		f64 reads_per_second[2];
+		u32 max_readers = 0;
+		for (u64 use_mutex = 0; use_mutex < 2; use_mutex += 1) {
+			memset(data, 0, sizeof(Rw_Lock_Test_Shared_Data));
+			rw_lock_init(&data->lock);
+			mutex_init(&data->mutex);
+			data->use_mutex = use_mutex;
+			data->iteration_count = 200000;
+			data->write_every = 1000;
+			
+			f64 start_seconds = os_get_elapsed_seconds();
+			for (u64 i = 0; i < thread_count; i += 1) {
+				os_thread_init(&threads[i], rw_lock_test_thread);
+				threads[i].data = data;
+				os_thread_start(&threads[i]);
+			}
+			for (u64 i = 0; i < thread_count; i += 1) os_thread_destroy(&threads[i]);
+			f64 seconds = os_get_elapsed_seconds() - start_seconds;
+			
+			reads_per_second[use_mutex] = (f64)(thread_count*data->iteration_count)/seconds;
+			if (!use_mutex) max_readers = data->max_active_readers;
+			
+			rw_lock_destroy(&data->lock);
+			mutex_destroy(&data->mutex);
+		}
+		print("\t%-7llu  %-7.2f  %-7.2f (up to %u readers at once)\n", thread_count, reads_per_second[0]/1000000.0, reads_per_second[1]/1000000.0, max_readers);
+	}
+	
+	dealloc(heap, data);
+	dealloc(heap, threads);
+}
+
+typedef struct Sort_Test_Item {
+	float32 y;
+	u32 id; // Original position, to check stability
+} Sort_Test_Item;
+#define sort_test_item_less(a, b) ((a)->y < (b)->y)
+DEFINE_SORT(sort_test_items_by_y, Sort_Test_Item, sort_test_item_less)
+#define sort_test_s64_less(a, b) (*(a) < *(b))
+DEFINE_SORT(sort_test_s64s, s64, sort_test_s64_less)
+
+int compare_sort_test_items(const void *a, const void *b) {
+	float32 ya = ((Sort_Test_Item*)a)->y;
+	float32 yb = ((Sort_Test_Item*)b)->y;
+	return ya < yb ? -1 : (ya > yb ? 1 : 0);
+}
+
+typedef enum Sort_Test_Pattern {
+	SORT_TEST_RANDOM,
+	SORT_TEST_FEW_UNIQUE,
+	SORT_TEST_SORTED,
+	SORT_TEST_REVERSED,
+	SORT_TEST_ALL_EQUAL,
+	SORT_TEST_SAWTOOTH,
+	SORT_TEST_PATTERN_COUNT,
+} Sort_Test_Pattern;
+void fill_sort_test_items(Sort_Test_Item *items, u64 count, Sort_Test_Pattern pattern) {
+	for (u64 i = 0; i < count; i += 1) {
+		switch (pattern) {
+			case SORT_TEST_RANDOM:     items[i].y = get_random_float32_in_range(-1000, 1000); break;
+			case SORT_TEST_FEW_UNIQUE: items[i].y = (float32)get_random_int_in_range(0, 7);   break;
+			case SORT_TEST_SORTED:     items[i].y = (float32)i;                               break;
+			case SORT_TEST_REVERSED:   items[i].y = (float32)(count - i);                     break;
+			case SORT_TEST_ALL_EQUAL:  items[i].y = 1;                                        break;
+			case SORT_TEST_SAWTOOTH:   items[i].y = (float32)(i % 100);                       break;
+			default: break;
+		}
+		items[i].id = (u32)i;
+	}
+}
+
+void test_type_specialized_sort() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 counts[] = {0, 1, 2, 3, 24, 25, 100, 129, 1000, 10007};
+	u64 max_count = 10007;
+	Sort_Test_Item *items = alloc(heap, sizeof(Sort_Test_Item)*max_count);
+	Sort_Test_Item *help = alloc(heap, sizeof(Sort_Test_Item)*max_count);
+	s64 *numbers = alloc(heap, sizeof(s64)*max_count);
+	
+	for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c += 1) {
+		u64 count = counts[c];
+		for (Sort_Test_Pattern pattern = 0; pattern < SORT_TEST_PATTERN_COUNT; pattern += 1) {
+			fill_sort_test_items(items, count, pattern);
+			sort_test_items_by_y(items, count);
+			u64 id_sum = 0;
+			for (u64 i = 0; i < count; i += 1) {
+				if (i > 0) assert(items[i].y >= items[i-1].y, "Sort failed at %llu of %llu", i, count);
+				id_sum += items[i].id;
+			}
+			assert(id_sum == (count ? count*(count-1)/2 : 0), "Sort lost or duplicated items");
+			
+			fill_sort_test_items(items, count, pattern);
+			sort_test_items_by_y_stable(items, help, count);
+			for (u64 i = 1; i < count; i += 1) {
+				assert(items[i].y >= items[i-1].y, "Stable sort failed at %llu of %llu", i, count);
+				if (items[i].y == items[i-1].y) assert(items[i].id > items[i-1].id, "Stable sort is not stable");
+			}
+			
+			for (u64 i = 0; i < count; i += 1) numbers[i] = (s64)items[(i*7919) % max(count, 1)].y - (s64)i;
+			sort_test_s64s(numbers, count);
+			for (u64 i = 1; i < count; i += 1) assert(numbers[i] >= numbers[i-1], "Sort failed on s64's");
+		}
+	}
+	
+	dealloc(heap, numbers);
+	dealloc(heap, help);
+	dealloc(heap, items);
+}
+
+void test_type_specialized_sort_speed(u64 count) {
+	Allocator heap = get_heap_allocator();
+	Sort_Test_Item *items = alloc(heap, sizeof(Sort_Test_Item)*count);
+	Sort_Test_Item *help = alloc(heap, sizeof(Sort_Test_Item)*count);
+	
+	const char *names[SORT_TEST_PATTERN_COUNT] = {"random", "few unique", "sorted", "reversed", "all equal", "sawtooth"};
+	print("\n%llu items:\n", count);
+	for (Sort_Test_Pattern pattern = 0; pattern < SORT_TEST_PATTERN_COUNT; pattern += 1) {
+		f64 seconds[3];
+		for (int kind = 0; kind < 3; kind += 1) {
+			fill_sort_test_items(items, count, pattern);
+			f64 start_seconds = os_get_elapsed_seconds();
+			switch (kind) {
+				case 0: merge_sort(items, help, count, sizeof(Sort_Test_Item), compare_sort_test_items); break;
+				case 1: sort_test_items_by_y(items, count); break;
+				case 2: sort_test_items_by_y_stable(items, help, count); break;
+			}
+			seconds[kind] = os_get_elapsed_seconds() - start_seconds;
+			for (u64 i = 1; i < count; i += 1) assert(items[i].y >= items[i-1].y, "Not sorted");
+		}
+		print("\t%cs: merge_sort %.2fms, DEFINE_SORT %.2fms (%.1fx), stable %.2fms (%.1fx)\n", names[pattern], 
+			seconds[0]*1000.0, 
+			seconds[1]*1000.0, seconds[0]/max(seconds[1], 0.000001), 
+			seconds[2]*1000.0, seconds[0]/max(seconds[2], 0.000001));
+	}
+	
+	dealloc(heap, help);
+	dealloc(heap, items);
+}
+
+void test_radix_sort_keys() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 counts[] = {0, 1, 2, 255, 256, 1000, 65537};
+	u64 max_count = 65537;
+	u64 ranges[][2] = { {0, 64}, {43, 21}, {8, 12}, {60, 4}, {17, 2} };
+	
+	u64 *original = alloc(heap, sizeof(u64)*max_count);
+	u64 *keys = alloc(heap, sizeof(u64)*max_count*2);
+	u32 *payloads = alloc(heap, sizeof(u32)*max_count*2);
+	
+	for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c += 1) {
+		u64 count = counts[c];
+		for (u64 r = 0; r < sizeof(ranges)/sizeof(ranges[0]); r += 1) {
+			u64 first_bit = ranges[r][0];
+			u64 bit_count = ranges[r][1];
+			u64 mask = bit_count == 64 ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << bit_count)-1);
+			
+			for (int few_unique = 0; few_unique < 2; few_unique += 1) {
+				for (u64 i = 0; i < count; i += 1) {
+					original[i] = get_random();
+					if (few_unique) original[i] = (original[i] & ~(mask << first_bit)) | ((u64)get_random_int_in_range(0, 3) << first_bit);
+					keys[i] = original[i];
+					payloads[i] = (u32)i;
+				}
+				
+				radix_sort_keys(keys, payloads, keys+count, payloads+count, count, first_bit, bit_count);
+				
+				for (u64 i = 0; i < count; i += 1) {
+					assert(keys[i] == original[payloads[i]], "Key and payload got separated at %llu", i);
+					if (i == 0) continue;
+					u64 a = (keys[i-1] >> first_bit) & mask;
+					u64 b = (keys[i]   >> first_bit) & mask;
+					assert(a <= b, "radix_sort_keys not sorted at %llu of %llu (bits %llu-%llu)", i, count, first_bit, first_bit+bit_count);
+					if (a == b) assert(payloads[i] > payloads[i-1], "radix_sort_keys is not stable");
+				}
+			}
+		}
+	}
+	
+	dealloc(heap, payloads);
+	dealloc(heap, keys);
+	dealloc(heap, original);
+}
+
+void test_parallel_radix_sort_keys() {
+	Allocator heap = get_heap_allocator();
+	
+	u64 counts[] = {1000, PARALLEL_RADIX_SORT_MIN_ITEM_COUNT, 100003};
+	u64 max_count = 100003;
+	u64 ranges[][2] = { {0, 64}, {43, 21}, {8, 12}, {17, 2} };
+	u64 worker_counts[] = {1, 2, 3, 8};
+	
+	u64 *original = alloc(heap, sizeof(u64)*max_count);
+	u64 *expected_keys = alloc(heap, sizeof(u64)*max_count*2);
+	u32 *expected_payloads = alloc(heap, sizeof(u32)*max_count*2);
+	u64 *keys = alloc(heap, sizeof(u64)*max_count*2);
+	u32 *payloads = alloc(heap, sizeof(u32)*max_count*2);
+	
+	u64 old_worker_count = test_job_system_stop();
+	
+	for (u64 w = 0; w < sizeof(worker_counts)/sizeof(u64); w += 1) {
+		job_system_init(worker_counts[w]);
+		
+		for (u64 c = 0; c < sizeof(counts)/sizeof(u64); c += 1) {
+			u64 count = counts[c];
+			for (u64 r = 0; r < sizeof(ranges)/sizeof(ranges[0]); r += 1) {
+				u64 first_bit = ranges[r][0];
+				u64 bit_count = ranges[r][1];
+				u64 mask = bit_count == 64 ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << bit_count)-1);
+				
+				for (int few_unique = 0; few_unique < 2; few_unique += 1) {
+					for (u64 i = 0; i < count; i += 1) {
+						original[i] = get_random();
+						if (few_unique) original[i] = (original[i] & ~(mask << first_bit)) | ((u64)get_random_int_in_range(0, 3) << first_bit);
+						keys[i] = expected_keys[i] = original[i];
+						payloads[i] = expected_payloads[i] = (u32)i;
+					}
+					
+					// Both are stable, so the results should be exactly the same
+					radix_sort_keys(expected_keys, expected_payloads, expected_keys+count, expected_payloads+count, count, first_bit, bit_count);
+					parallel_radix_sort_keys(keys, payloads, keys+count, payloads+count, count, first_bit, bit_count);
+					
+					for (u64 i = 0; i < count; i += 1) {
+						assert(keys[i] == expected_keys[i] && payloads[i] == expected_payloads[i], "parallel_radix_sort_keys differs from radix_sort_keys at %llu of %llu (bits %llu-%llu, %llu workers)", i, count, first_bit, first_bit+bit_count, worker_counts[w]);
+					}
+				}
+			}
+		}
+		
+		job_system_shutdown();
+	}
+	
+	test_job_system_restore(old_worker_count);
+	
+	dealloc(heap, payloads);
+	dealloc(heap, keys);
+	dealloc(heap, expected_payloads);
+	dealloc(heap, expected_keys);
+	dealloc(heap, original);
+}
+
+void test_parallel_radix_sort_speed(u64 item_count, int num_samples) {
+	Allocator heap = get_heap_allocator();
+	u64 *original = alloc(heap, sizeof(u64)*item_count);
+	u64 *expected_keys = alloc(heap, sizeof(u64)*item_count*2);
+	u32 *expected_payloads = alloc(heap, sizeof(u32)*item_count*2);
+	u64 *keys = alloc(heap, sizeof(u64)*item_count*2);
+	u32 *payloads = alloc(heap, sizeof(u32)*item_count*2);
+	
+	// Like the z bits of a quad sort key
+	const u64 first_bit = 43;
+	const u64 bit_count = 21;
+	for (u64 i = 0; i < item_count; i += 1) original[i] = get_random();
+	
+	// Single threaded reference
+	f64 serial_seconds = 0;
+	for (int a = 0; a < num_samples; a++) {
+		for (u64 i = 0; i < item_count; i += 1) {
+			expected_keys[i] = original[i];
+			expected_payloads[i] = (u32)i;
+		}
+		float64 start_seconds = os_get_elapsed_seconds();
+		radix_sort_keys(expected_keys, expected_payloads, expected_keys+item_count, expected_payloads+item_count, item_count, first_bit, bit_count);
+		serial_seconds += os_get_elapsed_seconds() - start_seconds;
+	}
+	serial_seconds /= num_samples;
+	print("\n%llu keys, %.2fms with radix_sort_keys:\n", item_count, serial_seconds*1000.0);
+	
+	u64 old_worker_count = test_job_system_stop();
+	
+	u64 max_worker_count = os_get_number_of_logical_processors();
+	for (u64 worker_count = 2; ; worker_count = min(worker_count*2, max_worker_count)) {
+		worker_count = min(worker_count, max_worker_count);
+		job_system_init(worker_count);
+		
+		f64 seconds = 0;
+		for (int a = 0; a < num_samples; a++) {
+			for (u64 i = 0; i < item_count; i += 1) {
+				keys[i] = original[i];
+				payloads[i] = (u32)i;
+			}
+			float64 start_seconds = os_get_elapsed_seconds();
+			parallel_radix_sort_keys(keys, payloads, keys+item_count, payloads+item_count, item_count, first_bit, bit_count);
+			seconds += os_get_elapsed_seconds() - start_seconds;
+			for (u64 i = 0; i < item_count; i += 1) {
+				assert(payloads[i] == expected_payloads[i], "parallel_radix_sort_keys differs from radix_sort_keys at %llu", i);
+			}
+		}
+		seconds /= num_samples;
+		
+		job_system_shutdown();
+		
+		print("\t%llu workers: %.2fms, %.2fx speedup\n", worker_count, seconds*1000.0, serial_seconds/seconds);
+		
+		if (worker_count == max_worker_count) break;
+	}
+	
+	test_job_system_restore(old_worker_count);
+	
+	dealloc(heap, payloads);
+	dealloc(heap, keys);
+	dealloc(heap, expected_payloads);
+	dealloc(heap, expected_keys);
+	dealloc(heap, original);
+}
+
+void test_draw_vertex_get_quad(void *quads, u64 index, Draw_Vertex_Quad *out) {
+	*out = ((Draw_Vertex_Quad*)quads)[index];
+}
+
+// How vertices used to be written, one corner & attribute at a time with round()
+void write_draw_vertices_reference(u64 first, u64 end, Draw_Vertex_Stream *stream) {
+	bool snap = stream->viewport_width != 0 && stream->viewport_height != 0;
+	float32 pixel_width  = snap ? 2.0f/(float32)stream->viewport_width  : 0;
+	float32 pixel_height = snap ? 2.0f/(float32)stream->viewport_height : 0;
+	
+	for (u64 i = first; i < end; i++) {
+		Draw_Vertex_Quad q;
+		stream->get_quad(stream->quads, stream->order ? stream->order[i] : i, &q);
+		
+		Vector2 corners[4] = { q.bottom_left, q.top_left, q.top_right, q.bottom_right };
+		for (u64 j = 0; j < 4 && snap; j++) {
+			corners[j].x = round(corners[j].x / pixel_width)  * pixel_width;
+			corners[j].y = round(corners[j].y / pixel_height) * pixel_height;
+		}
+		
+		Vector4 uv = q.uv;
+		if (stream->viewport_width % 2 != 0 && q.image_width) {
+			uv.x1 += (2.0/(float)q.image_width)*0.25;
+			uv.x2 += (2.0/(float)q.image_width)*0.25;
+		}
+		if (stream->viewport_height % 2 != 0 && q.image_height) {
+			uv.y1 -= (2.0/(float)q.image_height)*0.25;
+			uv.y2 -= (2.0/(float)q.image_height)*0.25;
+		}
+		
+		Draw_Vertex* pointer = stream->vertices + i*6;
+		Draw_Vertex* BL  = pointer + 0;
+		Draw_Vertex* TL  = pointer + 1;
+		Draw_Vertex* TR  = pointer + 2;
+		Draw_Vertex* BL2 = pointer + 3;
+		Draw_Vertex* TR2 = pointer + 4;
+		Draw_Vertex* BR  = pointer + 5;
+		
+		BL->position = v4(corners[0].x, corners[0].y, 0, 1);
+		TL->position = v4(corners[1].x, corners[1].y, 0, 1);
+		TR->position = v4(corners[2].x, corners[2].y, 0, 1);
+		BR->position = v4(corners[3].x, corners[3].y, 0, 1);
+		
+		BL->uv = v2(uv.x1, uv.y1);
+		TL->uv = v2(uv.x1, uv.y2);
+		TR->uv = v2(uv.x2, uv.y2);
+		BR->uv = v2(uv.x2, uv.y1);
+		
+		BL->self_uv = v2(0, 0);
+		TL->self_uv = v2(0, 1);
+		TR->self_uv = v2(1, 1);
+		BR->self_uv = v2(1, 0);
+		
+		memcpy(BL->userdata, q.userdata, sizeof(BL->userdata));
+		memcpy(TL->userdata, q.userdata, sizeof(TL->userdata));
+		memcpy(TR->userdata, q.userdata, sizeof(TR->userdata));
+		memcpy(BR->userdata, q.userdata, sizeof(BR->userdata));
+		
+		BL->color = TL->color = TR->color = BR->color = q.color;
+		BL->texture_index=TL->texture_index=TR->texture_index=BR->texture_index = stream->texture_indices[i];
+		BL->type=TL->type=TR->type=BR->type = q.type;
+		BL->sampler=TL->sampler=TR->sampler=BR->sampler = q.sampler;
+		
+		Vector4 scissor = q.scissor_index ? stream->scissors[q.scissor_index] : v4(0, 0, 0, 0);
+		BL->has_scissor=TL->has_scissor=TR->has_scissor=BR->has_scissor = q.scissor_index != 0;
+		BL->scissor=TL->scissor=TR->scissor=BR->scissor = scissor;
+		
+		*BL2 = *BL;
+		*TR2 = *TR;
+	}
+}
+
+// Random quads in & a bit outside of ndc, every 3rd without an image, 4 scissors.
+// userdata needs VERTEX_2D_USER_DATA_COUNT per quad.
+void fill_test_vertex_quads(Draw_Vertex_Quad *quads, Vector4 *userdata, s8 *texture_indices, u64 count) {
+	for (u64 i = 0; i < count; i++) {
+		Draw_Vertex_Quad *q = &quads[i];
+		*q = ZERO(Draw_Vertex_Quad);
+		
+		Vector2 p0 = v2(get_random_float32_in_range(-1.2f, 1.2f), get_random_float32_in_range(-1.2f, 1.2f));
+		Vector2 p1 = v2_add(p0, v2(get_random_float32_in_range(0.0f, 0.1f), get_random_float32_in_range(0.0f, 0.1f)));
+		q->bottom_left  = v2(p0.x, p0.y);
+		q->top_left     = v2(p0.x, p1.y);
+		q->top_right    = v2(p1.x, p1.y);
+		q->bottom_right = v2(p1.x, p0.y);
+		
+		q->color = v4(get_random_float32(), get_random_float32(), get_random_float32(), get_random_float32());
+		q->userdata = &userdata[i*VERTEX_2D_USER_DATA_COUNT];
+		for (u64 j = 0; j < VERTEX_2D_USER_DATA_COUNT; j++) q->userdata[j] = v4(i, j, -(float32)i, 0.5f);
+		q->scissor_index = (u32)(i % 4);
+		q->type = (u8)(i % 3);
+		if (i % 3 != 0) {
+			q->uv = v4(get_random_float32(), get_random_float32(), get_random_float32(), get_random_float32());
+			q->image_width = 64 << (i % 3);
+			q->image_height = 32 << (i % 3);
+			q->sampler = (u8)(i % 4);
+		}
+		
+		texture_indices[i] = i % 3 != 0 ? (s8)(i % 32) : -1;
+	}
+}
+
+void test_write_draw_vertices() {
+	Allocator heap = get_heap_allocator();
+	
+	const u64 count = 1000;
+	Draw_Vertex_Quad *quads = alloc(heap, sizeof(Draw_Vertex_Quad)*count);
+	Vector4 *userdata = alloc(heap, sizeof(Vector4)*VERTEX_2D_USER_DATA_COUNT*count);
+	u32 *order = alloc(heap, sizeof(u32)*count);
+	s8 *texture_indices = alloc(heap, count);
+	Draw_Vertex *vertices = alloc(heap, sizeof(Draw_Vertex)*count*6);
+	Draw_Vertex *expected = alloc(heap, sizeof(Draw_Vertex)*count*6);
+	Vector4 scissors[4] = { v4(0, 0, 0, 0), v4(1, 2, 3, 4), v4(5, 6, 7, 8), v4(-1, -2, 100, 200) };
+	
+	fill_test_vertex_quads(quads, userdata, texture_indices, count);
+	
+	// 1024x1024 makes pixels exactly 2^-9 in ndc, so the first 8 quads have their bottom
+	// left corners on -3.5, -2.5 ... 3.5 pixels. Those must round away from zero like round().
+	const float32 pixel = 1.0f/512.0f;
+	for (u64 i = 0; i < 8; i++) {
+		Vector2 p = v2(((float32)i - 3.5f)*pixel, ((float32)i - 3.5f)*pixel);
+		quads[i].bottom_left = p;
+		quads[i].top_left.x = p.x;
+		quads[i].bottom_right.y = p.y;
+	}
+	// Far off screen corners are left alone instead of overflowing
+	quads[8].bottom_left  = v2(-30000.0f, -30000.0f);
+	quads[8].top_left     = v2(-30000.0f,  30000.0f);
+	quads[8].top_right    = v2( 30000.0f,  30000.0f);
+	quads[8].bottom_right = v2( 30000.0f, -30000.0f);
+	
+	for (u64 i = 0; i < count; i++) order[i] = (u32)(count-1-i);
+	
+	Draw_Vertex_Stream stream = ZERO(Draw_Vertex_Stream);
+	stream.quads = quads;
+	stream.get_quad = test_draw_vertex_get_quad;
+	stream.order = order;
+	stream.texture_indices = texture_indices;
+	stream.scissors = scissors;
+	
+	// Even, then uneven to hit the uv hack, then no snapping
+	u32 viewports[3][2] = { {1024, 1024}, {1023, 511}, {0, 0} };
+	for (u64 round_index = 0; round_index < 3; round_index++) {
+		stream.viewport_width = viewports[round_index][0];
+		stream.viewport_height = viewports[round_index][1];
+		
+		stream.vertices = expected;
+		memset(expected, 0, sizeof(Draw_Vertex)*count*6);
+		write_draw_vertices_reference(0, count, &stream);
+		
+		// In two uneven ranges like parallel_for would
+		stream.vertices = vertices;
+		memset(vertices, 0xCD, sizeof(Draw_Vertex)*count*6);
+		write_draw_vertices(0, 333, &stream);
+		write_draw_vertices(333, count, &stream);
+		
+		for (u64 i = 0; i < count*6; i++) {
+			Draw_Vertex *v = &vertices[i];
+			Draw_Vertex *e = &expected[i];
+			// ==, not bytes_match, since round() gives -0 where write_draw_vertices gives 0
+			assert(v->position.x == e->position.x && v->position.y == e->position.y, "Vertex %llu at (%f, %f), expected (%f, %f)", i, v->position.x, v->position.y, e->position.x, e->position.y);
+			assert(v->position.z == 0 && v->position.w == 1, "Bad vertex z/w");
+			assert(bytes_match(&v->uv, &e->uv, sizeof(Vector2)), "Bad vertex uv (%f, %f) expected (%f, %f)", v->uv.x, v->uv.y, e->uv.x, e->uv.y);
+			assert(bytes_match(&v->self_uv, &e->self_uv, sizeof(Vector2)), "Bad vertex self_uv");
+			assert(bytes_match(&v->color, &e->color, sizeof(Vector4)), "Bad vertex color");
+			assert(bytes_match(v->userdata, e->userdata, sizeof(v->userdata)), "Bad vertex userdata");
+			assert(v->texture_index == e->texture_index, "Bad vertex texture index");
+			assert(v->type == e->type, "Bad vertex type");
+			assert(v->sampler == e->sampler, "Bad vertex sampler");
+			assert(v->has_scissor == e->has_scissor, "Bad vertex has_scissor");
+			assert(bytes_match(&v->scissor, &e->scissor, sizeof(Vector4)), "Bad vertex scissor");
+		}
+		
+		if (round_index == 0) {
+			// The halves from above, order is reversed
+			float32 halves[8] = { -4, -3, -2, -1, 1, 2, 3, 4 };
+			for (u64 i = 0; i < 8; i++) {
+				Draw_Vertex *v = &vertices[(count-1-i)*6];
+				assert(v->position.x == halves[i]*pixel && v->position.y == halves[i]*pixel, "%f pixels should round to %f, got (%f, %f)", (float32)i - 3.5f, halves[i], v->position.x/pixel, v->position.y/pixel);
+			}
+			Draw_Vertex *far = &vertices[(count-1-8)*6];
+			assert(far[0].position.x == -30000.0f && far[2].position.y == 30000.0f, "Far off vertex went wrong");
+		}
+	}
+	
+	dealloc(heap, expected);
+	dealloc(heap, vertices);
+	dealloc(heap, texture_indices);
+	dealloc(heap, order);
+	dealloc(heap, userdata);
+	dealloc(heap, quads);
+}
+
+void test_write_draw_vertices_speed(u64 quad_count, u64 num_samples) {
+	Allocator heap = get_heap_allocator();
+	
+	Draw_Vertex_Quad *quads = alloc(heap, sizeof(Draw_Vertex_Quad)*quad_count);
+	Vector4 *userdata = alloc(heap, sizeof(Vector4)*VERTEX_2D_USER_DATA_COUNT*quad_count);
+	s8 *texture_indices = alloc(heap, quad_count);
+	Draw_Vertex *vertices = alloc(heap, sizeof(Draw_Vertex)*quad_count*6);
+	Vector4 scissors[4] = { v4(0, 0, 0, 0), v4(1, 2, 3, 4), v4(5, 6, 7, 8), v4(-1, -2, 100, 200) };
+	
+	fill_test_vertex_quads(quads, userdata, texture_indices, quad_count);
+	
+	Draw_Vertex_Stream stream = ZERO(Draw_Vertex_Stream);
+	stream.quads = quads;
+	stream.get_quad = test_draw_vertex_get_quad;
+	stream.texture_indices = texture_indices;
+	stream.scissors = scissors;
+	stream.vertices = vertices;
+	stream.viewport_width = 1920;
+	stream.viewport_height = 1080;
+	
+	f64 reference_seconds = 0;
+	f64 stream_seconds = 0;
+	for (u64 a = 0; a < num_samples; a++) {
+		f64 start = os_get_elapsed_seconds();
+		write_draw_vertices_reference(0, quad_count, &stream);
+		reference_seconds += os_get_elapsed_seconds()-start;
+		
+		start = os_get_elapsed_seconds();
+		write_draw_vertices(0, quad_count, &stream);
+		stream_seconds += os_get_elapsed_seconds()-start;
+	}
+	
+	f64 ms = 1000.0/num_samples;
+	print("\n    %llu quads, %llu bytes per Draw_Vertex: per corner %.0f quads/ms, write_draw_vertices %.0f quads/ms, %.2fx\n",
+		quad_count, sizeof(Draw_Vertex),
+		quad_count/(reference_seconds*ms), quad_count/(stream_seconds*ms), reference_seconds/stream_seconds);
+	
+	dealloc(heap, vertices);
+	dealloc(heap, texture_indices);
+	dealloc(heap, userdata);
+	dealloc(heap, quads);
+}
+
+#ifndef OOGABOOGA_HEADLESS
+int compare_draw_quads(const void *a, const void *b) {
+    return ((Draw_Quad*)a)->z-((Draw_Quad*)b)->z;
+}
+void test_sort() {
+    
+    int num_samples = 500;
+    u64 id_bits = 21;
+    u64 item_count = 50000;
+    
+    f64 seconds = 0;
+    u64 cycles = 0;
+    
+    Draw_Quad *items = alloc(get_heap_allocator(), (item_count * 2) * sizeof(Draw_Quad));
+    Draw_Quad *buffer = items + item_count;
+
+    for (int a = 0; a < num_samples; a++) {
+        
+        for (u64 i = 0; i < item_count; i++) {
+            if (i % 2 == 0) items[i].z = get_random_int_in_range(0, pow(2, id_bits) / 2);
+            else items[i].z = i;
+        }
+    
+        u64 item_size = sizeof(Draw_Quad);
+        u64 sort_value_offset_in_item = offsetof(Draw_Quad, z);
+    
+        float64 start_seconds = os_get_elapsed_seconds();
+        u64 start_cycles = rdtsc();
+        radix_sort(items, buffer, item_count, item_size, sort_value_offset_in_item, id_bits);
+        u64 end_cycles = rdtsc();
+        float64 end_seconds = os_get_elapsed_seconds();
+    
+        for (u64 i = 1; i < item_count; i++) {
+            assert(items[i].z >= items[i-1].z, "Failed: not correctly sorted");
+        }
+        
+        seconds += end_seconds - start_seconds;
+        cycles += end_cycles - start_cycles;
+    }
+    
+    print("Radix sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
+
+	seconds = 0;
+    cycles = 0;
+	for (int a = 0; a < num_samples; a++) {
+        
+        for (u64 i = 0; i < item_count; i++) {
+            if (i % 2 == 0) items[i].z = get_random_int_in_range(0, pow(2, id_bits) / 2);
+            else items[i].z = i;
+        }
+    
+        u64 item_size = sizeof(Draw_Quad);
+        u64 sort_value_offset_in_item = offsetof(Draw_Quad, z);
+    
+        float64 start_seconds = os_get_elapsed_seconds();
+        u64 start_cycles = rdtsc();
+        merge_sort(items, buffer, item_count, item_size, compare_draw_quads);
+        u64 end_cycles = rdtsc();
+        float64 end_seconds = os_get_elapsed_seconds();
+    
+        for (u64 i = 1; i < item_count; i++) {
+            assert(items[i].z >= items[i-1].z, "Failed: not correctly sorted");
+        }
+        
+        seconds += end_seconds - start_seconds;
+        cycles += end_cycles - start_cycles;
+    }
+    
+    print("Merge sort took on average %llu cycles and %.2f ms\n", cycles / num_samples, (seconds * 1000.0) / (float64)num_samples);
+}
+
+// z_range 1 means all quads get the same z. Zs are already biased to be positive, like
+// the ones in sort keys, so radix_sort sorts them right too.
+void fill_sort_test_quads(Draw_Quad *items, u64 item_count, s64 z_range) {
+	for (u64 i = 0; i < item_count; i++) {
+		items[i].z = (s32)get_random_int_in_range(0, z_range-1);
+		// Remember where it came from so we can check that equal z's kept their order
+		items[i].userdata[0].x = (float32)i;
+	}
+}
+void check_sort_test_quads(Draw_Quad *items, u32 *order, u64 item_count) {
+	for (u64 i = 1; i < item_count; i++) {
+		Draw_Quad *a = &items[order ? order[i-1] : i-1];
+		Draw_Quad *b = &items[order ? order[i]   : i];
+		assert(b->z >= a->z, "Failed: not correctly sorted");
+		if (b->z == a->z) {
+			assert(b->userdata[0].x > a->userdata[0].x, "Failed: sort is not stable");
+		}
+	}
+}
+// Z sorting quads the old way, moving them with radix_sort, against sorting keys &
+// indices with radix_sort_keys like draw_frame_sort_quads does. Making the keys is timed too.
+void test_quad_z_sort_speed(u64 item_count, int num_samples) {
+	Allocator heap = get_heap_allocator();
+	Draw_Quad *items = alloc(heap, (item_count * 2) * sizeof(Draw_Quad));
+	Draw_Quad *buffer = items + item_count;
+	u64 *keys = alloc(heap, item_count * 2 * sizeof(u64));
+	u32 *order = alloc(heap, item_count * 2 * sizeof(u32));
+	
+	print("\n%llu quads (%llu bytes each):\n", item_count, sizeof(Draw_Quad));
+	
+	const char *range_names[3] = { "full z range", "256 z's", "one z" };
+	s64 ranges[3] = { 1 << MAX_Z_BITS, 256, 1 };
+	for (int r = 0; r < 3; r++) {
+		u64 cycles[2] = {0};
+		f64 seconds[2] = {0};
+		for (int by_key = 0; by_key < 2; by_key++) {
+			for (int a = 0; a < num_samples; a++) {
+				fill_sort_test_quads(items, item_count, ranges[r]);
+				
+				float64 start_seconds = os_get_elapsed_seconds();
+				u64 start_cycles = rdtsc();
+				if (by_key) {
+					for (u64 i = 0; i < item_count; i++) {
+						keys[i] = (u64)items[i].z;
+						order[i] = (u32)i;
+					}
+					radix_sort_keys(keys, order, keys+item_count, order+item_count, item_count, 0, MAX_Z_BITS);
+				} else {
+					radix_sort(items, buffer, item_count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+				}
+				cycles[by_key]  += rdtsc() - start_cycles;
+				seconds[by_key] += os_get_elapsed_seconds() - start_seconds;
+				
+				check_sort_test_quads(items, by_key ? order : 0, item_count);
+			}
+		}
+		print("\t%s: radix_sort %.2f ms (%llu cycles), radix_sort_keys %.2f ms (%llu cycles), %.2fx\n", 
+			range_names[r], 
+			seconds[0]*1000.0/num_samples, cycles[0]/num_samples, 
+			seconds[1]*1000.0/num_samples, cycles[1]/num_samples, 
+			seconds[1] > 0 ? seconds[0]/seconds[1] : 0);
+	}
+	
+	dealloc(heap, order);
+	dealloc(heap, keys);
+	dealloc(heap, items);
+}
+
+void fill_random_quads(Draw_Quad *quads, u64 count, float32 extent) {
+	for (u64 i = 0; i < count; i++) {
+		Draw_Quad *q = &quads[i];
+		*q = ZERO(Draw_Quad);
+		Vector2 p = v2(get_random_float32_in_range(-extent, extent), get_random_float32_in_range(-extent, extent));
+		Vector2 size = v2(get_random_float32_in_range(0.01f, 1), get_random_float32_in_range(0.01f, 1));
+		q->bottom_left  = p;
+		q->top_left     = v2(p.x, p.y+size.y);
+		q->top_right    = v2(p.x+size.x, p.y+size.y);
+		q->bottom_right = v2(p.x+size.x, p.y);
+		q->color = v4(get_random_float32(), get_random_float32(), get_random_float32(), 1);
+		q->uv = v4(0, 0, 1, 1);
+		q->type = QUAD_TYPE_REGULAR;
+		q->image_min_filter = GFX_FILTER_MODE_LINEAR;
+		q->z = 1234;
+		q->userdata[0] = v4(1, 2, 3, 4);
+	}
+}
+
+bool v2_roughly_match(Vector2 a, Vector2 b) {
+	return fabsf(a.x-b.x) <= 0.0001f*max(1.0f, fabsf(a.x)) && fabsf(a.y-b.y) <= 0.0001f*max(1.0f, fabsf(a.y));
+}
+
+void test_draw_quads() {
+	Allocator heap = get_heap_allocator();
+	
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	draw_frame.projection = m4_make_orthographic_projection(-8, 8, -4.5f, 4.5f, -1, 10);
+	draw_frame.camera_xform = m4_make_translation(v3(0.5f, -0.25f, 0));
+	
+	if (!draw_frame.quad_buffer) {
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), heap);
+	}
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	
+	const u64 count = 1000;
+	Draw_Quad *quads = alloc(heap, count*sizeof(Draw_Quad));
+	Draw_Quad *expected = alloc(heap, count*sizeof(Draw_Quad));
+	
+	for (int round = 0; round < 3; round++) {
+		
+		// Spread out so a good portion of the quads are culled
+		fill_random_quads(quads, count, 16);
+		
+		Matrix4 xform = m4_rotate_z(m4_make_translation(v3(get_random_float32_in_range(-2, 2), get_random_float32_in_range(-2, 2), 0)), get_random_float32_in_range(-PI32, PI32));
+		
+		if (round == 1) push_z_layer(7);
+		if (round == 2) push_window_scissor(v2(10, 20), v2(30, 40));
+		
+		u64 expected_count = 0;
+		for (u64 i = 0; i < count; i++) {
+			Draw_Quad *q = draw_quad_xform(quads[i], xform);
+			if (q != &_nil_quad) expected[expected_count++] = *q;
+		}
+		assert(expected_count > 0 && expected_count < count, "Expected some but not all quads to be culled, got %llu/%llu", expected_count, count);
+		assert(growing_array_get_valid_count(draw_frame.quad_buffer) == expected_count, "Bad quad count");
+		
+		// Put something in the frame first, batch should append after it
+		growing_array_resize((void**)&draw_frame.quad_buffer, 1);
+		
+		u64 drawn = draw_quads_xform(quads, count, xform);
+		
+		assert(drawn == expected_count, "Batched path drew %llu quads, expected %llu", drawn, expected_count);
+		assert(growing_array_get_valid_count(draw_frame.quad_buffer) == drawn+1, "Batched path did not append to frame");
+		
+		for (u64 i = 0; i < drawn; i++) {
+			Draw_Quad *a = &draw_frame.quad_buffer[i+1];
+			Draw_Quad *b = &expected[i];
+			assert(v2_roughly_match(a->bottom_left,  b->bottom_left),  "bottom_left mismatch at %llu", i);
+			assert(v2_roughly_match(a->top_left,     b->top_left),     "top_left mismatch at %llu", i);
+			assert(v2_roughly_match(a->top_right,    b->top_right),    "top_right mismatch at %llu", i);
+			assert(v2_roughly_match(a->bottom_right, b->bottom_right), "bottom_right mismatch at %llu", i);
+			assert(a->z == b->z, "z mismatch at %llu", i);
+			assert(a->scissor_index == b->scissor_index, "scissor_index mismatch at %llu", i);
+			assert(a->scissor_index == (round == 2 ? draw_frame.scissor_stack[0] : 0), "Bad scissor_index at %llu", i);
+			assert(a->image_min_filter == b->image_min_filter && a->image_mag_filter == b->image_mag_filter, "Filter mismatch at %llu", i);
+			assert(memcmp(&a->color, &b->color, sizeof(Vector4)) == 0 && memcmp(&a->uv, &b->uv, sizeof(Vector4)) == 0, "Attribute mismatch at %llu", i);
+			assert(a->image == b->image && a->type == b->type, "Attribute mismatch at %llu", i);
+			assert(memcmp(a->userdata, b->userdata, sizeof(a->userdata)) == 0, "userdata mismatch at %llu", i);
+		}
+		
+		if (round == 1) pop_z_layer();
+		if (round == 2) pop_window_scissor();
+		
+		growing_array_clear((void**)&draw_frame.quad_buffer);
+	}
+	
+	assert(draw_quads(quads, 0) == 0, "Empty batch should draw nothing");
+	assert(growing_array_get_valid_count(draw_frame.quad_buffer) == 0, "Empty batch should draw nothing");
+	
+	dealloc(heap, quads);
+	dealloc(heap, expected);
+	
+	draw_frame.projection = old_projection;
+	draw_frame.camera_xform = old_camera_xform;
+}
+
+void test_draw_frame_world_to_clip() {
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	
+	Matrix4 projection = m4_make_orthographic_projection(-640, 640, -360, 360, -1, 10);
+	Matrix4 camera = m4_make_translation(v3(100, -50, 0));
+	
+	draw_frame_set_projection(projection);
+	draw_frame_set_camera_xform(camera);
+	
+	Matrix4 expected = m4_mul(projection, m4_inverse(camera));
+	assert(m4_roughly_match(draw_frame_get_world_to_clip(), expected, 0.0001f), "Bad world_to_clip after setters");
+	assert(m4_roughly_match(m4_mul(draw_frame_get_clip_to_world(), draw_frame_get_world_to_clip()), m4_scalar(1.0), 0.0001f), "clip_to_world is not the inverse of world_to_clip");
+	
+	// Picking: clip space back to world space
+	Vector4 world = m4_transform(draw_frame_get_clip_to_world(), v4(0.5f, -0.5f, 0, 1));
+	assert(fabsf(world.x - 420) < 0.01f && fabsf(world.y + 230) < 0.01f, "Bad clip_to_world, got %.3f, %.3f", world.x, world.y);
+	
+	// Direct assignment must still invalidate the cache
+	camera = m4_rotate_z(m4_make_translation(v3(-3, 7, 0)), 1.2f);
+	draw_frame.camera_xform = camera;
+	expected = m4_mul(projection, m4_inverse(camera));
+	assert(m4_roughly_match(draw_frame_get_world_to_clip(), expected, 0.0001f), "Cache not invalidated by assigning camera_xform");
+	
+	projection = m4_make_orthographic_projection(0, 240, 0, 135, -1, 10);
+	draw_frame.projection = projection;
+	expected = m4_mul(projection, m4_inverse(camera));
+	assert(m4_roughly_match(draw_frame_get_world_to_clip(), expected, 0.0001f), "Cache not invalidated by assigning projection");
+	assert(m4_roughly_match(draw_frame_get_clip_to_world(), m4_inverse(expected), 0.001f), "clip_to_world not updated");
+	
+	// Not affine, needs the general inverse
+	projection = m4_scalar(1.0);
+	projection.m[3][2] = -1;
+	projection.m[3][3] = 2;
+	draw_frame_set_projection(projection);
+	assert(m4_roughly_match(draw_frame_get_clip_to_world(), m4_mul(camera, m4_inverse(projection)), 0.0001f), "Bad clip_to_world for a non affine projection");
+	
+	draw_frame_set_projection(old_projection);
+	draw_frame_set_camera_xform(old_camera_xform);
+}
+
+void test_draw_quads_speed(u64 quad_count, u64 num_samples) {
+	Allocator heap = get_heap_allocator();
+	
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	draw_frame.projection = m4_make_orthographic_projection(-16, 16, -9, 9, -1, 10);
+	draw_frame.camera_xform = m4_scalar(1.0);
+	
+	if (!draw_frame.quad_buffer) {
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), heap);
+	}
+	
+	Draw_Quad *quads = alloc(heap, quad_count*sizeof(Draw_Quad));
+	// About a quarter of these are on screen
+	fill_random_quads(quads, quad_count, 32);
+	Matrix4 xform = m4_make_translation(v3(0.5f, 0.5f, 0));
+	
+	f64 single_seconds = 0;
+	u64 single_cycles = 0;
+	f64 batched_seconds = 0;
+	u64 batched_cycles = 0;
+	u64 drawn = 0;
+	for (u64 a = 0; a < num_samples; a++) {
+		growing_array_clear((void**)&draw_frame.quad_buffer);
+		
+		f64 start_seconds = os_get_elapsed_seconds();
+		u64 start_cycles = rdtsc();
+		for (u64 i = 0; i < quad_count; i++) {
+			draw_quad_xform(quads[i], xform);
+		}
+		single_cycles += rdtsc()-start_cycles;
+		single_seconds += os_get_elapsed_seconds()-start_seconds;
+		
+		u64 single_drawn = growing_array_get_valid_count(draw_frame.quad_buffer);
+		growing_array_clear((void**)&draw_frame.quad_buffer);
+		
+		start_seconds = os_get_elapsed_seconds();
+		start_cycles = rdtsc();
+		drawn = draw_quads_xform(quads, quad_count, xform);
+		batched_cycles += rdtsc()-start_cycles;
+		batched_seconds += os_get_elapsed_seconds()-start_seconds;
+		
+		assert(drawn == single_drawn, "Batched path drew %llu quads, draw_quad_xform drew %llu", drawn, single_drawn);
+	}
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	
+	print("\n    %llu quads (%llu visible): draw_quad_xform %.2fms (%.1f cycles/quad), draw_quads_xform %.2fms (%.1f cycles/quad), %.2fx\n",
+		quad_count, drawn,
+		single_seconds*1000.0/num_samples, (f64)single_cycles/(f64)(quad_count*num_samples),
+		batched_seconds*1000.0/num_samples, (f64)batched_cycles/(f64)(quad_count*num_samples),
+		single_seconds/batched_seconds);
+	
+	dealloc(heap, quads);
+	
+	draw_frame.projection = old_projection;
+	draw_frame.camera_xform = old_camera_xform;
+}
+
+void test_draw_frame_sort_quads() {
+	Allocator heap = get_heap_allocator();
+	
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	draw_frame_set_projection(m4_scalar(1.0));
+	draw_frame_set_camera_xform(m4_scalar(1.0));
+	
+	if (!draw_frame.quad_buffer) {
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), heap);
+	}
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	if (draw_frame.scissor_buffer) growing_array_clear((void**)&draw_frame.scissor_buffer);
+	
+	Gfx_Image images[3] = {0};
+	
+	const u64 count = 5000;
+	for (u64 i = 0; i < count; i++) {
+		bool scissor = get_random_int_in_range(0, 3) == 0;
+		if (scissor) push_window_scissor(v2((float32)i, 0), v2((float32)i+10, 10));
+		push_z_layer((s32)get_random_int_in_range(-MAX_Z+1, MAX_Z));
+		
+		Vector2 p = v2(get_random_float32_in_range(-0.9f, 0.9f), get_random_float32_in_range(-0.9f, 0.9f));
+		s64 image_index = get_random_int_in_range(-1, 2);
+		Draw_Quad *q;
+		if (image_index >= 0) q = draw_image(&images[image_index], p, v2(0.05f, 0.05f), COLOR_WHITE);
+		else                  q = draw_rect(p, v2(0.05f, 0.05f), COLOR_WHITE);
+		q->userdata[0].x = (float32)i;
+		if (image_index == 1) q->image_min_filter = GFX_FILTER_MODE_LINEAR;
+		
+		pop_z_layer();
+		if (scissor) {
+			assert(q->scissor_index != 0, "Quad should have a scissor");
+			Vector4 rect = draw_frame.scissor_buffer[q->scissor_index];
+			assert(rect.x1 == (float32)i && rect.x2 == (float32)i+10, "Wrong scissor rect for quad");
+			pop_window_scissor();
+		} else {
+			assert(q->scissor_index == 0, "Quad should not have a scissor");
+		}
+	}
+	assert(growing_array_get_valid_count(draw_frame.quad_buffer) == count, "Quads were culled");
+	
+	u64 *keys = alloc(heap, sizeof(u64)*count*2);
+	u32 *order = alloc(heap, sizeof(u32)*count*2);
+	
+	for (u64 i = 0; i < count; i++) {
+		Draw_Quad *q = &draw_frame.quad_buffer[i];
+		u64 key = make_draw_quad_sort_key(q);
+		s64 z = (s64)((key >> DRAW_KEY_Z_SHIFT) & ((1ULL << DRAW_KEY_Z_BITS)-1)) - MAX_Z + 1;
+		u64 texture = (key >> DRAW_KEY_TEXTURE_SHIFT) & ((1ULL << DRAW_KEY_TEXTURE_BITS)-1);
+		u64 sampler = (key >> DRAW_KEY_SAMPLER_SHIFT) & ((1ULL << DRAW_KEY_SAMPLER_BITS)-1);
+		u64 scissor = (key >> DRAW_KEY_SCISSOR_SHIFT) & ((1ULL << DRAW_KEY_SCISSOR_BITS)-1);
+		assert(z == q->z, "Bad z in sort key, expected %d got %lld", q->z, z);
+		assert((texture != 0) == (q->image != 0), "Bad texture id in sort key");
+		assert(sampler == (q->image ? get_draw_quad_sampler(q) : 0), "Bad sampler in sort key");
+		assert(scissor == q->scissor_index, "Bad scissor index in sort key");
+		
+		for (u64 j = 0; j < 3 && q->image; j++) {
+			if (q->image == &images[j]) continue;
+			Draw_Quad other = *q;
+			other.image = &images[j];
+			assert(make_draw_quad_sort_key(&other) != key, "Different images got the same sort key");
+		}
+	}
+	
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	
+	for (u64 i = 0; i < count; i++) {
+		// Quads are not moved, only the order
+		assert(draw_frame.quad_buffer[i].userdata[0].x == (float32)i, "draw_frame_sort_quads moved quads");
+		if (i == 0) continue;
+		Draw_Quad *a = &draw_frame.quad_buffer[order[i-1]];
+		Draw_Quad *b = &draw_frame.quad_buffer[order[i]];
+		assert(a->z <= b->z, "Quads not sorted by z at %llu", i);
+		if (a->z == b->z) assert(order[i] > order[i-1], "Quads in the same z layer changed order");
+	}
+	
+	// State sorting must not swap overlapping quads with different images, that would
+	// change how they blend.
+	draw_frame.enable_state_sorting = true;
+	
+	// 0 and 1 overlap, 2 overlaps neither. images[0] sorts before images[1], so 1 would
+	// move in front of 0 if the overlap was ignored.
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	draw_image(&images[1], v2(0.0f, 0.0f), v2(0.5f, 0.5f), COLOR_WHITE);
+	draw_image(&images[0], v2(0.25f, 0.25f), v2(0.5f, 0.5f), COLOR_WHITE);
+	draw_image(&images[1], v2(-0.9f, -0.9f), v2(0.1f, 0.1f), COLOR_WHITE);
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	assert(order[0] == 0 && order[1] == 1 && order[2] == 2, "State sorting swapped overlapping quads: %u %u %u", order[0], order[1], order[2]);
+	
+	// Same images without overlap, now they can be grouped
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	draw_image(&images[1], v2(0.0f, 0.0f), v2(0.2f, 0.2f), COLOR_WHITE);
+	draw_image(&images[0], v2(0.5f, 0.5f), v2(0.2f, 0.2f), COLOR_WHITE);
+	draw_image(&images[1], v2(-0.9f, -0.9f), v2(0.1f, 0.1f), COLOR_WHITE);
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	assert(order[0] == 1 && order[1] == 0 && order[2] == 2, "State sorting did not group disjoint quads: %u %u %u", order[0], order[1], order[2]);
+	
+	// Lots of overlapping quads in a few z layers, no overlapping pair with different
+	// state may come out in a different order than it was drawn in.
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	const u64 overlap_count = 2000;
+	for (u64 i = 0; i < overlap_count; i++) {
+		push_z_layer((s32)(i % 2));
+		Vector2 p = v2(get_random_float32_in_range(-0.9f, 0.9f), get_random_float32_in_range(-0.9f, 0.9f));
+		s64 image_index = get_random_int_in_range(-1, 2);
+		Draw_Quad *q;
+		if (image_index >= 0) q = draw_image(&images[image_index], p, v2(0.1f, 0.1f), COLOR_WHITE);
+		else                  q = draw_rect(p, v2(0.1f, 0.1f), COLOR_WHITE);
+		if (image_index == 1 && i % 3 == 0) q->image_min_filter = GFX_FILTER_MODE_LINEAR;
+		pop_z_layer();
+	}
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	for (u64 i = 0; i < overlap_count; i++) {
+		Draw_Quad *a = &draw_frame.quad_buffer[order[i]];
+		if (i > 0) assert(draw_frame.quad_buffer[order[i-1]].z <= a->z, "State sorting broke z order at %llu", i);
+		for (u64 j = i+1; j < overlap_count; j++) {
+			Draw_Quad *b = &draw_frame.quad_buffer[order[j]];
+			if (a->z != b->z) break;
+			bool same_state = a->image == b->image && (!a->image || get_draw_quad_sampler(a) == get_draw_quad_sampler(b));
+			bool overlap = a->bottom_left.x <= b->top_right.x && a->top_right.x >= b->bottom_left.x
+			            && a->bottom_left.y <= b->top_right.y && a->top_right.y >= b->bottom_left.y;
+			if (same_state || overlap) {
+				assert(order[i] < order[j], "State sorting swapped quads %u and %u", order[i], order[j]);
+			}
+		}
+	}
+	
+	draw_frame.enable_state_sorting = false;
+	
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	growing_array_clear((void**)&draw_frame.scissor_buffer);
+	dealloc(heap, keys);
+	dealloc(heap, order);
+	
+	draw_frame_set_projection(old_projection);
+	draw_frame_set_camera_xform(old_camera_xform);
+}
+
+void check_draw_batches(Draw_Batch *batches, u32 *order, s8 *texture_indices, u64 quad_count) {
+	u64 batch_count = growing_array_get_valid_count(batches);
+	u64 next_quad = 0;
+	for (u64 b = 0; b < batch_count; b++) {
+		Draw_Batch *batch = &batches[b];
+		assert(batch->first_quad == next_quad, "Batches are not contiguous");
+		assert(batch->texture_count <= DRAW_BATCH_MAX_TEXTURES, "Too many textures in batch");
+		for (u64 i = batch->first_quad; i < batch->first_quad+batch->quad_count; i++) {
+			Draw_Quad *q = &draw_frame.quad_buffer[order ? order[i] : i];
+			if (!q->image) {
+				assert(texture_indices[i] == -1, "Quad without image got a texture slot");
+				continue;
+			}
+			assert(texture_indices[i] >= 0 && (u64)texture_indices[i] < batch->texture_count, "Bad texture slot %d", texture_indices[i]);
+			assert(batch->textures[texture_indices[i]] == q->image->gfx_handle, "Quad got the wrong texture slot");
+		}
+		for (u64 j = 0; j < batch->texture_count; j++) {
+			for (u64 k = j+1; k < batch->texture_count; k++) {
+				assert(batch->textures[j] != batch->textures[k], "Texture bound twice in a batch");
+			}
+		}
+		next_quad += batch->quad_count;
+	}
+	assert(next_quad == quad_count, "Batches don't cover every quad");
+}
+
+void test_draw_frame_batches() {
+	Allocator heap = get_heap_allocator();
+	
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	draw_frame_set_projection(m4_scalar(1.0));
+	draw_frame_set_camera_xform(m4_scalar(1.0));
+	
+	if (!draw_frame.quad_buffer) {
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), heap);
+	}
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	
+	// More images than texture slots, drawn interleaved in a few z layers
+	const u64 image_count = 40;
+	Gfx_Image images[40];
+	for (u64 i = 0; i < image_count; i++) {
+		images[i] = ZERO(Gfx_Image);
+		images[i].gfx_handle = (Gfx_Handle)(u64)(0x1000 + i*0x40);
+	}
+	
+	// On a grid so quads only overlap quads in other z layers, overlap would keep state
+	// sorting from grouping them. Rows are 1/64 apart and the next row is in another layer.
+	const u64 count = 4000;
+	for (u64 i = 0; i < count; i++) {
+		push_z_layer((s32)(i % 3));
+		Vector2 p = v2((float32)(i % 32)/16.0f - 0.995f, (float32)(i / 32)/64.0f - 0.995f);
+		if (i % 7 == 0) {
+			draw_rect(p, v2(0.02f, 0.02f), COLOR_WHITE);
+		} else {
+			Draw_Quad *q = draw_image(&images[i % image_count], p, v2(0.02f, 0.02f), COLOR_WHITE);
+			if (i % 5 == 0) q->image_mag_filter = GFX_FILTER_MODE_LINEAR;
+		}
+		pop_z_layer();
+	}
+	
+	u64 *keys = alloc(heap, sizeof(u64)*count*2);
+	u32 *order = alloc(heap, sizeof(u32)*count*2);
+	s8 *texture_indices = alloc(heap, count);
+	
+	// Submission order
+	Draw_Batch *batches = draw_frame_make_batches(&draw_frame, 0, texture_indices, heap);
+	check_draw_batches(batches, 0, texture_indices, count);
+	u64 unsorted_batch_count = growing_array_get_valid_count(batches);
+	growing_array_deinit((void**)&batches);
+	
+	// Z sorted
+	draw_frame.enable_z_sorting = true;
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	batches = draw_frame_make_batches(&draw_frame, order, texture_indices, heap);
+	check_draw_batches(batches, order, texture_indices, count);
+	u64 z_sorted_batch_count = growing_array_get_valid_count(batches);
+	growing_array_deinit((void**)&batches);
+	
+	// State sorted
+	draw_frame.enable_state_sorting = true;
+	draw_frame_sort_quads(&draw_frame, keys, keys+count, order, order+count);
+	for (u64 i = 1; i < count; i++) {
+		Draw_Quad *a = &draw_frame.quad_buffer[order[i-1]];
+		Draw_Quad *b = &draw_frame.quad_buffer[order[i]];
+		assert(a->z <= b->z, "State sorting broke z order at %llu", i);
+		if (a->z == b->z && a->image == b->image && get_draw_quad_sampler(a) == get_draw_quad_sampler(b)) {
+			assert(order[i] > order[i-1], "State sorting is not stable");
+		}
+	}
+	batches = draw_frame_make_batches(&draw_frame, order, texture_indices, heap);
+	check_draw_batches(batches, order, texture_indices, count);
+	u64 state_sorted_batch_count = growing_array_get_valid_count(batches);
+	growing_array_deinit((void**)&batches);
+	
+	// 3 z layers with 40 images each, every layer needs 2 batches at most
+	assert(state_sorted_batch_count <= 3*2, "State sorting should need at most 6 draw calls, got %llu", state_sorted_batch_count);
+	assert(state_sorted_batch_count < z_sorted_batch_count, "State sorting did not reduce draw calls");
+	
+	print("\n    %llu quads, %llu images: %llu draw calls unsorted, %llu z sorted, %llu state sorted\n", count, image_count, unsorted_batch_count, z_sorted_batch_count, state_sorted_batch_count);
+	
+	// Nothing to draw
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	batches = draw_frame_make_batches(&draw_frame, 0, texture_indices, heap);
+	assert(growing_array_get_valid_count(batches) == 0, "Empty frame should have no batches");
+	growing_array_deinit((void**)&batches);
+	
+	draw_frame.enable_z_sorting = false;
+	draw_frame.enable_state_sorting = false;
+	
+	dealloc(heap, texture_indices);
+	dealloc(heap, order);
+	dealloc(heap, keys);
+	
+	draw_frame_set_projection(old_projection);
+	draw_frame_set_camera_xform(old_camera_xform);
+}
+
+void test_draw_frame_speed(u64 quad_count, u64 num_samples) {
+	Allocator heap = get_heap_allocator();
+	
+	Matrix4 old_projection = draw_frame.projection;
+	Matrix4 old_camera_xform = draw_frame.camera_xform;
+	draw_frame_set_projection(m4_scalar(1.0));
+	draw_frame_set_camera_xform(m4_scalar(1.0));
+	
+	if (!draw_frame.quad_buffer) {
+		growing_array_init((void**)&draw_frame.quad_buffer, sizeof(Draw_Quad), heap);
+	}
+	
+	Gfx_Image image = ZERO(Gfx_Image);
+	s32 *zs = alloc(heap, sizeof(s32)*quad_count);
+	Vector2 *positions = alloc(heap, sizeof(Vector2)*quad_count);
+	for (u64 i = 0; i < quad_count; i++) {
+		zs[i] = (s32)get_random_int_in_range(-1000, 1000);
+		positions[i] = v2(get_random_float32_in_range(-0.9f, 0.9f), get_random_float32_in_range(-0.9f, 0.9f));
+	}
+	
+	// The old way of z sorting, moving every quad
+	Draw_Quad *moved_quads = alloc(heap, sizeof(Draw_Quad)*quad_count*2);
+	
+	u64 *keys = alloc(heap, sizeof(u64)*quad_count*2);
+	u32 *order = alloc(heap, sizeof(u32)*quad_count*2);
+	
+	f64 submit_seconds = 0;
+	f64 move_sort_seconds = 0;
+	f64 key_sort_seconds = 0;
+	for (u64 a = 0; a < num_samples; a++) {
+		growing_array_clear((void**)&draw_frame.quad_buffer);
+		
+		f64 start = os_get_elapsed_seconds();
+		for (u64 i = 0; i < quad_count; i++) {
+			push_z_layer(zs[i]);
+			draw_image(&image, positions[i], v2(0.01f, 0.01f), COLOR_WHITE);
+			pop_z_layer();
+		}
+		submit_seconds += os_get_elapsed_seconds()-start;
+		
+		assert(growing_array_get_valid_count(draw_frame.quad_buffer) == quad_count, "Quads were culled");
+		memcpy(moved_quads, draw_frame.quad_buffer, sizeof(Draw_Quad)*quad_count);
+		
+		start = os_get_elapsed_seconds();
+		radix_sort(moved_quads, moved_quads+quad_count, quad_count, sizeof(Draw_Quad), offsetof(Draw_Quad, z), MAX_Z_BITS);
+		move_sort_seconds += os_get_elapsed_seconds()-start;
+		
+		start = os_get_elapsed_seconds();
+		draw_frame_sort_quads(&draw_frame, keys, keys+quad_count, order, order+quad_count);
+		key_sort_seconds += os_get_elapsed_seconds()-start;
+		
+		for (u64 i = 0; i < quad_count; i++) {
+			assert(moved_quads[i].z == draw_frame.quad_buffer[order[i]].z, "Sorts disagree at %llu", i);
+		}
+	}
+	growing_array_clear((void**)&draw_frame.quad_buffer);
+	
+	f64 ms = 1000.0/num_samples;
+	print("\n    %llu quads, %llu bytes per Draw_Quad: submit %.0f quads/ms, z sort moving quads %.0f quads/ms, z sort by key %.0f quads/ms\n",
+		quad_count, sizeof(Draw_Quad),
+		quad_count/(submit_seconds*ms), quad_count/(move_sort_seconds*ms), quad_count/(key_sort_seconds*ms));
+	
+	dealloc(heap, order);
+	dealloc(heap, keys);
+	dealloc(heap, moved_quads);
+	dealloc(heap, positions);
+	dealloc(heap, zs);
+	
+	draw_frame_set_projection(old_projection);
+	draw_frame_set_camera_xform(old_camera_xform);
+}
+
+// The renderer's way into write_draw_vertices, which is tested headless
+void test_get_draw_quad_vertex_quad() {
+	Gfx_Image image = ZERO(Gfx_Image);
+	image.width = 64;
+	image.height = 32;
+	
+	Draw_Quad q = ZERO(Draw_Quad);
+	q.bottom_left  = v2(-1, -2);
+	q.top_left     = v2(-3, 4);
+	q.top_right    = v2(5, 6);
+	q.bottom_right = v2(7, -8);
+	q.color = v4(0.1f, 0.2f, 0.3f, 0.4f);
+	q.uv = v4(0.25f, 0.5f, 0.75f, 1.0f);
+	q.userdata[0] = v4(9, 10, 11, 12);
+	q.scissor_index = 3;
+	q.type = QUAD_TYPE_CIRCLE;
+	q.image_min_filter = GFX_FILTER_MODE_LINEAR;
+	
+	for (u64 with_image = 0; with_image < 2; with_image++) {
+		q.image = with_image ? &image : 0;
+		
+		Draw_Vertex_Quad v;
+		memset(&v, 0xCD, sizeof(v));
+		get_draw_quad_vertex_quad(&q, 0, &v);
+		
+		assert(bytes_match(&v.bottom_left, &q.bottom_left, sizeof(Vector2)), "Bad bottom_left");
+		assert(bytes_match(&v.top_left, &q.top_left, sizeof(Vector2)), "Bad top_left");
+		assert(bytes_match(&v.top_right, &q.top_right, sizeof(Vector2)), "Bad top_right");
+		assert(bytes_match(&v.bottom_right, &q.bottom_right, sizeof(Vector2)), "Bad bottom_right");
+		assert(bytes_match(&v.color, &q.color, sizeof(Vector4)), "Bad color");
+		assert(v.userdata == q.userdata, "userdata should point into the quad");
+		assert(v.scissor_index == 3, "Bad scissor_index");
+		assert(v.type == QUAD_TYPE_CIRCLE, "Bad type");
+		if (with_image) {
+			assert(bytes_match(&v.uv, &q.uv, sizeof(Vector4)), "Bad uv");
+			assert(v.image_width == 64 && v.image_height == 32, "Bad image size");
+			assert(v.sampler == get_draw_quad_sampler(&q), "Bad sampler");
+		} else {
+			assert(v.uv.x1 == 0 && v.uv.y1 == 0 && v.uv.x2 == 0 && v.uv.y2 == 0, "uv without an image should be 0");
+			assert(v.image_width == 0 && v.image_height == 0 && v.sampler == 0, "Image size & sampler without an image should be 0");
+		}
+	}
+}
+#endif /* OOGABOOGA_HEADLESS */
+
+typedef struct Test_Thing {
+    int foo;
+    float bar;
 } Test_Thing;
 void test_growing_array() {
     Test_Thing *things = 0;
@@ -1373,10 +4472,64 @@ void oogabooga_run_tests() {
 	test_allocator(true);
 	print("OK!\n");
 	
+#if RUN_TEST_BENCHMARKS
+	print("Testing allocator speed... ");
+	test_allocator_speed(2000, 200000);
+	print("OK!\n");
+#endif
+	
+	print("Testing temporary storage... ");
+	test_temporary_storage();
+	print("OK!\n");
+	
+	print("Testing arena... ");
+	test_arena();
+	print("OK!\n");
+	
+	print("Testing pool... ");
+	test_pool();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing threaded allocator speed... ");
+	test_allocator_threaded_speed(200000);
+	print("OK!\n");
+#endif
+	
 	print("Testing threads... ");
 	test_threads();
 	print("OK!\n");
 	
+	print("Testing job system... ");
+	test_job_system();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing job system speed... ");
+	test_job_system_speed(4096, 20000);
+	print("OK!\n");
+#endif
+	
+	print("Testing parallel for... ");
+	test_parallel_for();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing parallel for speed... ");
+	test_parallel_for_speed();
+	print("OK!\n");
+#endif
+	
+	print("Testing queues... ");
+	test_queues();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing queue speed... ");
+	test_queues_speed(4000000);
+	print("OK!\n");
+#endif
+	
 	print("Testing strings... ");
 	test_strings();
 	print("OK!\n");
@@ -1388,6 +4541,16 @@ void oogabooga_run_tests() {
 	print("Testing linmath... ");
 	test_linmath();
 	print("OK!\n");
+	
+	print("Testing linmath simd... ");
+	test_linmath_simd();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing linmath speed... ");
+	test_linmath_speed(100000);
+	print("OK!\n");
+#endif
 
 	print("Testing intmath... ");
 	test_intmath();
@@ -1397,10 +4560,36 @@ void oogabooga_run_tests() {
 	test_simd();
 	print("OK!\n");
 	
+	print("Testing simd dispatch... ");
+	test_simd_dispatch();
+	print("OK!\n");
+	
+	print("Testing simd spans... ");
+	test_simd_spans();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing simd span speed... ");
+	test_simd_span_speed(16*1024, 200);
+	print("OK!\n");
+#endif
+	
 	print("Testing hash table... ");
 	test_hash_table();
 	print("OK!\n");
 	
+	print("Testing swiss table... ");
+	test_swiss_table();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing hash table speed... ");
+	test_hash_table_speed(10000);
+	test_hash_table_speed(1000000);
+	test_hash_table_speed(1400000); // Close to max load for both tables
+	print("OK!\n");
+#endif
+	
 	print("Testing random distribution... ");
 	test_random_distribution();
 	print("OK!\n");
@@ -1408,11 +4597,115 @@ void oogabooga_run_tests() {
 	print("Testing mutex... ");
 	test_mutex();
 	print("OK!\n");
+	
+	print("Testing sync primitives... ");
+	test_sync_primitives();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing lock contention speed... ");
+	test_lock_contention_speed();
+	print("OK!\n");
+#endif
+
+#if ENABLE_LOCK_STATS
+	print("Testing lock stats... ");
+	test_lock_stats();
+	print("OK!\n");
+#endif
+	
+	print("Testing atomics... ");
+	test_atomics();
+	print("OK!\n");
+	
+	print("Testing rw lock... ");
+	test_rw_lock();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing rw lock reader scaling... ");
+	test_rw_lock_reader_scaling();
+	print("OK!\n");
+#endif
 
+	print("Testing type specialized sort... ");
+	test_type_specialized_sort();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing type specialized sort speed... ");
+	test_type_specialized_sort_speed(1000000);
+	print("OK!\n");
+#endif
+	
+	print("Testing radix sort keys... ");
+	test_radix_sort_keys();
+	print("OK!\n");
+	
+	print("Testing parallel radix sort keys... ");
+	test_parallel_radix_sort_keys();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing parallel radix sort speed... ");
+	test_parallel_radix_sort_speed(100000, 10);
+	test_parallel_radix_sort_speed(1000000, 2);
+	print("OK!\n");
+#endif
+	
+	print("Testing write draw vertices... ");
+	test_write_draw_vertices();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing write draw vertices speed... ");
+	test_write_draw_vertices_speed(200000, 10);
+	print("OK!\n");
+#endif
+	
 #ifndef OOGABOOGA_HEADLESS
 	print("Testing radix sort... ");
 	test_sort();
 	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing quad z sort speed... ");
+	test_quad_z_sort_speed(100000, 10);
+	test_quad_z_sort_speed(1000000, 2);
+	print("OK!\n");
+#endif
+	
+	print("Testing batched quad drawing... ");
+	test_draw_quads();
+	print("OK!\n");
+	
+	print("Testing draw frame world to clip cache... ");
+	test_draw_frame_world_to_clip();
+	print("OK!\n");
+	
+	print("Testing draw frame sort keys... ");
+	test_draw_frame_sort_quads();
+	print("OK!\n");
+	
+	print("Testing draw frame batching... ");
+	test_draw_frame_batches();
+	print("OK!\n");
+	
+	print("Testing get_draw_quad_vertex_quad... ");
+	test_get_draw_quad_vertex_quad();
+	print("OK!\n");
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing draw frame submit & sort speed... ");
+	test_draw_frame_speed(200000, 10);
+	print("OK!\n");
+#endif
+	
+#if RUN_TEST_BENCHMARKS
+	print("Testing batched quad drawing speed... ");
+	test_draw_quads_speed(100000, 10);
+	print("OK!\n");
+#endif
 #endif
 
 	
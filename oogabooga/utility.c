@@ -55,6 +55,74 @@ void radix_sort(void *collection, void *help_buffer, u64 item_count, u64 item_si
     }
 }
 
+// Sorts u64 keys with a u32 payload each (usually the index of the item the key was made
+// from), so big items can be processed in sorted order without being moved at all.
+// Only bits [first_bit, first_bit+number_of_bits) of the keys are compared, as unsigned.
+// Stable, and passes where every key has the same digit are skipped, so a frame where
+// every quad has the same z doesn't sort at all.
+// key_buffer & payload_buffer should be same size as keys & payloads, the result ends up
+// in keys & payloads.
+void radix_sort_keys(u64 *keys, u32 *payloads, u64 *key_buffer, u32 *payload_buffer, u64 item_count, u64 first_bit, u64 number_of_bits) {
+    local_persist const int RADIX = 256;
+    local_persist const int BITS_PER_PASS = 8;
+    local_persist const int MAX_PASS_COUNT = 8;
+    
+    assert(number_of_bits > 0 && first_bit+number_of_bits <= 64, "radix_sort_keys can only sort bits 0-63, got %llu bits from bit %llu", number_of_bits, first_bit);
+    if (item_count <= 1) return;
+    
+    const int PASS_COUNT = ((number_of_bits + BITS_PER_PASS - 1) / BITS_PER_PASS);
+    // The last pass can reach past the bits we sort on, those must not affect the order
+    const u64 VALUE_MASK = number_of_bits == 64 ? 0xFFFFFFFFFFFFFFFFULL : ((1ULL << number_of_bits) - 1);
+    
+    u64 count[MAX_PASS_COUNT][RADIX];
+    memset(count, 0, sizeof(count));
+    
+    for (u64 i = 0; i < item_count; ++i) {
+        u64 sort_value = (keys[i] >> first_bit) & VALUE_MASK;
+        for (int pass = 0; pass < PASS_COUNT; ++pass) {
+            ++count[pass][(sort_value >> (pass * BITS_PER_PASS)) & (RADIX-1)];
+        }
+    }
+    
+    u64 *src_keys = keys;
+    u32 *src_payloads = payloads;
+    u64 *dst_keys = key_buffer;
+    u32 *dst_payloads = payload_buffer;
+    
+    u64 prefix_sum[RADIX];
+    for (int pass = 0; pass < PASS_COUNT; ++pass) {
+        u32 shift = pass * BITS_PER_PASS;
+        
+        // Every key has the same digit, this pass wouldn't change the order
+        u32 first_digit = (((src_keys[0] >> first_bit) & VALUE_MASK) >> shift) & (RADIX-1);
+        if (count[pass][first_digit] == item_count) continue;
+        
+        prefix_sum[0] = 0;
+        for (u32 i = 1; i < RADIX; ++i) {
+            prefix_sum[i] = prefix_sum[i - 1] + count[pass][i - 1];
+        }
+        
+        for (u64 i = 0; i < item_count; ++i) {
+            u32 digit = (((src_keys[i] >> first_bit) & VALUE_MASK) >> shift) & (RADIX-1);
+            u64 dst = prefix_sum[digit]++;
+            dst_keys[dst] = src_keys[i];
+            dst_payloads[dst] = src_payloads[i];
+        }
+        
+        u64 *temp_keys = src_keys;
+        src_keys = dst_keys;
+        dst_keys = temp_keys;
+        u32 *temp_payloads = src_payloads;
+        src_payloads = dst_payloads;
+        dst_payloads = temp_payloads;
+    }
+    
+    if (src_keys != keys) {
+        memcpy(keys, src_keys, item_count * sizeof(u64));
+        memcpy(payloads, src_payloads, item_count * sizeof(u32));
+    }
+}
+
 void merge_sort(void *collection, void *help_buffer, u64 item_count, u64 item_size, int (*compare)(const void *, const void *)) {
     u8 *items = (u8 *)collection;
     u8 *buffer = (u8 *)help_buffer;
@@ -99,6 +167,145 @@ void merge_sort(void *collection, void *help_buffer, u64 item_count, u64 item_si
     }
 }
 
+// Type specialized sorts.
+// merge_sort above goes through a function pointer & memcpy for everything, this generates
+// sort procs for one type with the comparison inlined, so it's a lot faster:
+//
+//     #define entity_y_less(a, b) ((*(a))->pos.y > (*(b))->pos.y)
+//     DEFINE_SORT(sort_entities_by_y, Entity*, entity_y_less)
+//
+//     sort_entities_by_y(entities, entity_count);                    // Not stable
+//     sort_entities_by_y_stable(entities, help_buffer, entity_count); // Stable
+//
+// less(a, b) gets two Type pointers and should be true if *a goes before *b.
+// name() is an introsort: quicksort with a median of 3 (or 9 for big ranges) pivot,
+// insertion sort for small ranges, and heapsort if the recursion gets too deep, so it's
+// never worse than n log n.
+// name_stable() is a merge sort which keeps equal items in order. help_buffer should have
+// space for count items. It insertion sorts short runs first and skips merging runs which
+// are already in order, so mostly sorted input (like last frame's order) is cheap.
+#define SORT_INSERTION_THRESHOLD 24
+#define SORT_NINTHER_THRESHOLD 128
+#define SORT_STABLE_RUN_LENGTH 32
+#define DEFINE_SORT(name, Type, less) \
+	void name##_insertion_sort(Type *items, s64 count) { \
+		for (s64 i = 1; i < count; i += 1) { \
+			if (!less(&items[i], &items[i-1])) continue; \
+			Type item = items[i]; \
+			s64 j = i; \
+			do { \
+				items[j] = items[j-1]; \
+				j -= 1; \
+			} while (j > 0 && less(&item, &items[j-1])); \
+			items[j] = item; \
+		} \
+	} \
+	void name##_sift_down(Type *items, s64 root, s64 count) { \
+		while (true) { \
+			s64 child = root*2 + 1; \
+			if (child >= count) break; \
+			if (child + 1 < count && less(&items[child], &items[child+1])) child += 1; \
+			if (!less(&items[root], &items[child])) break; \
+			Type temp = items[root]; items[root] = items[child]; items[child] = temp; \
+			root = child; \
+		} \
+	} \
+	void name##_heap_sort(Type *items, s64 count) { \
+		for (s64 i = count/2 - 1; i >= 0; i -= 1) name##_sift_down(items, i, count); \
+		for (s64 end = count - 1; end > 0; end -= 1) { \
+			Type temp = items[0]; items[0] = items[end]; items[end] = temp; \
+			name##_sift_down(items, 0, end); \
+		} \
+	} \
+	/* Sorts the three so the median ends up in the middle one */ \
+	void name##_sort3(Type *items, s64 a, s64 b, s64 c) { \
+		Type temp; \
+		if (less(&items[b], &items[a])) { temp = items[a]; items[a] = items[b]; items[b] = temp; } \
+		if (less(&items[c], &items[b])) { temp = items[b]; items[b] = items[c]; items[c] = temp; } \
+		if (less(&items[b], &items[a])) { temp = items[a]; items[a] = items[b]; items[b] = temp; } \
+	} \
+	void name##_introsort(Type *items, s64 count, s64 depth_limit) { \
+		while (count > SORT_INSERTION_THRESHOLD) { \
+			if (depth_limit == 0) { \
+				name##_heap_sort(items, count); \
+				return; \
+			} \
+			depth_limit -= 1; \
+			\
+			s64 mid = count/2; \
+			if (count > SORT_NINTHER_THRESHOLD) { \
+				s64 step = count/8; \
+				name##_sort3(items, 0, step, step*2); \
+				name##_sort3(items, mid - step, mid, mid + step); \
+				name##_sort3(items, count-1 - step*2, count-1 - step, count-1); \
+				name##_sort3(items, step, mid, count-1 - step); \
+			} else { \
+				name##_sort3(items, 0, mid, count-1); \
+			} \
+			\
+			/* Hoare partition, stops on equal items so lots of duplicates still split evenly */ \
+			Type pivot = items[mid]; \
+			s64 i = -1; \
+			s64 j = count; \
+			while (true) { \
+				do { i += 1; } while (less(&items[i], &pivot)); \
+				do { j -= 1; } while (less(&pivot, &items[j])); \
+				if (i >= j) break; \
+				Type temp = items[i]; items[i] = items[j]; items[j] = temp; \
+			} \
+			\
+			/* Recurse into the smaller side so the stack stays at log n */ \
+			s64 left_count = j + 1; \
+			s64 right_count = count - left_count; \
+			if (left_count < right_count) { \
+				name##_introsort(items, left_count, depth_limit); \
+				items += left_count; \
+				count = right_count; \
+			} else { \
+				name##_introsort(items + left_count, right_count, depth_limit); \
+				count = left_count; \
+			} \
+		} \
+		name##_insertion_sort(items, count); \
+	} \
+	void name(Type *items, u64 count) { \
+		if (count < 2) return; \
+		s64 depth_limit = 0; \
+		for (u64 n = count; n > 1; n >>= 1) depth_limit += 2; \
+		name##_introsort(items, (s64)count, depth_limit); \
+	} \
+	void name##_stable(Type *items, Type *help_buffer, u64 count) { \
+		if (count < 2) return; \
+		for (u64 i = 0; i < count; i += SORT_STABLE_RUN_LENGTH) { \
+			name##_insertion_sort(items + i, (s64)min(SORT_STABLE_RUN_LENGTH, count - i)); \
+		} \
+		/* Merge back & forth between the two buffers instead of copying back every time */ \
+		Type *from = items; \
+		Type *to = help_buffer; \
+		for (u64 width = SORT_STABLE_RUN_LENGTH; width < count; width *= 2) { \
+			for (u64 first = 0; first < count; first += width*2) { \
+				u64 mid = min(first + width, count); \
+				u64 end = min(first + width*2, count); \
+				if (mid == end || !less(&from[mid], &from[mid-1])) { \
+					memcpy(to + first, from + first, (end - first)*sizeof(Type)); \
+					continue; \
+				} \
+				u64 left = first; \
+				u64 right = mid; \
+				u64 k = first; \
+				while (left < mid && right < end) { \
+					/* Only take from the right if it's strictly less, that's what keeps it stable */ \
+					if (less(&from[right], &from[left])) to[k++] = from[right++]; \
+					else                                 to[k++] = from[left++]; \
+				} \
+				while (left < mid)  to[k++] = from[left++]; \
+				while (right < end) to[k++] = from[right++]; \
+			} \
+			Type *temp = from; from = to; to = temp; \
+		} \
+		if (from != items) memcpy(items, from, count*sizeof(Type)); \
+	}
+
 inline bool bytes_match(void *a, void *b, u64 count) { return memcmp(a, b, count) == 0; }
 
 #define swap(a, b, type) { type t = a; a = b; b = t;  }
\ No newline at end of file